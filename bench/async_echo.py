@@ -0,0 +1,55 @@
+from fasttimer import timeit
+import asyncio
+import socket
+
+if True:
+    loop = asyncio.new_event_loop()
+
+    async def spin(n):
+        for i in range(n):
+            await asyncio.sleep(0)
+
+    async def switches():
+        await asyncio.gather(*[spin(100) for i in range(100)])
+
+    def tasks():
+        loop.run_until_complete(switches())
+
+    print(min(timeit(tasks,number=1) for x in range(10)), "10000 task switches")
+
+    server = socket.socket()
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(('127.0.0.1', 0))
+    server.listen(1024)
+    server.setblocking(False)
+    address = server.getsockname()
+
+    async def handle(conn):
+        while True:
+            data = await loop.sock_recv(conn, 4096)
+            if not data:
+                break
+            await loop.sock_sendall(conn, data)
+        conn.close()
+
+    async def serve(count):
+        for i in range(count):
+            pair = await loop.sock_accept(server)
+            loop.create_task(handle(pair[0]))
+
+    async def client():
+        sock = socket.socket()
+        sock.setblocking(False)
+        await loop.sock_connect(sock, address)
+        for i in range(10):
+            await loop.sock_sendall(sock, b'ping')
+            await loop.sock_recv(sock, 4096)
+        sock.close()
+
+    async def echo():
+        await asyncio.gather(serve(500), *[client() for i in range(500)])
+
+    def connections():
+        loop.run_until_complete(echo())
+
+    print(min(timeit(connections,number=1) for x in range(10)), "500 echo connections")
@@ -0,0 +1,45 @@
+import sys
+
+if hasattr(sys, 'set_int_max_str_digits'):
+    sys.set_int_max_str_digits(0)
+
+def operand(digits, seed):
+    # Deterministic pseudo-random value with the requested number of decimal digits
+    x = seed
+    parts = ['1']
+    for i in range(digits // 9 + 1):
+        x = (x * 6364136223846793005 + 1442695040888963407) & 0xFFFFFFFFFFFFFFFF
+        parts.append(str((x >> 20) % 1000000000 + 1000000000)[1:])
+    return int(''.join(parts)[:digits])
+
+def modpow(b, e, m):
+    result = 1
+    b = b % m
+    while e:
+        if e & 1:
+            result = (result * b) % m
+        b = (b * b) % m
+        e = e >> 1
+    return result
+
+if __name__ == '__main__':
+    from fasttimer import timeit
+    sizes = [1000, 10000, 100000, 1000000]
+    if len(sys.argv) > 1:
+        sizes = [int(x) for x in sys.argv[1:]]
+    for digits in sizes:
+        a = operand(digits, 1)
+        b = operand(digits, 2)
+        c = operand(digits // 2, 3)
+        s = str(a)
+        n = 1 if digits >= 100000 else 5
+        print(timeit(lambda: a * b, number=n) / n, f'mul {digits}')
+        print(timeit(lambda: (a * b) // c, number=n) / n, f'div {digits}')
+        print(timeit(lambda: str(a), number=n) / n, f'str {digits}')
+        print(timeit(lambda: int(s), number=n) / n, f'int {digits}')
+    m = operand(1233, 4) | 1
+    g = operand(1200, 5)
+    e = operand(1233, 6)
+    print(timeit(lambda: modpow(g, e, m), number=1), 'modpow 4096-bit')
+    print(timeit(lambda: pow(g, e, m), number=1), 'pow 4096-bit odd modulus')
+    print(timeit(lambda: pow(g, e, m + 1), number=1), 'pow 4096-bit even modulus')
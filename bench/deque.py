@@ -0,0 +1,23 @@
+from fasttimer import timeit
+from collections import deque
+
+if True:
+    d = deque()
+
+    def func():
+        d.append(1)
+        d.popleft()
+
+    print(min(timeit(func,number=100000) for x in range(10)), "deque append/popleft")
+
+    window = deque(range(1000), maxlen=1000)
+
+    def slide():
+        window.append(1)
+
+    print(min(timeit(slide,number=100000) for x in range(10)), "bounded deque append")
+
+    def rotate():
+        window.rotate(1)
+
+    print(min(timeit(rotate,number=100000) for x in range(10)), "deque rotate")
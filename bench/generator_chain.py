@@ -0,0 +1,28 @@
+from fasttimer import timeit
+
+if True:
+    def source(n):
+        for i in range(n):
+            yield i
+
+    def stage(it):
+        for i in it:
+            yield i
+
+    def deep_stage(it):
+        a, b, c, d, e, f, g, h = 1, 2, 3, 4, 5, 6, 7, 8
+        get = lambda: a + h
+        for i in it:
+            yield i + get()
+
+    def chain(depth, make):
+        def run():
+            it = source(10000)
+            for x in range(depth):
+                it = make(it)
+            for x in it:
+                pass
+        return run
+
+    print(min(timeit(chain(8, stage),number=1) for x in range(5)), "10000 items through 8 generators")
+    print(min(timeit(chain(8, deep_stage),number=1) for x in range(5)), "10000 items through 8 generators with locals and closures")
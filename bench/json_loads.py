@@ -0,0 +1,11 @@
+import json
+
+records = [{'id': i, 'name': 'record ' + str(i), 'active': i % 2 == 0,
+            'score': i * 1.5, 'tags': ['alpha', 'beta', 'gamma'], 'parent': None}
+           for i in range(1000)]
+document = json.dumps(records, indent=2)
+
+if __name__ == '__main__':
+    from fasttimer import timeit
+    print(min(timeit(lambda: json.loads(document), number=1) for x in range(10)), 'json.loads')
+    print(min(timeit(lambda: json.dumps(records), number=1) for x in range(10)), 'json.dumps')
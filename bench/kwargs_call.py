@@ -0,0 +1,16 @@
+def __main__():
+    def point(x, y, z=0, scale=1, label=None):
+        return x
+
+    class Request:
+        def __init__(self, method, path, headers=None, body=None, timeout=30):
+            self.path = path
+
+    for i in range(200000):
+        point(y=2, x=i)
+        point(i, 2, scale=3, label='p')
+        Request('GET', path='/', timeout=5)
+
+if __name__ == '__main__':
+    from fasttimer import timeit
+    print(timeit(__main__,number=1),'keyword calls')
@@ -0,0 +1,33 @@
+def __main__():
+    class Body:
+        def __init__(self, x, y, vx, vy, mass):
+            self.x = x
+            self.y = y
+            self.vx = vx
+            self.vy = vy
+            self.mass = mass
+
+    def advance(bodies, dt, steps):
+        for step in range(steps):
+            for i in range(len(bodies)):
+                a = bodies[i]
+                for j in range(i + 1, len(bodies)):
+                    b = bodies[j]
+                    dx = a.x - b.x
+                    dy = a.y - b.y
+                    d2 = dx * dx + dy * dy + 0.01
+                    mag = dt / (d2 * d2)
+                    a.vx -= dx * b.mass * mag
+                    a.vy -= dy * b.mass * mag
+                    b.vx += dx * a.mass * mag
+                    b.vy += dy * a.mass * mag
+            for body in bodies:
+                body.x += dt * body.vx
+                body.y += dt * body.vy
+
+    bodies = [Body(i * 1.5, i * -0.5, 0.0, 0.1 * i, 1.0 + i) for i in range(5)]
+    advance(bodies, 0.01, 20000)
+
+if __name__ == '__main__':
+    from fasttimer import timeit
+    print(timeit(__main__,number=1),'nbody')
@@ -0,0 +1,30 @@
+from fasttimer import timeit
+from concurrent.futures import ThreadPoolExecutor
+from threading import Thread
+
+if True:
+    def noop(x):
+        return x
+
+    pool = ThreadPoolExecutor(4)
+
+    def submits():
+        for f in [pool.submit(noop, i) for i in range(10000)]:
+            f.result()
+
+    def mapped():
+        sum(pool.map(noop, range(10000), chunksize=100))
+
+    class Spawned(Thread):
+        def run(self):
+            noop(0)
+
+    def threads():
+        t = [Spawned() for i in range(1000)]
+        for x in t: x.start()
+        for x in t: x.join()
+
+    print(min(timeit(submits,number=1) for x in range(10)), "10000 submits")
+    print(min(timeit(mapped,number=1) for x in range(10)), "map of 10000 in chunks of 100")
+    print(min(timeit(threads,number=1) for x in range(10)), "1000 fresh threads")
+    pool.shutdown()
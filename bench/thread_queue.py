@@ -0,0 +1,33 @@
+from fasttimer import timeit
+from threading import Thread
+from queue import Queue
+
+if True:
+    class Producer(Thread):
+        def __init__(self, q, n):
+            super().__init__()
+            self.q = q
+            self.n = n
+        def run(self):
+            for i in range(self.n):
+                self.q.put(i)
+            self.q.put(None)
+
+    class Consumer(Thread):
+        def __init__(self, q):
+            super().__init__()
+            self.q = q
+        def run(self):
+            while self.q.get() is not None:
+                pass
+
+    def pipeline(size):
+        def run():
+            q = Queue(size)
+            threads = [Producer(q, 50000), Consumer(q)]
+            for t in threads: t.start()
+            for t in threads: t.join()
+        return run
+
+    print(min(timeit(pipeline(64),number=1) for x in range(5)), "50000 items through a bounded queue")
+    print(min(timeit(pipeline(0),number=1) for x in range(5)), "50000 items through an unbounded queue")
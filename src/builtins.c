@@ -22,7 +22,12 @@ KrkValue krk_dirObject(int argc, const KrkValue argv[], int hasKw) {
 	if (IS_INSTANCE(argv[0])) {
 		/* Obtain self-reference */
 		KrkInstance * self = AS_INSTANCE(argv[0]);
-		for (size_t i = 0; i < self->fields.capacity; ++i) {
+		if (self->shape) {
+			for (KrkShape * shape = self->shape; shape->parent; shape = shape->parent) {
+				krk_writeValueArray(AS_LIST(myList), OBJECT_VAL(shape->name));
+			}
+		}
+		for (size_t i = 0; i < self->fields.used; ++i) {
 			if (!IS_KWARGS(self->fields.entries[i].key)) {
 				krk_writeValueArray(AS_LIST(myList),
 					self->fields.entries[i].key);
@@ -31,7 +36,7 @@ KrkValue krk_dirObject(int argc, const KrkValue argv[], int hasKw) {
 	} else if (IS_CLOSURE(argv[0])) {
 		/* Why not just make closures instances... */
 		KrkClosure * self = AS_CLOSURE(argv[0]);
-		for (size_t i = 0; i < self->fields.capacity; ++i) {
+		for (size_t i = 0; i < self->fields.used; ++i) {
 			if (!IS_KWARGS(self->fields.entries[i].key)) {
 				krk_writeValueArray(AS_LIST(myList),
 					self->fields.entries[i].key);
@@ -40,7 +45,7 @@ KrkValue krk_dirObject(int argc, const KrkValue argv[], int hasKw) {
 	} else if (IS_CLASS(argv[0])) {
 		KrkClass * _class = AS_CLASS(argv[0]);
 		while (_class) {
-			for (size_t i = 0; i < _class->methods.capacity; ++i) {
+			for (size_t i = 0; i < _class->methods.used; ++i) {
 				if (!IS_KWARGS(_class->methods.entries[i].key)) {
 					krk_writeValueArray(AS_LIST(myList),
 						_class->methods.entries[i].key);
@@ -53,7 +58,7 @@ KrkValue krk_dirObject(int argc, const KrkValue argv[], int hasKw) {
 	KrkClass * type = krk_getType(argv[0]);
 
 	while (type) {
-		for (size_t i = 0; i < type->methods.capacity; ++i) {
+		for (size_t i = 0; i < type->methods.used; ++i) {
 			if (!IS_KWARGS(type->methods.entries[i].key)) {
 				krk_writeValueArray(AS_LIST(myList),
 					type->methods.entries[i].key);
@@ -93,6 +98,7 @@ KRK_Method(object,__class__) {
 		if (!IS_CLASS(argv[1])) return krk_runtimeError(vm.exceptions->typeError, "'%T' object is not a class", argv[1]);
 		if (!IS_INSTANCE(argv[0]) || current->allocSize != sizeof(KrkInstance)) return krk_runtimeError(vm.exceptions->typeError, "'%T' object does not have modifiable type", argv[0]); /* TODO class? */
 		if (AS_CLASS(argv[1])->allocSize != sizeof(KrkInstance)) return krk_runtimeError(vm.exceptions->typeError, "'%S' type is not assignable", AS_CLASS(argv[1])->name);
+		krk_instanceDropShape(AS_INSTANCE(argv[0]));
 		AS_INSTANCE(argv[0])->_class = AS_CLASS(argv[1]);
 		current = AS_CLASS(argv[1]);
 	}
@@ -123,37 +129,51 @@ KRK_Function(getattr) {
 	FUNCTION_TAKES_AT_LEAST(2);
 	CHECK_ARG(1,str,KrkString*,property);
 
+	/* Attribute names are compared by identity, so they must be interned. */
+	property = krk_internString(property);
+	krk_push(OBJECT_VAL(property));
 	krk_push(argv[0]);
-	if (!krk_getAttribute(AS_STRING(argv[1]))) {
+	if (!krk_getAttribute(property)) {
+		krk_pop();
 		krk_pop();
 		if (argc == 3) return argv[2];
 		return krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%S'", argv[0], AS_STRING(argv[1]));
 	}
-	return krk_pop();
+	KrkValue out = krk_pop();
+	krk_pop();
+	return out;
 }
 
 KRK_Function(setattr) {
 	FUNCTION_TAKES_EXACTLY(3);
 	CHECK_ARG(1,str,KrkString*,property);
 
+	property = krk_internString(property);
+	krk_push(OBJECT_VAL(property));
 	krk_push(argv[0]);
 	krk_push(argv[2]);
-	if (!krk_setAttribute(AS_STRING(argv[1]))) {
+	if (!krk_setAttribute(property)) {
 		return krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%S'", argv[0], AS_STRING(argv[1]));
 	}
-	return krk_pop();
+	KrkValue out = krk_pop();
+	krk_pop();
+	return out;
 }
 
 KRK_Function(hasattr) {
 	FUNCTION_TAKES_AT_LEAST(2);
 	CHECK_ARG(1,str,KrkString*,property);
 
+	property = krk_internString(property);
+	krk_push(OBJECT_VAL(property));
 	krk_push(argv[0]);
-	if (!krk_getAttribute(AS_STRING(argv[1]))) {
+	if (!krk_getAttribute(property)) {
+		krk_pop();
 		krk_pop();
 		return BOOLEAN_VAL(0);
 	}
 	krk_pop();
+	krk_pop();
 	return BOOLEAN_VAL(1);
 }
 
@@ -161,8 +181,10 @@ KRK_Function(delattr) {
 	FUNCTION_TAKES_AT_LEAST(2);
 	CHECK_ARG(1,str,KrkString*,property);
 
+	property = krk_internString(property);
+	krk_push(OBJECT_VAL(property));
 	krk_push(argv[0]);
-	if (!krk_delAttribute(AS_STRING(argv[1]))) {
+	if (!krk_delAttribute(property)) {
 		return krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%S'", argv[0], AS_STRING(argv[1]));
 	}
 	return NONE_VAL();
@@ -309,7 +331,7 @@ KRK_Function(dir) {
 
 		/* Put all the keys from the globals table in it */
 		KrkTable * globals = krk_currentThread.frames[krk_currentThread.frameCount-1].globals;
-		for (size_t i = 0; i < globals->capacity; ++i) {
+		for (size_t i = 0; i < globals->used; ++i) {
 			KrkTableEntry * entry = &globals->entries[i];
 			if (IS_KWARGS(entry->key)) continue;
 			krk_writeValueArray(AS_LIST(myList), entry->key);
@@ -383,7 +405,7 @@ int krk_unpackIterable(KrkValue iterable, void * context, int callback(void *, c
 	} else if (IS_list(iterable)) {
 		if (callback(context, AS_LIST(iterable)->values, AS_LIST(iterable)->count)) return 1;
 	} else if (IS_dict(iterable)) {
-		for (size_t i = 0; i < AS_DICT(iterable)->capacity; ++i) {
+		for (size_t i = 0; i < AS_DICT(iterable)->used; ++i) {
 			if (!IS_KWARGS(AS_DICT(iterable)->entries[i].key)) {
 				if (callback(context, &AS_DICT(iterable)->entries[i].key, 1)) return 1;
 			}
@@ -810,6 +832,13 @@ KRK_Function(max) {
 	return context.base;
 }
 
+/* Writing to stdout can block on a full pipe; the strings written are held on the stack. */
+static void printChars(const char * chars, size_t length) {
+	krk_beginBlockingCall();
+	fwrite(chars, 1, length, stdout);
+	krk_endBlockingCall();
+}
+
 KRK_Function(print) {
 	KrkValue sepVal;
 	KrkValue endVal;
@@ -827,26 +856,18 @@ KRK_Function(print) {
 			endLen = AS_STRING(endVal)->length;
 		}
 	}
-	if (!argc) {
-		for (size_t j = 0; j < endLen; ++j) {
-			fputc(end[j], stdout);
-		}
-	}
+	if (!argc) printChars(end, endLen);
 	for (int i = 0; i < argc; ++i) {
 		KrkValue printable = argv[i];
 		if (IS_STRING(printable)) { /* krk_printValue runs repr */
 			/* Make sure we handle nil bits correctly. */
-			for (size_t j = 0; j < AS_STRING(printable)->length; ++j) {
-				fputc(AS_CSTRING(printable)[j], stdout);
-			}
+			printChars(AS_CSTRING(printable), AS_STRING(printable)->length);
 		} else {
 			krk_printValue(stdout, printable);
 			if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return NONE_VAL();
 		}
-		char * thingToPrint = (i == argc - 1) ? end : sep;
-		for (size_t j = 0; j < ((i == argc - 1) ? endLen : sepLen); ++j) {
-			fputc(thingToPrint[j], stdout);
-		}
+		if (i == argc - 1) printChars(end, endLen);
+		else printChars(sep, sepLen);
 	}
 
 	return NONE_VAL();
@@ -894,30 +915,36 @@ KRK_Function(locals) {
 	KrkCodeObject * func = frame->closure->function;
 	size_t offset = frame->ip - func->chunk.code;
 
+	/* If we are inside a generator, the frame may be on a stack segment further out. */
+	KrkValue * stack = krk_currentThread.stack;
+	for (KrkStackSegment * segment = krk_currentThread.segment;
+		segment->outer && (size_t)(frame - krk_currentThread.frames) < segment->frameBase;
+		segment = segment->outer, stack = segment->stack);
+
 	/* First, we'll populate with arguments */
 	size_t slot = 0;
 	for (short int i = 0; i < func->potentialPositionals; ++i) {
 		krk_tableSet(AS_DICT(dict),
 			func->positionalArgNames.values[i],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	if (func->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS) {
 		krk_tableSet(AS_DICT(dict),
 			func->positionalArgNames.values[func->potentialPositionals],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	for (short int i = 0; i < func->keywordArgs; ++i) {
 		krk_tableSet(AS_DICT(dict),
 			func->keywordArgNames.values[i],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	if (func->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS) {
 		krk_tableSet(AS_DICT(dict),
 			func->keywordArgNames.values[func->keywordArgs],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	/* Now we need to find out what non-argument locals are valid... */
@@ -926,7 +953,7 @@ KRK_Function(locals) {
 			func->localNames[i].deathday >= offset) {
 			krk_tableSet(AS_DICT(dict),
 				OBJECT_VAL(func->localNames[i].name),
-				krk_currentThread.stack[frame->slots + func->localNames[i].id]);
+				stack[frame->slots + func->localNames[i].id]);
 		}
 	}
 
@@ -1228,6 +1255,25 @@ KRK_Function(abs) {
 	}
 }
 
+KRK_Function(pow) {
+	KrkValue base, exp, mod = NONE_VAL();
+	if (!krk_parseArgs("VV|V", (const char*[]){"base","exp","mod"}, &base, &exp, &mod)) return NONE_VAL();
+
+	if (IS_NONE(mod)) return krk_operator_pow(base, exp);
+
+	/* Three-argument form has no reflected variant; only the base gets a say. */
+	KrkClass * type = krk_getType(base);
+	if (type->_pow) {
+		krk_push(base);
+		krk_push(exp);
+		krk_push(mod);
+		KrkValue result = krk_callDirect(type->_pow, 3);
+		if (!IS_NOTIMPL(result)) return result;
+	}
+
+	return krk_runtimeError(vm.exceptions->typeError, "unsupported operand types for pow(): '%T', '%T', '%T'", base, exp, mod);
+}
+
 KRK_Function(format) {
 	FUNCTION_TAKES_AT_LEAST(1);
 	FUNCTION_TAKES_AT_MOST(2);
@@ -1338,6 +1384,7 @@ KRK_Function(__build_class__) {
 	if (IS_CLOSURE(func)) {
 		if (AS_CLOSURE(func)->upvalueCount && AS_CLOSURE(func)->upvalues[0]->location == -1 && IS_NONE(AS_CLOSURE(func)->upvalues[0]->closed)) {
 			AS_CLOSURE(func)->upvalues[0]->closed = krk_peek(0);
+			krk_writeBarrier((KrkObj*)AS_CLOSURE(func)->upvalues[0]);
 		}
 	}
 
@@ -1388,6 +1435,7 @@ _error:
 KRK_Method(Cell,cell_contents) {
 	if (argc > 1) {
 		*UPVALUE_LOCATION(self) = argv[1];
+		krk_writeBarrier((KrkObj*)self);
 	}
 	return *UPVALUE_LOCATION(self);
 }
@@ -1670,6 +1718,11 @@ void _createAndBind_builtins(void) {
 	BUILTIN_FUNCTION("abs", FUNC_NAME(krk,abs),
 		"@brief Obtain the absolute value of a numeric.\n"
 		"@arguments iterable");
+	BUILTIN_FUNCTION("pow", FUNC_NAME(krk,pow),
+		"@brief Raise @p base to the power @p exp, optionally modulo @p mod.\n"
+		"@arguments base,exp,mod=None\n\n"
+		"With @p mod, the result is computed without forming the full power. "
+		"A negative @p exp with @p mod uses the modular inverse of @p base.");
 	BUILTIN_FUNCTION("format", FUNC_NAME(krk,format),
 		"@brief Format a value for string printing.\n"
 		"@arguments value[,format_spec]");
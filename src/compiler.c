@@ -621,12 +621,17 @@ static KrkCodeObject * endCompiler(struct GlobalState * state) {
 
 	function->totalArguments = function->potentialPositionals + function->keywordArgs + !!(function->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS) + !!(function->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS);
 
+	if (!state->parser.hadError) {
+		krk_optimizeCodeObject(function, !!(vm.globalFlags & KRK_GLOBAL_OPTIMIZE));
+	}
+
 #ifndef KRK_NO_DISASSEMBLY
 	if ((krk_currentThread.flags & KRK_THREAD_ENABLE_DISASSEMBLY) && !state->parser.hadError) {
 		krk_disassembleCodeObject(stderr, function, function->name ? function->name->chars : "(module)");
 	}
 #endif
 
+	krk_enableWriteBarrier((KrkObj*)function);
 	state->current = state->current->enclosing;
 	return function;
 }
@@ -669,7 +674,7 @@ static ssize_t identifierConstant(struct GlobalState * state, KrkToken * name) {
 			(int)classLength, className,
 			(int)name->length, name->start);
 
-		return krk_addConstant(currentChunk(), krk_finishStringBuilder(&sb));
+		return krk_addConstant(currentChunk(), OBJECT_VAL(krk_internString(AS_STRING(krk_finishStringBuilder(&sb)))));
 	}
 
 	return krk_addConstant(currentChunk(), OBJECT_VAL(krk_copyString(name->start, name->length)));
@@ -2834,7 +2839,7 @@ static void string(struct GlobalState * state, int exprType, RewindState *rewind
 					continue;
 				}
 				if (sb.length) { /* Make sure there's a string for coersion reasons */
-					emitConstant(krk_finishStringBuilder(&sb));
+					emitConstant(OBJECT_VAL(krk_internString(AS_STRING(krk_finishStringBuilder(&sb)))));
 					formatElements++;
 				}
 				const char * start = c+1;
@@ -2929,7 +2934,7 @@ _nextStr:
 		return;
 	}
 	if (sb.length || !formatElements) {
-		emitConstant(krk_finishStringBuilder(&sb));
+		emitConstant(OBJECT_VAL(krk_internString(AS_STRING(krk_finishStringBuilder(&sb)))));
 		formatElements++;
 	}
 	if (formatElements != 1) {
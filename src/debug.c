@@ -25,7 +25,7 @@ void krk_debug_dumpStack(FILE * file, KrkCallFrame * frame) {
 	for (KrkValue * slot = krk_currentThread.stack; slot < krk_currentThread.stackTop; slot++) {
 		fprintf(file, "[%c", frame->slots == i ? '*' : ' ');
 
-		for (size_t x = krk_currentThread.frameCount; x > 0; x--) {
+		for (size_t x = krk_currentThread.frameCount; x > krk_currentThread.segment->frameBase; x--) {
 			if (krk_currentThread.frames[x-1].slots > i) continue;
 			KrkCallFrame * f = &krk_currentThread.frames[x-1];
 			size_t relative = i - f->slots;
@@ -104,6 +104,10 @@ static int isJumpTarget(KrkCodeObject * func, size_t startPoint) {
 #define JUMP(opc,sign) case opc: { uint16_t jump = (chunk->code[offset + 1] << 8) | (chunk->code[offset + 2]); \
 	if ((size_t)(offset + 3 sign jump) == startPoint) return 1; \
 	size = 3; break; }
+#define FUSED(opc,kinds) case opc: { size = krk_fusedSize(kinds); \
+	if (strchr(kinds,'J') && offset + size + ((chunk->code[offset + size - 2] << 8) | chunk->code[offset + size - 1]) == startPoint) return 1; \
+	break; }
+#define QUICK(opc,generic)
 #define CLOSURE_MORE \
 	KrkCodeObject * function = AS_codeobject(chunk->constants.values[constant]); \
 	for (size_t j = 0; j < function->upvalueCount; ++j) { \
@@ -120,7 +124,7 @@ static int isJumpTarget(KrkCodeObject * func, size_t startPoint) {
 	while (offset < chunk->count) {
 		uint8_t opcode = chunk->code[offset];
 		size_t size = 0;
-		switch (opcode) {
+		switch (krk_genericOpcode(opcode)) {
 #include "opcodes.h"
 		}
 		offset += size;
@@ -131,6 +135,8 @@ static int isJumpTarget(KrkCodeObject * func, size_t startPoint) {
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
+#undef FUSED
+#undef QUICK
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
 #undef EXPAND_ARGS_MORE
@@ -182,6 +188,8 @@ static void _jump(OPARGS, int sign) {
 #define OPERAND(opc,more) case opc: _operand(f,#opc,&size,&offset,func,chunk,0,more); break; \
 	case opc ## _LONG: _operand(f,#opc "_LONG",&size,&offset,func,chunk,1,more); break;
 #define JUMP(opc,sign) case opc: _jump(f,#opc,&size,&offset,func,chunk,sign 1); break;
+#define FUSED(opc,kinds) case opc: _fused(f,#opc,&size,&offset,func,chunk,kinds); break;
+#define QUICK(opc,generic)
 
 #define CLOSURE_MORE _closure_more
 
@@ -245,6 +253,56 @@ static void _local_more(OPARGS, size_t operand) {
 	}
 }
 
+static KrkString * _localName(KrkCodeObject * func, size_t index, size_t offset) {
+	for (size_t i = 0; i < func->localNameCount; ++i) {
+		if (func->localNames[i].id == index && func->localNames[i].birthday <= offset && func->localNames[i].deathday >= offset) {
+			return func->localNames[i].name;
+		}
+	}
+	return NULL;
+}
+
+static const char * _compareName(uint8_t kind) {
+	switch (kind) {
+		case OP_LESS: return "<";
+		case OP_GREATER: return ">";
+		case OP_LESS_EQUAL: return "<=";
+		case OP_GREATER_EQUAL: return ">=";
+		case OP_EQUAL: return "==";
+	}
+	return "?";
+}
+
+static void _fused(OPARGS, const char * kinds) {
+	_print_opcode(OPARG_VALS);
+	*size = krk_fusedSize(kinds);
+	size_t i = *offset + 1;
+	for (const char * k = kinds; *k; ++k) {
+		if (k != kinds) fprintf(f, " ");
+		switch (*k) {
+			case 'L': {
+				KrkString * name = _localName(func, chunk->code[i], *offset);
+				if (name) fprintf(f, "%s", name->chars);
+				else fprintf(f, "local<%d>", (int)chunk->code[i]);
+				i++;
+				break;
+			}
+			case 'C':
+				krk_printValueSafe(f, chunk->constants.values[chunk->code[i++]]);
+				break;
+			case 'K':
+				fprintf(f, "%s", _compareName(chunk->code[i++]));
+				break;
+			case 'J': {
+				uint16_t jump = (chunk->code[i] << 8) | chunk->code[i + 1];
+				fprintf(f, "(to %d)", (int)(*offset + *size + jump));
+				i += 2;
+				break;
+			}
+		}
+	}
+}
+
 size_t krk_disassembleInstruction(FILE * f, KrkCodeObject * func, size_t offset) {
 	KrkChunk * chunk = &func->chunk;
 	if (offset > 0 && krk_lineNumber(chunk, offset) == krk_lineNumber(chunk, offset - 1)) {
@@ -262,7 +320,8 @@ size_t krk_disassembleInstruction(FILE * f, KrkCodeObject * func, size_t offset)
 	uint8_t opcode = chunk->code[offset];
 	size_t size = 1;
 
-	switch (opcode) {
+	/* Quickened instructions are shown as the generic instruction they stand in for. */
+	switch (krk_genericOpcode(opcode)) {
 #include "opcodes.h"
 		default:
 			fprintf(f, "Unknown opcode: %02x", opcode);
@@ -291,6 +350,8 @@ size_t krk_disassembleInstruction(FILE * f, KrkCodeObject * func, size_t offset)
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
+#undef FUSED
+#undef QUICK
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
 #undef EXPAND_ARGS_MORE
@@ -345,27 +406,32 @@ int krk_debug_addBreakpointCodeOffset(KrkCodeObject * target, size_t offset, int
 	return index;
 }
 
-int krk_debug_addBreakpointFileLine(KrkString * filename, size_t line, int flags) {
+struct BreakpointSearch {
+	KrkString * filename;
+	size_t line;
+	KrkCodeObject * target;
+};
+
+static void findBreakpointTarget(KrkObj * object, void * context) {
+	struct BreakpointSearch * search = context;
+	if (search->target || object->type != KRK_OBJ_CODEOBJECT) return;
+	KrkChunk * chunk = &((KrkCodeObject*)object)->chunk;
+	if (search->filename == chunk->filename) {
+		/* We have a candidate. */
+		if (krk_lineNumber(chunk, 0) <= search->line &&
+		    krk_lineNumber(chunk,chunk->count) >= search->line) {
+			search->target = (KrkCodeObject*)object;
+		}
+	}
+}
 
-	KrkCodeObject * target = NULL;
+int krk_debug_addBreakpointFileLine(KrkString * filename, size_t line, int flags) {
 
 	/* Examine all code objects to find one that matches the requested
 	 * filename and line number... */
-	KrkObj * object = vm.objects;
-	while (object) {
-		if (object->type == KRK_OBJ_CODEOBJECT) {
-			KrkChunk * chunk = &((KrkCodeObject*)object)->chunk;
-			if (filename == chunk->filename) {
-				/* We have a candidate. */
-				if (krk_lineNumber(chunk, 0) <= line &&
-				    krk_lineNumber(chunk,chunk->count) >= line) {
-					target = (KrkCodeObject*)object;
-					break;
-				}
-			}
-		}
-		object = object->next;
-	}
+	struct BreakpointSearch search = {filename, line, NULL};
+	krk_walkObjects(findBreakpointTarget, &search);
+	KrkCodeObject * target = search.target;
 
 	/* No matching function was found... */
 	if (!target) return -1;
@@ -656,7 +722,7 @@ KRK_Function(dis) {
 
 KRK_Function(build) {
 	FUNCTION_TAKES_AT_LEAST(1);
-	FUNCTION_TAKES_AT_MOST(2);
+	FUNCTION_TAKES_AT_MOST(3);
 	CHECK_ARG(0,str,KrkString*,code);
 	char * fileName = "<source>";
 	if (argc > 1) {
@@ -664,6 +730,13 @@ KRK_Function(build) {
 		fileName = filename->chars;
 	}
 
+	/* Optimize as requested, or as the VM was configured */
+	int oldFlags = vm.globalFlags;
+	if (argc > 2) {
+		if (krk_isFalsey(argv[2])) vm.globalFlags &= ~KRK_GLOBAL_OPTIMIZE;
+		else vm.globalFlags |= KRK_GLOBAL_OPTIMIZE;
+	}
+
 	/* Unset module */
 	krk_push(OBJECT_VAL(krk_currentThread.module));
 	KrkInstance * module = krk_currentThread.module;
@@ -671,6 +744,7 @@ KRK_Function(build) {
 	KrkCodeObject * c = krk_compile(code->chars,fileName);
 	krk_currentThread.module = module;
 	krk_pop();
+	vm.globalFlags = (vm.globalFlags & ~KRK_GLOBAL_OPTIMIZE) | (oldFlags & KRK_GLOBAL_OPTIMIZE);
 	if (c) return OBJECT_VAL(c);
 	else return NONE_VAL();
 }
@@ -685,6 +759,8 @@ KRK_Function(build) {
 	(chunk->code[offset + 2] << 8) | (chunk->code[offset + 3]); size = 4; more; break; }
 #define JUMP(opc,sign) case opc: { jump = 0 sign ((chunk->code[offset + 1] << 8) | (chunk->code[offset + 2])); \
 	size = 3; break; }
+#define FUSED(opc,kinds) case opc: { fused = kinds; size = krk_fusedSize(kinds); break; }
+#define QUICK(opc,generic)
 #define CLOSURE_MORE \
 	KrkCodeObject * function = AS_codeobject(chunk->constants.values[constant]); \
 	size_t baseOffset = offset; \
@@ -712,7 +788,8 @@ static KrkValue _examineInternal(KrkCodeObject* func) {
 		ssize_t jump = 0;
 		ssize_t operand = -1;
 		ssize_t local = -1;
-		switch (opcode) {
+		const char * fused = NULL;
+		switch (krk_genericOpcode(opcode)) {
 #include "opcodes.h"
 		}
 
@@ -720,7 +797,28 @@ static KrkValue _examineInternal(KrkCodeObject* func) {
 		krk_push(OBJECT_VAL(newTuple));
 		newTuple->values.values[newTuple->values.count++] = INTEGER_VAL(opcode);
 		newTuple->values.values[newTuple->values.count++] = INTEGER_VAL(size);
-		if (constant != -1) {
+		if (fused) {
+			/* Superinstructions describe each of their operands in a tuple */
+			KrkTuple * operands = krk_newTuple(strlen(fused));
+			newTuple->values.values[newTuple->values.count++] = OBJECT_VAL(operands);
+			size_t i = offset + 1;
+			for (const char * k = fused; *k; ++k) {
+				KrkValue value = INTEGER_VAL(chunk->code[i]);
+				if (*k == 'L') {
+					KrkString * name = _localName(func, chunk->code[i], offset);
+					if (name) value = OBJECT_VAL(name);
+				} else if (*k == 'C') {
+					value = chunk->constants.values[chunk->code[i]];
+				} else if (*k == 'K') {
+					value = OBJECT_VAL(krk_copyString(_compareName(chunk->code[i]), strlen(_compareName(chunk->code[i]))));
+				} else if (*k == 'J') {
+					value = INTEGER_VAL((chunk->code[i] << 8) | chunk->code[i + 1]);
+					i++;
+				}
+				operands->values.values[operands->values.count++] = value;
+				i++;
+			}
+		} else if (constant != -1) {
 			newTuple->values.values[newTuple->values.count++] = chunk->constants.values[constant];
 		} else if (jump != 0) {
 			newTuple->values.values[newTuple->values.count++] = INTEGER_VAL(jump);
@@ -749,6 +847,33 @@ static KrkValue _examineInternal(KrkCodeObject* func) {
 
 	return krk_pop();
 }
+#ifdef KRK_OPCODE_STATS
+KRK_Function(opcode_stats) {
+	FUNCTION_TAKES_AT_MOST(1);
+	KrkValue dict = krk_dict_of(0, NULL, 0);
+	krk_push(dict);
+	for (size_t i = 0; i < 256; ++i) {
+		size_t count = __atomic_load_n(&krk_opcodeCounts[i], __ATOMIC_RELAXED);
+		if (count) krk_tableSet(AS_DICT(dict), INTEGER_VAL(i), INTEGER_VAL(count));
+		for (size_t j = 0; j < 256; ++j) {
+			count = __atomic_load_n(&krk_opcodePairCounts[i][j], __ATOMIC_RELAXED);
+			if (!count) continue;
+			KrkTuple * pair = krk_newTuple(2);
+			pair->values.values[pair->values.count++] = INTEGER_VAL(i);
+			pair->values.values[pair->values.count++] = INTEGER_VAL(j);
+			krk_push(OBJECT_VAL(pair));
+			krk_tableSet(AS_DICT(dict), OBJECT_VAL(pair), INTEGER_VAL(count));
+			krk_pop();
+		}
+	}
+	if (argc > 0 && !krk_isFalsey(argv[0])) {
+		memset(krk_opcodeCounts, 0, sizeof(krk_opcodeCounts));
+		memset(krk_opcodePairCounts, 0, sizeof(krk_opcodePairCounts));
+	}
+	return krk_pop();
+}
+#endif
+
 KRK_Function(examine) {
 	FUNCTION_TAKES_EXACTLY(1);
 	CHECK_ARG(0,codeobject,KrkCodeObject*,func);
@@ -760,6 +885,8 @@ KRK_Function(examine) {
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
+#undef FUSED
+#undef QUICK
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
 #undef EXPAND_ARGS_MORE
@@ -797,9 +924,10 @@ void krk_module_init_dis(void) {
 
 	KRK_DOC(BIND_FUNC(module, build),
 		"@brief Compile a string to a code object.\n"
-		"@arguments code\n\n"
+		"@arguments code,filename=\"<source>\",optimize=None\n\n"
 		"Compiles the string @p code and returns a code object. If a syntax "
-		"error is encountered, it will be raised.");
+		"error is encountered, it will be raised. If @p optimize is given, it "
+		"overrides whether the bytecode optimizer (-O) is run.");
 
 	KRK_DOC(BIND_FUNC(module, examine),
 		"@brief Convert a code object to a list of instructions.\n"
@@ -833,6 +961,16 @@ void krk_module_init_dis(void) {
 		"Disable the breakpoint specified by @p handle. May raise @ref IndexError if "
 		"@p handle is not a valid breakpoint handle.");
 
+#ifdef KRK_OPCODE_STATS
+	KRK_DOC(BIND_FUNC(module, opcode_stats),
+		"@brief Get counts of executed instructions.\n"
+		"@arguments reset=False\n\n"
+		"Returns a dict mapping each opcode to the number of times it has run, and each pair "
+		"of opcodes as a tuple to the number of times the second ran directly after the first. "
+		"If @p reset is true, the counters are cleared afterwards. Only available in builds with "
+		"@c KRK_OPCODE_STATS enabled.");
+#endif
+
 	krk_attachNamedValue(&module->fields, "BREAKPOINT_ONCE", INTEGER_VAL(KRK_BREAKPOINT_ONCE));
 	krk_attachNamedValue(&module->fields, "BREAKPOINT_REPEAT", INTEGER_VAL(KRK_BREAKPOINT_REPEAT));
 
@@ -841,12 +979,16 @@ void krk_module_init_dis(void) {
 #define CONSTANT(opc,more) OPCODE(opc) OPCODE(opc ## _LONG)
 #define OPERAND(opc,more) OPCODE(opc) OPCODE(opc ## _LONG)
 #define JUMP(opc,sign) OPCODE(opc)
+#define FUSED(opc,kinds) OPCODE(opc)
+#define QUICK(opc,generic) OPCODE(opc)
 #include "opcodes.h"
 #undef SIMPLE
 #undef OPERANDB
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
+#undef FUSED
+#undef QUICK
 }
 
 #endif
@@ -372,13 +372,33 @@ static void attachTraceback(void) {
 		/* Build the traceback object */
 		if (krk_currentThread.frameCount) {
 
-			/* Go up until we get to the exit frame */
+			/* Go up until we get to the exit frame, looking through the stacks of
+			 * any generators we are running inside of as we go. */
 			size_t frameOffset = 0;
-			if (krk_currentThread.stackTop > krk_currentThread.stack) {
-				size_t stackOffset = krk_currentThread.stackTop - krk_currentThread.stack - 1;
-				while (stackOffset > 0 && !IS_HANDLER_TYPE(krk_currentThread.stack[stackOffset], OP_PUSH_TRY)) stackOffset--;
-				frameOffset = krk_currentThread.frameCount - 1;
-				while (frameOffset > 0 && krk_currentThread.frames[frameOffset].slots > stackOffset) frameOffset--;
+			KrkStackSegment * segment = krk_currentThread.segment;
+			KrkValue * stack = krk_currentThread.stack;
+			KrkValue * stackTop = krk_currentThread.stackTop;
+			size_t frameLimit = krk_currentThread.frameCount;
+			while (1) {
+				size_t stackOffset = 0;
+				if (stackTop > stack) {
+					stackOffset = stackTop - stack - 1;
+					while (stackOffset > 0 && !IS_HANDLER_TYPE(stack[stackOffset], OP_PUSH_TRY)) stackOffset--;
+				}
+				if (!stackOffset && segment->outer && segment->frameBase) {
+					frameLimit = segment->frameBase;
+					segment = segment->outer;
+					stack = segment->stack;
+					stackTop = segment->stackTop;
+					continue;
+				}
+				if (stackTop > stack) {
+					frameOffset = frameLimit - 1;
+					while (frameOffset > segment->frameBase && krk_currentThread.frames[frameOffset].slots > stackOffset) frameOffset--;
+				} else {
+					frameOffset = segment->frameBase;
+				}
+				break;
 			}
 
 			for (size_t i = frameOffset; i < krk_currentThread.frameCount; i++) {
@@ -7,6 +7,8 @@
 #include <string.h>
 #include <errno.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <kuroko/vm.h>
 #include <kuroko/value.h>
@@ -22,6 +24,13 @@ struct File {
 	KrkInstance inst;
 	FILE * filePtr;
 	int unowned;
+	char * buffer;      /**< Read-ahead buffer, allocated on the first read */
+	size_t bufferSize;  /**< Capacity of @c buffer */
+	size_t bufferPos;   /**< Offset of the next unread byte in @c buffer */
+	size_t bufferLen;   /**< Number of bytes in @c buffer */
+	int eof;            /**< A read reached the end of the file */
+	int reading;        /**< The underlying file position is ahead of ours by the unread bytes */
+	int dirty;          /**< There may be buffered writes that need flushing before a read */
 };
 
 #define IS_File(o) (krk_isInstanceOf(o, KRK_BASE_CLASS(File)))
@@ -45,27 +54,34 @@ struct Directory {
 #define CURRENT_CTYPE struct File *
 #define CURRENT_NAME  self
 
+/**
+ * @brief Default size of the read-ahead buffer, if @c open() is not given one.
+ */
+#define DEFAULT_BUFFER_SIZE 65536
+
 KRK_Function(open) {
-	FUNCTION_TAKES_AT_LEAST(1);
-	FUNCTION_TAKES_AT_MOST(2);
-	CHECK_ARG(0,str,KrkString*,filename);
-	if (argc == 2 && !IS_STRING(argv[1])) return TYPE_ERROR(str,argv[1]);
+	KrkString * filename;
+	KrkString * mode = NULL;
+	ssize_t buffering = -1;
+	if (!krk_parseArgs("O!|O!n", (const char*[]){"path","mode","buffering"},
+		vm.baseClasses->strClass, &filename, vm.baseClasses->strClass, &mode, &buffering)) return NONE_VAL();
+	if (buffering == 0 || buffering < -1) return krk_runtimeError(vm.exceptions->valueError, "open: buffering must be -1 or positive");
 	KrkValue arg;
 	int isBinary = 0;
-	if (argc == 1) {
+	if (!mode) {
 		arg = OBJECT_VAL(S("r"));
 		krk_push(arg); /* Will be peeked to find arg string for fopen */
 	} else {
 		/* Check mode against allowable modes */
-		if (AS_STRING(argv[1])->length == 0) return krk_runtimeError(vm.exceptions->typeError, "open: mode string must not be empty");
-		for (size_t i = 0; i < AS_STRING(argv[1])->length-1; ++i) {
-			if (AS_CSTRING(argv[1])[i] == 'b') {
+		if (mode->length == 0) return krk_runtimeError(vm.exceptions->typeError, "open: mode string must not be empty");
+		for (size_t i = 0; i < mode->length-1; ++i) {
+			if (mode->chars[i] == 'b') {
 				return krk_runtimeError(vm.exceptions->typeError, "open: 'b' mode indicator must appear at end of mode string");
 			}
 		}
-		arg = argv[1];
-		if (AS_CSTRING(argv[1])[AS_STRING(argv[1])->length-1] == 'b') {
-			KrkValue tmp = OBJECT_VAL(krk_copyString(AS_CSTRING(argv[1]), AS_STRING(argv[1])->length-1));
+		arg = OBJECT_VAL(mode);
+		if (mode->chars[mode->length-1] == 'b') {
+			KrkValue tmp = OBJECT_VAL(krk_copyString(mode->chars, mode->length-1));
 			krk_push(tmp);
 			isBinary = 1;
 		} else {
@@ -76,6 +92,9 @@ KRK_Function(open) {
 	FILE * file = fopen(filename->chars, AS_CSTRING(krk_peek(0)));
 	if (!file) return krk_runtimeError(vm.exceptions->ioError, "open: failed to open file; system returned: %s", strerror(errno));
 
+	/* Writes go through stdio's buffer, reads through ours; both get the requested size. */
+	if (buffering > 0) setvbuf(file, NULL, _IOFBF, buffering);
+
 	/* Now let's build an object to hold it */
 	KrkInstance * fileObject = krk_newInstance(isBinary ? KRK_BASE_CLASS(BinaryFile) : KRK_BASE_CLASS(File));
 	krk_push(OBJECT_VAL(fileObject));
@@ -85,74 +104,221 @@ KRK_Function(open) {
 	krk_attachNamedValue(&fileObject->fields, "modestr", arg);
 
 	((struct File*)fileObject)->filePtr = file;
+	((struct File*)fileObject)->bufferSize = buffering > 0 ? (size_t)buffering : DEFAULT_BUFFER_SIZE;
 
 	krk_pop();
 	krk_pop();
 	return OBJECT_VAL(fileObject);
 }
 
-#define BLOCK_SIZE 1024
+/**
+ * @brief Read up to @p size bytes from the underlying file.
+ *
+ * Files we opened are read with read(2), bypassing stdio's buffer so data
+ * lands directly where it is wanted. The standard streams are shared with
+ * other readers like @c input(), so they keep going through stdio, and
+ * for them @p line stops the read after a line feed.
+ *
+ * Must not be called with managed objects that are not on the stack.
+ *
+ * @return Bytes read, 0 at end of file, or -1 on error with an exception set.
+ */
+static ssize_t _file_sysread(struct File * self, char * dest, size_t size, int line) {
+	ssize_t result = 0;
+	int error = 0;
+
+	krk_beginBlockingCall();
+	if (self->unowned) {
+		if (line) {
+			while ((size_t)result < size) {
+				int c = fgetc(self->filePtr);
+				if (c < 0) break;
+				dest[result++] = c;
+				if (c == '\n') break;
+			}
+		} else {
+			result = fread(dest, 1, size, self->filePtr);
+		}
+		if (ferror(self->filePtr)) error = EIO;
+		else if (!result) self->eof = 1;
+	} else {
+		do {
+			result = read(fileno(self->filePtr), dest, size);
+		} while (result < 0 && errno == EINTR && !(krk_currentThread.flags & KRK_THREAD_SIGNALLED));
+		if (result < 0) error = errno;
+		else if (!result) self->eof = 1;
+	}
+	krk_endBlockingCall();
 
-KRK_Method(File,__str__) {
-	METHOD_TAKES_NONE();
-	KrkValue filename;
-	KrkValue modestr;
-	if (!krk_tableGet(&self->inst.fields, OBJECT_VAL(S("filename")), &filename) || !IS_STRING(filename)) return krk_runtimeError(vm.exceptions->baseException, "Corrupt File");
-	if (!krk_tableGet(&self->inst.fields, OBJECT_VAL(S("modestr")), &modestr) || !IS_STRING(modestr)) return krk_runtimeError(vm.exceptions->baseException, "Corrupt File");
+	if (error) {
+		krk_runtimeError(vm.exceptions->ioError, "Read error: %s", strerror(error));
+		return -1;
+	}
+	return result;
+}
 
-	return krk_stringFromFormat("<%s file '%S', mode '%S' at %p>", self->filePtr ? "open" : "closed", AS_STRING(filename), AS_STRING(modestr), (void*)self);
+/**
+ * @brief Write @p size bytes through stdio, which may block on a full pipe.
+ *
+ * Same restrictions as @ref _file_sysread.
+ */
+static size_t _file_syswrite(struct File * self, const void * data, size_t size) {
+	krk_beginBlockingCall();
+	size_t result = fwrite(data, 1, size, self->filePtr);
+	krk_endBlockingCall();
+	return result;
 }
 
-KRK_Method(File,readline) {
-	METHOD_TAKES_NONE();
-	FILE * file = self->filePtr;
+/**
+ * @brief Flush pending writes, which may block like @ref _file_syswrite.
+ */
+static void _file_sysflush(struct File * self) {
+	krk_beginBlockingCall();
+	fflush(self->filePtr);
+	krk_endBlockingCall();
+}
 
-	if (!file || feof(file)) {
-		return NONE_VAL();
+/**
+ * @brief Refill the read-ahead buffer once it has been used up.
+ *
+ * @return As for @ref _file_sysread
+ */
+static ssize_t _file_fill(struct File * self, int line) {
+	if (!self->buffer) {
+		if (!self->bufferSize) self->bufferSize = DEFAULT_BUFFER_SIZE;
+		self->buffer = malloc(self->bufferSize);
 	}
+	if (self->dirty) {
+		_file_sysflush(self);
+		self->dirty = 0;
+	}
+	self->reading = 1;
+	self->bufferPos = 0;
+	self->bufferLen = 0;
+	ssize_t result = _file_sysread(self, self->buffer, self->bufferSize, line);
+	if (result > 0) self->bufferLen = result;
+	return result;
+}
 
-	size_t sizeRead = 0;
-	size_t spaceAvailable = 0;
-	char * buffer = NULL;
-
-	do {
-		if (spaceAvailable < sizeRead + BLOCK_SIZE) {
-			spaceAvailable = (spaceAvailable ? spaceAvailable * 2 : (2 * BLOCK_SIZE));
-			buffer = realloc(buffer, spaceAvailable);
+/**
+ * @brief Read up to @p size bytes into @p dest, stopping early only at end of file.
+ *
+ * Buffered data is used first. Large reads then go straight into @p dest,
+ * while small ones refill the buffer so later calls can be served from it.
+ * The standard streams are never read ahead of what was asked for.
+ *
+ * @return Bytes read, or -1 on error with an exception set.
+ */
+static ssize_t _file_read_into(struct File * self, char * dest, size_t size) {
+	size_t got = 0;
+	while (got < size) {
+		size_t available = self->bufferLen - self->bufferPos;
+		if (available) {
+			size_t take = available < size - got ? available : size - got;
+			memcpy(dest + got, self->buffer + self->bufferPos, take);
+			self->bufferPos += take;
+			got += take;
+			continue;
 		}
-
-		char * target = &buffer[sizeRead];
-		while (sizeRead < spaceAvailable) {
-			int c = fgetc(file);
-			if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
-			if (c < 0) break;
-			sizeRead++;
-			*target++ = c;
-			if (c == '\n') goto _finish_line;
+		if (self->eof || (krk_currentThread.flags & KRK_THREAD_SIGNALLED)) break;
+		ssize_t result;
+		if (self->unowned || size - got >= (self->bufferSize ? self->bufferSize : DEFAULT_BUFFER_SIZE)) {
+			if (self->dirty) {
+				_file_sysflush(self);
+				self->dirty = 0;
+			}
+			self->reading = 1;
+			result = _file_sysread(self, dest + got, size - got, 0);
+			if (result > 0) got += result;
+		} else {
+			result = _file_fill(self, 0);
 		}
+		if (result < 0) return -1;
+		if (result == 0) break;
+	}
+	return got;
+}
 
-		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
-	} while (!feof(file));
+/**
+ * @brief Hand a buffer allocated with krk_reallocate over to a new str or bytes object.
+ *
+ * @p buffer has room for @p capacity bytes and holds @p length of them; it is
+ * shrunk to fit first. Strings are validated as UTF-8 but not interned.
+ */
+static KrkValue _file_take_buffer(char * buffer, size_t capacity, size_t length, int binary) {
+	if (binary) {
+		buffer = krk_reallocate(buffer, capacity, length);
+		KrkBytes * out = krk_newBytes(0, NULL);
+		out->bytes = (uint8_t*)buffer;
+		out->length = length;
+		return OBJECT_VAL(out);
+	}
+	buffer = krk_reallocate(buffer, capacity, length + 1);
+	return OBJECT_VAL(krk_takeStringChecked(buffer, length));
+}
+
+static KrkValue _file_make_line(const char * chars, size_t length, int binary) {
+	if (binary) return OBJECT_VAL(krk_newBytes(length, (uint8_t*)chars));
+	return OBJECT_VAL(krk_copyStringUninterned(chars, length));
+}
+
+/**
+ * @brief Shared implementation of readline for File and BinaryFile.
+ *
+ * Lines that fit in the read-ahead buffer are copied out of it once, directly
+ * into the new object; longer ones are collected in a temporary buffer first.
+ */
+static KrkValue _file_readline(struct File * self, int binary) {
+	if (!self->filePtr) return NONE_VAL();
 
-_finish_line: (void)0;
-	if (sizeRead == 0) {
-		free(buffer);
+	char * line = NULL;
+	size_t lineLen = 0;
+	size_t lineCap = 0;
+
+	for (;;) {
+		size_t available = self->bufferLen - self->bufferPos;
+		if (available) {
+			char * start = self->buffer + self->bufferPos;
+			char * newline = memchr(start, '\n', available);
+			size_t take = newline ? (size_t)(newline - start) + 1 : available;
+			if (newline && !line) {
+				self->bufferPos += take;
+				return _file_make_line(start, take, binary);
+			}
+			if (lineLen + take > lineCap) {
+				while (lineLen + take > lineCap) lineCap = lineCap ? lineCap * 2 : self->bufferSize;
+				line = realloc(line, lineCap);
+			}
+			memcpy(line + lineLen, start, take);
+			lineLen += take;
+			self->bufferPos += take;
+			if (newline) break;
+		}
+		if (self->eof || (krk_currentThread.flags & KRK_THREAD_SIGNALLED)) break;
+		ssize_t result = _file_fill(self, 1);
+		if (result < 0) {
+			free(line);
+			return NONE_VAL();
+		}
+		if (result == 0) break;
+	}
+
+	if (!lineLen) {
+		free(line);
 		return NONE_VAL();
 	}
 
-	/* Make a new string to fit our output. */
-	KrkString * out = krk_copyString(buffer,sizeRead);
-	free(buffer);
-	return OBJECT_VAL(out);
+	KrkValue out = _file_make_line(line, lineLen, binary);
+	free(line);
+	return out;
 }
 
-KRK_Method(File,readlines) {
-	METHOD_TAKES_NONE();
+static KrkValue _file_readlines(int argc, const KrkValue argv[], int binary) {
 	KrkValue myList = krk_list_of(0,NULL,0);
 	krk_push(myList);
 
 	for (;;) {
-		KrkValue line = FUNC_NAME(File,readline)(1, argv, 0);
+		KrkValue line = _file_readline(AS_File(argv[0]), binary);
 		if (IS_NONE(line)) break;
 		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
 
@@ -165,58 +331,102 @@ KRK_Method(File,readlines) {
 	return myList;
 }
 
-KRK_Method(File,read) {
-	METHOD_TAKES_AT_MOST(1);
+/**
+ * @brief Shared implementation of read for File and BinaryFile.
+ *
+ * The result is read directly into the storage of the returned object. When
+ * reading to the end of a regular file, its size is used to allocate that
+ * storage up front.
+ */
+static KrkValue _file_read(struct File * self, krk_integer_type sizeToRead, int binary) {
+	if (!self->filePtr || (self->eof && self->bufferPos == self->bufferLen)) {
+		return NONE_VAL();
+	}
 
-	krk_integer_type sizeToRead = -1;
-	if (argc > 1) {
-		CHECK_ARG(1,int,krk_integer_type,sizeFromArg);
-		if (sizeFromArg < -1) return krk_runtimeError(vm.exceptions->valueError, "size must be >= -1");
-		sizeToRead = sizeFromArg;
+	size_t extra = binary ? 0 : 1;
+	size_t capacity;
+
+	if (sizeToRead >= 0) {
+		capacity = sizeToRead + extra;
+	} else {
+		capacity = (self->bufferSize ? self->bufferSize : DEFAULT_BUFFER_SIZE) + extra;
+		struct stat st;
+		if (!self->unowned && !fstat(fileno(self->filePtr), &st) && S_ISREG(st.st_mode)) {
+			off_t pos = lseek(fileno(self->filePtr), 0, SEEK_CUR);
+			if (pos >= 0 && st.st_size > pos) {
+				/* One extra byte, so that reaching the end takes only one more read. */
+				capacity = (st.st_size - pos) + (self->bufferLen - self->bufferPos) + 1 + extra;
+			}
+		}
 	}
 
-	/* Get the file ptr reference */
-	FILE * file = self->filePtr;
+	char * buffer = krk_reallocate(NULL, 0, capacity);
+	size_t length = 0;
 
-	if (!file || feof(file)) {
-		return NONE_VAL();
+	for (;;) {
+		ssize_t result = _file_read_into(self, buffer + length, capacity - extra - length);
+		if (result < 0) {
+			krk_reallocate(buffer, capacity, 0);
+			return NONE_VAL();
+		}
+		length += result;
+		if (sizeToRead >= 0 || self->eof || (krk_currentThread.flags & KRK_THREAD_SIGNALLED)) break;
+		if (length == capacity - extra) {
+			buffer = krk_reallocate(buffer, capacity, capacity * 2);
+			capacity *= 2;
+		}
 	}
 
-	/* We'll do our read entirely with some native buffers and manage them here. */
-	size_t sizeRead = 0;
-	size_t spaceAvailable = 0;
-	char * buffer = NULL;
+	return _file_take_buffer(buffer, capacity, length, binary);
+}
 
-	if (sizeToRead == -1) {
-		do {
-			if (spaceAvailable < sizeRead + BLOCK_SIZE) {
-				spaceAvailable = (spaceAvailable ? spaceAvailable * 2 : (2 * BLOCK_SIZE));
-				buffer = realloc(buffer, spaceAvailable);
-			}
+/**
+ * @brief Give back any read-ahead before the underlying stream is written or repositioned.
+ *
+ * Files we opened are only ever positioned with lseek(2), as stdio would
+ * read ahead on its own if asked to seek. For those, this moves the file
+ * descriptor back to our logical position.
+ */
+static void _file_unread(struct File * self) {
+	if (!self->reading) return;
+	size_t unread = self->bufferLen - self->bufferPos;
+	if (!self->unowned && unread) lseek(fileno(self->filePtr), -(off_t)unread, SEEK_CUR);
+	self->bufferPos = self->bufferLen = 0;
+	self->reading = 0;
+	self->eof = 0;
+}
 
-			char * target = &buffer[sizeRead];
-			size_t newlyRead = fread(target, 1, BLOCK_SIZE, file);
-			if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
+KRK_Method(File,__str__) {
+	METHOD_TAKES_NONE();
+	KrkValue filename;
+	KrkValue modestr;
+	if (!krk_tableGet(&self->inst.fields, OBJECT_VAL(S("filename")), &filename) || !IS_STRING(filename)) return krk_runtimeError(vm.exceptions->baseException, "Corrupt File");
+	if (!krk_tableGet(&self->inst.fields, OBJECT_VAL(S("modestr")), &modestr) || !IS_STRING(modestr)) return krk_runtimeError(vm.exceptions->baseException, "Corrupt File");
 
-			if (newlyRead < BLOCK_SIZE) {
-				if (ferror(file)) {
-					free(buffer);
-					return krk_runtimeError(vm.exceptions->ioError, "Read error.");
-				}
-			}
+	return krk_stringFromFormat("<%s file '%S', mode '%S' at %p>", self->filePtr ? "open" : "closed", AS_STRING(filename), AS_STRING(modestr), (void*)self);
+}
 
-			sizeRead += newlyRead;
-		} while (!feof(file));
-	} else {
-		spaceAvailable = sizeToRead;
-		buffer = realloc(buffer, spaceAvailable);
-		sizeRead = fread(buffer, 1, sizeToRead, file);
+KRK_Method(File,readline) {
+	METHOD_TAKES_NONE();
+	return _file_readline(self, 0);
+}
+
+KRK_Method(File,readlines) {
+	METHOD_TAKES_NONE();
+	return _file_readlines(argc, argv, 0);
+}
+
+KRK_Method(File,read) {
+	METHOD_TAKES_AT_MOST(1);
+
+	krk_integer_type sizeToRead = -1;
+	if (argc > 1) {
+		CHECK_ARG(1,int,krk_integer_type,sizeFromArg);
+		if (sizeFromArg < -1) return krk_runtimeError(vm.exceptions->valueError, "size must be >= -1");
+		sizeToRead = sizeFromArg;
 	}
 
-	/* Make a new string to fit our output. */
-	KrkString * out = krk_copyString(buffer,sizeRead);
-	free(buffer);
-	return OBJECT_VAL(out);
+	return _file_read(self, sizeToRead, 0);
 }
 
 KRK_Method(File,write) {
@@ -229,24 +439,84 @@ KRK_Method(File,write) {
 		return NONE_VAL();
 	}
 
-	return INTEGER_VAL(fwrite(AS_CSTRING(argv[1]), 1, AS_STRING(argv[1])->length, file));
+	_file_unread(self);
+	self->dirty = 1;
+	return INTEGER_VAL(_file_syswrite(self, AS_CSTRING(argv[1]), AS_STRING(argv[1])->length));
 }
 
 KRK_Method(File,close) {
 	METHOD_TAKES_NONE();
 	FILE * file = self->filePtr;
-	if (file) fclose(file);
 	self->filePtr = NULL;
+	if (file) {
+		krk_beginBlockingCall();
+		fclose(file);
+		krk_endBlockingCall();
+	}
+	free(self->buffer);
+	self->buffer = NULL;
+	self->bufferPos = self->bufferLen = 0;
 	return NONE_VAL();
 }
 
 KRK_Method(File,flush) {
 	METHOD_TAKES_NONE();
-	FILE * file = self->filePtr;
-	if (file) fflush(file);
+	if (self->filePtr) _file_sysflush(self);
+	self->dirty = 0;
 	return NONE_VAL();
 }
 
+KRK_Method(File,seek) {
+	krk_integer_type offset;
+	int whence = SEEK_SET;
+	if (!krk_parseArgs(".L|i", (const char*[]){"offset","whence"}, &offset, &whence)) return NONE_VAL();
+	if (!self->filePtr) return krk_runtimeError(vm.exceptions->valueError, "I/O operation on closed file");
+	if (whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END) return krk_runtimeError(vm.exceptions->valueError, "invalid whence (%d, should be 0, 1 or 2)", whence);
+
+	_file_unread(self);
+	_file_sysflush(self);
+	self->dirty = 0;
+
+	off_t pos;
+	if (self->unowned) {
+		pos = fseek(self->filePtr, offset, whence) < 0 ? -1 : ftell(self->filePtr);
+	} else {
+		pos = lseek(fileno(self->filePtr), offset, whence);
+	}
+	if (pos < 0) return krk_runtimeError(vm.exceptions->ioError, "seek: %s", strerror(errno));
+	clearerr(self->filePtr);
+	return INTEGER_VAL(pos);
+}
+
+KRK_Method(File,tell) {
+	METHOD_TAKES_NONE();
+	if (!self->filePtr) return krk_runtimeError(vm.exceptions->valueError, "I/O operation on closed file");
+	off_t pos;
+	if (self->unowned) {
+		pos = ftell(self->filePtr);
+	} else {
+		if (self->dirty) {
+			_file_sysflush(self);
+			self->dirty = 0;
+		}
+		pos = lseek(fileno(self->filePtr), 0, SEEK_CUR);
+	}
+	if (pos < 0) return krk_runtimeError(vm.exceptions->ioError, "tell: %s", strerror(errno));
+	return INTEGER_VAL(pos - (off_t)(self->bufferLen - self->bufferPos));
+}
+
+KRK_Method(File,__iter__) {
+	METHOD_TAKES_NONE();
+	return argv[0];
+}
+
+KRK_Method(File,__call__) {
+	METHOD_TAKES_NONE();
+	KrkValue line = _file_readline(self, IS_BinaryFile(argv[0]));
+	if (IS_NONE(line)) return argv[0];
+	return line;
+}
+
 KRK_Method(File,__init__) {
 	return krk_runtimeError(vm.exceptions->typeError, "File objects can not be instantiated; use fileio.open() to obtain File objects.");
 }
@@ -270,6 +540,7 @@ static void makeFileInstance(KrkInstance * module, const char name[], FILE * fil
 	krk_attachNamedValue(&fileObject->fields, "modestr", modestr);
 	((struct File*)fileObject)->filePtr = file;
 	((struct File*)fileObject)->unowned = 1;
+	((struct File*)fileObject)->bufferSize = BUFSIZ;
 
 	krk_attachNamedObject(&module->fields, name, (KrkObj*)fileObject);
 
@@ -280,64 +551,12 @@ static void makeFileInstance(KrkInstance * module, const char name[], FILE * fil
 
 KRK_Method(BinaryFile,readline) {
 	METHOD_TAKES_NONE();
-	FILE * file = self->filePtr;
-
-	if (!file || feof(file)) {
-		return NONE_VAL();
-	}
-
-	size_t sizeRead = 0;
-	size_t spaceAvailable = 0;
-	char * buffer = NULL;
-
-	do {
-		if (spaceAvailable < sizeRead + BLOCK_SIZE) {
-			spaceAvailable = (spaceAvailable ? spaceAvailable * 2 : (2 * BLOCK_SIZE));
-			buffer = realloc(buffer, spaceAvailable);
-		}
-
-		char * target = &buffer[sizeRead];
-		while (sizeRead < spaceAvailable) {
-			int c = fgetc(file);
-			if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
-			if (c < 0) break;
-			sizeRead++;
-			*target++ = c;
-			if (c == '\n') goto _finish_line;
-		}
-
-		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
-	} while (!feof(file));
-
-_finish_line: (void)0;
-	if (sizeRead == 0) {
-		free(buffer);
-		return NONE_VAL();
-	}
-
-	/* Make a new string to fit our output. */
-	KrkBytes * out = krk_newBytes(sizeRead, (unsigned char*)buffer);
-	free(buffer);
-	return OBJECT_VAL(out);
+	return _file_readline(self, 1);
 }
 
 KRK_Method(BinaryFile,readlines) {
 	METHOD_TAKES_NONE();
-	KrkValue myList = krk_list_of(0,NULL,0);
-	krk_push(myList);
-
-	for (;;) {
-		KrkValue line = FUNC_NAME(BinaryFile,readline)(1, argv, 0);
-		if (IS_NONE(line)) break;
-		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
-
-		krk_push(line);
-		krk_writeValueArray(AS_LIST(myList), line);
-		krk_pop(); /* line */
-	}
-
-	krk_pop(); /* myList */
-	return myList;
+	return _file_readlines(argc, argv, 1);
 }
 
 KRK_Method(BinaryFile,read) {
@@ -350,54 +569,23 @@ KRK_Method(BinaryFile,read) {
 		sizeToRead = sizeFromArg;
 	}
 
-	/* Get the file ptr reference */
-	FILE * file = self->filePtr;
-
-	if (!file || feof(file)) {
-		return NONE_VAL();
-	}
-
-	/* We'll do our read entirely with some native buffers and manage them here. */
-	size_t sizeRead = 0;
-	size_t spaceAvailable = 0;
-	char * buffer = NULL;
-
-	if (sizeToRead == -1) {
-		do {
-			if (spaceAvailable < sizeRead + BLOCK_SIZE) {
-				spaceAvailable = (spaceAvailable ? spaceAvailable * 2 : (2 * BLOCK_SIZE));
-				buffer = realloc(buffer, spaceAvailable);
-			}
-
-			char * target = &buffer[sizeRead];
-			size_t newlyRead = fread(target, 1, BLOCK_SIZE, file);
-
-			if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
-
-			if (newlyRead < BLOCK_SIZE) {
-				if (ferror(file)) {
-					free(buffer);
-					return krk_runtimeError(vm.exceptions->ioError, "Read error.");
-				}
-			}
-
-			sizeRead += newlyRead;
-		} while (!feof(file));
-	} else {
-		spaceAvailable = sizeToRead;
-		buffer = realloc(buffer, spaceAvailable);
-		sizeRead = fread(buffer, 1, sizeToRead, file);
-	}
+	return _file_read(self, sizeToRead, 1);
+}
 
-	/* Make a new string to fit our output. */
-	KrkBytes * out = krk_newBytes(sizeRead, (unsigned char*)buffer);
-	free(buffer);
-	return OBJECT_VAL(out);
+KRK_Method(BinaryFile,readinto) {
+	METHOD_TAKES_EXACTLY(1);
+	KrkBuffer target;
+	if (!krk_getBuffer(argv[1], &target, 1)) return NONE_VAL();
+	if (!self->filePtr) return krk_runtimeError(vm.exceptions->valueError, "I/O operation on closed file");
+	ssize_t result = _file_read_into(self, (char*)target.buf, target.len);
+	if (result < 0) return NONE_VAL();
+	return INTEGER_VAL(result);
 }
 
 KRK_Method(BinaryFile,write) {
 	METHOD_TAKES_EXACTLY(1);
-	if (!IS_BYTES(argv[1])) return TYPE_ERROR(bytes,argv[1]);
+	KrkBuffer data;
+	if (!krk_getBuffer(argv[1], &data, 0)) return NONE_VAL();
 	/* Find the file ptr reference */
 	FILE * file = self->filePtr;
 
@@ -405,7 +593,9 @@ KRK_Method(BinaryFile,write) {
 		return NONE_VAL();
 	}
 
-	return INTEGER_VAL(fwrite(AS_BYTES(argv[1])->bytes, 1, AS_BYTES(argv[1])->length, file));
+	_file_unread(self);
+	self->dirty = 1;
+	return INTEGER_VAL(_file_syswrite(self, data.buf, data.len));
 }
 
 #undef CURRENT_CTYPE
@@ -416,6 +606,8 @@ static void _file_sweep(KrkInstance * self) {
 		fclose(me->filePtr);
 		me->filePtr = NULL;
 	}
+	free(me->buffer);
+	me->buffer = NULL;
 }
 
 static void _dir_sweep(KrkInstance * self) {
@@ -519,6 +711,14 @@ void krk_module_init_fileio(void) {
 		"Writes the contents of @p data to the stream.");
 	KRK_DOC(BIND_METHOD(File,close), "@brief Close the stream and flush any remaining buffered writes.");
 	KRK_DOC(BIND_METHOD(File,flush), "@brief Flush unbuffered writes to the stream.");
+	KRK_DOC(BIND_METHOD(File,seek), "@brief Move to a new position in the stream.\n"
+		"@arguments offset,whence=0\n\n"
+		"@p whence is @c 0 to seek from the start, @c 1 from the current position, or @c 2 from the end. "
+		"Returns the new position.");
+	KRK_DOC(BIND_METHOD(File,tell), "@brief Get the current position in the stream.");
+	KRK_DOC(BIND_METHOD(File,__iter__), "@brief Iterates over the lines of the stream.\n\n"
+		"Lines are read one at a time as with @ref readline, so the whole stream is never held at once.");
+	BIND_METHOD(File,__call__);
 	BIND_METHOD(File,__str__);
 	KRK_DOC(BIND_METHOD(File,__init__), "@bsnote{%File objects can not be initialized using this constructor. "
 		"Use the <a class=\"el\" href=\"#open\">open()</a> function instead.}");
@@ -534,6 +734,10 @@ void krk_module_init_fileio(void) {
 	BIND_METHOD(BinaryFile,read);
 	BIND_METHOD(BinaryFile,readline);
 	BIND_METHOD(BinaryFile,readlines);
+	KRK_DOC(BIND_METHOD(BinaryFile,readinto), "@brief Read into an existing buffer.\n"
+		"@arguments buffer\n\n"
+		"Fills @p buffer, which may be a @ref bytearray or any other writable bytes-like object, from the stream without allocating, "
+		"and returns the number of bytes read, which is less than its length only at the end of the stream.");
 	BIND_METHOD(BinaryFile,write);
 	krk_finalizeClass(BinaryFile);
 
@@ -559,10 +763,11 @@ void krk_module_init_fileio(void) {
 
 	/* Our base will be the open method */
 	KRK_DOC(BIND_FUNC(module,open), "@brief Open a file.\n"
-		"@arguments path,mode=\"r\"\n\n"
+		"@arguments path,mode=\"r\",buffering=-1\n\n"
 		"Opens @p path using the modestring @p mode. Supported modestring characters depend on the system implementation. "
 		"If the last character of @p mode is @c 'b' a @ref BinaryFile will be returned. If the file could not be opened, "
-		"an @ref IOError will be raised.");
+		"an @ref IOError will be raised. @p buffering sets the size in bytes of the buffers used for reading and writing; "
+		"the default is 64KiB.");
 	KRK_DOC(BIND_FUNC(module,opendir), "@brief Open a directory for scanning.\n"
 		"@arguments path\n\n"
 		"Opens the directory at @p path and returns a @ref Directory object. If @p path could not be opened or is not "
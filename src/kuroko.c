@@ -53,13 +53,38 @@ KRK_Function(paste) {
 	return NONE_VAL();
 }
 
+/*
+ * Waiting for input must not hold up other threads that want to collect
+ * garbage, so line editing and plain reads are marked as blocking calls.
+ */
+#ifndef NO_RLINE
+static int blockingRline(char * buf, int bufSize) {
+	krk_beginBlockingCall();
+	int result = rline(buf, bufSize);
+	krk_endBlockingCall();
+	return result;
+}
+#endif
+
+static char * blockingFgets(char * buf, int bufSize) {
+	krk_beginBlockingCall();
+	char * result = fgets(buf, bufSize, stdin);
+	krk_endBlockingCall();
+	return result;
+}
+
 static int doRead(char * buf, size_t bufSize) {
 #ifndef NO_RLINE
 	if (enableRline)
-		return rline(buf, bufSize);
+		return blockingRline(buf, bufSize);
 	else
 #endif
-		return read(STDIN_FILENO, buf, bufSize);
+	{
+		krk_beginBlockingCall();
+		int result = read(STDIN_FILENO, buf, bufSize);
+		krk_endBlockingCall();
+		return result;
+	}
 }
 
 static KrkValue readLine(char * prompt, int promptWidth, char * syntaxHighlighter) {
@@ -154,7 +179,7 @@ static char * syn_krk_keywords[] = {
 	NULL
 };
 
-static void tab_complete_func(rline_context_t * c) {
+static void completeAtCursor(rline_context_t * c) {
 	/* Figure out where the cursor is and if we should be completing anything. */
 	if (c->offset) {
 		size_t stackIn = krk_currentThread.stackTop - krk_currentThread.stack;
@@ -366,6 +391,13 @@ _cleanup:
 		return;
 	}
 }
+
+/* Completion runs from inside rline, which is a blocking call, but it needs managed objects. */
+static void tab_complete_func(rline_context_t * c) {
+	krk_endBlockingCall();
+	completeAtCursor(c);
+	krk_beginBlockingCall();
+}
 #endif
 
 #ifndef KRK_DISABLE_DEBUG
@@ -396,12 +428,12 @@ static int debuggerHook(KrkCallFrame * frame) {
 			rline_exp_set_prompts("(dbg) ", "", 6, 0);
 			rline_exp_set_syntax("krk-dbg");
 			rline_exp_set_tab_complete_func(NULL);
-			if (rline(buf, 4096) == 0) goto _dbgQuit;
+			if (blockingRline(buf, 4096) == 0) goto _dbgQuit;
 		} else {
 #endif
 			fprintf(stderr, "(dbg) ");
 			fflush(stderr);
-			char * out = fgets(buf, 4096, stdin);
+			char * out = blockingFgets(buf, 4096);
 			if (!out || !strlen(buf)) {
 				fprintf(stdout, "^D\n");
 				goto _dbgQuit;
@@ -765,8 +797,12 @@ int main(int argc, char * argv[]) {
 	int inspectAfter = 0;
 	int opt;
 	int maxDepth = -1;
-	while ((opt = getopt(argc, argv, "+:c:C:dgGim:rR:tTMSV-:")) != -1) {
+	while ((opt = getopt(argc, argv, "+:Bc:C:dgGim:OrR:tTMSV-:")) != -1) {
 		switch (opt) {
+			case 'B':
+				/* Do not write bytecode caches for imported modules. */
+				flags |= KRK_GLOBAL_NO_WRITE_BYTECODE;
+				break;
 			case 'c':
 				runCmd = optarg;
 				goto _finishArgs;
@@ -800,6 +836,10 @@ int main(int argc, char * argv[]) {
 				moduleAsMain = 1;
 				optind--; /* to get us back to optarg */
 				goto _finishArgs;
+			case 'O':
+				/* Run the bytecode optimizer over compiled code. */
+				flags |= KRK_GLOBAL_OPTIMIZE;
+				break;
 			case 'r':
 				enableRline = 0;
 				break;
@@ -830,11 +870,13 @@ int main(int argc, char * argv[]) {
 					fprintf(stderr,"usage: %s [flags] [FILE...]\n"
 						"\n"
 						"Interpreter options:\n"
+						" -B          Do not write bytecode caches for imported modules.\n"
 						" -d          Debug output from the bytecode compiler.\n"
 						" -g          Collect garbage on every allocation.\n"
 						" -G          Report GC collections.\n"
 						" -i          Enter repl after a running -c, -m, or FILE.\n"
 						" -m mod      Run a module as a script.\n"
+						" -O          Optimize compiled bytecode.\n"
 						" -r          Disable complex line editing in the REPL.\n"
 						" -R depth    Set maximum recursion depth.\n"
 						" -t          Disassemble instructions as they are exceuted.\n"
@@ -1054,14 +1096,14 @@ _finishArgs:
 #ifndef NO_RLINE
 				rline_scroll = 0;
 				if (enableRline) {
-					if (rline(buf, 4096) == 0) {
+					if (blockingRline(buf, 4096) == 0) {
 						valid = 0;
 						exitRepl = 1;
 						break;
 					}
 				} else {
 #endif
-					char * out = fgets(buf, 4096, stdin);
+					char * out = blockingFgets(buf, 4096);
 					if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) {
 						fprintf(stdout, "\n");
 					} else if ((!out || !strlen(buf))) {
@@ -3,6 +3,7 @@
  * @file compiler.h
  * @brief Exported methods for the source compiler.
  */
+#include <stdio.h>
 #include "object.h"
 
 /**
@@ -16,3 +17,41 @@
  */
 extern KrkCodeObject * krk_compile(const char * src, char * fileName);
 
+
+/**
+ * @brief Identifies the source file a serialized code object was compiled from.
+ *
+ * Stored in the header of marshaled bytecode so that a cached copy can be
+ * discarded when its source changes.
+ */
+typedef struct {
+	uint64_t mtime; /**< @brief Modification time of the source file, in seconds */
+	uint64_t size;  /**< @brief Size of the source file, in bytes */
+} KrkSourceStamp;
+
+/**
+ * @brief Serialize a compiled module to a file.
+ *
+ * Writes @p code and every code object reachable from its constants
+ * in the KRKB bytecode format.
+ *
+ * @param code   Module code object, as returned by @ref krk_compile
+ * @param out    File to write to.
+ * @param source Stamp of the source file to record, or NULL.
+ * @return 0 on success, non-zero if a constant can not be represented or the write failed.
+ */
+extern int krk_marshalCode(KrkCodeObject * code, FILE * out, const KrkSourceStamp * source);
+
+/**
+ * @brief Load a module code object from serialized bytecode.
+ *
+ * Does not raise exceptions; any malformed, truncated, or outdated input
+ * simply yields NULL so that callers can fall back to the source.
+ *
+ * @param data     Contents of a file written by @ref krk_marshalCode
+ * @param length   Size of @p data in bytes.
+ * @param fileName Filename to attach to the loaded code objects.
+ * @param source   If not NULL, the stamp recorded in @p data must match.
+ * @return The module code object, or NULL if @p data could not be used.
+ */
+extern KrkCodeObject * krk_unmarshalCode(const void * data, size_t length, KrkString * fileName, const KrkSourceStamp * source);
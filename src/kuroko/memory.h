@@ -15,6 +15,14 @@
 
 #define ALLOCATE(type, count) (type*)krk_reallocate(NULL,0,sizeof(type)*(count))
 
+/**
+ * @def KRK_GC_NURSERY_SIZE
+ * @brief Bytes that may be allocated between two collections of the young generation.
+ */
+#ifndef KRK_GC_NURSERY_SIZE
+#define KRK_GC_NURSERY_SIZE (4 * 1024 * 1024)
+#endif
+
 /**
  * @brief Resize an allocated heap object.
  *
@@ -48,6 +56,90 @@ extern void krk_freeObjects(void);
  */
 extern size_t krk_collectGarbage(void);
 
+/**
+ * @brief Run a collection of the young generation only.
+ *
+ * Objects that have survived a previous collection are assumed to
+ * be alive and are not scanned, except for those in the remembered
+ * set. Surviving young objects are promoted to the old generation.
+ *
+ * @return The number of objects released by this collection cycle.
+ */
+extern size_t krk_collectYoung(void);
+
+/**
+ * @brief Stop here if another thread is waiting to collect garbage.
+ *
+ * Collections stop every other thread at a safe point before they start.
+ * The VM reaches safe points on its own when it allocates, calls, or jumps
+ * backwards; long-running C code that does neither may call this to let
+ * a collection requested by another thread go ahead.
+ */
+extern void krk_gcSafepoint(void);
+
+/**
+ * @brief Mark the start of a call that may block indefinitely.
+ *
+ * While a thread is blocked in a system call it can not reach a safe point,
+ * so it must tell the collector not to wait for it. Between this and
+ * @ref krk_endBlockingCall the thread must not allocate or modify any
+ * managed object, as a collection may be running at the same time. Objects
+ * the thread still holds on its stack are not moved and may be read.
+ */
+extern void krk_beginBlockingCall(void);
+
+/**
+ * @brief Mark the end of a call started with @ref krk_beginBlockingCall.
+ *
+ * Waits for any collection that is still running to finish.
+ */
+extern void krk_endBlockingCall(void);
+
+/**
+ * @brief Add an old object to the remembered set.
+ *
+ * Called by @ref krk_writeBarrier; should not generally be
+ * called directly.
+ *
+ * @param object The object to remember.
+ */
+extern void krk_rememberObject(KrkObj * object);
+
+/**
+ * @brief Note that a reference is about to be stored in @p object.
+ *
+ * Collections of the young generation do not scan old objects, so any
+ * C code that stores a reference into an existing list, dict, tuple,
+ * upvalue, or instance of a managed class must call this first, or the
+ * referenced object may be freed while still in use. Objects that can
+ * not reasonably be tracked this way should instead be passed to
+ * @ref krk_disableWriteBarrier.
+ *
+ * @param object The object being modified.
+ */
+static inline void krk_writeBarrier(KrkObj * object) {
+	if ((object->flags & (KRK_OBJ_FLAGS_OLD | KRK_OBJ_FLAGS_REMEMBERED)) == KRK_OBJ_FLAGS_OLD) {
+		krk_rememberObject(object);
+	}
+}
+
+/**
+ * @brief Mark an object as modified by code that does not use write barriers.
+ *
+ * The object will be scanned in every collection of the young generation
+ * until @ref krk_enableWriteBarrier is called.
+ *
+ * @param object The object to be modified without barriers.
+ */
+extern void krk_disableWriteBarrier(KrkObj * object);
+
+/**
+ * @brief Return an object to write barrier tracking.
+ *
+ * @param object An object previously passed to @ref krk_disableWriteBarrier
+ */
+extern void krk_enableWriteBarrier(KrkObj * object);
+
 /**
  * @brief During a GC scan cycle, mark a value as used.
  *
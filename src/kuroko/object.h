@@ -50,6 +50,7 @@ typedef struct KrkObj {
 #define KRK_OBJ_FLAGS_STRING_UCS1   0x0001
 #define KRK_OBJ_FLAGS_STRING_UCS2   0x0002
 #define KRK_OBJ_FLAGS_STRING_UCS4   0x0003
+#define KRK_OBJ_FLAGS_STRING_INTERNED 0x0004
 
 #define KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS 0x0001
 #define KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS  0x0002
@@ -66,6 +67,11 @@ typedef struct KrkObj {
 #define KRK_OBJ_FLAGS_IN_REPR       0x0020
 #define KRK_OBJ_FLAGS_IMMORTAL      0x0040
 #define KRK_OBJ_FLAGS_VALID_HASH    0x0080
+#define KRK_OBJ_FLAGS_OLD           0x0400
+#define KRK_OBJ_FLAGS_REMEMBERED    0x0800
+#define KRK_OBJ_FLAGS_NO_BARRIER    0x1000
+#define KRK_OBJ_FLAGS_PINNED        0x2000
+#define KRK_OBJ_FLAGS_VERIFIED      0x4000
 
 
 /**
@@ -117,7 +123,7 @@ typedef struct KrkUpvalue {
 	int location;                  /**< @brief Stack offset or -1 if closed */
 	KrkValue   closed;             /**< @brief Heap storage for closed value */
 	struct KrkUpvalue * next;      /**< @brief Invasive linked list pointer to next upvalue */
-	struct KrkThreadState * owner; /**< @brief The thread that owns the stack this upvalue belongs in */
+	struct KrkStackSegment * owner; /**< @brief The stack segment this upvalue belongs in */
 } KrkUpvalue;
 
 /**
@@ -134,6 +140,60 @@ typedef struct {
 } KrkLocalEntry;
 
 struct KrkInstance;
+struct KrkClass;
+
+/**
+ * @brief Number of receiver classes an inline cache remembers before giving up.
+ */
+#define KRK_INLINE_CACHE_WAYS 4
+
+/**
+ * @brief State of an attribute lookup inline cache.
+ */
+typedef enum {
+	KRK_INLINE_CACHE_EMPTY = 0,   /**< Nothing has been looked up yet. */
+	KRK_INLINE_CACHE_MONOMORPHIC, /**< One receiver class has been seen. */
+	KRK_INLINE_CACHE_POLYMORPHIC, /**< Up to @ref KRK_INLINE_CACHE_WAYS receiver classes have been seen. */
+	KRK_INLINE_CACHE_MEGAMORPHIC, /**< Too many classes; lookups go straight to the shared method cache. */
+} KrkInlineCacheState;
+
+/**
+ * @brief One resolved class attribute in an inline cache.
+ *
+ * An entry is valid only while the receiver class still has the
+ * @c cacheIndex it had when the entry was filled. Changes to a class's
+ * methods reset its index, so stale entries never match again.
+ */
+typedef struct {
+	size_t index;            /**< @brief @c cacheIndex of the receiver class */
+	struct KrkClass * owner; /**< @brief Class in the inheritance chain that provided @ref value, or NULL if none did */
+	KrkValue value;          /**< @brief Resolved class attribute */
+} KrkInlineCacheEntry;
+
+/**
+ * @brief Per-name attribute lookup cache for a code object.
+ */
+typedef struct {
+	uint8_t state;           /**< @brief @ref KrkInlineCacheState */
+	uint8_t count;           /**< @brief Number of valid entries, published with a release store after the entry is filled */
+	uint8_t filling;         /**< @brief Set while a thread is adding an entry */
+	size_t shapeKey;         /**< @brief Identifier of the last instance shape seen and the name's slot in it plus one, packed, or 0 */
+	KrkInlineCacheEntry entries[KRK_INLINE_CACHE_WAYS];
+	size_t quickShape;       /**< @brief Shape identifier and slot, packed, for a quickened slot load */
+	size_t quickClass;       /**< @brief @c cacheIndex of a class known to have no attribute of this name */
+} KrkInlineCache;
+
+/**
+ * @brief Where a keyword argument binds in a call to a code object.
+ *
+ * Argument names are interned, so a code object's bindings form an
+ * open-addressed table keyed on the identity of the name.
+ */
+typedef struct {
+	KrkString * name;        /**< @brief Parameter name, or NULL for an unused entry */
+	unsigned short slot;     /**< @brief Offset of the parameter from the first argument on the stack */
+	unsigned short index;    /**< @brief Position in @c positionalArgNames, or @c potentialPositionals plus position in @c keywordArgNames */
+} KrkArgumentBinding;
 
 /**
  * @brief Code object.
@@ -157,6 +217,10 @@ typedef struct {
 	size_t localNameCount;                 /**< @brief Number of entries in @ref localNames */
 	KrkLocalEntry * localNames;            /**< @brief Stores the names of local variables used in the function, for debugging */
 	KrkString * qualname;                  /**< @brief The dotted name of the function */
+	KrkInlineCache * inlineCaches;         /**< @brief Attribute lookup caches, one per constant, allocated on first use */
+	uint16_t * warmupCounters;             /**< @brief Execution counts for quickening, one per bytecode offset, allocated on first use */
+	KrkArgumentBinding * argumentPlan;     /**< @brief Keyword argument bindings, allocated on first call with keywords */
+	size_t argumentPlanSize;               /**< @brief Number of entries in @ref argumentPlan, a power of two */
 } KrkCodeObject;
 
 
@@ -179,6 +243,60 @@ typedef struct {
 
 typedef void (*KrkCleanupCallback)(struct KrkInstance *);
 
+/**
+ * @brief Contiguous bytes exposed by an object through the buffer protocol.
+ *
+ * @c buf is only valid while the exporting object is reachable and has not
+ * been resized; callers fill one of these immediately before use.
+ */
+typedef struct {
+	uint8_t * buf;  /**< @brief First byte of the exported memory */
+	size_t len;     /**< @brief Number of bytes at @ref buf */
+	int readonly;   /**< @brief Set if the memory must not be written through @ref buf */
+} KrkBuffer;
+
+/**
+ * @brief Buffer protocol export callback.
+ *
+ * Fills @p out with the memory of @p self. Returns 1 on success, or raises
+ * an exception and returns 0.
+ */
+typedef int (*KrkGetBufferCallback)(KrkValue self, KrkBuffer * out);
+
+/**
+ * @brief Maximum number of attributes an instance can hold in slots.
+ *
+ * Instances that grow past this fall back to storing attributes in a table.
+ */
+#define KRK_SHAPE_MAX_SLOTS 16
+
+/**
+ * @brief Maximum number of distinct transitions out of a single shape.
+ */
+#define KRK_SHAPE_MAX_TRANSITIONS 16
+
+/**
+ * @brief Attribute layout shared by instances of a class.
+ *
+ * Instances of classes built by managed code start out with their class's
+ * root shape and move along a tree of transitions as attributes are added,
+ * so instances that set the same attributes in the same order share a shape
+ * and keep their values in a compact slot array instead of a table.
+ *
+ * Each shape other than the root adds one attribute, @ref name, which
+ * is stored at slot @ref count - 1. Shapes are owned by their class and
+ * released along with it.
+ */
+typedef struct KrkShape {
+	struct KrkShape * parent;    /**< @brief Shape this one was derived from, or NULL for the root */
+	struct KrkShape * children;  /**< @brief First shape derived from this one */
+	struct KrkShape * sibling;   /**< @brief Next shape derived from the same parent */
+	struct KrkString * name;     /**< @brief Attribute added by this shape */
+	size_t count;                /**< @brief Number of attributes in this shape */
+	size_t childCount;           /**< @brief Number of shapes derived from this one */
+	size_t id;                   /**< @brief Unique identifier, used by inline caches */
+} KrkShape;
+
 /**
  * @brief Type object.
  * @extends KrkObj
@@ -242,6 +360,8 @@ typedef struct KrkClass {
 	KrkObj * _bool;
 
 	size_t cacheIndex;
+	KrkShape * shape;         /**< @brief Root shape for instances, or NULL if instances always use a table */
+	KrkGetBufferCallback _getbuffer; /**< @brief C function exporting the memory of an instance for the buffer protocol */
 } KrkClass;
 
 /**
@@ -251,11 +371,17 @@ typedef struct KrkClass {
  * Created by class initializers, instances are the standard type of objects
  * built by managed code. Not all objects are instances, but all instances are
  * objects, and all instances have well-defined class.
+ *
+ * Instances of classes with a root @ref KrkShape keep attributes added by
+ * managed code in @ref slots. C code that writes to @ref fields directly
+ * still works; such attributes are found after the slots.
  */
 typedef struct KrkInstance {
 	KrkObj obj;         /**< @protected @brief Base */
 	KrkClass * _class;  /**< @brief Type */
 	KrkTable fields;    /**< @brief Attributes table */
+	KrkShape * shape;   /**< @brief Layout of @ref slots, or NULL if all attributes are in @ref fields */
+	KrkValue * slots;   /**< @brief Attribute values, indexed according to @ref shape */
 } KrkInstance;
 
 /**
@@ -410,6 +536,74 @@ extern KrkString * krk_takeString(char * chars, size_t length);
  */
 extern KrkString * krk_takeStringVetted(char * chars, size_t length, size_t codesLength, KrkStringType type, uint32_t hash);
 
+/**
+ * @brief Like @ref krk_takeStringVetted but without interning the result.
+ * @memberof KrkString
+ *
+ * The new string is not entered into the interned string table and its hash
+ * is not calculated until it is first needed. Use this for temporaries such as
+ * the results of concatenation or slicing, which are rarely used as names.
+ * Uninterned strings still compare equal to, and hash the same as, interned
+ * strings with the same contents; @ref krk_internString can intern one later.
+ *
+ * @param chars C string to take ownership of, allocated with @c ALLOCATE.
+ * @param length Length of the C string.
+ * @param codesLength Length of the expected resulting KrkString in codepoints.
+ * @param type Compact type of the string, eg. UCS1, UCS2, UCS4... @see KrkStringType
+ */
+extern KrkString * krk_takeStringUninterned(char * chars, size_t length, size_t codesLength, KrkStringType type);
+
+/**
+ * @brief Like @ref krk_copyString but without interning the result.
+ * @memberof KrkString
+ *
+ * @param chars C string to copy; must be valid UTF-8.
+ * @param length Length of the C string.
+ * @return A new, uninterned, string object.
+ */
+extern KrkString * krk_copyStringUninterned(const char * chars, size_t length);
+
+/**
+ * @brief Like @ref krk_takeStringUninterned but checks the contents itself.
+ * @memberof KrkString
+ *
+ * Validates @p chars as UTF-8 and takes ownership of it without copying.
+ * If it is not valid, @p chars is freed, a @ref ValueError is raised, and
+ * an empty string is returned.
+ *
+ * @param chars C string to take ownership of, allocated with @c ALLOCATE with room for @p length + 1 bytes.
+ * @param length Length of the C string.
+ * @return A new, uninterned, string object.
+ */
+extern KrkString * krk_takeStringChecked(char * chars, size_t length);
+
+/**
+ * @brief Obtain the interned string with the same contents as @p string.
+ * @memberof KrkString
+ *
+ * If no string with these contents has been interned yet, @p string
+ * itself is interned and returned. Interned strings can be compared
+ * by identity, which is what attribute lookups and shapes rely on.
+ *
+ * @param string String to intern.
+ * @return The interned string.
+ */
+extern KrkString * krk_internString(KrkString * string);
+
+/**
+ * @brief Get the hash of a string, calculating it if it has not been yet.
+ * @memberof KrkString
+ */
+extern uint32_t krk_stringHash(KrkString * string);
+
+/**
+ * @brief Compare the contents of two strings.
+ * @memberof KrkString
+ *
+ * @return 1 if the strings are equal, 0 otherwise.
+ */
+extern int krk_stringsEqual(KrkString * a, KrkString * b);
+
 /**
  * @brief Obtain a string object representation of the given C string.
  * @memberof KrkString
@@ -592,6 +786,20 @@ extern KrkTuple *       krk_newTuple(size_t length);
  */
 extern KrkBytes *       krk_newBytes(size_t length, uint8_t * source);
 
+/**
+ * @brief Get the memory behind a bytes-like object.
+ *
+ * Works for any object whose class (or a base of it) provides a
+ * @c _getbuffer callback: @ref bytes, @ref bytearray, @ref memoryview,
+ * and types from C modules such as @c mmap.
+ *
+ * @param value    Object to export.
+ * @param out      Receives the pointer, length and read-only flag.
+ * @param writable If set, read-only buffers are rejected.
+ * @return 1 on success, 0 with a @ref TypeError (or other exception) set on failure.
+ */
+extern int krk_getBuffer(KrkValue value, KrkBuffer * out, int writable);
+
 #define krk_isObjType(v,t) (IS_OBJECT(v) && (AS_OBJECT(v)->type == (t)))
 #define OBJECT_TYPE(value) (AS_OBJECT(value)->type)
 #define IS_STRING(value)   krk_isObjType(value, KRK_OBJ_STRING)
@@ -24,11 +24,18 @@ typedef struct {
 
 /**
  * @brief Simple hash table of arbitrary keys to values.
+ *
+ * Entries are kept in insertion order in a dense array, followed in the
+ * same allocation by a sparse index of positions in that array. Deleted
+ * entries remain as tombstones (with @c KWARGS keys) until the table is
+ * next resized, so iterate over the first @c used entries and skip any
+ * with @c KWARGS keys.
  */
 typedef struct {
-	size_t count;
-	size_t capacity;
-	KrkTableEntry * entries;
+	size_t count;            /**< Number of live keys in the table */
+	size_t capacity;         /**< Number of entries the table has room for */
+	size_t used;             /**< Number of entries consumed, including tombstones */
+	KrkTableEntry * entries; /**< Entries in insertion order */
 } KrkTable;
 
 /**
@@ -132,7 +139,8 @@ extern int krk_tableGet_fast(KrkTable * table, struct KrkString * str, KrkValue
  * @memberof KrkTable
  *
  * Scans the table 'table' for the key 'key' and, if found, removes
- * the entry, replacing it with a tombstone value.
+ * the entry, replacing it with a tombstone value. The order of the
+ * remaining entries is not changed.
  *
  * @param table Table to delete from.
  * @param key   Key to delete.
@@ -145,7 +153,8 @@ extern int krk_tableDelete(KrkTable * table, KrkValue key);
  * @memberof KrkTable
  *
  * Scans the table 'table' for the key 'key' and, if found, removes
- * the entry, replacing it with a tombstone value.
+ * the entry, replacing it with a tombstone value. The order of the
+ * remaining entries is not changed.
  *
  * @param table Table to delete from.
  * @param key   Key to delete.
@@ -157,16 +166,14 @@ extern int krk_tableDeleteExact(KrkTable * table, KrkValue key);
  * @brief Internal table scan function.
  * @memberof KrkTable
  *
- * Scans through the the entry array 'entries' to find the appropriate entry
- * for 'key', return a pointer to the entry, which may be or may not have
- * an associated pair.
+ * Scans through the index of 'table' to find the entry for 'key'.
  *
- * @param entries  Table entry array to scan.
- * @param capacity Size of the table entry array, in entries.
- * @param key      Key to locate.
- * @return A pointer to the entry for 'key'.
+ * @param table Table to scan.
+ * @param key   Key to locate.
+ * @return A pointer to the entry for 'key', or NULL if it is not present
+ *         (or is unhashable, in which case an exception has been raised).
  */
-extern KrkTableEntry * krk_findEntry(KrkTableEntry * entries, size_t capacity, KrkValue key);
+extern KrkTableEntry * krk_findEntry(KrkTable * table, KrkValue key);
 
 /**
  * @brief Calculate the hash for a value.
@@ -184,10 +191,11 @@ extern int krk_hashValue(KrkValue value, uint32_t *hashOut);
  * @brief Preset the size of a table.
  * @memberof KrkTable
  *
- * Reserves space for a large table.
+ * Reserves space for a large table. Also discards any tombstones
+ * left by deleted entries.
  *
  * @param table Table to resize.
- * @param capacity Target capacity.
+ * @param capacity Minimum number of entries to make room for.
  */
 extern void krk_tableAdjustCapacity(KrkTable * table, size_t capacity);
 
@@ -177,7 +177,8 @@ void krk_pushStringBuilderStr(struct StringBuilder * sb, const char *str, size_t
  *
  * Creates a string object from the contents of the string builder and
  * frees the space allocated for the builder, returning a value representing
- * the newly created string object.
+ * the newly created string object. The result is not interned; pass it
+ * through @ref krk_internString if it will be used as a name.
  *
  * @param sb String builder to finalize.
  * @return A value representing a string object.
@@ -31,6 +31,15 @@
  */
 #define KRK_THREAD_SCRATCH_SIZE 3
 
+/**
+ * @def KRK_SLAB_CLASSES
+ * @brief Number of size classes of object slots, each 16 bytes larger than the last.
+ *
+ * Objects of up to 16 times this many bytes are allocated from pages of
+ * same-sized slots; each thread keeps a few free slots of every class.
+ */
+#define KRK_SLAB_CLASSES 16
+
 /**
  * @brief Represents a managed call state in a VM thread.
  *
@@ -147,8 +156,30 @@ struct BaseClasses {
 	KrkClass * LockClass;            /**< Threading.Lock */
 	KrkClass * CompilerStateClass;   /**< Compiler global state */
 	KrkClass * CellClass;            /**< Upvalue cell */
+	KrkClass * memoryviewClass;      /**< View of the memory of a bytes-like object */
 };
 
+/**
+ * @brief A stack a thread can run on.
+ *
+ * Every thread starts on its own base segment. Generators and coroutines
+ * carry a segment of their own, which the thread switches to while they
+ * run, so suspending and resuming them does not copy their stack.
+ *
+ * While a segment is current, its live state is in the thread's registers
+ * (@c stack, @c stackTop, @c openUpvalues ...) and only @c stack and
+ * @c stackSize are kept up to date here; the rest is written back when
+ * the thread switches away from it.
+ */
+typedef struct KrkStackSegment {
+	KrkValue * stack;              /**< Bottom of this segment's stack. */
+	KrkValue * stackTop;           /**< Top of the stack, while not current. */
+	size_t stackSize;              /**< Size of the allocated stack space. */
+	KrkUpvalue * openUpvalues;     /**< Unclosed upvalues in this segment, while not current. */
+	struct KrkStackSegment * outer; /**< Segment that was current before this one was entered. */
+	size_t frameBase;              /**< Index of the first call frame running on this segment. */
+} KrkStackSegment;
+
 /**
  * @brief Execution state of a VM thread.
  *
@@ -173,8 +204,18 @@ typedef struct KrkThreadState {
 	KrkValue currentException; /**< When an exception is thrown, it is stored here. */
 	int flags;                 /**< Thread-local VM flags; each thread inherits the low byte of the global VM flags. */
 	KrkValue * stackMax;       /**< End of allocated stack space. */
+	KrkStackSegment * segment; /**< The stack segment currently in use. */
+	KrkStackSegment baseSegment; /**< The thread's own stack segment. */
 
 	KrkValue scratchSpace[KRK_THREAD_SCRATCH_SIZE]; /**< A place to store a few values to keep them from being prematurely GC'd. */
+	KrkObj * slabCache[KRK_SLAB_CLASSES];           /**< Free object slots reserved by this thread, by size class. */
+
+	ssize_t pendingBytes;      /**< Bytes allocated (or freed, if negative) by this thread not yet added to @c vm.bytesAllocated */
+	int noSafepoint;           /**< While nonzero, this thread holds a lock other threads may spin on and must not stop for a collection. */
+	int inBlockingCall;        /**< Set between @ref krk_beginBlockingCall and @ref krk_endBlockingCall */
+	size_t statAllocated;      /**< Total bytes allocated by this thread. */
+	size_t statCollections;    /**< Number of collections run by this thread. */
+	size_t statStops;          /**< Number of times this thread was stopped for a collection run by another thread. */
 } KrkThreadState;
 
 /**
@@ -197,12 +238,17 @@ typedef struct KrkVM {
 	struct Exceptions * exceptions;   /**< Pointer to a (static) namespacing struct for the KrkClass*'s of basic exception types */
 
 	/* Garbage collector state */
-	KrkObj * objects;                 /**< Linked list of all objects in the GC */
+	KrkObj * objects;                 /**< Linked list of old objects too large for the object slabs */
 	size_t bytesAllocated;            /**< Running total of bytes allocated */
 	size_t nextGC;                    /**< Point at which we should sweep again */
 	size_t grayCount;                 /**< Count of objects marked by scan. */
 	size_t grayCapacity;              /**< How many objects we can fit in the scan list. */
 	KrkObj** grayStack;               /**< Scan list */
+	KrkObj * youngObjects;            /**< Linked list of objects that have not survived a collection */
+	size_t nextMajorGC;               /**< Point at which the next collection should be a full one */
+	size_t rememberedCount;           /**< Count of old objects in the remembered set */
+	size_t rememberedCapacity;        /**< How many objects we can fit in the remembered set. */
+	KrkObj** remembered;              /**< Old objects that may reference young objects */
 
 	KrkThreadState * threads;         /**< Invasive linked list of all VM threads. */
 	FILE * callgrindFile;             /**< File to write unprocessed callgrind data to. */
@@ -218,6 +264,7 @@ typedef struct KrkVM {
 #define KRK_THREAD_SINGLE_STEP         (1 << 4)
 #define KRK_THREAD_SIGNALLED           (1 << 5)
 #define KRK_THREAD_DEFER_STACK_FREE    (1 << 6)
+#define KRK_THREAD_SAFEPOINT           (1 << 7)
 
 /* Global flags */
 #define KRK_GLOBAL_ENABLE_STRESS_GC    (1 << 8)
@@ -227,6 +274,8 @@ typedef struct KrkVM {
 #define KRK_GLOBAL_REPORT_GC_COLLECTS  (1 << 12)
 #define KRK_GLOBAL_THREADS             (1 << 13)
 #define KRK_GLOBAL_NO_DEFAULT_MODULES  (1 << 14)
+#define KRK_GLOBAL_NO_WRITE_BYTECODE   (1 << 15)
+#define KRK_GLOBAL_OPTIMIZE            (1 << 16)
 
 #ifndef KRK_DISABLE_THREADS
 #  define threadLocal __thread
@@ -887,6 +936,27 @@ extern void krk_addObjects(void);
  */
 extern KrkValue krk_operator_lt(KrkValue,KrkValue);
 
+/**
+ * @brief Add two values, as with the binary @c + operator.
+ *
+ * This is equivalent to the opcode instruction OP_ADD.
+ */
+extern KrkValue krk_operator_add(KrkValue,KrkValue);
+
+/**
+ * @brief Subtract the right value from the left, as with the binary @c - operator.
+ *
+ * This is equivalent to the opcode instruction OP_SUBTRACT.
+ */
+extern KrkValue krk_operator_sub(KrkValue,KrkValue);
+
+/**
+ * @brief Raise the left value to the power of the right value.
+ *
+ * This is equivalent to the opcode instruction OP_POW.
+ */
+extern KrkValue krk_operator_pow(KrkValue,KrkValue);
+
 /**
  * @brief Compare to values, returning @ref True if the left is greater than the right.
  *
@@ -953,7 +1023,7 @@ extern KrkValue krk_instanceSetAttribute_wrapper(KrkValue owner, KrkString * nam
  * this function to be used in context where a default value is desired, but note
  * that exceptions may be raised \__getattr__ methods or by descriptor \__get__ methods.
  *
- * @param name Name of the attribute to look up.
+ * @param name Name of the attribute to look up; must be an interned string.
  * @return 1 if the attribute was found, 0 otherwise.
  */
 extern int krk_getAttribute(KrkString * name);
@@ -970,7 +1040,7 @@ extern int krk_getAttribute(KrkString * name);
  * though exceptions may still be raised by \__setattr__ methods or descriptor
  * \__set__ methods.
  *
- * @param name Name of the attribute to set.
+ * @param name Name of the attribute to set; must be an interned string.
  * @return 1 if the attribute could be set, 0 otherwise.
  */
 extern int krk_setAttribute(KrkString * name);
@@ -985,7 +1055,7 @@ extern int krk_setAttribute(KrkString * name);
  *
  * @warning Currently, no \__delattr__ mechanism is available.
  *
- * @param name Name of the attribute to delete.
+ * @param name Name of the attribute to delete; must be an interned string.
  * @return 1 if the attribute was found and can be deleted, 0 otherwise.
  */
 extern int krk_delAttribute(KrkString * name);
@@ -0,0 +1,570 @@
+/**
+ * @file marshal.c
+ * @brief Serialization of compiled code objects.
+ *
+ * Implements the KRKB format shared by krk-compile and the module
+ * importer's bytecode cache. A file consists of a header, a table of
+ * every string referenced by any code object, and then each code object
+ * in turn, with the module body first. Code objects refer to strings and
+ * to each other by their index in those tables.
+ *
+ * All values are stored in host byte order; the format is meant for
+ * caches and prebuilt modules on the machine that produced them, and
+ * the header's opcode fingerprint already ties it to a single build.
+ */
+#include <string.h>
+#include <kuroko/vm.h>
+#include <kuroko/memory.h>
+#include <kuroko/compiler.h>
+#include <kuroko/util.h>
+
+#include "private.h"
+
+/**
+ * Bump this whenever the layout below, or the meaning of any
+ * instruction operand emitted by the compiler, changes.
+ */
+#define KRK_MARSHAL_VERSION 2
+
+/* Only the low bits of a code object's flags describe the code; the rest are GC state. */
+#define KRK_OBJ_FLAGS_CODEOBJECT_MASK 0x000F
+
+struct MarshalHeader {
+	uint8_t  magic[4];     /* K R K B */
+	uint32_t version;      /* KRK_MARSHAL_VERSION */
+	uint32_t opcodes;      /* Fingerprint of the opcode table */
+	uint32_t reserved;
+	uint64_t sourceMtime;
+	uint64_t sourceSize;
+} __attribute__((packed));
+
+struct FunctionHeader {
+	uint32_t nameInd;
+	uint32_t docInd;
+	uint32_t qualInd;
+	uint16_t reqArgs;
+	uint16_t kwArgs;
+	uint16_t posArgs;
+	uint16_t flags;
+	uint32_t upvalues;
+	uint32_t locals;
+	uint32_t bcSize;
+	uint32_t lmSize;
+	uint32_t ctSize;
+} __attribute__((packed));
+
+struct LocalEntry {
+	uint32_t id;
+	uint32_t birthday;
+	uint32_t deathday;
+} __attribute__((packed));
+
+struct LineMapEntry {
+	uint32_t startOffset;
+	uint32_t line;
+} __attribute__((packed));
+
+#define NO_STRING UINT32_MAX
+
+/**
+ * Opcode values are not stable between builds, so rather than trusting
+ * ourselves to bump the version whenever opcodes.h is edited, the header
+ * carries a hash of the opcode names in table order.
+ */
+static uint32_t opcodeFingerprint(void) {
+	static uint32_t fingerprint = 0;
+	if (fingerprint) return fingerprint;
+	static const char names[] =
+#define OPCODE(opc)         #opc " "
+#define SIMPLE(opc)         OPCODE(opc)
+#define CONSTANT(opc,more)  OPCODE(opc) OPCODE(opc ## _LONG)
+#define OPERAND(opc,more)   OPCODE(opc) OPCODE(opc ## _LONG)
+#define JUMP(opc,sign)      OPCODE(opc)
+#define FUSED(opc,kinds)    OPCODE(opc)
+#define QUICK(opc,generic)  OPCODE(opc)
+#include "opcodes.h"
+#undef SIMPLE
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+#undef FUSED
+#undef QUICK
+#undef OPCODE
+	;
+	uint32_t hash = 2166136261u;
+	for (const char * c = names; *c; ++c) {
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	}
+	fingerprint = hash | 1;
+	return fingerprint;
+}
+
+struct MarshalWriter {
+	FILE * out;
+	KrkTable stringIndex;
+	KrkValueArray strings;
+	KrkTable functionIndex;
+	KrkValueArray functions;
+};
+
+static uint32_t writerString(struct MarshalWriter * w, KrkString * str) {
+	KrkValue index;
+	if (krk_tableGet_fast(&w->stringIndex, str, &index)) return AS_INTEGER(index);
+	krk_writeValueArray(&w->strings, OBJECT_VAL(str));
+	krk_tableSet(&w->stringIndex, OBJECT_VAL(str), INTEGER_VAL(w->strings.count - 1));
+	return w->strings.count - 1;
+}
+
+static uint32_t writerFunction(struct MarshalWriter * w, KrkCodeObject * func) {
+	KrkValue index;
+	if (krk_tableGet(&w->functionIndex, OBJECT_VAL(func), &index)) return AS_INTEGER(index);
+	krk_writeValueArray(&w->functions, OBJECT_VAL(func));
+	krk_tableSet(&w->functionIndex, OBJECT_VAL(func), INTEGER_VAL(w->functions.count - 1));
+	return w->functions.count - 1;
+}
+
+static size_t argNameCount(KrkCodeObject * func, int keyword) {
+	if (keyword) return func->keywordArgs + !!(func->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS);
+	return func->potentialPositionals + !!(func->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS);
+}
+
+/**
+ * Walk every code object reachable from the module body through its
+ * constants, assigning indexes to functions and strings.
+ */
+static void collectTables(struct MarshalWriter * w, KrkCodeObject * code) {
+	writerFunction(w, code);
+	for (size_t f = 0; f < w->functions.count; ++f) {
+		KrkCodeObject * func = AS_codeobject(w->functions.values[f]);
+		if (func->name) writerString(w, func->name);
+		if (func->docstring) writerString(w, func->docstring);
+		if (func->qualname) writerString(w, func->qualname);
+		for (size_t i = 0; i < argNameCount(func, 0); ++i) writerString(w, AS_STRING(func->positionalArgNames.values[i]));
+		for (size_t i = 0; i < argNameCount(func, 1); ++i) writerString(w, AS_STRING(func->keywordArgNames.values[i]));
+		for (size_t i = 0; i < func->localNameCount; ++i) writerString(w, func->localNames[i].name);
+		for (size_t i = 0; i < func->chunk.constants.count; ++i) {
+			KrkValue value = func->chunk.constants.values[i];
+			if (IS_STRING(value)) writerString(w, AS_STRING(value));
+			else if (IS_codeobject(value)) writerFunction(w, AS_codeobject(value));
+		}
+	}
+}
+
+static void writeU8(struct MarshalWriter * w, uint8_t val) {
+	fwrite(&val, 1, 1, w->out);
+}
+
+static void writeU32(struct MarshalWriter * w, uint32_t val) {
+	fwrite(&val, 1, sizeof(uint32_t), w->out);
+}
+
+static void writeIndex(struct MarshalWriter * w, char shortTag, char longTag, uint32_t index) {
+	if (index < 256) {
+		writeU8(w, shortTag);
+		writeU8(w, index);
+	} else {
+		writeU8(w, longTag);
+		writeU32(w, index);
+	}
+}
+
+static int writeConstant(struct MarshalWriter * w, KrkValue value) {
+	switch (KRK_VAL_TYPE(value)) {
+		case KRK_VAL_INTEGER: {
+			krk_integer_type i = AS_INTEGER(value);
+			if (i >= 0 && i < 256) {
+				writeU8(w, 'i');
+				writeU8(w, i);
+			} else {
+				int64_t val = i;
+				writeU8(w, 'I');
+				fwrite(&val, 1, sizeof(int64_t), w->out);
+			}
+			return 0;
+		}
+		case KRK_VAL_BOOLEAN:
+			writeU8(w, 'o');
+			writeU8(w, AS_BOOLEAN(value));
+			return 0;
+		case KRK_VAL_NONE:
+			writeU8(w, 'N');
+			return 0;
+		case KRK_VAL_KWARGS:
+			writeU8(w, 'k');
+			writeU32(w, AS_INTEGER(value));
+			return 0;
+		case KRK_VAL_OBJECT:
+			switch (AS_OBJECT(value)->type) {
+				case KRK_OBJ_STRING:
+					writeIndex(w, 's', 'S', writerString(w, AS_STRING(value)));
+					return 0;
+				case KRK_OBJ_CODEOBJECT:
+					writeIndex(w, 'f', 'F', writerFunction(w, AS_codeobject(value)));
+					return 0;
+				case KRK_OBJ_BYTES: {
+					KrkBytes * bytes = AS_BYTES(value);
+					writeU8(w, 'B');
+					writeU32(w, bytes->length);
+					/* Empty bytes objects have no buffer at all. */
+					if (bytes->length) fwrite(bytes->bytes, 1, bytes->length, w->out);
+					return 0;
+				}
+				case KRK_OBJ_INSTANCE:
+					if (krk_isInstanceOf(value, vm.baseClasses->longClass)) {
+						KrkValue repr = krk_stringFromFormat("%R", value);
+						if (!IS_STRING(repr)) return 1;
+						krk_push(repr);
+						writeU8(w, 'L');
+						writeU32(w, AS_STRING(repr)->length);
+						fwrite(AS_CSTRING(repr), 1, AS_STRING(repr)->length, w->out);
+						krk_pop();
+						return 0;
+					}
+					return 1;
+				default:
+					return 1;
+			}
+		default:
+#ifndef KRK_NO_FLOAT
+			if (IS_FLOATING(value)) {
+				double val = AS_FLOATING(value);
+				writeU8(w, 'd');
+				fwrite(&val, 1, sizeof(double), w->out);
+				return 0;
+			}
+#endif
+			return 1;
+	}
+}
+
+static int writeFunction(struct MarshalWriter * w, KrkCodeObject * func) {
+	struct FunctionHeader header = {
+		func->name ? writerString(w, func->name) : NO_STRING,
+		func->docstring ? writerString(w, func->docstring) : NO_STRING,
+		func->qualname ? writerString(w, func->qualname) : NO_STRING,
+		func->requiredArgs,
+		func->keywordArgs,
+		func->potentialPositionals,
+		func->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_MASK,
+		func->upvalueCount,
+		func->localNameCount,
+		func->chunk.count,
+		func->chunk.linesCount,
+		func->chunk.constants.count,
+	};
+	fwrite(&header, 1, sizeof(header), w->out);
+
+	for (size_t i = 0; i < argNameCount(func, 0); ++i) writeU32(w, writerString(w, AS_STRING(func->positionalArgNames.values[i])));
+	for (size_t i = 0; i < argNameCount(func, 1); ++i) writeU32(w, writerString(w, AS_STRING(func->keywordArgNames.values[i])));
+
+	for (size_t i = 0; i < func->localNameCount; ++i) {
+		struct LocalEntry entry = {
+			func->localNames[i].id,
+			func->localNames[i].birthday,
+			func->localNames[i].deathday,
+		};
+		fwrite(&entry, 1, sizeof(entry), w->out);
+		writeU32(w, writerString(w, func->localNames[i].name));
+	}
+
+	/* Modules are written as soon as they are compiled, before anything
+	 * has run long enough to be quickened, so this is always generic code. */
+	fwrite(func->chunk.code, 1, func->chunk.count, w->out);
+
+	for (size_t i = 0; i < func->chunk.linesCount; ++i) {
+		struct LineMapEntry entry = {
+			func->chunk.lines[i].startOffset,
+			func->chunk.lines[i].line,
+		};
+		fwrite(&entry, 1, sizeof(entry), w->out);
+	}
+
+	for (size_t i = 0; i < func->chunk.constants.count; ++i) {
+		if (writeConstant(w, func->chunk.constants.values[i])) return 1;
+	}
+
+	return 0;
+}
+
+int krk_marshalCode(KrkCodeObject * code, FILE * out, const KrkSourceStamp * source) {
+	struct MarshalWriter w;
+	w.out = out;
+	krk_initTable(&w.stringIndex);
+	krk_initValueArray(&w.strings);
+	krk_initTable(&w.functionIndex);
+	krk_initValueArray(&w.functions);
+
+	collectTables(&w, code);
+
+	struct MarshalHeader header = {
+		{'K','R','K','B'},
+		KRK_MARSHAL_VERSION,
+		opcodeFingerprint(),
+		0,
+		source ? source->mtime : 0,
+		source ? source->size : 0,
+	};
+	fwrite(&header, 1, sizeof(header), out);
+
+	writeU32(&w, w.strings.count);
+	for (size_t i = 0; i < w.strings.count; ++i) {
+		KrkString * str = AS_STRING(w.strings.values[i]);
+		writeU32(&w, str->length);
+		fwrite(str->chars, 1, str->length, out);
+	}
+
+	int result = 0;
+	writeU32(&w, w.functions.count);
+	for (size_t i = 0; i < w.functions.count && !result; ++i) {
+		result = writeFunction(&w, AS_codeobject(w.functions.values[i]));
+	}
+
+	krk_freeTable(&w.stringIndex);
+	krk_freeValueArray(&w.strings);
+	krk_freeTable(&w.functionIndex);
+	krk_freeValueArray(&w.functions);
+
+	return result || ferror(out);
+}
+
+struct MarshalReader {
+	const uint8_t * data;
+	size_t length;
+	size_t offset;
+	KrkTuple * strings;
+	KrkTuple * functions;
+};
+
+static int readBytes(struct MarshalReader * r, void * out, size_t size) {
+	if (r->length - r->offset < size) return 1;
+	memcpy(out, r->data + r->offset, size);
+	r->offset += size;
+	return 0;
+}
+
+static int readU8(struct MarshalReader * r, uint8_t * out) {
+	return readBytes(r, out, 1);
+}
+
+static int readU32(struct MarshalReader * r, uint32_t * out) {
+	return readBytes(r, out, sizeof(uint32_t));
+}
+
+static int readString(struct MarshalReader * r, uint32_t index, KrkString ** out) {
+	if (index == NO_STRING) {
+		*out = NULL;
+		return 0;
+	}
+	if (index >= r->strings->values.count) return 1;
+	*out = AS_STRING(r->strings->values.values[index]);
+	return 0;
+}
+
+static int readStringRef(struct MarshalReader * r, KrkString ** out) {
+	uint32_t index;
+	return readU32(r, &index) || index == NO_STRING || readString(r, index, out);
+}
+
+static int readIndex(struct MarshalReader * r, uint8_t tag, char shortTag, uint32_t * out) {
+	if (tag == shortTag) {
+		uint8_t index;
+		if (readU8(r, &index)) return 1;
+		*out = index;
+		return 0;
+	}
+	return readU32(r, out);
+}
+
+static int readConstant(struct MarshalReader * r, KrkValue * out) {
+	uint8_t tag;
+	if (readU8(r, &tag)) return 1;
+	switch (tag) {
+		case 'i': {
+			uint8_t val;
+			if (readU8(r, &val)) return 1;
+			*out = INTEGER_VAL(val);
+			return 0;
+		}
+		case 'I': {
+			int64_t val;
+			if (readBytes(r, &val, sizeof(int64_t))) return 1;
+			*out = INTEGER_VAL(val);
+			return 0;
+		}
+		case 'o': {
+			uint8_t val;
+			if (readU8(r, &val)) return 1;
+			*out = BOOLEAN_VAL(val);
+			return 0;
+		}
+		case 'N':
+			*out = NONE_VAL();
+			return 0;
+		case 'k': {
+			uint32_t val;
+			if (readU32(r, &val)) return 1;
+			*out = KWARGS_VAL(val);
+			return 0;
+		}
+		case 's':
+		case 'S': {
+			uint32_t index;
+			KrkString * str;
+			if (readIndex(r, tag, 's', &index) || index == NO_STRING || readString(r, index, &str)) return 1;
+			*out = OBJECT_VAL(str);
+			return 0;
+		}
+		case 'f':
+		case 'F': {
+			uint32_t index;
+			if (readIndex(r, tag, 'f', &index) || index >= r->functions->values.count) return 1;
+			*out = r->functions->values.values[index];
+			return 0;
+		}
+		case 'B': {
+			uint32_t length;
+			if (readU32(r, &length) || r->length - r->offset < length) return 1;
+			*out = OBJECT_VAL(krk_newBytes(length, (uint8_t*)r->data + r->offset));
+			r->offset += length;
+			return 0;
+		}
+		case 'L': {
+			uint32_t length;
+			if (readU32(r, &length) || r->length - r->offset < length) return 1;
+			*out = krk_parse_int((const char*)r->data + r->offset, length, 10);
+			r->offset += length;
+			return IS_NONE(*out);
+		}
+#ifndef KRK_NO_FLOAT
+		case 'd': {
+			double val;
+			if (readBytes(r, &val, sizeof(double))) return 1;
+			*out = FLOATING_VAL(val);
+			return 0;
+		}
+#endif
+		default:
+			return 1;
+	}
+}
+
+static int readFunction(struct MarshalReader * r, KrkCodeObject * self, KrkString * fileName) {
+	struct FunctionHeader function;
+	if (readBytes(r, &function, sizeof(function))) return 1;
+
+	if (readString(r, function.nameInd, &self->name)) return 1;
+	if (readString(r, function.docInd, &self->docstring)) return 1;
+	if (readString(r, function.qualInd, &self->qualname)) return 1;
+
+	self->requiredArgs = function.reqArgs;
+	self->keywordArgs = function.kwArgs;
+	self->potentialPositionals = function.posArgs;
+	self->obj.flags |= function.flags & KRK_OBJ_FLAGS_CODEOBJECT_MASK;
+	self->upvalueCount = function.upvalues;
+	self->totalArguments = argNameCount(self, 0) + argNameCount(self, 1);
+	self->chunk.filename = fileName;
+
+	for (size_t i = 0; i < argNameCount(self, 0); ++i) {
+		KrkString * name;
+		if (readStringRef(r, &name)) return 1;
+		krk_writeValueArray(&self->positionalArgNames, OBJECT_VAL(name));
+	}
+
+	for (size_t i = 0; i < argNameCount(self, 1); ++i) {
+		KrkString * name;
+		if (readStringRef(r, &name)) return 1;
+		krk_writeValueArray(&self->keywordArgNames, OBJECT_VAL(name));
+	}
+
+	if (function.locals > (r->length - r->offset) / sizeof(struct LocalEntry)) return 1;
+	self->localNames = ALLOCATE(KrkLocalEntry, function.locals);
+	if (function.locals) memset(self->localNames, 0, sizeof(KrkLocalEntry) * function.locals);
+	self->localNameCapacity = function.locals;
+	self->localNameCount = function.locals;
+	for (size_t i = 0; i < function.locals; ++i) {
+		struct LocalEntry entry;
+		KrkString * name;
+		if (readBytes(r, &entry, sizeof(entry)) || readStringRef(r, &name)) return 1;
+		self->localNames[i] = (KrkLocalEntry){entry.id, entry.birthday, entry.deathday, name};
+	}
+
+	if (function.bcSize > r->length - r->offset) return 1;
+	self->chunk.code = ALLOCATE(uint8_t, function.bcSize);
+	self->chunk.capacity = function.bcSize;
+	readBytes(r, self->chunk.code, function.bcSize);
+	self->chunk.count = function.bcSize;
+
+	if (function.lmSize > (r->length - r->offset) / sizeof(struct LineMapEntry)) return 1;
+	self->chunk.lines = ALLOCATE(KrkLineMap, function.lmSize);
+	self->chunk.linesCapacity = function.lmSize;
+	for (size_t i = 0; i < function.lmSize; ++i) {
+		struct LineMapEntry entry;
+		readBytes(r, &entry, sizeof(entry));
+		self->chunk.lines[i] = (KrkLineMap){entry.startOffset, entry.line};
+	}
+	self->chunk.linesCount = function.lmSize;
+
+	for (size_t i = 0; i < function.ctSize; ++i) {
+		KrkValue value;
+		if (readConstant(r, &value)) return 1;
+		krk_push(value);
+		krk_writeValueArray(&self->chunk.constants, value);
+		krk_pop();
+	}
+
+	return 0;
+}
+
+KrkCodeObject * krk_unmarshalCode(const void * data, size_t length, KrkString * fileName, const KrkSourceStamp * source) {
+	struct MarshalReader r = { data, length, 0, NULL, NULL };
+
+	struct MarshalHeader header;
+	if (readBytes(&r, &header, sizeof(header))) return NULL;
+	if (memcmp(header.magic, "KRKB", 4)) return NULL;
+	if (header.version != KRK_MARSHAL_VERSION || header.opcodes != opcodeFingerprint()) return NULL;
+	if (source && (header.sourceMtime != source->mtime || header.sourceSize != source->size)) return NULL;
+
+	/* Both tables stay on the stack until every code object is linked to the module body. */
+	uint32_t stringCount;
+	if (readU32(&r, &stringCount) || stringCount > (r.length - r.offset) / sizeof(uint32_t)) return NULL;
+	r.strings = krk_newTuple(stringCount);
+	krk_push(OBJECT_VAL(r.strings));
+
+	for (size_t i = 0; i < stringCount; ++i) {
+		uint32_t strLen;
+		if (readU32(&r, &strLen) || r.length - r.offset < strLen) goto _error;
+		r.strings->values.values[r.strings->values.count++] =
+			OBJECT_VAL(krk_copyString((const char*)r.data + r.offset, strLen));
+		r.offset += strLen;
+	}
+
+	uint32_t functionCount;
+	if (readU32(&r, &functionCount) || !functionCount ||
+	    functionCount > (r.length - r.offset) / sizeof(struct FunctionHeader)) goto _error;
+	r.functions = krk_newTuple(functionCount);
+	krk_push(OBJECT_VAL(r.functions));
+
+	for (size_t i = 0; i < functionCount; ++i) {
+		r.functions->values.values[r.functions->values.count++] = OBJECT_VAL(krk_newCodeObject());
+	}
+
+	for (size_t i = 0; i < functionCount; ++i) {
+		if (readFunction(&r, AS_codeobject(r.functions->values.values[i]), fileName)) goto _error;
+	}
+
+	if (r.offset != r.length) goto _error;
+
+	for (size_t i = 0; i < functionCount; ++i) {
+		krk_enableWriteBarrier(AS_OBJECT(r.functions->values.values[i]));
+	}
+
+	KrkCodeObject * out = AS_codeobject(r.functions->values.values[0]);
+	krk_pop();
+	krk_pop();
+	return out;
+
+_error:
+	if (r.functions) krk_pop();
+	krk_pop();
+	return NULL;
+}
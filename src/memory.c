@@ -4,6 +4,7 @@
 #include <kuroko/compiler.h>
 #include <kuroko/table.h>
 #include <kuroko/util.h>
+#include <kuroko/threads.h>
 
 #include "private.h"
 
@@ -143,29 +144,196 @@ static int _debug_mem_has(const void *ptr) {
 }
 #endif
 
+/**
+ * Allocation accounting
+ *
+ * Threads count the bytes they allocate and free in their own state, and
+ * only add them to the shared vm.bytesAllocated once the count passes
+ * KRK_GC_ALLOCATION_BUFFER, so that they do not all contend on one counter.
+ * Collections stop every thread and fold their counts in before starting.
+ */
+#define KRK_GC_ALLOCATION_BUFFER (64 * 1024)
+
+static inline void countBytes(size_t old, size_t new) {
+	krk_currentThread.pendingBytes += (ssize_t)new - (ssize_t)old;
+	if (new > old) krk_currentThread.statAllocated += new - old;
+}
+
+static void foldPendingBytes(void) {
+	for (KrkThreadState * thread = vm.threads; thread; thread = thread->next) {
+		vm.bytesAllocated += thread->pendingBytes;
+		thread->pendingBytes = 0;
+	}
+}
+
 void krk_gcTakeBytes(const void * ptr, size_t size) {
 #if defined(KRK_EXTENSIVE_MEMORY_DEBUGGING)
 	_debug_mem_set(ptr, size);
 #endif
 
-	vm.bytesAllocated += size;
+	countBytes(0, size);
 }
 
-void * krk_reallocate(void * ptr, size_t old, size_t new) {
+/**
+ * Safe points
+ *
+ * Any thread may start a collection, but every other thread must first be
+ * stopped somewhere it is not in the middle of modifying the heap. The
+ * collecting thread raises KRK_THREAD_SAFEPOINT on the others and waits
+ * until none of them is still running; threads notice the flag when they
+ * allocate and wherever the interpreter checks for signals, and wait for
+ * the collection to finish. Threads blocked in system calls are already
+ * stopped, as far as the collector is concerned: they are not counted as
+ * running between krk_beginBlockingCall and krk_endBlockingCall.
+ *
+ * Until a second thread is started, none of this is needed and the
+ * single thread collects directly.
+ */
+#ifndef KRK_DISABLE_THREADS
+static pthread_mutex_t _worldLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  _worldCond = PTHREAD_COND_INITIALIZER;
+static int stopRequested = 0;
+static size_t runningThreads = 1;
 
-	vm.bytesAllocated -= old;
-	vm.bytesAllocated += new;
+/* Called with _worldLock held. */
+static void parkThread(void) {
+	runningThreads--;
+	krk_currentThread.statStops++;
+	pthread_cond_broadcast(&_worldCond);
+	while (stopRequested) pthread_cond_wait(&_worldCond, &_worldLock);
+	runningThreads++;
+}
 
-	if (new > old && ptr != krk_currentThread.stack && &krk_currentThread == vm.threads && !(vm.globalFlags & KRK_GLOBAL_GC_PAUSED)) {
-#ifndef KRK_NO_STRESS_GC
-		if (vm.globalFlags & KRK_GLOBAL_ENABLE_STRESS_GC) {
-			krk_collectGarbage();
+static void stopTheWorld(void) {
+	if (!(vm.globalFlags & KRK_GLOBAL_THREADS)) return;
+	pthread_mutex_lock(&_worldLock);
+	while (stopRequested) parkThread();
+	stopRequested = 1;
+	runningThreads--;
+	while (runningThreads) {
+		/*
+		 * Threads update their own flags without atomics, which can lose
+		 * our bit, so it is raised again every time we wake up.
+		 */
+		for (KrkThreadState * thread = vm.threads; thread; thread = thread->next) {
+			if (thread != &krk_currentThread) __atomic_or_fetch(&thread->flags, KRK_THREAD_SAFEPOINT, __ATOMIC_SEQ_CST);
 		}
-#endif
-		if (vm.bytesAllocated > vm.nextGC) {
-			krk_collectGarbage();
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += 1000000;
+		if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+		pthread_cond_timedwait(&_worldCond, &_worldLock, &deadline);
+	}
+	pthread_mutex_unlock(&_worldLock);
+}
+
+static void resumeTheWorld(void) {
+	if (!(vm.globalFlags & KRK_GLOBAL_THREADS)) return;
+	pthread_mutex_lock(&_worldLock);
+	stopRequested = 0;
+	runningThreads++;
+	pthread_cond_broadcast(&_worldCond);
+	pthread_mutex_unlock(&_worldLock);
+}
+
+void krk_gcSafepoint(void) {
+	__atomic_and_fetch(&krk_currentThread.flags, ~KRK_THREAD_SAFEPOINT, __ATOMIC_SEQ_CST);
+	if (krk_currentThread.noSafepoint || krk_currentThread.inBlockingCall) return;
+	pthread_mutex_lock(&_worldLock);
+	if (stopRequested) parkThread();
+	pthread_mutex_unlock(&_worldLock);
+}
+
+void krk_beginBlockingCall(void) {
+	if (!(vm.globalFlags & KRK_GLOBAL_THREADS) || krk_currentThread.inBlockingCall) return;
+	pthread_mutex_lock(&_worldLock);
+	krk_currentThread.inBlockingCall = 1;
+	runningThreads--;
+	pthread_cond_broadcast(&_worldCond);
+	pthread_mutex_unlock(&_worldLock);
+}
+
+void krk_endBlockingCall(void) {
+	if (!krk_currentThread.inBlockingCall) return;
+	pthread_mutex_lock(&_worldLock);
+	while (stopRequested) pthread_cond_wait(&_worldCond, &_worldLock);
+	runningThreads++;
+	krk_currentThread.inBlockingCall = 0;
+	pthread_mutex_unlock(&_worldLock);
+}
+
+/**
+ * Called by a thread that is about to start another one. The new thread
+ * counts as running from here on, so no collection can get past
+ * stopTheWorld until it has added itself to vm.threads.
+ */
+void krk_gcExpectThread(void) {
+	pthread_mutex_lock(&_worldLock);
+	vm.globalFlags |= KRK_GLOBAL_THREADS;
+	runningThreads++;
+	pthread_mutex_unlock(&_worldLock);
+}
+
+void krk_gcAttachThread(void) {
+	pthread_mutex_lock(&_worldLock);
+	krk_currentThread.next = vm.threads->next;
+	__atomic_store_n(&vm.threads->next, &krk_currentThread, __ATOMIC_RELEASE);
+	krk_currentThread.noSafepoint = 0;
+	if (stopRequested) parkThread();
+	pthread_mutex_unlock(&_worldLock);
+}
+
+void krk_gcDetachThread(void) {
+	pthread_mutex_lock(&_worldLock);
+	vm.bytesAllocated += krk_currentThread.pendingBytes;
+	krk_currentThread.pendingBytes = 0;
+	for (KrkThreadState * previous = vm.threads; previous; previous = previous->next) {
+		if (previous->next == &krk_currentThread) {
+			previous->next = krk_currentThread.next;
+			break;
 		}
 	}
+	runningThreads--;
+	pthread_cond_broadcast(&_worldCond);
+	pthread_mutex_unlock(&_worldLock);
+}
+#else
+#define stopTheWorld()
+#define resumeTheWorld()
+void krk_gcSafepoint(void) { }
+void krk_beginBlockingCall(void) { }
+void krk_endBlockingCall(void) { }
+#endif
+
+/**
+ * Called when the heap grows.
+ */
+static inline void collectIfNeeded(void) {
+	if (unlikely(krk_currentThread.flags & KRK_THREAD_SAFEPOINT)) krk_gcSafepoint();
+	if ((vm.globalFlags & KRK_GLOBAL_GC_PAUSED) || krk_currentThread.noSafepoint) return;
+#ifndef KRK_NO_STRESS_GC
+	if (vm.globalFlags & KRK_GLOBAL_ENABLE_STRESS_GC) {
+		/* Mostly young collections, with the occasional full one so that promoted garbage is found too. */
+		static unsigned int stressCount = 0;
+		if (++stressCount & 7) krk_collectYoung();
+		else krk_collectGarbage();
+		return;
+	}
+#endif
+	if (krk_currentThread.pendingBytes < KRK_GC_ALLOCATION_BUFFER) return;
+	size_t total = __atomic_add_fetch(&vm.bytesAllocated, (size_t)krk_currentThread.pendingBytes, __ATOMIC_RELAXED);
+	krk_currentThread.pendingBytes = 0;
+	if (total > vm.nextGC) {
+		if (total > vm.nextMajorGC) krk_collectGarbage();
+		else krk_collectYoung();
+	}
+}
+
+void * krk_reallocate(void * ptr, size_t old, size_t new) {
+
+	countBytes(old, new);
+
+	if (new > old && ptr != krk_currentThread.stack) collectIfNeeded();
 
 	void * out;
 	if (new == 0) {
@@ -198,48 +366,204 @@ void * krk_reallocate(void * ptr, size_t old, size_t new) {
 	return out;
 }
 
+/**
+ * Object slabs
+ *
+ * Nearly every object is a small, fixed-size struct, so rather than going
+ * through malloc for each one, objects of up to KRK_SLAB_MAX bytes are
+ * carved out of pages of equally-sized slots. Each thread keeps a chain
+ * of free slots of every size class in its own state and only takes the
+ * slab lock to fetch another batch of them, or to carve up a new page.
+ *
+ * Free slots are marked with a type that no object has, so the pages
+ * double as a list of every small object: old objects are not kept on
+ * any list, and full collections find them by walking the pages. Slots
+ * released by a sweep are gathered per size class and handed back to the
+ * shared pool all at once when the collection is done.
+ *
+ * Larger objects (classes, and instances of types with a lot of C state)
+ * still come from krk_reallocate, and once promoted are kept on vm.objects.
+ * Pages are never returned to the system before the VM is torn down.
+ */
+#define KRK_SLAB_GRANULE   16
+#define KRK_SLAB_MAX       (KRK_SLAB_CLASSES * KRK_SLAB_GRANULE)
+#define KRK_SLAB_PAGE_SIZE (64 * 1024)
+#define KRK_SLAB_BATCH     64
+#define KRK_SLOT_FREE      0xFFFF
+
+typedef struct KrkSlabPage {
+	struct KrkSlabPage * next;
+	size_t slotSize;
+	size_t slotCount;
+} KrkSlabPage;
+
+#define SLAB_HEADER_SIZE ((sizeof(KrkSlabPage) + KRK_SLAB_GRANULE - 1) & ~(size_t)(KRK_SLAB_GRANULE - 1))
+#define SLAB_SLOT(page,i) ((KrkObj*)((char*)(page) + SLAB_HEADER_SIZE + (i) * (page)->slotSize))
+
+#ifndef KRK_DISABLE_THREADS
+static volatile int _slabLock = 0;
+#endif
+
+static KrkSlabPage * slabPages = NULL;
+static KrkObj * slabFree[KRK_SLAB_CLASSES];
+static KrkObj * sweptSlots[KRK_SLAB_CLASSES];
+static KrkObj * sweptTail[KRK_SLAB_CLASSES];
+
+static inline size_t slabClass(size_t size) {
+	return (size - 1) / KRK_SLAB_GRANULE;
+}
+
+static KrkObj * newSlabPage(size_t sizeClass) {
+	KrkSlabPage * page = malloc(KRK_SLAB_PAGE_SIZE);
+	if (!page) exit(1);
+	page->slotSize = (sizeClass + 1) * KRK_SLAB_GRANULE;
+	page->slotCount = (KRK_SLAB_PAGE_SIZE - SLAB_HEADER_SIZE) / page->slotSize;
+
+	KrkObj * head = NULL;
+	for (size_t i = page->slotCount; i > 0; --i) {
+		KrkObj * slot = SLAB_SLOT(page, i - 1);
+		slot->type = KRK_SLOT_FREE;
+		slot->flags = 0;
+		slot->next = head;
+		head = slot;
+	}
+
+	/* Pages are only ever added at the front, so walkers need not take the lock. */
+	page->next = slabPages;
+	slabPages = page;
+	return head;
+}
+
+/**
+ * Take a batch of free slots from the shared pool.
+ */
+static KrkObj * refillSlots(size_t sizeClass) {
+	_obtain_lock(_slabLock);
+	KrkObj * head = slabFree[sizeClass];
+	if (head) {
+		KrkObj * tail = head;
+		for (int i = 1; i < KRK_SLAB_BATCH && tail->next; ++i) tail = tail->next;
+		slabFree[sizeClass] = tail->next;
+		tail->next = NULL;
+	} else {
+		head = newSlabPage(sizeClass);
+	}
+	_release_lock(_slabLock);
+	return head;
+}
+
+void * krk_allocateObjectMemory(size_t size) {
+	if (size > KRK_SLAB_MAX) return krk_reallocate(NULL, 0, size);
+
+	size_t sizeClass = slabClass(size);
+	countBytes(0, (sizeClass + 1) * KRK_SLAB_GRANULE);
+	collectIfNeeded();
+
+	KrkObj * slot = krk_currentThread.slabCache[sizeClass];
+	if (!slot) slot = refillSlots(sizeClass);
+	krk_currentThread.slabCache[sizeClass] = slot->next;
+	return slot;
+}
+
+void krk_releaseThreadSlots(void) {
+	_obtain_lock(_slabLock);
+	for (size_t i = 0; i < KRK_SLAB_CLASSES; ++i) {
+		KrkObj * head = krk_currentThread.slabCache[i];
+		if (!head) continue;
+		KrkObj * tail = head;
+		while (tail->next) tail = tail->next;
+		tail->next = slabFree[i];
+		slabFree[i] = head;
+		krk_currentThread.slabCache[i] = NULL;
+	}
+	_release_lock(_slabLock);
+}
+
+/**
+ * Return the slots released by a sweep to the shared pool.
+ */
+static void flushSweptSlots(void) {
+	_obtain_lock(_slabLock);
+	for (size_t i = 0; i < KRK_SLAB_CLASSES; ++i) {
+		if (!sweptSlots[i]) continue;
+		sweptTail[i]->next = slabFree[i];
+		slabFree[i] = sweptSlots[i];
+		sweptSlots[i] = NULL;
+		sweptTail[i] = NULL;
+	}
+	_release_lock(_slabLock);
+}
+
+static size_t objectSize(KrkObj * object) {
+	switch (object->type) {
+		case KRK_OBJ_CODEOBJECT:   return sizeof(KrkCodeObject);
+		case KRK_OBJ_NATIVE:       return sizeof(KrkNative);
+		case KRK_OBJ_CLOSURE:      return sizeof(KrkClosure);
+		case KRK_OBJ_STRING:       return sizeof(KrkString);
+		case KRK_OBJ_UPVALUE:      return sizeof(KrkUpvalue);
+		case KRK_OBJ_CLASS:        return sizeof(KrkClass);
+		case KRK_OBJ_INSTANCE:     return ((KrkInstance*)object)->_class->allocSize;
+		case KRK_OBJ_BOUND_METHOD: return sizeof(KrkBoundMethod);
+		case KRK_OBJ_TUPLE:        return sizeof(KrkTuple);
+		case KRK_OBJ_BYTES:        return sizeof(KrkBytes);
+	}
+	return 0;
+}
+
+static inline int isSlabObject(KrkObj * object) {
+	return objectSize(object) <= KRK_SLAB_MAX;
+}
+
+void krk_walkObjects(void (*callback)(KrkObj * object, void * context), void * context) {
+	for (KrkSlabPage * page = slabPages; page; page = page->next) {
+		for (size_t i = 0; i < page->slotCount; ++i) {
+			KrkObj * object = SLAB_SLOT(page, i);
+			if (object->type != KRK_SLOT_FREE) callback(object, context);
+		}
+	}
+	for (KrkObj * object = vm.youngObjects; object; object = object->next) {
+		if (!isSlabObject(object)) callback(object, context);
+	}
+	for (KrkObj * object = vm.objects; object; object = object->next) {
+		callback(object, context);
+	}
+}
+
 static void freeObject(KrkObj * object) {
+	size_t size = objectSize(object);
 	switch (object->type) {
 		case KRK_OBJ_STRING: {
 			KrkString * string = (KrkString*)object;
 			FREE_ARRAY(char, string->chars, string->length + 1);
 			if (string->codes && string->codes != string->chars) free(string->codes);
-			FREE(KrkString, object);
 			break;
 		}
 		case KRK_OBJ_CODEOBJECT: {
 			KrkCodeObject * function = (KrkCodeObject*)object;
+			if (function->inlineCaches) FREE_ARRAY(KrkInlineCache, function->inlineCaches, function->chunk.constants.count);
+			if (function->warmupCounters) FREE_ARRAY(uint16_t, function->warmupCounters, function->chunk.count);
+			if (function->argumentPlan) FREE_ARRAY(KrkArgumentBinding, function->argumentPlan, function->argumentPlanSize);
 			krk_freeChunk(&function->chunk);
 			krk_freeValueArray(&function->positionalArgNames);
 			krk_freeValueArray(&function->keywordArgNames);
 			FREE_ARRAY(KrkLocalEntry, function->localNames, function->localNameCount);
 			function->localNameCount = 0;
-			FREE(KrkCodeObject, object);
-			break;
-		}
-		case KRK_OBJ_NATIVE: {
-			FREE(KrkNative, object);
 			break;
 		}
 		case KRK_OBJ_CLOSURE: {
 			KrkClosure * closure = (KrkClosure*)object;
 			FREE_ARRAY(KrkUpvalue*,closure->upvalues,closure->upvalueCount);
 			krk_freeTable(&closure->fields);
-			FREE(KrkClosure, object);
-			break;
-		}
-		case KRK_OBJ_UPVALUE: {
-			FREE(KrkUpvalue, object);
 			break;
 		}
 		case KRK_OBJ_CLASS: {
 			KrkClass * _class = (KrkClass*)object;
 			krk_freeTable(&_class->methods);
 			krk_freeTable(&_class->subclasses);
+			if (_class->shape) krk_freeShape(_class->shape);
 			if (_class->base) {
 				krk_tableDeleteExact(&_class->base->subclasses, OBJECT_VAL(object));
 			}
-			FREE(KrkClass, object);
 			break;
 		}
 		case KRK_OBJ_INSTANCE: {
@@ -248,52 +572,95 @@ static void freeObject(KrkObj * object) {
 				inst->_class->_ongcsweep(inst);
 			}
 			krk_freeTable(&inst->fields);
-			krk_reallocate(object,inst->_class->allocSize,0);
+			krk_freeSlots(inst);
 			break;
 		}
-		case KRK_OBJ_BOUND_METHOD:
-			FREE(KrkBoundMethod, object);
-			break;
 		case KRK_OBJ_TUPLE: {
 			KrkTuple * tuple = (KrkTuple*)object;
 			krk_freeValueArray(&tuple->values);
-			FREE(KrkTuple, object);
 			break;
 		}
 		case KRK_OBJ_BYTES: {
 			KrkBytes * bytes = (KrkBytes*)object;
 			FREE_ARRAY(uint8_t, bytes->bytes, bytes->length);
-			FREE(KrkBytes, bytes);
 			break;
 		}
+		case KRK_OBJ_NATIVE:
+		case KRK_OBJ_UPVALUE:
+		case KRK_OBJ_BOUND_METHOD:
+			break;
 	}
+
+	if (size > KRK_SLAB_MAX) {
+		krk_reallocate(object, size, 0);
+		return;
+	}
+
+	size_t sizeClass = slabClass(size);
+	countBytes((sizeClass + 1) * KRK_SLAB_GRANULE, 0);
+	object->type = KRK_SLOT_FREE;
+	object->flags = 0;
+	object->next = sweptSlots[sizeClass];
+	if (!sweptSlots[sizeClass]) sweptTail[sizeClass] = object;
+	sweptSlots[sizeClass] = object;
 }
 
-void krk_freeObjects(void) {
-	KrkObj * object = vm.objects;
-	KrkObj * other = NULL;
+static void freeAtExit(KrkObj * object) {
+	if (object->type == KRK_OBJ_CLASS) {
+		((KrkClass*)object)->base = NULL;
+	}
+	freeObject(object);
+}
 
-	while (object) {
-		KrkObj * next = object->next;
-		if (object->type == KRK_OBJ_INSTANCE) {
-			freeObject(object);
-		} else {
-			object->next = other;
-			other = object;
+void krk_freeObjects(void) {
+	/* Large objects are on one of the two lists; small ones are found in the pages. */
+	KrkObj * large = vm.objects;
+	for (KrkObj * object = vm.youngObjects, * next; object; object = next) {
+		next = object->next;
+		if (!isSlabObject(object)) {
+			object->next = large;
+			large = object;
 		}
-		object = next;
 	}
+	vm.youngObjects = NULL;
+	vm.objects = NULL;
 
-	while (other) {
-		KrkObj * next = other->next;
-		if (other->type == KRK_OBJ_CLASS) {
-			((KrkClass*)other)->base = NULL;
+	/* Instances go first, as they may still need their classes. */
+	for (int instances = 1; instances >= 0; --instances) {
+		for (KrkSlabPage * page = slabPages; page; page = page->next) {
+			for (size_t i = 0; i < page->slotCount; ++i) {
+				KrkObj * object = SLAB_SLOT(page, i);
+				if (object->type == KRK_SLOT_FREE || (object->type == KRK_OBJ_INSTANCE) != instances) continue;
+				freeAtExit(object);
+			}
 		}
-		freeObject(other);
-		other = next;
+		KrkObj * previous = NULL;
+		for (KrkObj * object = large, * next; object; object = next) {
+			next = object->next;
+			if ((object->type == KRK_OBJ_INSTANCE) != instances) {
+				previous = object;
+				continue;
+			}
+			if (previous) previous->next = next;
+			else large = next;
+			freeAtExit(object);
+		}
+	}
+
+	while (slabPages) {
+		KrkSlabPage * next = slabPages->next;
+		free(slabPages);
+		slabPages = next;
+	}
+	for (size_t i = 0; i < KRK_SLAB_CLASSES; ++i) {
+		slabFree[i] = NULL;
+		sweptSlots[i] = NULL;
+		sweptTail[i] = NULL;
+		krk_currentThread.slabCache[i] = NULL;
 	}
 
 	free(vm.grayStack);
+	free(vm.remembered);
 }
 
 void krk_freeMemoryDebugger(void) {
@@ -307,17 +674,114 @@ void krk_freeMemoryDebugger(void) {
 			x = n;
 		}
 	}
+	foldPendingBytes();
 	if (vm.bytesAllocated != 0) {
 		abort();
 	}
 #endif
 }
 
-void krk_markObject(KrkObj * object) {
-	if (!object) return;
-	if (object->flags & KRK_OBJ_FLAGS_IS_MARKED) return;
-	object->flags |= KRK_OBJ_FLAGS_IS_MARKED;
+/**
+ * Generational collection
+ *
+ * Most objects die young, so most collections only look at objects
+ * allocated since the last one (vm.youngObjects). Anything that survives
+ * a collection is promoted to the old generation (vm.objects), which is
+ * only scanned and swept by a full collection.
+ *
+ * For a young collection to be correct, every reference from an old object
+ * to a young one must be found without scanning the whole old generation.
+ * Old objects that may hold such references are kept in the remembered set,
+ * and are treated as extra roots. Objects get there in one of two ways:
+ *
+ * - Types whose mutations all pass through a small number of places (lists,
+ *   dicts, tuples, upvalues, code objects, and instances of managed classes)
+ *   are "protected": those places call krk_writeBarrier, which remembers
+ *   the object the first time it is modified after being promoted, and the
+ *   object is forgotten again once its referents have been promoted.
+ *
+ * - Everything else - classes, functions, and instances of types with
+ *   C-level state, whose fields tables are poked at directly throughout the
+ *   interpreter and by extension modules - is "unprotected" and stays in the
+ *   remembered set for as long as it lives. The same goes for objects that
+ *   have been explicitly passed to krk_disableWriteBarrier.
+ *
+ * C code also tends to fill in containers it has just pushed to the stack
+ * without any barriers, and a collection may promote such a container in
+ * the middle of that. Objects referenced directly from thread roots are
+ * therefore pinned in the remembered set until the first young collection
+ * after they stop being roots.
+ */
+static int collectingYoung = 0;
+
+#ifndef KRK_DISABLE_THREADS
+static volatile int _rememberLock = 0;
+#endif
+
+#if defined(KRK_GC_VERIFY_BARRIERS)
+/**
+ * Barrier verification
+ *
+ * When built with KRK_GC_VERIFY_BARRIERS, every young collection finishes
+ * its marking phase with a second, full trace from the roots. Any young
+ * object this finds that the young collection did not mark is reachable
+ * only through an old object that was modified without a barrier, and
+ * would be freed out from under it: report it and abort.
+ *
+ * The full trace tracks what it has seen with a flag bit of its own so
+ * that it does not disturb the marks of the real collection.
+ */
+static int verifyingBarriers = 0;
+static KrkObj * verifyingParent = NULL;
+#endif
 
+static int isBarrierProtected(KrkObj * object) {
+	if (object->flags & KRK_OBJ_FLAGS_NO_BARRIER) return 0;
+	switch (object->type) {
+		case KRK_OBJ_STRING:
+		case KRK_OBJ_BYTES:
+		case KRK_OBJ_NATIVE:
+		case KRK_OBJ_BOUND_METHOD:
+		case KRK_OBJ_UPVALUE:
+		case KRK_OBJ_CODEOBJECT:
+			return 1;
+		case KRK_OBJ_TUPLE:
+			/* Tuples are filled in place after allocation. */
+			return ((KrkTuple*)object)->values.count == ((KrkTuple*)object)->values.capacity;
+		case KRK_OBJ_INSTANCE: {
+			KrkInstance * instance = (KrkInstance*)object;
+			if (instance->_class == vm.baseClasses->listClass || instance->_class == vm.baseClasses->dictClass) return 1;
+			return instance->shape && !instance->_class->_ongcscan;
+		}
+		default:
+			return 0;
+	}
+}
+
+void krk_rememberObject(KrkObj * object) {
+	_obtain_lock(_rememberLock);
+	if (!(object->flags & KRK_OBJ_FLAGS_REMEMBERED)) {
+		if (vm.rememberedCapacity < vm.rememberedCount + 1) {
+			vm.rememberedCapacity = GROW_CAPACITY(vm.rememberedCapacity);
+			vm.remembered = realloc(vm.remembered, sizeof(KrkObj*) * vm.rememberedCapacity);
+			if (!vm.remembered) exit(1);
+		}
+		object->flags |= KRK_OBJ_FLAGS_REMEMBERED;
+		vm.remembered[vm.rememberedCount++] = object;
+	}
+	_release_lock(_rememberLock);
+}
+
+void krk_disableWriteBarrier(KrkObj * object) {
+	object->flags |= KRK_OBJ_FLAGS_NO_BARRIER;
+	krk_writeBarrier(object);
+}
+
+void krk_enableWriteBarrier(KrkObj * object) {
+	object->flags &= ~KRK_OBJ_FLAGS_NO_BARRIER;
+}
+
+static void pushGray(KrkObj * object) {
 	if (vm.grayCapacity < vm.grayCount + 1) {
 		vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
 		vm.grayStack = realloc(vm.grayStack, sizeof(KrkObj*) * vm.grayCapacity);
@@ -326,6 +790,34 @@ void krk_markObject(KrkObj * object) {
 	vm.grayStack[vm.grayCount++] = object;
 }
 
+#if defined(KRK_GC_VERIFY_BARRIERS)
+static void verifyObject(KrkObj * object) {
+	if (object->flags & KRK_OBJ_FLAGS_VERIFIED) return;
+	if (!(object->flags & (KRK_OBJ_FLAGS_OLD | KRK_OBJ_FLAGS_IS_MARKED))) {
+		fprintf(stderr, "[gc] missing write barrier: %s at %p references unmarked young %s at %p\n",
+			verifyingParent ? krk_typeName(OBJECT_VAL(verifyingParent)) : "root", (void*)verifyingParent,
+			krk_typeName(OBJECT_VAL(object)), (void*)object);
+		abort();
+	}
+	object->flags |= KRK_OBJ_FLAGS_VERIFIED;
+	pushGray(object);
+}
+#endif
+
+void krk_markObject(KrkObj * object) {
+	if (!object) return;
+#if defined(KRK_GC_VERIFY_BARRIERS)
+	if (verifyingBarriers) {
+		verifyObject(object);
+		return;
+	}
+#endif
+	if (object->flags & KRK_OBJ_FLAGS_IS_MARKED) return;
+	if (collectingYoung && (object->flags & KRK_OBJ_FLAGS_OLD)) return;
+	object->flags |= KRK_OBJ_FLAGS_IS_MARKED;
+	pushGray(object);
+}
+
 void krk_markValue(KrkValue value) {
 	if (!IS_OBJECT(value)) return;
 	krk_markObject(AS_OBJECT(value));
@@ -337,6 +829,13 @@ static void markArray(KrkValueArray * array) {
 	}
 }
 
+static void markShape(KrkShape * shape) {
+	krk_markObject((KrkObj*)shape->name);
+	for (KrkShape * child = shape->children; child; child = child->sibling) {
+		markShape(child);
+	}
+}
+
 static void blackenObject(KrkObj * object) {
 	switch (object->type) {
 		case KRK_OBJ_CLOSURE: {
@@ -374,12 +873,18 @@ static void blackenObject(KrkObj * object) {
 			krk_markObject((KrkObj*)_class->base);
 			krk_markObject((KrkObj*)_class->_class);
 			krk_markTable(&_class->methods);
+			if (_class->shape) markShape(_class->shape);
 			break;
 		}
 		case KRK_OBJ_INSTANCE: {
 			krk_markObject((KrkObj*)((KrkInstance*)object)->_class);
 			if (((KrkInstance*)object)->_class->_ongcscan) ((KrkInstance*)object)->_class->_ongcscan((KrkInstance*)object);
 			krk_markTable(&((KrkInstance*)object)->fields);
+			if (((KrkInstance*)object)->shape) {
+				for (size_t i = 0; i < ((KrkInstance*)object)->shape->count; ++i) {
+					krk_markValue(((KrkInstance*)object)->slots[i]);
+				}
+			}
 			break;
 		}
 		case KRK_OBJ_BOUND_METHOD: {
@@ -407,36 +912,165 @@ static void traceReferences(void) {
 	}
 }
 
-static size_t sweep(void) {
-	KrkObj * previous = NULL;
-	KrkObj * object = vm.objects;
+/**
+ * Move a surviving young object to the old generation.
+ */
+static void promote(KrkObj * object) {
+	if (!isBarrierProtected(object) || (object->flags & KRK_OBJ_FLAGS_PINNED)) krk_rememberObject(object);
+	object->flags &= ~(KRK_OBJ_FLAGS_IS_MARKED | KRK_OBJ_FLAGS_SECOND_CHANCE | KRK_OBJ_FLAGS_PINNED);
+	object->flags |= KRK_OBJ_FLAGS_OLD;
+	/* Old objects in the slabs are found by walking the pages. */
+	if (!isSlabObject(object)) {
+		object->next = vm.objects;
+		vm.objects = object;
+	}
+}
+
+/*
+ * Freeing an instance still needs its class, for the instance size and
+ * any sweep callback, and nothing orders a class after its instances in
+ * the young list, the old list or the slab pages. Unreachable classes are
+ * set aside during the sweeps and freed once every instance is gone.
+ */
+static KrkObj * deadClasses = NULL;
+
+static void releaseObject(KrkObj * object) {
+	if (object->type == KRK_OBJ_CLASS) {
+		object->next = deadClasses;
+		deadClasses = object;
+		return;
+	}
+	freeObject(object);
+}
+
+static void freeDeadClasses(void) {
+	/* Bases may be going too, so detach from them all before freeing any. */
+	for (KrkObj * object = deadClasses; object; object = object->next) {
+		KrkClass * _class = (KrkClass*)object;
+		if (_class->base) {
+			krk_tableDeleteExact(&_class->base->subclasses, OBJECT_VAL(object));
+			_class->base = NULL;
+		}
+	}
+	while (deadClasses) {
+		KrkObj * next = deadClasses->next;
+		freeObject(deadClasses);
+		deadClasses = next;
+	}
+}
+
+static size_t sweepYoung(void) {
+	/* Other threads keep allocating while we sweep, so take the whole list for ourselves. */
+	KrkObj * object = __sync_lock_test_and_set(&vm.youngObjects, NULL);
+	KrkObj * survivors = NULL;
+	KrkObj * tail = NULL;
 	size_t count = 0;
 	while (object) {
+		KrkObj * next = object->next;
 		if (object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) {
-			object->flags &= ~(KRK_OBJ_FLAGS_IS_MARKED | KRK_OBJ_FLAGS_SECOND_CHANCE);
-			previous = object;
-			object = object->next;
+			promote(object);
 		} else if (object->flags & KRK_OBJ_FLAGS_SECOND_CHANCE) {
-			KrkObj * unreached = object;
-			object = object->next;
+			releaseObject(object);
+			count++;
+		} else {
+			/* This is tableRemoveWhite for young strings, without walking the whole table. */
+			if (object->type == KRK_OBJ_STRING && (object->flags & KRK_OBJ_FLAGS_STRING_INTERNED)) krk_tableDeleteExact(&vm.strings, OBJECT_VAL(object));
+			object->flags |= KRK_OBJ_FLAGS_SECOND_CHANCE;
+			object->next = NULL;
+			if (tail) tail->next = object;
+			else survivors = object;
+			tail = object;
+		}
+		object = next;
+	}
+
+	if (survivors) {
+		KrkObj * head;
+		do {
+			head = vm.youngObjects;
+			tail->next = head;
+		} while (!__sync_bool_compare_and_swap(&vm.youngObjects, head, survivors));
+	}
+
+	return count;
+}
+
+/**
+ * @return 1 if the object was released.
+ */
+static int sweepOldObject(KrkObj * object) {
+	if (object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) {
+		if (!isBarrierProtected(object) || (object->flags & KRK_OBJ_FLAGS_PINNED)) krk_rememberObject(object);
+		object->flags &= ~(KRK_OBJ_FLAGS_IS_MARKED | KRK_OBJ_FLAGS_SECOND_CHANCE | KRK_OBJ_FLAGS_PINNED);
+		return 0;
+	} else if (object->flags & KRK_OBJ_FLAGS_SECOND_CHANCE) {
+		releaseObject(object);
+		return 1;
+	} else {
+		/* Nothing else will keep its young referents alive until the next full collection. */
+		object->flags |= KRK_OBJ_FLAGS_SECOND_CHANCE;
+		krk_rememberObject(object);
+		return 0;
+	}
+}
+
+static size_t sweepOld(void) {
+	size_t count = 0;
+
+	for (KrkSlabPage * page = slabPages; page; page = page->next) {
+		for (size_t i = 0; i < page->slotCount; ++i) {
+			KrkObj * object = SLAB_SLOT(page, i);
+			if (object->flags & KRK_OBJ_FLAGS_OLD) count += sweepOldObject(object);
+		}
+	}
+
+	KrkObj * previous = NULL;
+	KrkObj * object = vm.objects;
+	while (object) {
+		KrkObj * next = object->next;
+		if (sweepOldObject(object)) {
+			count++;
 			if (previous != NULL) {
-				previous->next = object;
+				previous->next = next;
 			} else {
-				vm.objects = object;
+				vm.objects = next;
 			}
-			freeObject(unreached);
-			count++;
 		} else {
-			object->flags |= KRK_OBJ_FLAGS_SECOND_CHANCE;
 			previous = object;
-			object = object->next;
 		}
+		object = next;
 	}
 	return count;
 }
 
+/**
+ * After a young collection everything a protected object referenced has
+ * been promoted, so it no longer needs to be remembered - unless it is
+ * still a root and may yet be modified without barriers.
+ */
+static void compactRemembered(void) {
+	size_t out = 0;
+	for (size_t i = 0; i < vm.rememberedCount; ++i) {
+		KrkObj * object = vm.remembered[i];
+		if (isBarrierProtected(object) && !(object->flags & (KRK_OBJ_FLAGS_SECOND_CHANCE | KRK_OBJ_FLAGS_PINNED))) {
+			object->flags &= ~KRK_OBJ_FLAGS_REMEMBERED;
+		} else {
+			vm.remembered[out++] = object;
+		}
+		object->flags &= ~KRK_OBJ_FLAGS_PINNED;
+	}
+	vm.rememberedCount = out;
+}
+
+static void forgetRemembered(void) {
+	for (size_t i = 0; i < vm.rememberedCount; ++i) {
+		vm.remembered[i]->flags &= ~KRK_OBJ_FLAGS_REMEMBERED;
+	}
+	vm.rememberedCount = 0;
+}
+
 void krk_markTable(KrkTable * table) {
-	for (size_t i = 0; i < table->capacity; ++i) {
+	for (size_t i = 0; i < table->used; ++i) {
 		KrkTableEntry * entry = &table->entries[i];
 		krk_markValue(entry->key);
 		krk_markValue(entry->value);
@@ -444,7 +1078,7 @@ void krk_markTable(KrkTable * table) {
 }
 
 static void tableRemoveWhite(KrkTable * table) {
-	for (size_t i = 0; i < table->capacity; ++i) {
+	for (size_t i = 0; i < table->used; ++i) {
 		KrkTableEntry * entry = &table->entries[i];
 		if (IS_OBJECT(entry->key) && !((AS_OBJECT(entry->key))->flags & KRK_OBJ_FLAGS_IS_MARKED)) {
 			krk_tableDeleteExact(table, entry->key);
@@ -452,19 +1086,39 @@ static void tableRemoveWhite(KrkTable * table) {
 	}
 }
 
+static void markThreadRoot(KrkValue value) {
+	if (!IS_OBJECT(value)) return;
+	KrkObj * object = AS_OBJECT(value);
+	object->flags |= KRK_OBJ_FLAGS_PINNED;
+	if (collectingYoung && (object->flags & KRK_OBJ_FLAGS_OLD)) {
+		krk_writeBarrier(object);
+	} else {
+		krk_markObject(object);
+	}
+}
+
 static void markThreadRoots(KrkThreadState * thread) {
 	for (KrkValue * slot = thread->stack; slot && slot < thread->stackTop; ++slot) {
-		krk_markValue(*slot);
+		markThreadRoot(*slot);
 	}
 	for (KrkUpvalue * upvalue = thread->openUpvalues; upvalue; upvalue = upvalue->next) {
 		krk_markObject((KrkObj*)upvalue);
 	}
-	krk_markValue(thread->currentException);
+	/* Segments suspended beneath a running generator are roots as well. */
+	for (KrkStackSegment * segment = thread->segment ? thread->segment->outer : NULL; segment; segment = segment->outer) {
+		for (KrkValue * slot = segment->stack; slot && slot < segment->stackTop; ++slot) {
+			markThreadRoot(*slot);
+		}
+		for (KrkUpvalue * upvalue = segment->openUpvalues; upvalue; upvalue = upvalue->next) {
+			krk_markObject((KrkObj*)upvalue);
+		}
+	}
+	markThreadRoot(thread->currentException);
 
 	if (thread->module)  krk_markObject((KrkObj*)thread->module);
 
 	for (int i = 0; i < KRK_THREAD_SCRATCH_SIZE; ++i) {
-		krk_markValue(thread->scratchSpace[i]);
+		markThreadRoot(thread->scratchSpace[i]);
 	}
 }
 
@@ -505,38 +1159,93 @@ static int smartSize(char _out[100], size_t s) {
 }
 #endif
 
-size_t krk_collectGarbage(void) {
-#ifndef KRK_NO_GC_TRACING
-	struct timespec outTime, inTime;
+#if defined(KRK_GC_VERIFY_BARRIERS)
+static void clearVerified(KrkObj * object, void * context) {
+	object->flags &= ~KRK_OBJ_FLAGS_VERIFIED;
+}
 
-	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
-		clock_gettime(CLOCK_MONOTONIC, &inTime);
+static void verifyBarriers(void) {
+	collectingYoung = 0;
+	verifyingBarriers = 1;
+	markRoots();
+	while (vm.grayCount > 0) {
+		verifyingParent = vm.grayStack[--vm.grayCount];
+		blackenObject(verifyingParent);
 	}
+	verifyingParent = NULL;
+	verifyingBarriers = 0;
+	collectingYoung = 1;
+	krk_walkObjects(clearVerified, NULL);
+}
+#endif
 
-	size_t bytesBefore = vm.bytesAllocated;
+static size_t collectYoung(void) {
+	collectingYoung = 1;
+	markRoots();
+	/* Blackening does not add to the remembered set, so the count is stable. */
+	for (size_t i = 0; i < vm.rememberedCount; ++i) {
+		blackenObject(vm.remembered[i]);
+	}
+	traceReferences();
+#if defined(KRK_GC_VERIFY_BARRIERS)
+	verifyBarriers();
 #endif
+	collectingYoung = 0;
+	compactRemembered();
+	size_t out = sweepYoung();
+	freeDeadClasses();
+	return out;
+}
 
+static size_t collectAll(void) {
+	forgetRemembered();
 	markRoots();
 	traceReferences();
 	tableRemoveWhite(&vm.strings);
-	size_t out = sweep();
+	size_t out = sweepOld();
+	out += sweepYoung();
+	freeDeadClasses();
 
 	/**
 	 * The GC scheduling is in need of some improvement. The strategy at the moment
-	 * is to schedule the next collect at double the current post-collection byte
+	 * is to schedule the next full collect at double the current post-collection byte
 	 * allocation size, up until that reaches 128MiB (64*2). Beyond that point,
-	 * the next collection is scheduled for 64MiB after the current value.
+	 * the next full collection is scheduled for 64MiB after the current value.
 	 *
 	 * Previously, we always doubled as that was what Lox did, but this rather
 	 * quickly runs into issues when memory allocation climbs into the GiB range.
 	 * 64MiB seems to be a good switchover point.
 	 */
 	if (vm.bytesAllocated < 0x4000000) {
-		vm.nextGC = vm.bytesAllocated * 2;
+		vm.nextMajorGC = vm.bytesAllocated * 2;
 	} else {
-		vm.nextGC = vm.bytesAllocated + 0x4000000;
+		vm.nextMajorGC = vm.bytesAllocated + 0x4000000;
+	}
+
+	return out;
+}
+
+static size_t collect(int young) {
+	stopTheWorld();
+	foldPendingBytes();
+
+#ifndef KRK_NO_GC_TRACING
+	struct timespec outTime, inTime;
+
+	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
+		clock_gettime(CLOCK_MONOTONIC, &inTime);
 	}
 
+	size_t bytesBefore = vm.bytesAllocated;
+#endif
+
+	size_t out = young ? collectYoung() : collectAll();
+	flushSweptSlots();
+	foldPendingBytes();
+
+	/* Whichever kind of collection we just did, the young generation is empty again. */
+	vm.nextGC = vm.bytesAllocated + KRK_GC_NURSERY_SIZE;
+
 #ifndef KRK_NO_GC_TRACING
 	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
 		clock_gettime(CLOCK_MONOTONIC, &outTime);
@@ -552,21 +1261,42 @@ size_t krk_collectGarbage(void) {
 		char smartFreed[100];
 		smartSize(smartFreed, bytesBefore - vm.bytesAllocated);
 		char smartNext[100];
-		smartSize(smartNext, vm.nextGC);
+		smartSize(smartNext, vm.nextMajorGC);
 
-		fprintf(stderr, "[gc] %lld.%.9lds %s before; %s after; freed %s in %llu objects; next collection at %s\n",
+		fprintf(stderr, "[gc] %s %lld.%.9lds %s before; %s after; freed %s in %llu objects; %zu remembered; next full collection at %s\n",
+			young ? "young" : "full",
 			(long long)diff.tv_sec, diff.tv_nsec,
-			smartBefore,smartAfter,smartFreed,(unsigned long long)out, smartNext);
+			smartBefore,smartAfter,smartFreed,(unsigned long long)out, vm.rememberedCount, smartNext);
 	}
 #endif
+	krk_currentThread.statCollections++;
+	resumeTheWorld();
 	return out;
 }
 
+size_t krk_collectGarbage(void) {
+	return collect(0);
+}
+
+size_t krk_collectYoung(void) {
+	return collect(1);
+}
+
 #ifndef KRK_NO_SYSTEM_MODULES
 KRK_Function(collect) {
+	int generation = 1;
+	if (!krk_parseArgs("|i", (const char*[]){"generation"}, &generation)) return NONE_VAL();
+	return INTEGER_VAL(generation ? krk_collectGarbage() : krk_collectYoung());
+}
+
+KRK_Function(thread_stats) {
 	FUNCTION_TAKES_NONE();
-	if (&krk_currentThread != vm.threads) return krk_runtimeError(vm.exceptions->valueError, "only the main thread can do that");
-	return INTEGER_VAL(krk_collectGarbage());
+	KrkValue stats = krk_dict_of(0,NULL,0);
+	krk_push(stats);
+	krk_attachNamedValue(AS_DICT(stats), "allocated", INTEGER_VAL(krk_currentThread.statAllocated));
+	krk_attachNamedValue(AS_DICT(stats), "collections", INTEGER_VAL(krk_currentThread.statCollections));
+	krk_attachNamedValue(AS_DICT(stats), "stops", INTEGER_VAL(krk_currentThread.statStops));
+	return krk_pop();
 }
 
 KRK_Function(pause) {
@@ -594,7 +1324,14 @@ void krk_module_init_gc(void) {
 	KRK_DOC(gcModule, "@brief Namespace containing methods for controlling the garbage collector.");
 
 	KRK_DOC(BIND_FUNC(gcModule,collect),
-		"@brief Triggers one cycle of garbage collection.");
+		"@brief Triggers one cycle of garbage collection.\n"
+		"@arguments generation=1\n\n"
+		"@param generation Pass 0 to only examine objects allocated since the last collection.");
+	KRK_DOC(BIND_FUNC(gcModule,thread_stats),
+		"@brief Collector statistics for the calling thread.\n\n"
+		"Returns a @ref dict with the number of bytes the thread has @c allocated, the number of "
+		"@c collections it has run, and the number of times it was stopped (@c stops) for a "
+		"collection run by another thread.");
 	KRK_DOC(BIND_FUNC(gcModule,pause),
 		"@brief Disables automatic garbage collection until @ref resume is called.");
 	KRK_DOC(BIND_FUNC(gcModule,resume),
@@ -0,0 +1,1660 @@
+/**
+ * @file    module__asyncio.c
+ * @brief   Native core of the asyncio module.
+ *
+ * Provides an event loop that drives coroutines, along with @c Future,
+ * @c Task and @c gather, which asyncio.krk re-exports.
+ *
+ * The loop keeps three sources of work: a ring of callbacks that are ready
+ * to run, a binary heap of timers ordered by deadline, and a table of file
+ * descriptors indexed by number, each with an optional reader and writer.
+ * Descriptors are watched with epoll where it is available and with poll()
+ * everywhere else.
+ *
+ * A Task steps its coroutine until it yields a Future, then parks itself
+ * in that future's callbacks. Awaiting a future goes through a small
+ * iterator that yields the future while it is pending and, once it is
+ * resumed, produces the result or raises the stored exception from its
+ * @c \__finish__, which is how the VM's @c yield @c from delivers
+ * exceptions into the waiting coroutine.
+ *
+ * Socket operations try the system call first and only register with the
+ * loop when it would block, so a stream that keeps up with its reader
+ * never touches epoll at all.
+ *
+ * Entries in the ready ring, timer heap and descriptor table are either
+ * a Task, a socket operation, a callable, or a tuple of a callable and
+ * its arguments; everything but the last two is dispatched natively.
+ */
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+#include <unistd.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+#include <kuroko/memory.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define LOOP_READY_MIN  16
+#define LOOP_MAX_EVENTS 64
+
+#define FD_READ  1
+#define FD_WRITE 2
+
+#define FUTURE_PENDING   0
+#define FUTURE_RESULT    1
+#define FUTURE_EXCEPTION 2
+
+static KrkClass * EventLoop = NULL;
+static KrkClass * Future = NULL;
+static KrkClass * Task = NULL;
+static KrkClass * FutureIter = NULL;
+static KrkClass * GatheringFuture = NULL;
+static KrkClass * SleepFuture = NULL;
+static KrkClass * SockOp = NULL;
+static KrkClass * InvalidStateError = NULL;
+
+/* From the socket module, which is loaded along with this one. */
+static KrkClass * SocketError = NULL;
+static KrkClass * BlockingIOError = NULL;
+
+struct Timer {
+	double when;
+	uint64_t seq;       /**< Breaks ties so timers with the same deadline run in order */
+	KrkValue callback;
+};
+
+struct FdEntry {
+	KrkValue reader;
+	KrkValue writer;
+	int want;           /**< Which of @c reader and @c writer are set */
+	int registered;     /**< What the kernel was last told to watch for */
+};
+
+struct Loop {
+	KrkInstance inst;
+	KrkValue * ready;   /**< Ring of callbacks, capacity is zero or a power of two */
+	size_t readyHead;
+	size_t readyCount;
+	size_t readyCap;
+	struct Timer * timers;
+	size_t timerCount;
+	size_t timerCap;
+	uint64_t timerSeq;
+	struct FdEntry * fds;
+	size_t fdCap;
+	size_t fdCount;     /**< Descriptors with a reader or a writer */
+	int epfd;
+	int open;
+	int running;
+	int stopping;
+};
+
+struct Future {
+	KrkInstance inst;
+	KrkValue loop;
+	KrkValue value;     /**< Result or exception, depending on @c state */
+	KrkValue * callbacks;
+	size_t callbackCount;
+	size_t callbackCap;
+	int state;
+};
+
+struct Task {
+	struct Future fut;
+	KrkValue coro;      /**< What was passed in, for repr */
+	KrkValue iter;      /**< What gets stepped: the coroutine, or what its __await__ returned */
+};
+
+struct GatheringFuture {
+	struct Future fut;
+	KrkValue children;  /**< Tuple of futures, in the order results are reported */
+	size_t remaining;
+};
+
+/**
+ * Returned by sleep(), which may be called before there is a loop to
+ * sleep on; the timer starts once it is awaited or otherwise attached
+ * to a loop. Until then, @c value holds the result to finish with.
+ */
+struct SleepFuture {
+	struct Future fut;
+	double delay;
+};
+
+struct FutureIter {
+	KrkInstance inst;
+	KrkValue future;
+};
+
+#define SOCK_RECV      1
+#define SOCK_RECV_INTO 2
+#define SOCK_SEND      3
+#define SOCK_SENDALL   4
+#define SOCK_ACCEPT    5
+#define SOCK_CONNECT   6
+
+struct SockOp {
+	KrkInstance inst;
+	KrkValue future;
+	KrkValue sock;
+	KrkValue data;      /**< Buffer to send or receive into */
+	int fd;
+	int kind;
+	size_t nbytes;
+	size_t offset;      /**< Progress of a sendall */
+};
+
+#define IS_EventLoop(o) (krk_isInstanceOf(o,EventLoop))
+#define AS_EventLoop(o) ((struct Loop*)AS_OBJECT(o))
+#define IS_Future(o) (krk_isInstanceOf(o,Future))
+#define AS_Future(o) ((struct Future*)AS_OBJECT(o))
+#define IS_Task(o) (krk_isInstanceOf(o,Task))
+#define AS_Task(o) ((struct Task*)AS_OBJECT(o))
+#define IS_FutureIter(o) (krk_isInstanceOf(o,FutureIter))
+#define AS_FutureIter(o) ((struct FutureIter*)AS_OBJECT(o))
+#define IS_GatheringFuture(o) (krk_isInstanceOf(o,GatheringFuture))
+#define AS_GatheringFuture(o) ((struct GatheringFuture*)AS_OBJECT(o))
+#define IS_SleepFuture(o) (krk_isInstanceOf(o,SleepFuture))
+#define AS_SleepFuture(o) ((struct SleepFuture*)AS_OBJECT(o))
+#define IS_SockOp(o) (krk_isInstanceOf(o,SockOp))
+#define AS_SockOp(o) ((struct SockOp*)AS_OBJECT(o))
+
+#define CURRENT_NAME  self
+
+/** The loop inside run_until_complete or run_forever on this thread, if any. */
+static threadLocal struct Loop * _running_loop = NULL;
+
+static double _now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void _loop_gcscan(KrkInstance * _self) {
+	struct Loop * self = (struct Loop*)_self;
+	for (size_t i = 0; i < self->readyCount; ++i) {
+		krk_markValue(self->ready[(self->readyHead + i) & (self->readyCap - 1)]);
+	}
+	for (size_t i = 0; i < self->timerCount; ++i) {
+		krk_markValue(self->timers[i].callback);
+	}
+	for (size_t i = 0; i < self->fdCap; ++i) {
+		if (self->fds[i].want & FD_READ) krk_markValue(self->fds[i].reader);
+		if (self->fds[i].want & FD_WRITE) krk_markValue(self->fds[i].writer);
+	}
+}
+
+static void _loop_close(struct Loop * self) {
+	if (self->open) {
+#ifdef __linux__
+		close(self->epfd);
+#endif
+		self->open = 0;
+	}
+	if (self->readyCap) krk_reallocate(self->ready, sizeof(KrkValue) * self->readyCap, 0);
+	if (self->timerCap) krk_reallocate(self->timers, sizeof(struct Timer) * self->timerCap, 0);
+	if (self->fdCap) krk_reallocate(self->fds, sizeof(struct FdEntry) * self->fdCap, 0);
+	self->ready = NULL;
+	self->readyHead = self->readyCount = self->readyCap = 0;
+	self->timers = NULL;
+	self->timerCount = self->timerCap = 0;
+	self->fds = NULL;
+	self->fdCap = self->fdCount = 0;
+}
+
+static void _loop_gcsweep(KrkInstance * _self) {
+	_loop_close((struct Loop*)_self);
+}
+
+static void _future_gcscan(KrkInstance * _self) {
+	struct Future * self = (struct Future*)_self;
+	krk_markValue(self->loop);
+	krk_markValue(self->value);
+	for (size_t i = 0; i < self->callbackCount; ++i) {
+		krk_markValue(self->callbacks[i]);
+	}
+}
+
+static void _future_gcsweep(KrkInstance * _self) {
+	struct Future * self = (struct Future*)_self;
+	if (self->callbackCap) krk_reallocate(self->callbacks, sizeof(KrkValue) * self->callbackCap, 0);
+	self->callbacks = NULL;
+	self->callbackCount = self->callbackCap = 0;
+}
+
+static void _task_gcscan(KrkInstance * _self) {
+	_future_gcscan(_self);
+	krk_markValue(((struct Task*)_self)->coro);
+	krk_markValue(((struct Task*)_self)->iter);
+}
+
+static void _gathering_gcscan(KrkInstance * _self) {
+	_future_gcscan(_self);
+	krk_markValue(((struct GatheringFuture*)_self)->children);
+}
+
+static void _future_iter_gcscan(KrkInstance * _self) {
+	krk_markValue(((struct FutureIter*)_self)->future);
+}
+
+static void _sockop_gcscan(KrkInstance * _self) {
+	struct SockOp * self = (struct SockOp*)_self;
+	krk_markValue(self->future);
+	krk_markValue(self->sock);
+	krk_markValue(self->data);
+}
+
+static int _loop_valid(struct Loop * self) {
+	if (!self->open) {
+		krk_runtimeError(InvalidStateError, "Event loop is closed");
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Append to the ready ring, which doubles when full and is
+ * unwrapped into the front of the new storage when it does.
+ */
+static void _loop_schedule(struct Loop * self, KrkValue callback) {
+	if (self->readyCount == self->readyCap) {
+		size_t old = self->readyCap;
+		size_t cap = old ? old * 2 : LOOP_READY_MIN;
+		krk_push(callback);
+		KrkValue * values = krk_reallocate(NULL, 0, sizeof(KrkValue) * cap);
+		for (size_t i = 0; i < self->readyCount; ++i) {
+			values[i] = self->ready[(self->readyHead + i) & (old - 1)];
+		}
+		if (old) krk_reallocate(self->ready, sizeof(KrkValue) * old, 0);
+		self->ready = values;
+		self->readyCap = cap;
+		self->readyHead = 0;
+		krk_pop();
+	}
+	krk_writeBarrier((KrkObj*)self);
+	self->ready[(self->readyHead + self->readyCount) & (self->readyCap - 1)] = callback;
+	self->readyCount++;
+}
+
+static KrkValue _loop_unschedule(struct Loop * self) {
+	KrkValue out = self->ready[self->readyHead];
+	self->readyHead = (self->readyHead + 1) & (self->readyCap - 1);
+	self->readyCount--;
+	return out;
+}
+
+static int _timer_before(struct Timer * a, struct Timer * b) {
+	return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void _loop_add_timer(struct Loop * self, double when, KrkValue callback) {
+	if (self->timerCount == self->timerCap) {
+		size_t old = self->timerCap;
+		self->timerCap = old ? old * 2 : 8;
+		krk_push(callback);
+		self->timers = krk_reallocate(self->timers, sizeof(struct Timer) * old, sizeof(struct Timer) * self->timerCap);
+		krk_pop();
+	}
+	krk_writeBarrier((KrkObj*)self);
+	struct Timer timer = {when, self->timerSeq++, callback};
+	size_t i = self->timerCount++;
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (!_timer_before(&timer, &self->timers[parent])) break;
+		self->timers[i] = self->timers[parent];
+		i = parent;
+	}
+	self->timers[i] = timer;
+}
+
+static struct Timer _loop_pop_timer(struct Loop * self) {
+	struct Timer out = self->timers[0];
+	struct Timer last = self->timers[--self->timerCount];
+	size_t n = self->timerCount;
+	size_t i = 0;
+	while (1) {
+		size_t child = i * 2 + 1;
+		if (child >= n) break;
+		if (child + 1 < n && _timer_before(&self->timers[child+1], &self->timers[child])) child++;
+		if (!_timer_before(&self->timers[child], &last)) break;
+		self->timers[i] = self->timers[child];
+		i = child;
+	}
+	if (n) self->timers[i] = last;
+	return out;
+}
+
+/**
+ * Tell the kernel what we now want for @p fd. A descriptor that was closed
+ * while registered silently drops out of an epoll set, so a failed change
+ * is retried as an add and a failed removal is ignored.
+ */
+static int _loop_update_fd(struct Loop * self, int fd) {
+	struct FdEntry * entry = &self->fds[fd];
+	if (entry->want == entry->registered) return 1;
+#ifdef __linux__
+	struct epoll_event ev = {0};
+	ev.data.fd = fd;
+	if (entry->want & FD_READ) ev.events |= EPOLLIN;
+	if (entry->want & FD_WRITE) ev.events |= EPOLLOUT;
+	int result;
+	if (!entry->want) {
+		epoll_ctl(self->epfd, EPOLL_CTL_DEL, fd, &ev);
+		result = 0;
+	} else if (!entry->registered) {
+		result = epoll_ctl(self->epfd, EPOLL_CTL_ADD, fd, &ev);
+		if (result < 0 && errno == EEXIST) result = epoll_ctl(self->epfd, EPOLL_CTL_MOD, fd, &ev);
+	} else {
+		result = epoll_ctl(self->epfd, EPOLL_CTL_MOD, fd, &ev);
+		if (result < 0 && errno == ENOENT) result = epoll_ctl(self->epfd, EPOLL_CTL_ADD, fd, &ev);
+	}
+	if (result < 0) {
+		int err = errno;
+		entry->want = entry->registered;
+		krk_runtimeError(vm.exceptions->OSError, "%s", strerror(err));
+		return 0;
+	}
+#endif
+	if (entry->want && !entry->registered) self->fdCount++;
+	if (!entry->want && entry->registered) self->fdCount--;
+	entry->registered = entry->want;
+	return 1;
+}
+
+static int _loop_set_fd(struct Loop * self, int fd, int which, KrkValue callback) {
+	if (fd < 0) {
+		krk_runtimeError(vm.exceptions->valueError, "invalid file descriptor: %d", fd);
+		return 0;
+	}
+	if ((size_t)fd >= self->fdCap) {
+		size_t old = self->fdCap;
+		size_t cap = old ? old : 16;
+		while (cap <= (size_t)fd) cap *= 2;
+		krk_push(callback);
+		self->fds = krk_reallocate(self->fds, sizeof(struct FdEntry) * old, sizeof(struct FdEntry) * cap);
+		memset(&self->fds[old], 0, sizeof(struct FdEntry) * (cap - old));
+		self->fdCap = cap;
+		krk_pop();
+	}
+	krk_writeBarrier((KrkObj*)self);
+	struct FdEntry * entry = &self->fds[fd];
+	if (which == FD_READ) entry->reader = callback;
+	else entry->writer = callback;
+	entry->want |= which;
+	return _loop_update_fd(self, fd);
+}
+
+static int _loop_clear_fd(struct Loop * self, int fd, int which) {
+	if (fd < 0 || (size_t)fd >= self->fdCap || !(self->fds[fd].want & which)) return 0;
+	struct FdEntry * entry = &self->fds[fd];
+	entry->want &= ~which;
+	if (which == FD_READ) entry->reader = NONE_VAL();
+	else entry->writer = NONE_VAL();
+	_loop_update_fd(self, fd);
+	return 1;
+}
+
+static void _future_run_callback(struct Future * self, KrkValue callback);
+static void _sleep_start(struct SleepFuture * self, struct Loop * loop);
+
+/**
+ * Settle a future and hand it to everything that was waiting on it.
+ * Callbacks that are Tasks and gathers are handled natively; anything
+ * else is scheduled to be called with the future as its argument.
+ */
+static void _future_finish(struct Future * self, KrkValue value, int state) {
+	krk_writeBarrier((KrkObj*)self);
+	self->value = value;
+	self->state = state;
+	krk_push(OBJECT_VAL(self));
+	for (size_t i = 0; i < self->callbackCount; ++i) {
+		_future_run_callback(self, self->callbacks[i]);
+	}
+	if (self->callbackCap) krk_reallocate(self->callbacks, sizeof(KrkValue) * self->callbackCap, 0);
+	self->callbacks = NULL;
+	self->callbackCount = self->callbackCap = 0;
+	krk_pop();
+}
+
+/**
+ * Move the exception that was just raised into @p self, clearing it
+ * from the thread so the caller can carry on.
+ */
+static void _future_take_exception(struct Future * self) {
+	KrkValue exc = krk_currentThread.currentException;
+	krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+	krk_push(exc);
+	_future_finish(self, exc, FUTURE_EXCEPTION);
+	krk_pop();
+}
+
+static void _future_add_callback(struct Future * self, KrkValue callback) {
+	if (self->state != FUTURE_PENDING) {
+		_future_run_callback(self, callback);
+		return;
+	}
+	if (self->callbackCount == self->callbackCap) {
+		size_t old = self->callbackCap;
+		self->callbackCap = old ? old * 2 : 2;
+		krk_push(callback);
+		self->callbacks = krk_reallocate(self->callbacks, sizeof(KrkValue) * old, sizeof(KrkValue) * self->callbackCap);
+		krk_pop();
+	}
+	krk_writeBarrier((KrkObj*)self);
+	self->callbacks[self->callbackCount++] = callback;
+}
+
+static void _gathering_child_done(struct GatheringFuture * self, struct Future * child) {
+	if (self->fut.state != FUTURE_PENDING) return;
+	if (child->state == FUTURE_EXCEPTION) {
+		_future_finish(&self->fut, child->value, FUTURE_EXCEPTION);
+		return;
+	}
+	if (--self->remaining) return;
+	KrkTuple * children = AS_TUPLE(self->children);
+	KrkValue results = krk_list_of(0, NULL, 0);
+	krk_push(results);
+	for (size_t i = 0; i < children->values.count; ++i) {
+		krk_writeValueArray(AS_LIST(results), AS_Future(children->values.values[i])->value);
+	}
+	_future_finish(&self->fut, results, FUTURE_RESULT);
+	krk_pop();
+}
+
+static void _future_run_callback(struct Future * self, KrkValue callback) {
+	if (IS_GatheringFuture(callback)) {
+		_gathering_child_done(AS_GatheringFuture(callback), self);
+		return;
+	}
+	if (!IS_EventLoop(self->loop)) return;
+	struct Loop * loop = AS_EventLoop(self->loop);
+	if (IS_Task(callback)) {
+		_loop_schedule(loop, callback);
+		return;
+	}
+	KrkValue args[] = {callback, OBJECT_VAL(self)};
+	KrkValue pair = krk_tuple_of(2, args, 0);
+	krk_push(pair);
+	_loop_schedule(loop, pair);
+	krk_pop();
+}
+
+static struct Future * _future_new(KrkClass * type, struct Loop * loop) {
+	struct Future * out = (struct Future*)krk_newInstance(type);
+	out->loop = OBJECT_VAL(loop);
+	out->value = NONE_VAL();
+	return out;
+}
+
+/**
+ * Advance a task's coroutine by one step and decide what to do with
+ * whatever it yielded.
+ */
+static void _task_step(struct Task * self) {
+	if (self->fut.state != FUTURE_PENDING) return;
+	struct Loop * loop = AS_EventLoop(self->fut.loop);
+
+	KrkValue result;
+	if (krk_isInstanceOf(self->iter, vm.baseClasses->generatorClass)) {
+		krk_push(self->iter);
+		result = krk_callStack(0);
+	} else {
+		KrkValue send = krk_valueGetAttribute_default(self->iter, "send", NONE_VAL());
+		if (IS_NONE(send)) {
+			krk_push(self->iter);
+			result = krk_callStack(0);
+		} else {
+			krk_push(send);
+			krk_push(NONE_VAL());
+			result = krk_callStack(1);
+		}
+	}
+
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		/* An interrupt is for whoever is running the loop, not the task. */
+		if (krk_isInstanceOf(krk_currentThread.currentException, vm.exceptions->keyboardInterrupt)) return;
+		_future_take_exception(&self->fut);
+		return;
+	}
+
+	if (krk_valuesSame(result, self->iter)) {
+		/* The coroutine returned; fetch its return value. */
+		KrkValue finish = krk_valueGetAttribute_default(self->iter, "__finish__", NONE_VAL());
+		KrkValue value = NONE_VAL();
+		if (!IS_NONE(finish)) {
+			krk_push(finish);
+			value = krk_callStack(0);
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+				_future_take_exception(&self->fut);
+				return;
+			}
+		}
+		krk_push(value);
+		_future_finish(&self->fut, value, FUTURE_RESULT);
+		krk_pop();
+		return;
+	}
+
+	if (IS_Future(result)) {
+		if (AS_OBJECT(result) == (KrkObj*)self) {
+			krk_runtimeError(InvalidStateError, "Task cannot await on itself");
+			_future_take_exception(&self->fut);
+			return;
+		}
+		krk_push(result);
+		if (IS_SleepFuture(result) && !IS_EventLoop(AS_Future(result)->loop)) _sleep_start(AS_SleepFuture(result), loop);
+		_future_add_callback(AS_Future(result), OBJECT_VAL(self));
+		krk_pop();
+		return;
+	}
+
+	if (IS_NONE(result)) {
+		/* A bare yield gives up the rest of this iteration. */
+		_loop_schedule(loop, OBJECT_VAL(self));
+		return;
+	}
+
+	krk_runtimeError(vm.exceptions->typeError, "Task got bad yield: %V", result);
+	_future_take_exception(&self->fut);
+}
+
+static int _sockop_fail(struct SockOp * self, int err) {
+	krk_runtimeError(SocketError ? SocketError : vm.exceptions->OSError, "Socket error: %s", strerror(err));
+	_future_take_exception(AS_Future(self->future));
+	return 1;
+}
+
+static int _would_block(int err) {
+	return err == EAGAIN || err == EWOULDBLOCK || err == EINTR;
+}
+
+/**
+ * Try to make progress on a socket operation without blocking.
+ * Returns 1 once the operation's future has been settled, 0 if
+ * the socket was not ready.
+ */
+static int _sockop_attempt(struct SockOp * self) {
+	struct Future * future = AS_Future(self->future);
+	if (future->state != FUTURE_PENDING) return 1;
+
+	switch (self->kind) {
+		case SOCK_RECV: {
+			uint8_t * buf = krk_reallocate(NULL, 0, self->nbytes);
+			ssize_t result = recv(self->fd, buf, self->nbytes, MSG_DONTWAIT);
+			if (result < 0) {
+				int err = errno;
+				krk_reallocate(buf, self->nbytes, 0);
+				return _would_block(err) ? 0 : _sockop_fail(self, err);
+			}
+			buf = krk_reallocate(buf, self->nbytes, result);
+			KrkBytes * out = krk_newBytes(0, NULL);
+			out->bytes = buf;
+			out->length = result;
+			krk_push(OBJECT_VAL(out));
+			_future_finish(future, OBJECT_VAL(out), FUTURE_RESULT);
+			krk_pop();
+			return 1;
+		}
+		case SOCK_RECV_INTO: {
+			KrkBuffer buf;
+			if (!krk_getBuffer(self->data, &buf, 1)) {
+				_future_take_exception(future);
+				return 1;
+			}
+			size_t nbytes = self->nbytes && self->nbytes < buf.len ? self->nbytes : buf.len;
+			ssize_t result = recv(self->fd, buf.buf, nbytes, MSG_DONTWAIT);
+			if (result < 0) return _would_block(errno) ? 0 : _sockop_fail(self, errno);
+			_future_finish(future, INTEGER_VAL(result), FUTURE_RESULT);
+			return 1;
+		}
+		case SOCK_SEND:
+		case SOCK_SENDALL: {
+			KrkBuffer buf;
+			if (!krk_getBuffer(self->data, &buf, 0)) {
+				_future_take_exception(future);
+				return 1;
+			}
+			while (self->offset < buf.len) {
+				ssize_t result = send(self->fd, buf.buf + self->offset, buf.len - self->offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+				if (result < 0) return _would_block(errno) ? 0 : _sockop_fail(self, errno);
+				self->offset += result;
+				if (self->kind == SOCK_SEND) break;
+			}
+			_future_finish(future, self->kind == SOCK_SEND ? INTEGER_VAL(self->offset) : NONE_VAL(), FUTURE_RESULT);
+			return 1;
+		}
+		case SOCK_ACCEPT: {
+			KrkValue method = krk_valueGetAttribute(self->sock, "accept");
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+				_future_take_exception(future);
+				return 1;
+			}
+			krk_push(method);
+			KrkValue result = krk_callStack(0);
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+				if (BlockingIOError && krk_isInstanceOf(krk_currentThread.currentException, BlockingIOError)) {
+					krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+					return 0;
+				}
+				_future_take_exception(future);
+				return 1;
+			}
+			krk_push(result);
+			/* Connections are handed out ready to be used with the loop. */
+			if (IS_TUPLE(result) && AS_TUPLE(result)->values.count) {
+				KrkValue setblocking = krk_valueGetAttribute_default(AS_TUPLE(result)->values.values[0], "setblocking", NONE_VAL());
+				if (!IS_NONE(setblocking)) {
+					krk_push(setblocking);
+					krk_push(BOOLEAN_VAL(0));
+					krk_callStack(1);
+				}
+			}
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+				_future_take_exception(future);
+			} else {
+				_future_finish(future, result, FUTURE_RESULT);
+			}
+			krk_pop();
+			return 1;
+		}
+		case SOCK_CONNECT: {
+			int err = 0;
+			socklen_t len = sizeof(err);
+			if (getsockopt(self->fd, SOL_SOCKET, SO_ERROR, (void*)&err, &len) < 0) err = errno;
+			if (err == EINPROGRESS || err == EALREADY || _would_block(err)) return 0;
+			if (err) return _sockop_fail(self, err);
+			_future_finish(future, NONE_VAL(), FUTURE_RESULT);
+			return 1;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Run one callback from the ready ring, a timer, or a descriptor.
+ * Returns 0 if a plain callback raised, leaving the exception set
+ * so it propagates out of the loop.
+ */
+static int _loop_dispatch(struct Loop * self, KrkValue callback) {
+	if (IS_Task(callback)) {
+		_task_step(AS_Task(callback));
+	} else if (IS_SleepFuture(callback)) {
+		struct Future * future = AS_Future(callback);
+		if (future->state == FUTURE_PENDING) _future_finish(future, future->value, FUTURE_RESULT);
+	} else if (IS_SockOp(callback)) {
+		struct SockOp * op = AS_SockOp(callback);
+		if (_sockop_attempt(op)) {
+			int which = (op->kind == SOCK_SEND || op->kind == SOCK_SENDALL || op->kind == SOCK_CONNECT) ? FD_WRITE : FD_READ;
+			struct FdEntry * entry = &self->fds[op->fd];
+			if ((entry->want & which) && krk_valuesSame(which == FD_READ ? entry->reader : entry->writer, callback)) {
+				_loop_clear_fd(self, op->fd, which);
+			}
+		}
+	} else if (IS_TUPLE(callback)) {
+		KrkTuple * tuple = AS_TUPLE(callback);
+		for (size_t i = 0; i < tuple->values.count; ++i) {
+			krk_push(tuple->values.values[i]);
+		}
+		krk_callStack(tuple->values.count - 1);
+	} else {
+		krk_push(callback);
+		krk_callStack(0);
+	}
+	return !(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION);
+}
+
+/**
+ * Dispatch the reader and writer for a descriptor the kernel reported.
+ * Errors and hangups wake both sides so each can find out for itself.
+ */
+static int _loop_fd_ready(struct Loop * self, int fd, int readable, int writable) {
+	if (readable && (size_t)fd < self->fdCap && (self->fds[fd].want & FD_READ)) {
+		krk_push(self->fds[fd].reader);
+		int ok = _loop_dispatch(self, krk_peek(0));
+		krk_pop();
+		if (!ok) return 0;
+	}
+	if (writable && (size_t)fd < self->fdCap && (self->fds[fd].want & FD_WRITE)) {
+		krk_push(self->fds[fd].writer);
+		int ok = _loop_dispatch(self, krk_peek(0));
+		krk_pop();
+		if (!ok) return 0;
+	}
+	return 1;
+}
+
+/**
+ * Wait for at most @p timeout seconds, or forever if it is negative,
+ * and dispatch whatever descriptors became ready.
+ */
+static int _loop_poll(struct Loop * self, double timeout) {
+	int ms = timeout < 0 ? -1 : (int)ceil(timeout * 1000.0);
+#ifdef __linux__
+	struct epoll_event events[LOOP_MAX_EVENTS];
+	krk_beginBlockingCall();
+	int count = epoll_wait(self->epfd, events, LOOP_MAX_EVENTS, ms);
+	int err = errno;
+	krk_endBlockingCall();
+	if (count < 0) {
+		if (err == EINTR) return 1;
+		krk_runtimeError(vm.exceptions->OSError, "%s", strerror(err));
+		return 0;
+	}
+	for (int i = 0; i < count; ++i) {
+		uint32_t revents = events[i].events;
+		if (!_loop_fd_ready(self, events[i].data.fd,
+			revents & (EPOLLIN | EPOLLERR | EPOLLHUP), revents & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return 0;
+	}
+	return 1;
+#else
+	/* Without epoll, the set of descriptors is rebuilt for every wait. */
+	size_t cap = self->fdCount ? self->fdCount : 1;
+	struct pollfd * pfds = krk_reallocate(NULL, 0, sizeof(struct pollfd) * cap);
+	nfds_t nfds = 0;
+	for (size_t fd = 0; fd < self->fdCap; ++fd) {
+		if (!self->fds[fd].registered) continue;
+		pfds[nfds].fd = fd;
+		pfds[nfds].events = ((self->fds[fd].registered & FD_READ) ? POLLIN : 0) | ((self->fds[fd].registered & FD_WRITE) ? POLLOUT : 0);
+		pfds[nfds].revents = 0;
+		nfds++;
+	}
+	krk_beginBlockingCall();
+	int count = poll(pfds, nfds, ms);
+	int err = errno;
+	krk_endBlockingCall();
+	int ok = 1;
+	if (count < 0 && err != EINTR) {
+		krk_runtimeError(vm.exceptions->OSError, "%s", strerror(err));
+		ok = 0;
+	}
+	for (nfds_t i = 0; count > 0 && ok && i < nfds; ++i) {
+		short revents = pfds[i].revents;
+		if (!revents) continue;
+		ok = _loop_fd_ready(self, pfds[i].fd,
+			revents & (POLLIN | POLLERR | POLLHUP), revents & (POLLOUT | POLLERR | POLLHUP));
+	}
+	krk_reallocate(pfds, sizeof(struct pollfd) * cap, 0);
+	return ok;
+#endif
+}
+
+/**
+ * One pass of the loop: wait for I/O for as long as nothing else needs
+ * to happen, move expired timers to the ready ring, then run every
+ * callback that was ready when the pass began. Returns -1 if there was
+ * nothing left that could ever make progress.
+ */
+static int _loop_run_once(struct Loop * self) {
+	double timeout = -1;
+	if (self->readyCount || self->stopping) {
+		timeout = 0;
+	} else if (self->timerCount) {
+		timeout = self->timers[0].when - _now();
+		if (timeout < 0) timeout = 0;
+	} else if (!self->fdCount) {
+		return -1;
+	}
+
+	if (self->fdCount || timeout > 0) {
+		if (!_loop_poll(self, timeout)) return 0;
+	}
+
+	if (self->timerCount) {
+		double now = _now();
+		while (self->timerCount && self->timers[0].when <= now) {
+			struct Timer timer = _loop_pop_timer(self);
+			krk_push(timer.callback);
+			_loop_schedule(self, timer.callback);
+			krk_pop();
+		}
+	}
+
+	size_t count = self->readyCount;
+	for (size_t i = 0; i < count && self->readyCount; ++i) {
+		krk_push(_loop_unschedule(self));
+		int ok = _loop_dispatch(self, krk_peek(0));
+		krk_pop();
+		if (!ok) return 0;
+	}
+	return 1;
+}
+
+static int _loop_interrupted(void) {
+	return !!(krk_currentThread.flags & (KRK_THREAD_HAS_EXCEPTION | KRK_THREAD_SIGNALLED));
+}
+
+static int _loop_enter(struct Loop * self, struct Loop ** previous) {
+	if (!_loop_valid(self)) return 0;
+	if (self->running) {
+		krk_runtimeError(InvalidStateError, "This event loop is already running");
+		return 0;
+	}
+	self->running = 1;
+	self->stopping = 0;
+	*previous = _running_loop;
+	_running_loop = self;
+	return 1;
+}
+
+static void _loop_leave(struct Loop * self, struct Loop * previous) {
+	self->running = 0;
+	self->stopping = 0;
+	_running_loop = previous;
+}
+
+static struct Task * _task_new(struct Loop * loop, KrkValue coro) {
+	/* Resolve what we will be stepping before anything is scheduled. */
+	krk_push(coro);
+	if (!krk_getAwaitable()) {
+		krk_pop();
+		return NULL;
+	}
+	struct Task * task = (struct Task*)_future_new(Task, loop);
+	task->coro = coro;
+	task->iter = krk_peek(0);
+	krk_push(OBJECT_VAL(task));
+	_loop_schedule(loop, OBJECT_VAL(task));
+	krk_pop();
+	krk_pop();
+	return task;
+}
+
+static void _sleep_start(struct SleepFuture * self, struct Loop * loop) {
+	krk_writeBarrier((KrkObj*)self);
+	self->fut.loop = OBJECT_VAL(loop);
+	if (self->delay <= 0) {
+		_loop_schedule(loop, OBJECT_VAL(self));
+	} else {
+		_loop_add_timer(loop, _now() + self->delay, OBJECT_VAL(self));
+	}
+}
+
+/** Anything awaitable becomes a future on @p loop; futures pass through. */
+static struct Future * _ensure_future(struct Loop * loop, KrkValue value) {
+	if (IS_Future(value)) {
+		if (IS_SleepFuture(value) && !IS_EventLoop(AS_Future(value)->loop)) _sleep_start(AS_SleepFuture(value), loop);
+		return AS_Future(value);
+	}
+	return (struct Future*)_task_new(loop, value);
+}
+
+static struct Loop * _resolve_loop(KrkValue loop) {
+	if (IS_EventLoop(loop)) return AS_EventLoop(loop);
+	if (!IS_NONE(loop)) {
+		krk_runtimeError(vm.exceptions->typeError, "expected EventLoop, not '%T'", loop);
+		return NULL;
+	}
+	if (!_running_loop) {
+		krk_runtimeError(InvalidStateError, "no running event loop");
+		return NULL;
+	}
+	return _running_loop;
+}
+
+static int _get_fd(KrkValue sock) {
+	if (IS_INTEGER(sock)) return AS_INTEGER(sock);
+	KrkValue method = krk_valueGetAttribute(sock, "fileno");
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return -1;
+	krk_push(method);
+	KrkValue result = krk_callStack(0);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return -1;
+	if (!IS_INTEGER(result)) {
+		krk_runtimeError(vm.exceptions->typeError, "fileno() returned '%T', expected int", result);
+		return -1;
+	}
+	return AS_INTEGER(result);
+}
+
+#define CURRENT_CTYPE struct Loop *
+
+KRK_Method(EventLoop,__init__) {
+	METHOD_TAKES_NONE();
+	if (self->open) return krk_runtimeError(InvalidStateError, "EventLoop already initialized");
+#ifdef __linux__
+	self->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (self->epfd < 0) return krk_runtimeError(vm.exceptions->OSError, "%s", strerror(errno));
+#endif
+	self->open = 1;
+	return NONE_VAL();
+}
+
+KRK_Method(EventLoop,time) {
+	METHOD_TAKES_NONE();
+	return FLOATING_VAL(_now());
+}
+
+static KrkValue _make_callback(int argc, const KrkValue argv[]) {
+	if (argc == 1) return argv[0];
+	return krk_tuple_of(argc, argv, 0);
+}
+
+KRK_Method(EventLoop,call_soon) {
+	METHOD_TAKES_AT_LEAST(1);
+	if (!_loop_valid(self)) return NONE_VAL();
+	KrkValue callback = _make_callback(argc - 1, &argv[1]);
+	krk_push(callback);
+	_loop_schedule(self, callback);
+	krk_pop();
+	return NONE_VAL();
+}
+
+static KrkValue _loop_call_at(struct Loop * self, KrkValue when, int argc, const KrkValue argv[]) {
+	if (!_loop_valid(self)) return NONE_VAL();
+	double deadline;
+	if (IS_INTEGER(when)) deadline = AS_INTEGER(when);
+	else if (IS_FLOATING(when)) deadline = AS_FLOATING(when);
+	else return krk_runtimeError(vm.exceptions->typeError, "expected a number, not '%T'", when);
+	KrkValue callback = _make_callback(argc, argv);
+	krk_push(callback);
+	_loop_add_timer(self, deadline, callback);
+	krk_pop();
+	return NONE_VAL();
+}
+
+KRK_Method(EventLoop,call_at) {
+	METHOD_TAKES_AT_LEAST(2);
+	return _loop_call_at(self, argv[1], argc - 2, &argv[2]);
+}
+
+KRK_Method(EventLoop,call_later) {
+	METHOD_TAKES_AT_LEAST(2);
+	double delay;
+	if (IS_INTEGER(argv[1])) delay = AS_INTEGER(argv[1]);
+	else if (IS_FLOATING(argv[1])) delay = AS_FLOATING(argv[1]);
+	else return TYPE_ERROR(float,argv[1]);
+	return _loop_call_at(self, FLOATING_VAL(_now() + delay), argc - 2, &argv[2]);
+}
+
+static KrkValue _loop_add_fd(struct Loop * self, int which, int argc, const KrkValue argv[]) {
+	if (!_loop_valid(self)) return NONE_VAL();
+	int fd = _get_fd(argv[0]);
+	if (fd < 0 && (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return NONE_VAL();
+	KrkValue callback = _make_callback(argc - 1, &argv[1]);
+	krk_push(callback);
+	_loop_set_fd(self, fd, which, callback);
+	krk_pop();
+	return NONE_VAL();
+}
+
+static KrkValue _loop_remove_fd(struct Loop * self, int which, KrkValue sock) {
+	int fd = _get_fd(sock);
+	if (fd < 0 && (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return NONE_VAL();
+	return BOOLEAN_VAL(_loop_clear_fd(self, fd, which));
+}
+
+KRK_Method(EventLoop,add_reader) {
+	METHOD_TAKES_AT_LEAST(2);
+	return _loop_add_fd(self, FD_READ, argc - 1, &argv[1]);
+}
+
+KRK_Method(EventLoop,add_writer) {
+	METHOD_TAKES_AT_LEAST(2);
+	return _loop_add_fd(self, FD_WRITE, argc - 1, &argv[1]);
+}
+
+KRK_Method(EventLoop,remove_reader) {
+	METHOD_TAKES_EXACTLY(1);
+	return _loop_remove_fd(self, FD_READ, argv[1]);
+}
+
+KRK_Method(EventLoop,remove_writer) {
+	METHOD_TAKES_EXACTLY(1);
+	return _loop_remove_fd(self, FD_WRITE, argv[1]);
+}
+
+KRK_Method(EventLoop,create_future) {
+	METHOD_TAKES_NONE();
+	return OBJECT_VAL(_future_new(Future, self));
+}
+
+KRK_Method(EventLoop,create_task) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!_loop_valid(self)) return NONE_VAL();
+	struct Task * task = _task_new(self, argv[1]);
+	return task ? OBJECT_VAL(task) : NONE_VAL();
+}
+
+KRK_Method(EventLoop,run_until_complete) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!_loop_valid(self)) return NONE_VAL();
+	struct Future * future = _ensure_future(self, argv[1]);
+	if (!future) return NONE_VAL();
+	krk_push(OBJECT_VAL(future));
+
+	struct Loop * previous;
+	if (!_loop_enter(self, &previous)) return NONE_VAL();
+	while (future->state == FUTURE_PENDING && !self->stopping) {
+		int result = _loop_run_once(self);
+		if (result < 0) break;
+		if (!result || _loop_interrupted()) {
+			_loop_leave(self, previous);
+			return NONE_VAL();
+		}
+	}
+	if (future->state != FUTURE_PENDING && self->readyCount) {
+		/* Let the future's own callbacks see it finish before we return. */
+		if (!_loop_run_once(self) || _loop_interrupted()) {
+			_loop_leave(self, previous);
+			return NONE_VAL();
+		}
+	}
+	_loop_leave(self, previous);
+
+	krk_pop();
+	if (future->state == FUTURE_PENDING) {
+		return krk_runtimeError(InvalidStateError, "Event loop stopped before Future completed.");
+	}
+	if (future->state == FUTURE_EXCEPTION) {
+		krk_raiseException(future->value, NONE_VAL());
+		return NONE_VAL();
+	}
+	return future->value;
+}
+
+KRK_Method(EventLoop,run_forever) {
+	METHOD_TAKES_NONE();
+	struct Loop * previous;
+	if (!_loop_enter(self, &previous)) return NONE_VAL();
+	while (!self->stopping) {
+		/* With nothing else to wait on, a stop can only come from another thread's signal. */
+		int result = self->readyCount || self->timerCount || self->fdCount ? _loop_run_once(self) : _loop_poll(self, 0.1);
+		if (!result || _loop_interrupted()) break;
+	}
+	_loop_leave(self, previous);
+	return NONE_VAL();
+}
+
+KRK_Method(EventLoop,stop) {
+	METHOD_TAKES_NONE();
+	self->stopping = 1;
+	return NONE_VAL();
+}
+
+KRK_Method(EventLoop,is_running) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(self->running);
+}
+
+KRK_Method(EventLoop,is_closed) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(!self->open);
+}
+
+KRK_Method(EventLoop,close) {
+	METHOD_TAKES_NONE();
+	if (self->running) return krk_runtimeError(InvalidStateError, "Cannot close a running event loop");
+	_loop_close(self);
+	return NONE_VAL();
+}
+
+/**
+ * Start a socket operation: try it right away, and only if it would
+ * block, park it on the loop until the descriptor is ready.
+ */
+static KrkValue _loop_sock_op(struct Loop * self, KrkValue sock, int kind, KrkValue data, size_t nbytes, int tryFirst) {
+	if (!_loop_valid(self)) return NONE_VAL();
+	int fd = _get_fd(sock);
+	if (fd < 0) {
+		if (!(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) krk_runtimeError(vm.exceptions->valueError, "invalid file descriptor: %d", fd);
+		return NONE_VAL();
+	}
+
+	int which = (kind == SOCK_SEND || kind == SOCK_SENDALL || kind == SOCK_CONNECT) ? FD_WRITE : FD_READ;
+	if ((size_t)fd < self->fdCap && (self->fds[fd].want & which) &&
+	    IS_SockOp(which == FD_READ ? self->fds[fd].reader : self->fds[fd].writer) &&
+	    AS_Future(AS_SockOp(which == FD_READ ? self->fds[fd].reader : self->fds[fd].writer)->future)->state == FUTURE_PENDING) {
+		return krk_runtimeError(InvalidStateError, "another operation is already waiting on fd %d", fd);
+	}
+
+	struct Future * future = _future_new(Future, self);
+	krk_push(OBJECT_VAL(future));
+	struct SockOp * op = (struct SockOp*)krk_newInstance(SockOp);
+	op->future = OBJECT_VAL(future);
+	op->sock = sock;
+	op->data = data;
+	op->fd = fd;
+	op->kind = kind;
+	op->nbytes = nbytes;
+	krk_push(OBJECT_VAL(op));
+
+	if (!tryFirst || !_sockop_attempt(op)) {
+		if (!_loop_set_fd(self, fd, which, OBJECT_VAL(op))) return NONE_VAL();
+	}
+
+	krk_pop();
+	return krk_pop();
+}
+
+static int _check_nonblocking(KrkValue sock) {
+	KrkValue method = krk_valueGetAttribute_default(sock, "getblocking", NONE_VAL());
+	if (IS_NONE(method)) return 1;
+	krk_push(method);
+	KrkValue result = krk_callStack(0);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return 0;
+	if (!krk_isFalsey(result)) {
+		krk_runtimeError(vm.exceptions->valueError, "the socket must be non-blocking");
+		return 0;
+	}
+	return 1;
+}
+
+KRK_Method(EventLoop,sock_recv) {
+	KrkValue sock;
+	ssize_t nbytes;
+	if (!krk_parseArgs(".Vn", (const char*[]){"sock","nbytes"}, &sock, &nbytes)) return NONE_VAL();
+	if (nbytes < 0) return krk_runtimeError(vm.exceptions->valueError, "negative buffersize in sock_recv");
+	return _loop_sock_op(self, sock, SOCK_RECV, NONE_VAL(), nbytes, 1);
+}
+
+KRK_Method(EventLoop,sock_recv_into) {
+	KrkValue sock, buffer;
+	ssize_t nbytes = 0;
+	if (!krk_parseArgs(".VV|n", (const char*[]){"sock","buf","nbytes"}, &sock, &buffer, &nbytes)) return NONE_VAL();
+	if (nbytes < 0) return krk_runtimeError(vm.exceptions->valueError, "negative buffersize in sock_recv_into");
+	KrkBuffer buf;
+	if (!krk_getBuffer(buffer, &buf, 1)) return NONE_VAL();
+	return _loop_sock_op(self, sock, SOCK_RECV_INTO, buffer, nbytes, 1);
+}
+
+KRK_Method(EventLoop,sock_send) {
+	KrkValue sock, data;
+	if (!krk_parseArgs(".VV", (const char*[]){"sock","data"}, &sock, &data)) return NONE_VAL();
+	KrkBuffer buf;
+	if (!krk_getBuffer(data, &buf, 0)) return NONE_VAL();
+	return _loop_sock_op(self, sock, SOCK_SEND, data, 0, 1);
+}
+
+KRK_Method(EventLoop,sock_sendall) {
+	KrkValue sock, data;
+	if (!krk_parseArgs(".VV", (const char*[]){"sock","data"}, &sock, &data)) return NONE_VAL();
+	KrkBuffer buf;
+	if (!krk_getBuffer(data, &buf, 0)) return NONE_VAL();
+	return _loop_sock_op(self, sock, SOCK_SENDALL, data, 0, 1);
+}
+
+KRK_Method(EventLoop,sock_accept) {
+	KrkValue sock;
+	if (!krk_parseArgs(".V", (const char*[]){"sock"}, &sock)) return NONE_VAL();
+	if (!_check_nonblocking(sock)) return NONE_VAL();
+	return _loop_sock_op(self, sock, SOCK_ACCEPT, NONE_VAL(), 0, 1);
+}
+
+KRK_Method(EventLoop,sock_connect) {
+	KrkValue sock, address;
+	if (!krk_parseArgs(".VV", (const char*[]){"sock","address"}, &sock, &address)) return NONE_VAL();
+	if (!_check_nonblocking(sock)) return NONE_VAL();
+
+	KrkValue method = krk_valueGetAttribute(sock, "connect_ex");
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	krk_push(method);
+	krk_push(address);
+	KrkValue result = krk_callStack(1);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	if (!IS_INTEGER(result)) return krk_runtimeError(vm.exceptions->typeError, "connect_ex() returned '%T', expected int", result);
+
+	int err = AS_INTEGER(result);
+	if (err == 0) {
+		struct Future * future = _future_new(Future, self);
+		future->state = FUTURE_RESULT;
+		return OBJECT_VAL(future);
+	}
+	if (err != EINPROGRESS && err != EALREADY && !_would_block(err)) {
+		return krk_runtimeError(SocketError ? SocketError : vm.exceptions->OSError, "Socket error: %s", strerror(err));
+	}
+	return _loop_sock_op(self, sock, SOCK_CONNECT, NONE_VAL(), 0, 0);
+}
+
+KRK_Method(EventLoop,__repr__) {
+	METHOD_TAKES_NONE();
+	return krk_stringFromFormat("<EventLoop running=%s closed=%s>",
+		self->running ? "True" : "False", self->open ? "False" : "True");
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct Future *
+
+KRK_Method(Future,__init__) {
+	KrkValue loop = NONE_VAL();
+	if (!krk_parseArgs(".|$V", (const char*[]){"loop"}, &loop)) return NONE_VAL();
+	struct Loop * resolved = _resolve_loop(loop);
+	if (!resolved) return NONE_VAL();
+	krk_writeBarrier((KrkObj*)self);
+	self->loop = OBJECT_VAL(resolved);
+	self->value = NONE_VAL();
+	return NONE_VAL();
+}
+
+static int _future_check(struct Future * self) {
+	if (!IS_EventLoop(self->loop)) {
+		krk_runtimeError(InvalidStateError, "Future is not attached to an event loop");
+		return 0;
+	}
+	return 1;
+}
+
+KRK_Method(Future,done) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(self->state != FUTURE_PENDING);
+}
+
+KRK_Method(Future,result) {
+	METHOD_TAKES_NONE();
+	if (self->state == FUTURE_PENDING) return krk_runtimeError(InvalidStateError, "Result is not set.");
+	if (self->state == FUTURE_EXCEPTION) {
+		krk_raiseException(self->value, NONE_VAL());
+		return NONE_VAL();
+	}
+	return self->value;
+}
+
+KRK_Method(Future,exception) {
+	METHOD_TAKES_NONE();
+	if (self->state == FUTURE_PENDING) return krk_runtimeError(InvalidStateError, "Exception is not set.");
+	return self->state == FUTURE_EXCEPTION ? self->value : NONE_VAL();
+}
+
+KRK_Method(Future,set_result) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!_future_check(self)) return NONE_VAL();
+	if (self->state != FUTURE_PENDING) return krk_runtimeError(InvalidStateError, "invalid state");
+	_future_finish(self, argv[1], FUTURE_RESULT);
+	return NONE_VAL();
+}
+
+KRK_Method(Future,set_exception) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!_future_check(self)) return NONE_VAL();
+	if (self->state != FUTURE_PENDING) return krk_runtimeError(InvalidStateError, "invalid state");
+	KrkValue exc = argv[1];
+	if (IS_CLASS(exc)) {
+		/* Like raise, accept the class and make an instance. */
+		krk_push(exc);
+		exc = krk_callStack(0);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	}
+	if (!krk_isInstanceOf(exc, vm.exceptions->baseException)) {
+		return krk_runtimeError(vm.exceptions->typeError, "exceptions must derive from BaseException");
+	}
+	krk_push(exc);
+	_future_finish(self, exc, FUTURE_EXCEPTION);
+	krk_pop();
+	return NONE_VAL();
+}
+
+KRK_Method(Future,add_done_callback) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!_future_check(self)) return NONE_VAL();
+	_future_add_callback(self, argv[1]);
+	return NONE_VAL();
+}
+
+KRK_Method(Future,remove_done_callback) {
+	METHOD_TAKES_EXACTLY(1);
+	size_t removed = 0, j = 0;
+	for (size_t i = 0; i < self->callbackCount; ++i) {
+		if (krk_valuesSameOrEqual(self->callbacks[i], argv[1])) {
+			removed++;
+			continue;
+		}
+		self->callbacks[j++] = self->callbacks[i];
+	}
+	self->callbackCount = j;
+	return INTEGER_VAL(removed);
+}
+
+KRK_Method(Future,get_loop) {
+	METHOD_TAKES_NONE();
+	return self->loop;
+}
+
+KRK_Method(Future,__await__) {
+	METHOD_TAKES_NONE();
+	struct FutureIter * out = (struct FutureIter*)krk_newInstance(FutureIter);
+	out->future = OBJECT_VAL(self);
+	return OBJECT_VAL(out);
+}
+
+KRK_Method(Future,__repr__) {
+	METHOD_TAKES_NONE();
+	KrkClass * type = krk_getType(argv[0]);
+	if (self->state == FUTURE_PENDING) return krk_stringFromFormat("<%S pending>", type->name);
+	if (self->state == FUTURE_EXCEPTION) return krk_stringFromFormat("<%S finished exception=%R>", type->name, self->value);
+	return krk_stringFromFormat("<%S finished result=%R>", type->name, self->value);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct Task *
+
+KRK_Method(Task,__init__) {
+	KrkValue coro;
+	KrkValue loop = NONE_VAL();
+	if (!krk_parseArgs(".V|$V", (const char*[]){"coro","loop"}, &coro, &loop)) return NONE_VAL();
+	if (IS_EventLoop(self->fut.loop)) return krk_runtimeError(InvalidStateError, "Task already initialized");
+	struct Loop * resolved = _resolve_loop(loop);
+	if (!resolved || !_loop_valid(resolved)) return NONE_VAL();
+	krk_push(coro);
+	if (!krk_getAwaitable()) return NONE_VAL();
+	krk_writeBarrier((KrkObj*)self);
+	self->fut.loop = OBJECT_VAL(resolved);
+	self->fut.value = NONE_VAL();
+	self->coro = coro;
+	self->iter = krk_pop();
+	_loop_schedule(resolved, OBJECT_VAL(self));
+	return NONE_VAL();
+}
+
+KRK_Method(Task,get_coro) {
+	METHOD_TAKES_NONE();
+	return self->coro;
+}
+
+KRK_Method(Task,__repr__) {
+	METHOD_TAKES_NONE();
+	KrkValue repr = FUNC_NAME(Future,__repr__)(argc, argv, hasKw);
+	if (!IS_STRING(repr)) return repr;
+	krk_push(repr);
+	KrkValue out = krk_stringFromFormat("%.*s coro=%R>", (int)AS_STRING(repr)->length - 1, AS_CSTRING(repr), self->coro);
+	krk_pop();
+	return out;
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct FutureIter *
+
+KRK_Method(FutureIter,__iter__) {
+	METHOD_TAKES_NONE();
+	return OBJECT_VAL(self);
+}
+
+KRK_Method(FutureIter,__call__) {
+	METHOD_TAKES_AT_MOST(1);
+	if (!IS_Future(self->future)) return OBJECT_VAL(self);
+	if (IS_SleepFuture(self->future) && !IS_EventLoop(AS_Future(self->future)->loop)) {
+		struct Loop * loop = _resolve_loop(NONE_VAL());
+		if (!loop) return NONE_VAL();
+		_sleep_start(AS_SleepFuture(self->future), loop);
+	}
+	if (AS_Future(self->future)->state == FUTURE_PENDING) return self->future;
+	return OBJECT_VAL(self);
+}
+
+KRK_Method(FutureIter,send) {
+	METHOD_TAKES_EXACTLY(1);
+	return FUNC_NAME(FutureIter,__call__)(argc, argv, hasKw);
+}
+
+KRK_Method(FutureIter,__finish__) {
+	METHOD_TAKES_NONE();
+	if (!IS_Future(self->future)) return NONE_VAL();
+	struct Future * future = AS_Future(self->future);
+	if (future->state == FUTURE_PENDING) return krk_runtimeError(InvalidStateError, "await wasn't used with future");
+	if (future->state == FUTURE_EXCEPTION) {
+		krk_raiseException(future->value, NONE_VAL());
+		return NONE_VAL();
+	}
+	return future->value;
+}
+
+KRK_Function(gather) {
+	int count;
+	const KrkValue * aws;
+	KrkValue loop = NONE_VAL();
+	if (!krk_parseArgs("*$V", (const char*[]){"loop"}, &count, &aws, &loop)) return NONE_VAL();
+
+	struct Loop * resolved = NULL;
+	if (IS_NONE(loop)) {
+		for (int i = 0; i < count && !resolved; ++i) {
+			if (IS_Future(aws[i]) && IS_EventLoop(AS_Future(aws[i])->loop)) resolved = AS_EventLoop(AS_Future(aws[i])->loop);
+		}
+	}
+	if (!resolved) resolved = _resolve_loop(loop);
+	if (!resolved || !_loop_valid(resolved)) return NONE_VAL();
+
+	struct GatheringFuture * out = (struct GatheringFuture*)_future_new(GatheringFuture, resolved);
+	krk_push(OBJECT_VAL(out));
+	KrkTuple * children = krk_newTuple(count);
+	out->children = OBJECT_VAL(children);
+	for (int i = 0; i < count; ++i) {
+		struct Future * child = _ensure_future(resolved, aws[i]);
+		if (!child) return NONE_VAL();
+		children->values.values[children->values.count++] = OBJECT_VAL(child);
+	}
+	out->remaining = count;
+
+	if (!count) {
+		KrkValue results = krk_list_of(0, NULL, 0);
+		krk_push(results);
+		_future_finish(&out->fut, results, FUTURE_RESULT);
+		krk_pop();
+	}
+	for (int i = 0; i < count && out->fut.state == FUTURE_PENDING; ++i) {
+		_future_add_callback(AS_Future(children->values.values[i]), OBJECT_VAL(out));
+	}
+	return krk_pop();
+}
+
+KRK_Function(sleep) {
+	KrkValue delay;
+	KrkValue result = NONE_VAL();
+	if (!krk_parseArgs("V|V", (const char*[]){"delay","result"}, &delay, &result)) return NONE_VAL();
+	double seconds;
+	if (IS_INTEGER(delay)) seconds = AS_INTEGER(delay);
+	else if (IS_FLOATING(delay)) seconds = AS_FLOATING(delay);
+	else return TYPE_ERROR(float,delay);
+
+	struct SleepFuture * out = (struct SleepFuture*)krk_newInstance(SleepFuture);
+	out->fut.loop = NONE_VAL();
+	out->fut.value = result;
+	out->delay = seconds;
+	return OBJECT_VAL(out);
+}
+
+KRK_Function(get_running_loop) {
+	FUNCTION_TAKES_NONE();
+	struct Loop * loop = _resolve_loop(NONE_VAL());
+	return loop ? OBJECT_VAL(loop) : NONE_VAL();
+}
+
+KRK_Function(_get_running_loop) {
+	FUNCTION_TAKES_NONE();
+	return _running_loop ? OBJECT_VAL(_running_loop) : NONE_VAL();
+}
+
+KrkValue krk_module_onload__asyncio(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+
+	KRK_DOC(module, "@brief Native core of the asyncio module.");
+
+	/* Socket operations report the socket module's own errors. The name stays on the stack while the import runs. */
+	size_t stackBefore = krk_currentThread.stackTop - krk_currentThread.stack;
+	krk_push(OBJECT_VAL(S("socket")));
+	if (krk_doRecursiveModuleLoad(AS_STRING(krk_peek(0)))) {
+		KrkValue socketModule = krk_peek(0);
+		KrkValue value = krk_valueGetAttribute_default(socketModule, "SocketError", NONE_VAL());
+		if (IS_CLASS(value)) SocketError = AS_CLASS(value);
+		value = krk_valueGetAttribute_default(socketModule, "BlockingIOError", NONE_VAL());
+		if (IS_CLASS(value)) BlockingIOError = AS_CLASS(value);
+	} else {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+	}
+	krk_currentThread.stackTop = &krk_currentThread.stack[stackBefore];
+
+	krk_makeClass(module, &InvalidStateError, "InvalidStateError", vm.exceptions->Exception);
+	KRK_DOC(InvalidStateError, "Raised when a future or event loop is used in a state that does not allow the operation.");
+	krk_finalizeClass(InvalidStateError);
+
+	krk_makeClass(module, &EventLoop, "EventLoop", vm.baseClasses->objectClass);
+	EventLoop->allocSize = sizeof(struct Loop);
+	EventLoop->_ongcscan = _loop_gcscan;
+	EventLoop->_ongcsweep = _loop_gcsweep;
+	KRK_DOC(EventLoop, "@brief Runs coroutines, callbacks and timers, and waits for file descriptors to become ready.\n\n"
+		"An event loop is not thread-safe; each thread should run its own.");
+	BIND_METHOD(EventLoop,__init__);
+	BIND_METHOD(EventLoop,__repr__);
+	KRK_DOC(BIND_METHOD(EventLoop,time),
+		"@brief The loop's clock, in seconds, which timers are measured against.");
+	KRK_DOC(BIND_METHOD(EventLoop,call_soon),
+		"@brief Arrange for @p callback to be called with @p args on the next iteration.\n"
+		"@arguments callback,*args");
+	KRK_DOC(BIND_METHOD(EventLoop,call_later),
+		"@brief Arrange for @p callback to be called with @p args after @p delay seconds.\n"
+		"@arguments delay,callback,*args");
+	KRK_DOC(BIND_METHOD(EventLoop,call_at),
+		"@brief Arrange for @p callback to be called with @p args once @ref time reaches @p when.\n"
+		"@arguments when,callback,*args");
+	KRK_DOC(BIND_METHOD(EventLoop,add_reader),
+		"@brief Call @p callback with @p args whenever @p fd is readable.\n"
+		"@arguments fd,callback,*args\n\n"
+		"@p fd may be a file descriptor or any object with a @c fileno method.");
+	KRK_DOC(BIND_METHOD(EventLoop,remove_reader),
+		"@brief Stop watching @p fd for reading. Returns whether it was being watched.\n"
+		"@arguments fd");
+	KRK_DOC(BIND_METHOD(EventLoop,add_writer),
+		"@brief Call @p callback with @p args whenever @p fd is writable.\n"
+		"@arguments fd,callback,*args");
+	KRK_DOC(BIND_METHOD(EventLoop,remove_writer),
+		"@brief Stop watching @p fd for writing. Returns whether it was being watched.\n"
+		"@arguments fd");
+	KRK_DOC(BIND_METHOD(EventLoop,create_future),
+		"@brief Create a @ref Future attached to this loop.");
+	KRK_DOC(BIND_METHOD(EventLoop,create_task),
+		"@brief Wrap a coroutine in a @ref Task and schedule it to run.\n"
+		"@arguments coro");
+	KRK_DOC(BIND_METHOD(EventLoop,run_until_complete),
+		"@brief Run the loop until @p future is done, and return its result.\n"
+		"@arguments future\n\n"
+		"Coroutines are wrapped in a @ref Task first. Exceptions raised by plain callbacks "
+		"stop the loop and propagate from here.");
+	KRK_DOC(BIND_METHOD(EventLoop,run_forever),
+		"@brief Run the loop until @ref stop is called.");
+	KRK_DOC(BIND_METHOD(EventLoop,stop),
+		"@brief Stop the loop after the current iteration.");
+	KRK_DOC(BIND_METHOD(EventLoop,is_running),
+		"@brief Whether the loop is currently running.");
+	KRK_DOC(BIND_METHOD(EventLoop,is_closed),
+		"@brief Whether the loop has been closed.");
+	KRK_DOC(BIND_METHOD(EventLoop,close),
+		"@brief Close the loop, discarding anything still scheduled.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_recv),
+		"@brief Receive up to @p nbytes from @p sock.\n"
+		"@arguments sock,nbytes\n\n"
+		"Returns a @ref Future for a @ref bytes object, which is empty when the peer has closed the connection.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_recv_into),
+		"@brief Receive from @p sock into a writable buffer.\n"
+		"@arguments sock,buf,nbytes=0\n\n"
+		"Returns a @ref Future for the number of bytes received.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_send),
+		"@brief Send as much of @p data on @p sock as it will take in one call.\n"
+		"@arguments sock,data\n\n"
+		"Returns a @ref Future for the number of bytes sent.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_sendall),
+		"@brief Send all of @p data on @p sock.\n"
+		"@arguments sock,data");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_accept),
+		"@brief Accept a connection on the non-blocking listening socket @p sock.\n"
+		"@arguments sock\n\n"
+		"Returns a @ref Future for a @c (conn,address) pair, where @c conn is non-blocking.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_connect),
+		"@brief Connect the non-blocking socket @p sock to @p address.\n"
+		"@arguments sock,address");
+	krk_finalizeClass(EventLoop);
+
+	krk_makeClass(module, &Future, "Future", vm.baseClasses->objectClass);
+	Future->allocSize = sizeof(struct Future);
+	Future->_ongcscan = _future_gcscan;
+	Future->_ongcsweep = _future_gcsweep;
+	KRK_DOC(Future, "@brief The eventual result of an asynchronous operation.\n"
+		"@arguments loop=None\n\n"
+		"Without @p loop, the future is attached to the running loop.");
+	BIND_METHOD(Future,__init__);
+	BIND_METHOD(Future,__repr__);
+	KRK_DOC(BIND_METHOD(Future,done), "@brief Whether a result or exception has been set.");
+	KRK_DOC(BIND_METHOD(Future,result),
+		"@brief Return the result, or raise the exception that was set.");
+	KRK_DOC(BIND_METHOD(Future,exception),
+		"@brief Return the exception that was set, or @c None if there was a result.");
+	KRK_DOC(BIND_METHOD(Future,set_result),
+		"@brief Mark the future done with @p result and schedule its callbacks.\n"
+		"@arguments result");
+	KRK_DOC(BIND_METHOD(Future,set_exception),
+		"@brief Mark the future done with @p exception and schedule its callbacks.\n"
+		"@arguments exception");
+	KRK_DOC(BIND_METHOD(Future,add_done_callback),
+		"@brief Call @p fn with the future once it is done.\n"
+		"@arguments fn");
+	KRK_DOC(BIND_METHOD(Future,remove_done_callback),
+		"@brief Remove every registration of @p fn, returning how many there were.\n"
+		"@arguments fn");
+	KRK_DOC(BIND_METHOD(Future,get_loop), "@brief The loop this future is attached to.");
+	BIND_METHOD(Future,__await__);
+	krk_defineNative(&Future->methods, "__iter__", FUNC_NAME(Future,__await__));
+	krk_finalizeClass(Future);
+
+	krk_makeClass(module, &Task, "Task", Future);
+	Task->allocSize = sizeof(struct Task);
+	Task->_ongcscan = _task_gcscan;
+	KRK_DOC(Task, "@brief A @ref Future that runs a coroutine to completion.\n"
+		"@arguments coro,loop=None");
+	BIND_METHOD(Task,__init__);
+	BIND_METHOD(Task,__repr__);
+	KRK_DOC(BIND_METHOD(Task,get_coro), "@brief The coroutine this task is running.");
+	krk_finalizeClass(Task);
+
+	krk_makeClass(module, &GatheringFuture, "_GatheringFuture", Future);
+	GatheringFuture->allocSize = sizeof(struct GatheringFuture);
+	GatheringFuture->_ongcscan = _gathering_gcscan;
+	GatheringFuture->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	krk_finalizeClass(GatheringFuture);
+
+	krk_makeClass(module, &SleepFuture, "_SleepFuture", Future);
+	SleepFuture->allocSize = sizeof(struct SleepFuture);
+	SleepFuture->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	krk_finalizeClass(SleepFuture);
+
+	krk_makeClass(module, &FutureIter, "FutureIter", vm.baseClasses->objectClass);
+	FutureIter->allocSize = sizeof(struct FutureIter);
+	FutureIter->_ongcscan = _future_iter_gcscan;
+	FutureIter->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	BIND_METHOD(FutureIter,__iter__);
+	BIND_METHOD(FutureIter,__call__);
+	BIND_METHOD(FutureIter,send);
+	BIND_METHOD(FutureIter,__finish__);
+	krk_finalizeClass(FutureIter);
+
+	krk_makeClass(module, &SockOp, "_SockOp", vm.baseClasses->objectClass);
+	SockOp->allocSize = sizeof(struct SockOp);
+	SockOp->_ongcscan = _sockop_gcscan;
+	SockOp->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	krk_finalizeClass(SockOp);
+
+	KRK_DOC(BIND_FUNC(module,gather),
+		"@brief Run awaitables concurrently and collect their results.\n"
+		"@arguments *aws,loop=None\n\n"
+		"Returns a @ref Future for a list of results in the order of @p aws. "
+		"If any of them raises, the gathered future takes the first exception.");
+	KRK_DOC(BIND_FUNC(module,sleep),
+		"@brief Suspend the calling coroutine for @p delay seconds.\n"
+		"@arguments delay,result=None\n\n"
+		"Returns a @ref Future that resolves to @p result. The delay starts once it is "
+		"awaited or handed to a loop, so it may be created before any loop is running.");
+	KRK_DOC(BIND_FUNC(module,get_running_loop),
+		"@brief Return the loop running on this thread, or raise @ref InvalidStateError if there is none.");
+	KRK_DOC(BIND_FUNC(module,_get_running_loop),
+		"@brief Return the loop running on this thread, or @c None.");
+
+	return krk_pop();
+}
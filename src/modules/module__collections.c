@@ -0,0 +1,1017 @@
+/**
+ * @file    module__collections.c
+ * @brief   Native core of the collections module.
+ *
+ * Provides @c deque, @c OrderedDict and @c Counter, which collections.krk
+ * re-exports.
+ *
+ * A deque is a ring buffer of values whose capacity is always a power of
+ * two, so both ends can be pushed and popped in constant time and indexing
+ * is a mask away. Every store into the buffer goes through the write
+ * barrier, and the buffer is marked by the deque's scan callback.
+ *
+ * OrderedDict and Counter are subclasses of @c dict and work on its
+ * table directly, which already keeps its entries in insertion order.
+ */
+#include <string.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+#include <kuroko/memory.h>
+
+#define DEQUE_MIN_SIZE 8
+
+static KrkClass * deque = NULL;
+static KrkClass * deque_iterator = NULL;
+static KrkClass * OrderedDict = NULL;
+static KrkClass * Counter = NULL;
+
+struct Deque {
+	KrkInstance inst;
+	KrkValue * values;
+	size_t head;        /**< Physical index of the first element */
+	size_t count;       /**< Number of elements */
+	size_t capacity;    /**< Size of @c values, zero or a power of two */
+	size_t maxlen;      /**< Bound on @c count, if @c bounded is set */
+	int bounded;
+	size_t state;       /**< Bumped on every change in length, to catch mutation during iteration */
+};
+
+struct DequeIterator {
+	KrkInstance inst;
+	KrkValue deque;
+	size_t i;
+	size_t state;
+	int reversed;
+};
+
+struct OrderedDict {
+	KrkDict dict;
+	KrkTableEntry * entries; /**< Table storage @c first refers to */
+	size_t first;            /**< Every entry before this one in @c entries is a tombstone */
+};
+
+#define IS_deque(o) (krk_isInstanceOf(o,deque))
+#define AS_deque(o) ((struct Deque*)AS_OBJECT(o))
+#define IS_deque_iterator(o) (krk_isInstanceOf(o,deque_iterator))
+#define AS_deque_iterator(o) ((struct DequeIterator*)AS_OBJECT(o))
+#define IS_OrderedDict(o) (krk_isInstanceOf(o,OrderedDict))
+#define AS_OrderedDict(o) ((struct OrderedDict*)AS_OBJECT(o))
+#define IS_Counter(o) (krk_isInstanceOf(o,Counter))
+#define AS_Counter(o) ((KrkDict*)AS_OBJECT(o))
+
+#define DEQUE_AT(self,i) ((self)->values[((self)->head + (i)) & ((self)->capacity - 1)])
+
+static void _deque_gcscan(KrkInstance * _self) {
+	struct Deque * self = (struct Deque*)_self;
+	for (size_t i = 0; i < self->count; ++i) {
+		krk_markValue(DEQUE_AT(self,i));
+	}
+}
+
+static void _deque_gcsweep(KrkInstance * _self) {
+	struct Deque * self = (struct Deque*)_self;
+	if (self->capacity) krk_reallocate(self->values, sizeof(KrkValue) * self->capacity, 0);
+	self->values = NULL;
+	self->capacity = 0;
+	self->count = 0;
+}
+
+static void _deque_iterator_gcscan(KrkInstance * self) {
+	krk_markValue(((struct DequeIterator*)self)->deque);
+}
+
+/**
+ * @brief Make room for at least one more element, unwrapping the ring into the new buffer.
+ */
+static void _deque_grow(struct Deque * self) {
+	if (self->count < self->capacity) return;
+	size_t capacity = self->capacity ? self->capacity * 2 : DEQUE_MIN_SIZE;
+	KrkValue * values = krk_reallocate(NULL, 0, sizeof(KrkValue) * capacity);
+	for (size_t i = 0; i < self->count; ++i) {
+		values[i] = DEQUE_AT(self,i);
+	}
+	if (self->capacity) krk_reallocate(self->values, sizeof(KrkValue) * self->capacity, 0);
+	self->values = values;
+	self->capacity = capacity;
+	self->head = 0;
+}
+
+static KrkValue _deque_pop_back(struct Deque * self) {
+	KrkValue out = DEQUE_AT(self, self->count - 1);
+	self->count--;
+	self->state++;
+	return out;
+}
+
+static KrkValue _deque_pop_front(struct Deque * self) {
+	KrkValue out = self->values[self->head];
+	self->head = (self->head + 1) & (self->capacity - 1);
+	self->count--;
+	self->state++;
+	return out;
+}
+
+static void _deque_push_back(struct Deque * self, KrkValue value) {
+	if (self->bounded && self->count == self->maxlen) {
+		if (!self->maxlen) return;
+		_deque_pop_front(self);
+	}
+	_deque_grow(self);
+	krk_writeBarrier((KrkObj*)self);
+	DEQUE_AT(self, self->count) = value;
+	self->count++;
+	self->state++;
+}
+
+static void _deque_push_front(struct Deque * self, KrkValue value) {
+	if (self->bounded && self->count == self->maxlen) {
+		if (!self->maxlen) return;
+		_deque_pop_back(self);
+	}
+	_deque_grow(self);
+	krk_writeBarrier((KrkObj*)self);
+	self->head = (self->head - 1) & (self->capacity - 1);
+	self->values[self->head] = value;
+	self->count++;
+	self->state++;
+}
+
+/**
+ * @brief Remove the element at logical index @p i, shifting whichever side is shorter.
+ */
+static void _deque_delete_at(struct Deque * self, size_t i) {
+	if (i < self->count / 2) {
+		for (size_t j = i; j > 0; --j) DEQUE_AT(self,j) = DEQUE_AT(self,j-1);
+		_deque_pop_front(self);
+	} else {
+		for (size_t j = i; j + 1 < self->count; ++j) DEQUE_AT(self,j) = DEQUE_AT(self,j+1);
+		_deque_pop_back(self);
+	}
+}
+
+static int _deque_extend_callback(void * context, const KrkValue * values, size_t count) {
+	struct Deque * self = context;
+	for (size_t i = 0; i < count; ++i) _deque_push_back(self, values[i]);
+	return 0;
+}
+
+static int _deque_extendleft_callback(void * context, const KrkValue * values, size_t count) {
+	struct Deque * self = context;
+	for (size_t i = 0; i < count; ++i) _deque_push_front(self, values[i]);
+	return 0;
+}
+
+/**
+ * @brief Extend from an iterable, taking a snapshot first if it is the deque itself.
+ */
+static int _deque_extend_from(struct Deque * self, KrkValue iterable, int left) {
+	if (IS_OBJECT(iterable) && AS_OBJECT(iterable) == (KrkObj*)self) {
+		KrkValue snapshot = krk_list_of(0, NULL, 0);
+		krk_push(snapshot);
+		for (size_t i = 0; i < self->count; ++i) krk_writeValueArray(AS_LIST(snapshot), DEQUE_AT(self,i));
+		iterable = snapshot;
+		int result = krk_unpackIterable(iterable, self, left ? _deque_extendleft_callback : _deque_extend_callback);
+		krk_pop();
+		return result;
+	}
+	return krk_unpackIterable(iterable, self, left ? _deque_extendleft_callback : _deque_extend_callback);
+}
+
+/**
+ * @brief Find @p value from logical index @p start up to @p stop.
+ *
+ * @return The index, -1 if not found, or -2 if a comparison raised or changed the deque.
+ */
+static ssize_t _deque_find(struct Deque * self, KrkValue value, size_t start, size_t stop) {
+	size_t state = self->state;
+	for (size_t i = start; i < stop && i < self->count; ++i) {
+		int equal = krk_valuesSameOrEqual(DEQUE_AT(self,i), value);
+		if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return -2;
+		if (unlikely(self->state != state)) {
+			krk_runtimeError(vm.exceptions->valueError, "deque mutated during iteration");
+			return -2;
+		}
+		if (equal) return i;
+	}
+	return -1;
+}
+
+#define CURRENT_CTYPE struct Deque *
+#define CURRENT_NAME  self
+
+#define DEQUE_WRAP_INDEX(index) \
+	if (index < 0) index += self->count; \
+	if (unlikely(index < 0 || index >= (krk_integer_type)self->count)) return krk_runtimeError(vm.exceptions->indexError, "deque index out of range")
+
+KRK_Method(deque,__init__) {
+	KrkValue iterable = NONE_VAL();
+	KrkValue maxlen = NONE_VAL();
+	if (!krk_parseArgs(".|VV", (const char*[]){"iterable","maxlen"}, &iterable, &maxlen)) return NONE_VAL();
+
+	if (IS_NONE(maxlen)) {
+		self->bounded = 0;
+	} else if (IS_INTEGER(maxlen)) {
+		if (AS_INTEGER(maxlen) < 0) return krk_runtimeError(vm.exceptions->valueError, "maxlen must be non-negative");
+		self->bounded = 1;
+		self->maxlen = AS_INTEGER(maxlen);
+	} else {
+		return krk_runtimeError(vm.exceptions->typeError, "maxlen must be int, not '%T'", maxlen);
+	}
+
+	self->count = 0;
+	self->head = 0;
+	self->state++;
+
+	if (!IS_NONE(iterable)) _deque_extend_from(self, iterable, 0);
+	return NONE_VAL();
+}
+
+KRK_Method(deque,maxlen) {
+	if (argc > 1) return krk_runtimeError(vm.exceptions->attributeError, "attribute 'maxlen' of 'deque' objects is not writable");
+	if (!self->bounded) return NONE_VAL();
+	return INTEGER_VAL(self->maxlen);
+}
+
+KRK_Method(deque,__len__) {
+	METHOD_TAKES_NONE();
+	return INTEGER_VAL(self->count);
+}
+
+KRK_Method(deque,append) {
+	METHOD_TAKES_EXACTLY(1);
+	_deque_push_back(self, argv[1]);
+	return NONE_VAL();
+}
+
+KRK_Method(deque,appendleft) {
+	METHOD_TAKES_EXACTLY(1);
+	_deque_push_front(self, argv[1]);
+	return NONE_VAL();
+}
+
+KRK_Method(deque,pop) {
+	METHOD_TAKES_NONE();
+	if (!self->count) return krk_runtimeError(vm.exceptions->indexError, "pop from an empty deque");
+	return _deque_pop_back(self);
+}
+
+KRK_Method(deque,popleft) {
+	METHOD_TAKES_NONE();
+	if (!self->count) return krk_runtimeError(vm.exceptions->indexError, "pop from an empty deque");
+	return _deque_pop_front(self);
+}
+
+KRK_Method(deque,extend) {
+	METHOD_TAKES_EXACTLY(1);
+	_deque_extend_from(self, argv[1], 0);
+	return NONE_VAL();
+}
+
+KRK_Method(deque,extendleft) {
+	METHOD_TAKES_EXACTLY(1);
+	_deque_extend_from(self, argv[1], 1);
+	return NONE_VAL();
+}
+
+KRK_Method(deque,clear) {
+	METHOD_TAKES_NONE();
+	self->count = 0;
+	self->head = 0;
+	self->state++;
+	return NONE_VAL();
+}
+
+KRK_Method(deque,copy) {
+	METHOD_TAKES_NONE();
+	struct Deque * out = (struct Deque*)krk_newInstance(deque);
+	krk_push(OBJECT_VAL(out));
+	out->bounded = self->bounded;
+	out->maxlen = self->maxlen;
+	for (size_t i = 0; i < self->count; ++i) _deque_push_back(out, DEQUE_AT(self,i));
+	return krk_pop();
+}
+
+KRK_Method(deque,count) {
+	METHOD_TAKES_EXACTLY(1);
+	krk_integer_type count = 0;
+	size_t i = 0;
+	ssize_t found;
+	while ((found = _deque_find(self, argv[1], i, self->count)) >= 0) {
+		count++;
+		i = found + 1;
+	}
+	if (found == -2) return NONE_VAL();
+	return INTEGER_VAL(count);
+}
+
+KRK_Method(deque,index) {
+	KrkValue value;
+	ssize_t start = 0;
+	ssize_t stop = self->count;
+	if (!krk_parseArgs(".V|nn", (const char*[]){"value","start","stop"}, &value, &start, &stop)) return NONE_VAL();
+
+	if (start < 0) start = (start + (ssize_t)self->count) < 0 ? 0 : start + (ssize_t)self->count;
+	if (stop < 0) stop = (stop + (ssize_t)self->count) < 0 ? 0 : stop + (ssize_t)self->count;
+	if (start >= stop) return krk_runtimeError(vm.exceptions->valueError, "%V is not in deque", value);
+
+	ssize_t found = _deque_find(self, value, start, stop);
+	if (found == -2) return NONE_VAL();
+	if (found == -1) return krk_runtimeError(vm.exceptions->valueError, "%V is not in deque", value);
+	return INTEGER_VAL(found);
+}
+
+KRK_Method(deque,insert) {
+	ssize_t index;
+	KrkValue value;
+	if (!krk_parseArgs(".nV", (const char*[]){"index","value"}, &index, &value)) return NONE_VAL();
+
+	if (self->bounded && self->count == self->maxlen) return krk_runtimeError(vm.exceptions->indexError, "deque already at its maximum size");
+
+	ssize_t count = self->count;
+	if (index < 0) index = (index + count) < 0 ? 0 : index + count;
+	if (index > count) index = count;
+
+	if (index < count / 2) {
+		_deque_push_front(self, value);
+		for (ssize_t j = 0; j < index; ++j) DEQUE_AT(self,j) = DEQUE_AT(self,j+1);
+	} else {
+		_deque_push_back(self, value);
+		for (ssize_t j = count; j > index; --j) DEQUE_AT(self,j) = DEQUE_AT(self,j-1);
+	}
+	DEQUE_AT(self,index) = value;
+	return NONE_VAL();
+}
+
+KRK_Method(deque,remove) {
+	METHOD_TAKES_EXACTLY(1);
+	ssize_t found = _deque_find(self, argv[1], 0, self->count);
+	if (found == -2) return NONE_VAL();
+	if (found == -1) return krk_runtimeError(vm.exceptions->valueError, "%V is not in deque", argv[1]);
+	_deque_delete_at(self, found);
+	return NONE_VAL();
+}
+
+KRK_Method(deque,rotate) {
+	ssize_t n = 1;
+	if (!krk_parseArgs(".|n", (const char*[]){"n"}, &n)) return NONE_VAL();
+	if (self->count < 2) return NONE_VAL();
+
+	ssize_t count = self->count;
+	self->state++;
+	n %= count;
+	if (n < 0) n += count;
+	if (n > count / 2) n -= count;
+
+	if (self->count == self->capacity) {
+		/* A full ring rotates by moving its head. */
+		self->head = (self->head - n) & (self->capacity - 1);
+		return NONE_VAL();
+	}
+
+	/* Otherwise move whichever end is shorter around to the other one. */
+	size_t mask = self->capacity - 1;
+	for (; n > 0; --n) {
+		size_t tail = (self->head + self->count - 1) & mask;
+		self->head = (self->head - 1) & mask;
+		self->values[self->head] = self->values[tail];
+	}
+	for (; n < 0; ++n) {
+		size_t tail = (self->head + self->count) & mask;
+		self->values[tail] = self->values[self->head];
+		self->head = (self->head + 1) & mask;
+	}
+	return NONE_VAL();
+}
+
+KRK_Method(deque,reverse) {
+	METHOD_TAKES_NONE();
+	for (size_t i = 0, j = self->count; i + 1 < j; ++i, --j) {
+		KrkValue tmp = DEQUE_AT(self,i);
+		DEQUE_AT(self,i) = DEQUE_AT(self,j-1);
+		DEQUE_AT(self,j-1) = tmp;
+	}
+	return NONE_VAL();
+}
+
+KRK_Method(deque,__getitem__) {
+	METHOD_TAKES_EXACTLY(1);
+	CHECK_ARG(1,int,krk_integer_type,index);
+	DEQUE_WRAP_INDEX(index);
+	return DEQUE_AT(self,index);
+}
+
+KRK_Method(deque,__setitem__) {
+	METHOD_TAKES_EXACTLY(2);
+	CHECK_ARG(1,int,krk_integer_type,index);
+	DEQUE_WRAP_INDEX(index);
+	krk_writeBarrier((KrkObj*)self);
+	DEQUE_AT(self,index) = argv[2];
+	return argv[2];
+}
+
+KRK_Method(deque,__delitem__) {
+	METHOD_TAKES_EXACTLY(1);
+	CHECK_ARG(1,int,krk_integer_type,index);
+	DEQUE_WRAP_INDEX(index);
+	_deque_delete_at(self, index);
+	return NONE_VAL();
+}
+
+KRK_Method(deque,__contains__) {
+	METHOD_TAKES_EXACTLY(1);
+	ssize_t found = _deque_find(self, argv[1], 0, self->count);
+	if (found == -2) return NONE_VAL();
+	return BOOLEAN_VAL(found >= 0);
+}
+
+KRK_Method(deque,__eq__) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!IS_deque(argv[1])) return NOTIMPL_VAL();
+	struct Deque * them = AS_deque(argv[1]);
+	if (self->count != them->count) return BOOLEAN_VAL(0);
+	for (size_t i = 0; i < self->count && i < them->count; ++i) {
+		if (!krk_valuesSameOrEqual(DEQUE_AT(self,i), DEQUE_AT(them,i))) return BOOLEAN_VAL(0);
+	}
+	return BOOLEAN_VAL(self->count == them->count);
+}
+
+KRK_Method(deque,__repr__) {
+	METHOD_TAKES_NONE();
+	if (((KrkObj*)self)->flags & KRK_OBJ_FLAGS_IN_REPR) return OBJECT_VAL(S("[...]"));
+	((KrkObj*)self)->flags |= KRK_OBJ_FLAGS_IN_REPR;
+	struct StringBuilder sb = {0};
+	pushStringBuilderStr(&sb, "deque([", 7);
+	for (size_t i = 0; i < self->count; ++i) {
+		if (i) pushStringBuilderStr(&sb, ", ", 2);
+		KrkValue value = DEQUE_AT(self,i);
+		KrkClass * type = krk_getType(value);
+		krk_push(value);
+		KrkValue result = krk_callDirect(type->_reprer, 1);
+		if (!IS_STRING(result)) break;
+		pushStringBuilderStr(&sb, AS_STRING(result)->chars, AS_STRING(result)->length);
+	}
+	pushStringBuilder(&sb, ']');
+	if (self->bounded) {
+		char tmp[40];
+		size_t len = snprintf(tmp, sizeof(tmp), ", maxlen=%zu", self->maxlen);
+		pushStringBuilderStr(&sb, tmp, len);
+	}
+	pushStringBuilder(&sb, ')');
+	((KrkObj*)self)->flags &= ~(KRK_OBJ_FLAGS_IN_REPR);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		discardStringBuilder(&sb);
+		return NONE_VAL();
+	}
+	return finishStringBuilder(&sb);
+}
+
+static KrkValue _deque_make_iterator(struct Deque * self, int reversed) {
+	struct DequeIterator * out = (struct DequeIterator*)krk_newInstance(deque_iterator);
+	out->deque = OBJECT_VAL(self);
+	out->i = 0;
+	out->state = self->state;
+	out->reversed = reversed;
+	return OBJECT_VAL(out);
+}
+
+KRK_Method(deque,__iter__) {
+	METHOD_TAKES_NONE();
+	return _deque_make_iterator(self, 0);
+}
+
+KRK_Method(deque,__reversed__) {
+	METHOD_TAKES_NONE();
+	return _deque_make_iterator(self, 1);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct DequeIterator *
+
+KRK_Method(deque_iterator,__iter__) {
+	METHOD_TAKES_NONE();
+	return OBJECT_VAL(self);
+}
+
+KRK_Method(deque_iterator,__call__) {
+	METHOD_TAKES_NONE();
+	if (!IS_deque(self->deque)) return argv[0];
+	struct Deque * them = AS_deque(self->deque);
+	if (self->state != them->state) {
+		return krk_runtimeError(vm.exceptions->valueError, "deque mutated during iteration");
+	}
+	if (self->i >= them->count) return argv[0];
+	size_t i = self->reversed ? them->count - self->i - 1 : self->i;
+	self->i++;
+	return DEQUE_AT(them,i);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct OrderedDict *
+
+/**
+ * @brief Find the first live entry, remembering how many tombstones lead the table.
+ *
+ * Popping from the front leaves tombstones behind that are only squeezed out
+ * when the table is next resized, so without the hint a queue-like use of
+ * popitem(last=False) would rescan them every time. Any resize moves the
+ * entries to new storage, which invalidates the hint.
+ */
+static KrkTableEntry * _odict_first(struct OrderedDict * self) {
+	KrkTable * table = &self->dict.entries;
+	if (self->entries != table->entries || self->first > table->used - table->count) {
+		self->entries = table->entries;
+		self->first = 0;
+	}
+	while (self->first < table->used && IS_KWARGS(table->entries[self->first].key)) self->first++;
+	return self->first < table->used ? &table->entries[self->first] : NULL;
+}
+
+static KrkTableEntry * _odict_last(struct OrderedDict * self) {
+	KrkTable * table = &self->dict.entries;
+	for (size_t i = table->used; i > 0; --i) {
+		if (!IS_KWARGS(table->entries[i-1].key)) return &table->entries[i-1];
+	}
+	return NULL;
+}
+
+KRK_Method(OrderedDict,popitem) {
+	int last = 1;
+	if (!krk_parseArgs(".|p", (const char*[]){"last"}, &last)) return NONE_VAL();
+	KrkTableEntry * entry = last ? _odict_last(self) : _odict_first(self);
+	if (!entry) return krk_runtimeError(vm.exceptions->keyError, "dictionary is empty");
+	KrkValue pair[2] = { entry->key, entry->value };
+	KrkValue out = krk_tuple_of(2, pair, 0);
+	krk_push(out);
+	krk_tableDelete(&self->dict.entries, pair[0]);
+	return krk_pop();
+}
+
+KRK_Method(OrderedDict,move_to_end) {
+	KrkValue key;
+	int last = 1;
+	if (!krk_parseArgs(".V|p", (const char*[]){"key","last"}, &key, &last)) return NONE_VAL();
+
+	KrkTable * table = &self->dict.entries;
+	KrkValue value;
+	if (!krk_tableGet(table, key, &value)) {
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+		return krk_runtimeError(vm.exceptions->keyError, "%V", key);
+	}
+
+	if (last) {
+		/* Re-inserting after a delete appends the entry at the end. */
+		KrkTableEntry * end = _odict_last(self);
+		if (end && krk_valuesSame(end->key, key)) return NONE_VAL();
+		krk_push(value);
+		krk_tableDelete(table, key);
+		krk_tableSet(table, key, value);
+		krk_pop();
+		return NONE_VAL();
+	}
+
+	KrkTableEntry * front = _odict_first(self);
+	if (front && krk_valuesSame(front->key, key)) return NONE_VAL();
+
+	/* Moving to the front means rebuilding the table; the old one keeps everything alive meanwhile. */
+	KrkTable rebuilt;
+	krk_initTable(&rebuilt);
+	krk_tableAdjustCapacity(&rebuilt, table->count);
+	krk_tableSet(&rebuilt, key, value);
+	for (size_t i = 0; i < table->used; ++i) {
+		KrkTableEntry * entry = &table->entries[i];
+		if (IS_KWARGS(entry->key) || krk_valuesSame(entry->key, key)) continue;
+		krk_tableSet(&rebuilt, entry->key, entry->value);
+	}
+	krk_freeTable(table);
+	*table = rebuilt;
+	krk_writeBarrier((KrkObj*)self);
+	return NONE_VAL();
+}
+
+KRK_Method(OrderedDict,clear) {
+	METHOD_TAKES_NONE();
+	krk_freeTable(&self->dict.entries);
+	self->entries = NULL;
+	self->first = 0;
+	return NONE_VAL();
+}
+
+KRK_Method(OrderedDict,__eq__) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!IS_OrderedDict(argv[1])) {
+		/* Against a plain dict, order does not matter. */
+		krk_push(argv[0]);
+		krk_push(argv[1]);
+		return krk_callDirect(vm.baseClasses->dictClass->_eq, 2);
+	}
+	KrkTable * a = &self->dict.entries;
+	KrkTable * b = &AS_OrderedDict(argv[1])->dict.entries;
+	if (a->count != b->count) return BOOLEAN_VAL(0);
+	size_t j = 0;
+	for (size_t i = 0; i < a->used; ++i) {
+		if (IS_KWARGS(a->entries[i].key)) continue;
+		while (j < b->used && IS_KWARGS(b->entries[j].key)) j++;
+		if (j >= b->used) return BOOLEAN_VAL(0);
+		if (!krk_valuesSameOrEqual(a->entries[i].key, b->entries[j].key)) return BOOLEAN_VAL(0);
+		if (!krk_valuesSameOrEqual(a->entries[i].value, b->entries[j].value)) return BOOLEAN_VAL(0);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+		j++;
+	}
+	return BOOLEAN_VAL(1);
+}
+
+/**
+ * @brief repr a dict subclass as @c Name({...}) using the plain dict repr for the body.
+ */
+static KrkValue _wrap_dict_repr(KrkValue self) {
+	KrkClass * type = krk_getType(self);
+	krk_push(self);
+	KrkValue body = krk_callDirect(vm.baseClasses->dictClass->_reprer, 1);
+	if (!IS_STRING(body)) return NONE_VAL();
+	struct StringBuilder sb = {0};
+	pushStringBuilderStr(&sb, type->name->chars, type->name->length);
+	pushStringBuilder(&sb, '(');
+	pushStringBuilderStr(&sb, AS_STRING(body)->chars, AS_STRING(body)->length);
+	pushStringBuilder(&sb, ')');
+	return finishStringBuilder(&sb);
+}
+
+KRK_Method(OrderedDict,__repr__) {
+	METHOD_TAKES_NONE();
+	return _wrap_dict_repr(argv[0]);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE KrkDict *
+
+/**
+ * @brief Add @p amount (or subtract, if @p sign is negative) to the count for @p key.
+ */
+static int _counter_add(KrkDict * self, KrkValue key, KrkValue amount, int sign) {
+	KrkValue current = INTEGER_VAL(0);
+	if (!krk_tableGet(&self->entries, key, &current) && (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return 1;
+
+	KrkValue result;
+	if (IS_INTEGER(current) && IS_INTEGER(amount) && AS_INTEGER(amount) > -0x40000000L && AS_INTEGER(amount) < 0x40000000L &&
+	    AS_INTEGER(current) > -0x400000000000L && AS_INTEGER(current) < 0x400000000000L) {
+		/* Small enough that the result can not overflow the boxed integer range */
+		result = INTEGER_VAL(AS_INTEGER(current) + sign * AS_INTEGER(amount));
+	} else {
+		result = sign > 0 ? krk_operator_add(current, amount) : krk_operator_sub(current, amount);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return 1;
+	}
+
+	krk_push(result);
+	krk_tableSet(&self->entries, key, result);
+	krk_writeBarrier((KrkObj*)self);
+	krk_pop();
+	return 0;
+}
+
+struct CounterContext {
+	KrkDict * self;
+	int sign;
+};
+
+static int _counter_update_callback(void * context, const KrkValue * values, size_t count) {
+	struct CounterContext * ctx = context;
+	for (size_t i = 0; i < count; ++i) {
+		if (_counter_add(ctx->self, values[i], INTEGER_VAL(1), ctx->sign)) return 1;
+	}
+	return 0;
+}
+
+static int _counter_update_mapping(KrkDict * self, KrkTable * from, int sign) {
+	for (size_t i = 0; i < from->used; ++i) {
+		KrkTableEntry * entry = &from->entries[i];
+		if (IS_KWARGS(entry->key)) continue;
+		if (_counter_add(self, entry->key, entry->value, sign)) return 1;
+	}
+	return 0;
+}
+
+static KrkValue _counter_update(KrkDict * self, int argc, const KrkValue argv[], int hasKw, int sign, const char * _method_name) {
+	KrkValue iterable = NONE_VAL();
+	if (!krk_parseArgs(".|V~", (const char*[]){"iterable"}, &iterable)) return NONE_VAL();
+
+	if (IS_NONE(iterable)) {
+		/* Nothing */
+	} else if (krk_isInstanceOf(iterable, vm.baseClasses->dictClass)) {
+		if (_counter_update_mapping(self, AS_DICT(iterable), sign)) return NONE_VAL();
+	} else {
+		struct CounterContext ctx = { self, sign };
+		if (krk_unpackIterable(iterable, &ctx, _counter_update_callback)) return NONE_VAL();
+	}
+
+	if (hasKw) _counter_update_mapping(self, AS_DICT(argv[argc]), sign);
+	return NONE_VAL();
+}
+
+KRK_Method(Counter,__init__) {
+	return _counter_update(self, argc, argv, hasKw, 1, _method_name);
+}
+
+KRK_Method(Counter,update) {
+	return _counter_update(self, argc, argv, hasKw, 1, _method_name);
+}
+
+KRK_Method(Counter,subtract) {
+	return _counter_update(self, argc, argv, hasKw, -1, _method_name);
+}
+
+KRK_Method(Counter,__getitem__) {
+	METHOD_TAKES_EXACTLY(1);
+	KrkValue out;
+	if (!krk_tableGet(&self->entries, argv[1], &out)) {
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+		return INTEGER_VAL(0);
+	}
+	return out;
+}
+
+KRK_Method(Counter,__delitem__) {
+	METHOD_TAKES_EXACTLY(1);
+	krk_tableDelete(&self->entries, argv[1]);
+	return NONE_VAL();
+}
+
+KRK_Method(Counter,total) {
+	METHOD_TAKES_NONE();
+	KrkValue total = INTEGER_VAL(0);
+	for (size_t i = 0; i < self->entries.used; ++i) {
+		KrkTableEntry * entry = &self->entries.entries[i];
+		if (IS_KWARGS(entry->key)) continue;
+		total = krk_operator_add(total, entry->value);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	}
+	return total;
+}
+
+/**
+ * @brief Whether count @p a should come after count @p b in most_common order.
+ */
+static int _counter_less(KrkValue a, KrkValue b) {
+	if (IS_INTEGER(a) && IS_INTEGER(b)) return AS_INTEGER(a) < AS_INTEGER(b);
+	KrkValue result = krk_operator_lt(a, b);
+	return IS_BOOLEAN(result) && AS_BOOLEAN(result);
+}
+
+/**
+ * @brief Stable merge sort of entries by descending count.
+ */
+static void _counter_sort(KrkTableEntry ** entries, KrkTableEntry ** scratch, size_t n) {
+	if (n < 2) return;
+	size_t mid = n / 2;
+	_counter_sort(entries, scratch, mid);
+	_counter_sort(entries + mid, scratch, n - mid);
+	if (!_counter_less(entries[mid-1]->value, entries[mid]->value)) return;
+	memcpy(scratch, entries, sizeof(KrkTableEntry*) * mid);
+	size_t i = 0, j = mid, k = 0;
+	while (i < mid && j < n) {
+		if (_counter_less(scratch[i]->value, entries[j]->value)) entries[k++] = entries[j++];
+		else entries[k++] = scratch[i++];
+	}
+	while (i < mid) entries[k++] = scratch[i++];
+}
+
+/**
+ * @brief Build a list of (key, count) pairs in most_common order.
+ */
+static KrkValue _counter_most_common(KrkDict * self, ssize_t limit) {
+	size_t n = self->entries.count;
+	KrkTableEntry ** sorted = malloc(sizeof(KrkTableEntry*) * (n * 2 + 1));
+	size_t k = 0;
+	for (size_t i = 0; i < self->entries.used; ++i) {
+		if (!IS_KWARGS(self->entries.entries[i].key)) sorted[k++] = &self->entries.entries[i];
+	}
+	_counter_sort(sorted, sorted + n, n);
+
+	if (limit < 0 || (size_t)limit > n) limit = n;
+	KrkValue out = krk_list_of(0, NULL, 0);
+	krk_push(out);
+	for (ssize_t i = 0; i < limit && !(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION); ++i) {
+		KrkValue pair[2] = { sorted[i]->key, sorted[i]->value };
+		krk_writeValueArray(AS_LIST(out), krk_tuple_of(2, pair, 0));
+	}
+	free(sorted);
+	return krk_pop();
+}
+
+KRK_Method(Counter,most_common) {
+	KrkValue n = NONE_VAL();
+	if (!krk_parseArgs(".|V", (const char*[]){"n"}, &n)) return NONE_VAL();
+	ssize_t limit = -1;
+	if (IS_INTEGER(n)) limit = AS_INTEGER(n) < 0 ? 0 : AS_INTEGER(n);
+	else if (!IS_NONE(n)) return krk_runtimeError(vm.exceptions->typeError, "n must be int, not '%T'", n);
+	return _counter_most_common(self, limit);
+}
+
+KRK_Method(Counter,elements) {
+	METHOD_TAKES_NONE();
+	KrkValue out = krk_list_of(0, NULL, 0);
+	krk_push(out);
+	for (size_t i = 0; i < self->entries.used; ++i) {
+		KrkTableEntry * entry = &self->entries.entries[i];
+		if (IS_KWARGS(entry->key) || !IS_INTEGER(entry->value)) continue;
+		for (krk_integer_type j = 0; j < AS_INTEGER(entry->value); ++j) {
+			krk_writeValueArray(AS_LIST(out), entry->key);
+		}
+	}
+	return krk_pop();
+}
+
+KRK_Method(Counter,copy) {
+	METHOD_TAKES_NONE();
+	KrkDict * out = (KrkDict*)krk_newInstance(krk_getType(argv[0]));
+	krk_push(OBJECT_VAL(out));
+	krk_tableAddAll(&self->entries, &out->entries);
+	return krk_pop();
+}
+
+KRK_Method(Counter,__repr__) {
+	METHOD_TAKES_NONE();
+	if (((KrkObj*)self)->flags & KRK_OBJ_FLAGS_IN_REPR) return OBJECT_VAL(S("Counter(...)"));
+	KrkValue pairs = _counter_most_common(self, -1);
+	krk_push(pairs);
+	((KrkObj*)self)->flags |= KRK_OBJ_FLAGS_IN_REPR;
+
+	struct StringBuilder sb = {0};
+	pushStringBuilderStr(&sb, "Counter({", 9);
+	KrkValueArray * items = AS_LIST(pairs);
+	for (size_t i = 0; i < items->count && !(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION); ++i) {
+		if (i) pushStringBuilderStr(&sb, ", ", 2);
+		KrkTuple * pair = AS_TUPLE(items->values[i]);
+		for (int j = 0; j < 2; ++j) {
+			KrkClass * type = krk_getType(pair->values.values[j]);
+			krk_push(pair->values.values[j]);
+			KrkValue result = krk_callDirect(type->_reprer, 1);
+			if (!IS_STRING(result)) break;
+			pushStringBuilderStr(&sb, AS_STRING(result)->chars, AS_STRING(result)->length);
+			if (!j) pushStringBuilderStr(&sb, ": ", 2);
+		}
+	}
+	pushStringBuilderStr(&sb, "})", 2);
+
+	((KrkObj*)self)->flags &= ~(KRK_OBJ_FLAGS_IN_REPR);
+	krk_pop();
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		discardStringBuilder(&sb);
+		return NONE_VAL();
+	}
+	return finishStringBuilder(&sb);
+}
+
+/**
+ * @brief Shared body for Counter's binary operators.
+ *
+ * Keys from the left operand come first, then any new ones from the right.
+ * As with multisets, only positive counts are kept in the result.
+ */
+static KrkValue _counter_binop(KrkValue left, KrkValue right, KrkValue (*combine)(KrkValue,KrkValue)) {
+	if (!IS_Counter(right)) return NOTIMPL_VAL();
+	KrkDict * a = AS_Counter(left);
+	KrkDict * b = AS_Counter(right);
+	KrkDict * out = (KrkDict*)krk_newInstance(Counter);
+	krk_push(OBJECT_VAL(out));
+
+	for (int side = 0; side < 2; ++side) {
+		KrkTable * table = side ? &b->entries : &a->entries;
+		for (size_t i = 0; i < table->used; ++i) {
+			KrkValue key = table->entries[i].key;
+			if (IS_KWARGS(key)) continue;
+			KrkValue x = INTEGER_VAL(0), y = INTEGER_VAL(0);
+			if (side && krk_tableGet(&a->entries, key, &x)) continue;
+			krk_tableGet(&a->entries, key, &x);
+			krk_tableGet(&b->entries, key, &y);
+			KrkValue result = combine(x, y);
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+			if (_counter_less(INTEGER_VAL(0), result)) {
+				krk_push(result);
+				krk_tableSet(&out->entries, key, result);
+				krk_pop();
+			}
+		}
+	}
+
+	return krk_pop();
+}
+
+static KrkValue _counter_max(KrkValue a, KrkValue b) { return _counter_less(a, b) ? b : a; }
+static KrkValue _counter_min(KrkValue a, KrkValue b) { return _counter_less(b, a) ? b : a; }
+
+KRK_Method(Counter,__add__) {
+	METHOD_TAKES_EXACTLY(1);
+	return _counter_binop(argv[0], argv[1], krk_operator_add);
+}
+
+KRK_Method(Counter,__sub__) {
+	METHOD_TAKES_EXACTLY(1);
+	return _counter_binop(argv[0], argv[1], krk_operator_sub);
+}
+
+KRK_Method(Counter,__or__) {
+	METHOD_TAKES_EXACTLY(1);
+	return _counter_binop(argv[0], argv[1], _counter_max);
+}
+
+KRK_Method(Counter,__and__) {
+	METHOD_TAKES_EXACTLY(1);
+	return _counter_binop(argv[0], argv[1], _counter_min);
+}
+
+KrkValue krk_module_onload__collections(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+
+	KRK_DOC(module, "@brief Native implementations of the collection types in @ref collections.");
+
+	krk_makeClass(module, &deque, "deque", vm.baseClasses->objectClass);
+	deque->allocSize = sizeof(struct Deque);
+	deque->_ongcscan = _deque_gcscan;
+	deque->_ongcsweep = _deque_gcsweep;
+	KRK_DOC(deque, "@brief Double-ended queue with constant time operations at both ends.\n"
+		"@arguments iterable=None,maxlen=None\n\n"
+		"If @p maxlen is given, adding to a full deque discards an element from the opposite end.");
+	BIND_METHOD(deque,__init__);
+	BIND_PROP(deque,maxlen);
+	BIND_METHOD(deque,__len__);
+	KRK_DOC(BIND_METHOD(deque,append), "@brief Add @p x to the right end.\n@arguments x");
+	KRK_DOC(BIND_METHOD(deque,appendleft), "@brief Add @p x to the left end.\n@arguments x");
+	KRK_DOC(BIND_METHOD(deque,pop), "@brief Remove and return the element at the right end.");
+	KRK_DOC(BIND_METHOD(deque,popleft), "@brief Remove and return the element at the left end.");
+	KRK_DOC(BIND_METHOD(deque,extend), "@brief Append each element of @p iterable to the right end.\n@arguments iterable");
+	KRK_DOC(BIND_METHOD(deque,extendleft), "@brief Append each element of @p iterable to the left end, reversing their order.\n@arguments iterable");
+	KRK_DOC(BIND_METHOD(deque,clear), "@brief Remove all elements.");
+	KRK_DOC(BIND_METHOD(deque,copy), "@brief Make a shallow copy of the deque.");
+	KRK_DOC(BIND_METHOD(deque,count), "@brief Count the elements equal to @p x.\n@arguments x");
+	KRK_DOC(BIND_METHOD(deque,index), "@brief Find the first index of @p x between @p start and @p stop.\n@arguments x,start=0,stop=len(self)");
+	KRK_DOC(BIND_METHOD(deque,insert), "@brief Insert @p x before index @p i.\n@arguments i,x");
+	KRK_DOC(BIND_METHOD(deque,remove), "@brief Remove the first element equal to @p value.\n@arguments value");
+	KRK_DOC(BIND_METHOD(deque,rotate), "@brief Rotate @p n steps to the right, or to the left if @p n is negative.\n@arguments n=1");
+	KRK_DOC(BIND_METHOD(deque,reverse), "@brief Reverse the elements in place.");
+	BIND_METHOD(deque,__getitem__);
+	BIND_METHOD(deque,__setitem__);
+	BIND_METHOD(deque,__delitem__);
+	BIND_METHOD(deque,__contains__);
+	BIND_METHOD(deque,__eq__);
+	BIND_METHOD(deque,__repr__);
+	krk_defineNative(&deque->methods, "__str__", FUNC_NAME(deque,__repr__));
+	BIND_METHOD(deque,__iter__);
+	BIND_METHOD(deque,__reversed__);
+	krk_attachNamedValue(&deque->methods, "__hash__", NONE_VAL());
+	krk_finalizeClass(deque);
+
+	krk_makeClass(module, &deque_iterator, "deque_iterator", vm.baseClasses->objectClass);
+	deque_iterator->allocSize = sizeof(struct DequeIterator);
+	deque_iterator->_ongcscan = _deque_iterator_gcscan;
+	BIND_METHOD(deque_iterator,__iter__);
+	BIND_METHOD(deque_iterator,__call__);
+	krk_finalizeClass(deque_iterator);
+
+	krk_makeClass(module, &OrderedDict, "OrderedDict", vm.baseClasses->dictClass);
+	OrderedDict->allocSize = sizeof(struct OrderedDict);
+	KRK_DOC(OrderedDict, "@brief Dictionary with operations for reordering its entries.");
+	KRK_DOC(BIND_METHOD(OrderedDict,popitem),
+		"@brief Remove and return the last (key, value) pair, or the first if @p last is false.\n"
+		"@arguments last=True");
+	KRK_DOC(BIND_METHOD(OrderedDict,move_to_end),
+		"@brief Move @p key to the end, or to the start if @p last is false.\n"
+		"@arguments key,last=True");
+	BIND_METHOD(OrderedDict,clear);
+	BIND_METHOD(OrderedDict,__eq__);
+	BIND_METHOD(OrderedDict,__repr__);
+	krk_defineNative(&OrderedDict->methods, "__str__", FUNC_NAME(OrderedDict,__repr__));
+	krk_finalizeClass(OrderedDict);
+
+	krk_makeClass(module, &Counter, "Counter", vm.baseClasses->dictClass);
+	KRK_DOC(Counter, "@brief Dictionary for counting hashable values.\n"
+		"@arguments iterable=None,**kwargs\n\n"
+		"Missing keys have a count of zero.");
+	BIND_METHOD(Counter,__init__);
+	KRK_DOC(BIND_METHOD(Counter,update),
+		"@brief Add counts from an iterable of elements or a mapping of counts.\n"
+		"@arguments iterable=None,**kwargs");
+	KRK_DOC(BIND_METHOD(Counter,subtract),
+		"@brief Subtract counts from an iterable of elements or a mapping of counts.\n"
+		"@arguments iterable=None,**kwargs");
+	KRK_DOC(BIND_METHOD(Counter,most_common),
+		"@brief List the @p n most common elements and their counts, from most to least common.\n"
+		"@arguments n=None");
+	KRK_DOC(BIND_METHOD(Counter,elements),
+		"@brief List each element as many times as its count.");
+	KRK_DOC(BIND_METHOD(Counter,total), "@brief Sum of all counts.");
+	BIND_METHOD(Counter,copy);
+	BIND_METHOD(Counter,__getitem__);
+	BIND_METHOD(Counter,__delitem__);
+	BIND_METHOD(Counter,__repr__);
+	krk_defineNative(&Counter->methods, "__str__", FUNC_NAME(Counter,__repr__));
+	BIND_METHOD(Counter,__add__);
+	BIND_METHOD(Counter,__sub__);
+	BIND_METHOD(Counter,__or__);
+	BIND_METHOD(Counter,__and__);
+	krk_finalizeClass(Counter);
+
+	krk_pop();
+	return OBJECT_VAL(module);
+}
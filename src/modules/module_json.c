@@ -0,0 +1,802 @@
+/**
+ * @file    module_json.c
+ * @brief   JSON encoder and decoder.
+ *
+ * Parses directly out of the buffer of a str or bytes object, building
+ * values on the VM stack so they are kept alive while the containers
+ * holding them are filled in. Lists and dicts are created only once all
+ * of their elements are known, so they can be allocated at their final size.
+ *
+ * Scanning through runs of whitespace and string contents is done sixteen
+ * bytes at a time where SSE2 is available.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#define JSON_MAX_DEPTH 1000
+
+static KrkClass * LineIterator = NULL;
+
+struct LineIterator {
+	KrkInstance inst;
+	KrkValue source;
+	KrkValue readline;
+	size_t line;
+};
+
+struct JsonParser {
+	const char * s;
+	size_t len;
+	size_t pos;
+	int depth;
+};
+
+static int parseValue(struct JsonParser * p);
+
+static KrkValue parseError(struct JsonParser * p, const char * msg) {
+	size_t line = 1, col = 1;
+	for (size_t i = 0; i < p->pos && i < p->len; ++i) {
+		if (p->s[i] == '\n') {
+			line++;
+			col = 1;
+		} else {
+			col++;
+		}
+	}
+	return krk_runtimeError(vm.exceptions->valueError, "%s: line %zu column %zu (char %zu)", msg, line, col, p->pos);
+}
+
+static inline int isWhitespace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline void skipWhitespace(struct JsonParser * p) {
+	/* Most values are not preceded by whitespace, or only by a single space. */
+	if (p->pos < p->len && !isWhitespace(p->s[p->pos])) return;
+#if defined(__SSE2__)
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i nl    = _mm_set1_epi8('\n');
+	const __m128i cr    = _mm_set1_epi8('\r');
+	const __m128i tab   = _mm_set1_epi8('\t');
+	while (p->pos + 16 <= p->len) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(p->s + p->pos));
+		__m128i ws = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, nl)),
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, tab)));
+		unsigned int mask = ~_mm_movemask_epi8(ws) & 0xFFFF;
+		if (mask) {
+			p->pos += __builtin_ctz(mask);
+			return;
+		}
+		p->pos += 16;
+	}
+#endif
+	while (p->pos < p->len && isWhitespace(p->s[p->pos])) p->pos++;
+}
+
+/**
+ * Find the first quote, backslash, or control character at or after @p i.
+ */
+static inline size_t scanString(const char * s, size_t i, size_t len) {
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i slash = _mm_set1_epi8('\\');
+	const __m128i ctrl  = _mm_set1_epi8(0x1F);
+	while (i + 16 <= len) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(s + i));
+		__m128i special = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, slash)),
+			_mm_cmpeq_epi8(_mm_min_epu8(chunk, ctrl), chunk));
+		unsigned int mask = _mm_movemask_epi8(special);
+		if (mask) return i + __builtin_ctz(mask);
+		i += 16;
+	}
+#endif
+	while (i < len && s[i] != '"' && s[i] != '\\' && (unsigned char)s[i] >= 0x20) i++;
+	return i;
+}
+
+static int parseHex4(struct JsonParser * p, uint32_t * out) {
+	if (p->pos + 4 > p->len) return 1;
+	uint32_t value = 0;
+	for (int i = 0; i < 4; ++i) {
+		char c = p->s[p->pos++];
+		value <<= 4;
+		if (c >= '0' && c <= '9') value |= c - '0';
+		else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+		else return 1;
+	}
+	*out = value;
+	return 0;
+}
+
+static void pushCodepoint(struct StringBuilder * sb, uint32_t c) {
+	if (c < 0x80) {
+		krk_pushStringBuilder(sb, c);
+	} else if (c < 0x800) {
+		krk_pushStringBuilder(sb, 0xC0 | (c >> 6));
+		krk_pushStringBuilder(sb, 0x80 | (c & 0x3F));
+	} else if (c < 0x10000) {
+		krk_pushStringBuilder(sb, 0xE0 | (c >> 12));
+		krk_pushStringBuilder(sb, 0x80 | ((c >> 6) & 0x3F));
+		krk_pushStringBuilder(sb, 0x80 | (c & 0x3F));
+	} else {
+		krk_pushStringBuilder(sb, 0xF0 | (c >> 18));
+		krk_pushStringBuilder(sb, 0x80 | ((c >> 12) & 0x3F));
+		krk_pushStringBuilder(sb, 0x80 | ((c >> 6) & 0x3F));
+		krk_pushStringBuilder(sb, 0x80 | (c & 0x3F));
+	}
+}
+
+static int parseString(struct JsonParser * p) {
+	size_t start = ++p->pos;
+	size_t end = scanString(p->s, start, p->len);
+
+	/* The common case: no escapes, so we can copy straight out of the buffer. */
+	if (end < p->len && p->s[end] == '"') {
+		p->pos = end + 1;
+		krk_push(OBJECT_VAL(krk_copyString(p->s + start, end - start)));
+		return 0;
+	}
+
+	struct StringBuilder sb = {0};
+	krk_pushStringBuilderStr(&sb, p->s + start, end - start);
+	p->pos = end;
+
+	while (1) {
+		if (p->pos >= p->len) {
+			krk_discardStringBuilder(&sb);
+			parseError(p, "Unterminated string");
+			return 1;
+		}
+		char c = p->s[p->pos];
+		if (c == '"') break;
+		if ((unsigned char)c < 0x20) {
+			krk_discardStringBuilder(&sb);
+			parseError(p, "Invalid control character in string");
+			return 1;
+		}
+		/* Must be a backslash. */
+		if (++p->pos >= p->len) continue;
+		switch (p->s[p->pos++]) {
+			case '"':  krk_pushStringBuilder(&sb, '"'); break;
+			case '\\': krk_pushStringBuilder(&sb, '\\'); break;
+			case '/':  krk_pushStringBuilder(&sb, '/'); break;
+			case 'b':  krk_pushStringBuilder(&sb, '\b'); break;
+			case 'f':  krk_pushStringBuilder(&sb, '\f'); break;
+			case 'n':  krk_pushStringBuilder(&sb, '\n'); break;
+			case 'r':  krk_pushStringBuilder(&sb, '\r'); break;
+			case 't':  krk_pushStringBuilder(&sb, '\t'); break;
+			case 'u': {
+				uint32_t codepoint;
+				if (parseHex4(p, &codepoint)) {
+					krk_discardStringBuilder(&sb);
+					parseError(p, "Invalid \\u escape");
+					return 1;
+				}
+				/* Combine surrogate pairs; strings can not hold a lone surrogate. */
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && p->pos + 6 <= p->len &&
+				    p->s[p->pos] == '\\' && p->s[p->pos+1] == 'u') {
+					size_t save = p->pos;
+					uint32_t low;
+					p->pos += 2;
+					if (!parseHex4(p, &low) && low >= 0xDC00 && low < 0xE000) {
+						codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+					} else {
+						p->pos = save;
+					}
+				}
+				if (codepoint >= 0xD800 && codepoint < 0xE000) {
+					krk_discardStringBuilder(&sb);
+					parseError(p, "Invalid \\u escape: lone surrogate");
+					return 1;
+				}
+				pushCodepoint(&sb, codepoint);
+				break;
+			}
+			default:
+				p->pos--;
+				krk_discardStringBuilder(&sb);
+				parseError(p, "Invalid escape");
+				return 1;
+		}
+		end = scanString(p->s, p->pos, p->len);
+		krk_pushStringBuilderStr(&sb, p->s + p->pos, end - p->pos);
+		p->pos = end;
+	}
+
+	p->pos++;
+	krk_push(krk_finishStringBuilder(&sb));
+	return 0;
+}
+
+static int parseNumber(struct JsonParser * p) {
+	size_t start = p->pos;
+	int isFloat = 0;
+
+	if (p->s[p->pos] == '-') p->pos++;
+	if (p->pos < p->len && p->s[p->pos] == '0') {
+		p->pos++;
+	} else if (p->pos < p->len && p->s[p->pos] >= '1' && p->s[p->pos] <= '9') {
+		while (p->pos < p->len && p->s[p->pos] >= '0' && p->s[p->pos] <= '9') p->pos++;
+	} else {
+		parseError(p, "Expecting digit");
+		return 1;
+	}
+	if (p->pos < p->len && p->s[p->pos] == '.') {
+		isFloat = 1;
+		p->pos++;
+		if (p->pos >= p->len || p->s[p->pos] < '0' || p->s[p->pos] > '9') {
+			parseError(p, "Expecting digit");
+			return 1;
+		}
+		while (p->pos < p->len && p->s[p->pos] >= '0' && p->s[p->pos] <= '9') p->pos++;
+	}
+	if (p->pos < p->len && (p->s[p->pos] == 'e' || p->s[p->pos] == 'E')) {
+		isFloat = 1;
+		p->pos++;
+		if (p->pos < p->len && (p->s[p->pos] == '+' || p->s[p->pos] == '-')) p->pos++;
+		if (p->pos >= p->len || p->s[p->pos] < '0' || p->s[p->pos] > '9') {
+			parseError(p, "Expecting digit");
+			return 1;
+		}
+		while (p->pos < p->len && p->s[p->pos] >= '0' && p->s[p->pos] <= '9') p->pos++;
+	}
+
+	size_t width = p->pos - start;
+
+	if (!isFloat) {
+		/* Anything with fewer digits than this fits in a small int. */
+		if (width < 15) {
+			const char * c = p->s + start;
+			int negative = *c == '-';
+			krk_integer_type value = 0;
+			for (c += negative; c < p->s + p->pos; ++c) value = value * 10 + (*c - '0');
+			krk_push(INTEGER_VAL(negative ? -value : value));
+			return 0;
+		}
+		KrkValue result = krk_parse_int(p->s + start, width, 10);
+		if (IS_NONE(result)) {
+			parseError(p, "Invalid number");
+			return 1;
+		}
+		krk_push(result);
+		return 0;
+	}
+
+	/* The buffer may not be terminated after the number, so strtod needs a copy. */
+	char tmp[64];
+	char * buf = width < sizeof(tmp) ? tmp : malloc(width + 1);
+	memcpy(buf, p->s + start, width);
+	buf[width] = '\0';
+	double value = strtod(buf, NULL);
+	if (buf != tmp) free(buf);
+	krk_push(FLOATING_VAL(value));
+	return 0;
+}
+
+static int parseLiteral(struct JsonParser * p, const char * word, size_t len, KrkValue value) {
+	if (p->pos + len > p->len || memcmp(p->s + p->pos, word, len)) {
+		parseError(p, "Expecting value");
+		return 1;
+	}
+	p->pos += len;
+	krk_push(value);
+	return 0;
+}
+
+static int parseArray(struct JsonParser * p) {
+	size_t base = krk_currentThread.stackTop - krk_currentThread.stack;
+	size_t count = 0;
+
+	p->pos++;
+	skipWhitespace(p);
+	if (p->pos < p->len && p->s[p->pos] == ']') {
+		p->pos++;
+	} else {
+		while (1) {
+			if (parseValue(p)) return 1;
+			count++;
+			skipWhitespace(p);
+			if (p->pos < p->len && p->s[p->pos] == ',') {
+				p->pos++;
+				continue;
+			}
+			if (p->pos < p->len && p->s[p->pos] == ']') {
+				p->pos++;
+				break;
+			}
+			parseError(p, "Expecting ',' delimiter");
+			return 1;
+		}
+	}
+
+	KrkValue list = krk_list_of(0, NULL, 0);
+	krk_push(list);
+	if (count) {
+		KrkValueArray * out = AS_LIST(list);
+		out->values = GROW_ARRAY(KrkValue, out->values, 0, count);
+		out->capacity = count;
+		memcpy(out->values, krk_currentThread.stack + base, sizeof(KrkValue) * count);
+		out->count = count;
+	}
+	krk_currentThread.stackTop = krk_currentThread.stack + base;
+	krk_push(list);
+	return 0;
+}
+
+static int parseObject(struct JsonParser * p) {
+	size_t base = krk_currentThread.stackTop - krk_currentThread.stack;
+	size_t count = 0;
+
+	p->pos++;
+	skipWhitespace(p);
+	if (p->pos < p->len && p->s[p->pos] == '}') {
+		p->pos++;
+	} else {
+		while (1) {
+			skipWhitespace(p);
+			if (p->pos >= p->len || p->s[p->pos] != '"') {
+				parseError(p, "Expecting property name enclosed in double quotes");
+				return 1;
+			}
+			if (parseString(p)) return 1;
+			skipWhitespace(p);
+			if (p->pos >= p->len || p->s[p->pos] != ':') {
+				parseError(p, "Expecting ':' delimiter");
+				return 1;
+			}
+			p->pos++;
+			if (parseValue(p)) return 1;
+			count++;
+			skipWhitespace(p);
+			if (p->pos < p->len && p->s[p->pos] == ',') {
+				p->pos++;
+				continue;
+			}
+			if (p->pos < p->len && p->s[p->pos] == '}') {
+				p->pos++;
+				break;
+			}
+			parseError(p, "Expecting ',' delimiter");
+			return 1;
+		}
+	}
+
+	KrkValue dict = krk_dict_of(0, NULL, 0);
+	krk_push(dict);
+	if (count) {
+		krk_tableAdjustCapacity(AS_DICT(dict), count);
+		for (size_t i = 0; i < count; ++i) {
+			KrkValue * pair = krk_currentThread.stack + base + i * 2;
+			krk_tableSet(AS_DICT(dict), pair[0], pair[1]);
+		}
+	}
+	krk_currentThread.stackTop = krk_currentThread.stack + base;
+	krk_push(dict);
+	return 0;
+}
+
+static int parseValue(struct JsonParser * p) {
+	skipWhitespace(p);
+	if (p->pos >= p->len) {
+		parseError(p, "Expecting value");
+		return 1;
+	}
+	switch (p->s[p->pos]) {
+		case '"': return parseString(p);
+		case '{':
+		case '[': {
+			if (++p->depth > JSON_MAX_DEPTH) {
+				parseError(p, "Maximum nesting depth exceeded");
+				return 1;
+			}
+			int result = p->s[p->pos] == '{' ? parseObject(p) : parseArray(p);
+			p->depth--;
+			return result;
+		}
+		case 't': return parseLiteral(p, "true", 4, BOOLEAN_VAL(1));
+		case 'f': return parseLiteral(p, "false", 5, BOOLEAN_VAL(0));
+		case 'n': return parseLiteral(p, "null", 4, NONE_VAL());
+		case 'N': return parseLiteral(p, "NaN", 3, FLOATING_VAL(NAN));
+		case 'I': return parseLiteral(p, "Infinity", 8, FLOATING_VAL(INFINITY));
+		case '-':
+			if (p->pos + 1 < p->len && p->s[p->pos+1] == 'I') {
+				p->pos++;
+				return parseLiteral(p, "Infinity", 8, FLOATING_VAL(-INFINITY));
+			}
+			return parseNumber(p);
+		default:
+			if (p->s[p->pos] >= '0' && p->s[p->pos] <= '9') return parseNumber(p);
+			parseError(p, "Expecting value");
+			return 1;
+	}
+}
+
+/**
+ * Parse a complete document from a str or bytes object.
+ */
+static KrkValue decode(const char * _method_name, KrkValue source) {
+	struct JsonParser p = {0};
+	if (IS_STRING(source)) {
+		p.s = AS_CSTRING(source);
+		p.len = AS_STRING(source)->length;
+	} else if (IS_BYTES(source)) {
+		p.s = (const char *)AS_BYTES(source)->bytes;
+		p.len = AS_BYTES(source)->length;
+	} else {
+		return TYPE_ERROR(str or bytes, source);
+	}
+
+	/* The source is on our caller's stack, so it will not be collected from under us. */
+	size_t base = krk_currentThread.stackTop - krk_currentThread.stack;
+	if (parseValue(&p)) {
+		krk_currentThread.stackTop = krk_currentThread.stack + base;
+		return NONE_VAL();
+	}
+	skipWhitespace(&p);
+	if (p.pos != p.len) {
+		krk_currentThread.stackTop = krk_currentThread.stack + base;
+		return parseError(&p, "Extra data");
+	}
+	return krk_pop();
+}
+
+struct JsonEncoder {
+	struct StringBuilder sb;
+	int indent;
+	int depth;
+};
+
+static int encodeValue(struct JsonEncoder * e, KrkValue value);
+
+static void encodeNewline(struct JsonEncoder * e) {
+	if (e->indent < 0) return;
+	krk_pushStringBuilder(&e->sb, '\n');
+	for (int i = 0; i < e->indent * e->depth; ++i) krk_pushStringBuilder(&e->sb, ' ');
+}
+
+static void encodeString(struct JsonEncoder * e, KrkString * str) {
+	static const char hex[] = "0123456789abcdef";
+	const char * s = str->chars;
+	size_t len = str->length;
+	size_t i = 0;
+
+	krk_pushStringBuilder(&e->sb, '"');
+	while (i < len) {
+		size_t end = scanString(s, i, len);
+		krk_pushStringBuilderStr(&e->sb, s + i, end - i);
+		if (end == len) break;
+		unsigned char c = s[end];
+		krk_pushStringBuilder(&e->sb, '\\');
+		switch (c) {
+			case '"':  krk_pushStringBuilder(&e->sb, '"'); break;
+			case '\\': krk_pushStringBuilder(&e->sb, '\\'); break;
+			case '\b': krk_pushStringBuilder(&e->sb, 'b'); break;
+			case '\f': krk_pushStringBuilder(&e->sb, 'f'); break;
+			case '\n': krk_pushStringBuilder(&e->sb, 'n'); break;
+			case '\r': krk_pushStringBuilder(&e->sb, 'r'); break;
+			case '\t': krk_pushStringBuilder(&e->sb, 't'); break;
+			default: {
+				char esc[5] = {'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+				krk_pushStringBuilderStr(&e->sb, esc, 5);
+				break;
+			}
+		}
+		i = end + 1;
+	}
+	krk_pushStringBuilder(&e->sb, '"');
+}
+
+static int encodeRepr(struct JsonEncoder * e, KrkValue value) {
+	krk_push(value);
+	KrkValue result = krk_callDirect(krk_getType(value)->_reprer, 1);
+	if (!IS_STRING(result)) return 1;
+	krk_pushStringBuilderStr(&e->sb, AS_CSTRING(result), AS_STRING(result)->length);
+	return 0;
+}
+
+static int encodeFloat(struct JsonEncoder * e, KrkValue value) {
+	double d = AS_FLOATING(value);
+	if (isnan(d)) {
+		krk_pushStringBuilderStr(&e->sb, "NaN", 3);
+	} else if (isinf(d)) {
+		if (d < 0) krk_pushStringBuilderStr(&e->sb, "-Infinity", 9);
+		else krk_pushStringBuilderStr(&e->sb, "Infinity", 8);
+	} else {
+		return encodeRepr(e, value);
+	}
+	return 0;
+}
+
+static int encodeKey(struct JsonEncoder * e, KrkValue key) {
+	if (IS_STRING(key)) {
+		encodeString(e, AS_STRING(key));
+		return 0;
+	}
+	krk_pushStringBuilder(&e->sb, '"');
+	if (IS_BOOLEAN(key)) {
+		if (AS_BOOLEAN(key)) krk_pushStringBuilderStr(&e->sb, "true", 4);
+		else krk_pushStringBuilderStr(&e->sb, "false", 5);
+	} else if (IS_NONE(key)) {
+		krk_pushStringBuilderStr(&e->sb, "null", 4);
+	} else if (IS_INTEGER(key) || krk_isInstanceOf(key, vm.baseClasses->intClass)) {
+		if (encodeRepr(e, key)) return 1;
+	} else if (IS_FLOATING(key)) {
+		if (encodeFloat(e, key)) return 1;
+	} else {
+		krk_runtimeError(vm.exceptions->typeError, "keys must be str, int, float, bool or None, not '%T'", key);
+		return 1;
+	}
+	krk_pushStringBuilder(&e->sb, '"');
+	return 0;
+}
+
+static int encodeContainer(struct JsonEncoder * e, KrkValue value) {
+	KrkObj * obj = AS_OBJECT(value);
+	if (obj->flags & KRK_OBJ_FLAGS_IN_REPR) {
+		krk_runtimeError(vm.exceptions->valueError, "Circular reference detected");
+		return 1;
+	}
+	obj->flags |= KRK_OBJ_FLAGS_IN_REPR;
+	e->depth++;
+
+	int result = 0;
+	if (krk_isInstanceOf(value, vm.baseClasses->dictClass)) {
+		KrkTable * table = AS_DICT(value);
+		size_t c = 0;
+		krk_pushStringBuilder(&e->sb, '{');
+		for (size_t i = 0; i < table->used && !result; ++i) {
+			KrkTableEntry * entry = &table->entries[i];
+			if (IS_KWARGS(entry->key)) continue;
+			if (c++) krk_pushStringBuilderStr(&e->sb, ", ", e->indent < 0 ? 2 : 1);
+			encodeNewline(e);
+			result = encodeKey(e, entry->key);
+			if (result) break;
+			krk_pushStringBuilderStr(&e->sb, ": ", 2);
+			result = encodeValue(e, entry->value);
+		}
+		e->depth--;
+		if (c) encodeNewline(e);
+		krk_pushStringBuilder(&e->sb, '}');
+	} else {
+		KrkValueArray * values = IS_TUPLE(value) ? &AS_TUPLE(value)->values : AS_LIST(value);
+		krk_pushStringBuilder(&e->sb, '[');
+		for (size_t i = 0; i < values->count && !result; ++i) {
+			if (i) krk_pushStringBuilderStr(&e->sb, ", ", e->indent < 0 ? 2 : 1);
+			encodeNewline(e);
+			result = encodeValue(e, values->values[i]);
+		}
+		e->depth--;
+		if (values->count) encodeNewline(e);
+		krk_pushStringBuilder(&e->sb, ']');
+	}
+
+	obj->flags &= ~KRK_OBJ_FLAGS_IN_REPR;
+	return result;
+}
+
+static int encodeValue(struct JsonEncoder * e, KrkValue value) {
+	if (IS_NONE(value)) {
+		krk_pushStringBuilderStr(&e->sb, "null", 4);
+	} else if (IS_BOOLEAN(value)) {
+		if (AS_BOOLEAN(value)) krk_pushStringBuilderStr(&e->sb, "true", 4);
+		else krk_pushStringBuilderStr(&e->sb, "false", 5);
+	} else if (IS_INTEGER(value)) {
+		char tmp[32];
+		size_t len = snprintf(tmp, 32, PRIkrk_int, AS_INTEGER(value));
+		krk_pushStringBuilderStr(&e->sb, tmp, len);
+	} else if (IS_FLOATING(value)) {
+		return encodeFloat(e, value);
+	} else if (IS_STRING(value)) {
+		encodeString(e, AS_STRING(value));
+	} else if (IS_TUPLE(value) || krk_isInstanceOf(value, vm.baseClasses->listClass) ||
+	           krk_isInstanceOf(value, vm.baseClasses->dictClass)) {
+		return encodeContainer(e, value);
+	} else if (krk_isInstanceOf(value, vm.baseClasses->intClass)) {
+		/* Long ints */
+		return encodeRepr(e, value);
+	} else {
+		krk_runtimeError(vm.exceptions->typeError, "Object of type '%T' is not JSON serializable", value);
+		return 1;
+	}
+	return 0;
+}
+
+static KrkValue encode(const char * _method_name, KrkValue value, KrkValue indent) {
+	struct JsonEncoder e = {{0}, -1, 0};
+	if (IS_INTEGER(indent)) {
+		e.indent = AS_INTEGER(indent) < 0 ? 0 : AS_INTEGER(indent);
+	} else if (!IS_NONE(indent)) {
+		return TYPE_ERROR(int or None, indent);
+	}
+	if (encodeValue(&e, value)) return krk_discardStringBuilder(&e.sb);
+	return krk_finishStringBuilder(&e.sb);
+}
+
+KRK_Function(loads) {
+	FUNCTION_TAKES_EXACTLY(1);
+	return decode(_method_name, argv[0]);
+}
+
+KRK_Function(dumps) {
+	KrkValue value;
+	KrkValue indent = NONE_VAL();
+	if (!krk_parseArgs("V|V", (const char *[]){"obj","indent"}, &value, &indent)) return NONE_VAL();
+	return encode(_method_name, value, indent);
+}
+
+static KrkValue callMethod(KrkValue object, char * name, KrkValue arg, int argCount) {
+	KrkValue method = krk_valueGetAttribute(object, name);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	krk_push(method);
+	if (argCount) krk_push(arg);
+	return krk_callStack(argCount);
+}
+
+KRK_Function(load) {
+	FUNCTION_TAKES_EXACTLY(1);
+	KrkValue contents = callMethod(argv[0], "read", NONE_VAL(), 0);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	krk_push(contents);
+	KrkValue result = decode(_method_name, contents);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	krk_pop();
+	return result;
+}
+
+KRK_Function(dump) {
+	KrkValue value, file;
+	KrkValue indent = NONE_VAL();
+	if (!krk_parseArgs("VV|V", (const char *[]){"obj","fp","indent"}, &value, &file, &indent)) return NONE_VAL();
+	KrkValue output = encode(_method_name, value, indent);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	krk_push(output);
+	callMethod(file, "write", output, 1);
+	krk_pop();
+	return NONE_VAL();
+}
+
+#define CURRENT_CTYPE struct LineIterator *
+#define CURRENT_NAME  self
+
+#define IS_LineIterator(o) (krk_isInstanceOf(o,LineIterator))
+#define AS_LineIterator(o) ((struct LineIterator*)AS_OBJECT(o))
+
+static void _lineiterator_gcscan(KrkInstance * _self) {
+	struct LineIterator * self = (struct LineIterator*)_self;
+	krk_markValue(self->source);
+	krk_markValue(self->readline);
+}
+
+KRK_Method(LineIterator,__init__) {
+	METHOD_TAKES_EXACTLY(1);
+	self->source = argv[1];
+	self->readline = NONE_VAL();
+	self->line = 0;
+
+	/* Files are read a line at a time; anything else should be an iterable of lines. */
+	KrkValue readline = krk_valueGetAttribute_default(argv[1], "readline", NONE_VAL());
+	if (!IS_NONE(readline)) {
+		self->readline = readline;
+		return NONE_VAL();
+	}
+
+	KrkClass * type = krk_getType(argv[1]);
+	if (!type->_iter) return krk_runtimeError(vm.exceptions->typeError, "'%T' object is not iterable", argv[1]);
+	krk_push(argv[1]);
+	KrkValue iter = krk_callDirect(type->_iter, 1);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	self->source = iter;
+	return NONE_VAL();
+}
+
+KRK_Method(LineIterator,__iter__) {
+	METHOD_TAKES_NONE();
+	return argv[0];
+}
+
+KRK_Method(LineIterator,__call__) {
+	METHOD_TAKES_NONE();
+	while (1) {
+		KrkValue line;
+		if (!IS_NONE(self->readline)) {
+			krk_push(self->readline);
+			line = krk_callStack(0);
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+			if (IS_NONE(line)) return argv[0];
+		} else {
+			krk_push(self->source);
+			line = krk_callStack(0);
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+			if (krk_valuesSame(line, self->source)) return argv[0];
+		}
+
+		self->line++;
+
+		/* Skip blank lines, but an empty read means we are at the end. */
+		const char * s;
+		size_t len;
+		if (IS_STRING(line)) {
+			s = AS_CSTRING(line);
+			len = AS_STRING(line)->length;
+		} else if (IS_BYTES(line)) {
+			s = (const char*)AS_BYTES(line)->bytes;
+			len = AS_BYTES(line)->length;
+		} else {
+			return TYPE_ERROR(str or bytes, line);
+		}
+		if (!len && !IS_NONE(self->readline)) return argv[0];
+		size_t i = 0;
+		while (i < len && isWhitespace(s[i])) i++;
+		if (i == len) continue;
+
+		krk_push(line);
+		KrkValue result = decode(_method_name, line);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+		krk_pop();
+		return result;
+	}
+}
+
+KRK_Function(iterload) {
+	FUNCTION_TAKES_EXACTLY(1);
+	KrkInstance * out = krk_newInstance(LineIterator);
+	krk_push(OBJECT_VAL(out));
+	krk_push(OBJECT_VAL(out));
+	krk_push(argv[0]);
+	krk_callDirect(LineIterator->_init, 2);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	return krk_pop();
+}
+
+KrkValue krk_module_onload_json(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+
+	KRK_DOC(module, "@brief JSON encoder and decoder.\n\n"
+		"Provides methods for parsing and producing the JSON data interchange format.");
+
+	KRK_DOC(BIND_FUNC(module,loads),
+		"@brief Parse @p s as a JSON document.\n"
+		"@arguments s\n\n"
+		"@p s may be a @ref str or @ref bytes object containing UTF-8 text. "
+		"Objects become @ref dict, arrays become @ref list. Raises @ref ValueError if @p s is not valid JSON.");
+	KRK_DOC(BIND_FUNC(module,dumps),
+		"@brief Serialize @p obj as a JSON document.\n"
+		"@arguments obj,indent=None\n\n"
+		"Accepts @ref dict, @ref list, @ref tuple, @ref str, numbers, booleans and @c None. "
+		"If @p indent is an integer, the output is pretty-printed with that many spaces per level.");
+	KRK_DOC(BIND_FUNC(module,load),
+		"@brief Parse the contents of a file as a JSON document.\n"
+		"@arguments fp\n\n"
+		"Calls @c fp.read() and parses the result as with @ref loads.");
+	KRK_DOC(BIND_FUNC(module,dump),
+		"@brief Serialize @p obj as a JSON document and write it to a file.\n"
+		"@arguments obj,fp,indent=None\n\n"
+		"Writes the result of @ref dumps to @c fp.write().");
+	KRK_DOC(BIND_FUNC(module,iterload),
+		"@brief Iterate over the documents in a newline-delimited JSON stream.\n"
+		"@arguments source\n\n"
+		"@p source may be a file, which is read one line at a time with @c readline(), "
+		"or any iterable of lines. Each non-blank line is parsed as a separate document.");
+
+	krk_makeClass(module, &LineIterator, "LineIterator", vm.baseClasses->objectClass);
+	LineIterator->allocSize = sizeof(struct LineIterator);
+	LineIterator->_ongcscan = _lineiterator_gcscan;
+	BIND_METHOD(LineIterator,__init__);
+	BIND_METHOD(LineIterator,__iter__);
+	BIND_METHOD(LineIterator,__call__);
+	krk_finalizeClass(LineIterator);
+
+	krk_pop();
+	return OBJECT_VAL(module);
+}
@@ -0,0 +1,551 @@
+/**
+ * @file    module_mmap.c
+ * @brief   Memory-mapped files.
+ *
+ * Provides @c mmap.mmap, a mutable, fixed-size byte sequence backed by a
+ * mapping of a file (or of anonymous memory) rather than by the heap.
+ *
+ * Slicing an mmap with a step of one does not copy: the result is another
+ * @c mmap object, a view, which points into the same mapping and keeps the
+ * object that owns the mapping alive. Closing the owner unmaps the memory,
+ * after which every view of it reports itself as closed, so each access
+ * checks the owner before touching the mapping.
+ */
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+#include <kuroko/memory.h>
+
+#define ACCESS_DEFAULT 0
+#define ACCESS_READ    1
+#define ACCESS_WRITE   2
+#define ACCESS_COPY    3
+
+static KrkClass * mmapClass = NULL;
+
+struct MMap {
+	KrkInstance inst;
+	uint8_t * data;   /**< First byte of this object's window into the mapping */
+	size_t size;      /**< Length of the window */
+	size_t pos;       /**< Position for read, readline, write and seek */
+	KrkValue base;    /**< For a view, the mmap that owns the mapping; not an object otherwise */
+	void * addr;      /**< Page-aligned start of the mapping, owner only; NULL once closed */
+	size_t maplen;    /**< Length passed to mmap(2), owner only */
+	size_t offset;    /**< File offset of @c data */
+	int access;
+	int readonly;
+	int shared;       /**< Whether @c flush should write back to a file */
+};
+
+#define IS_mmap(o) (krk_isInstanceOf(o,mmapClass))
+#define AS_mmap(o) ((struct MMap*)AS_OBJECT(o))
+#define CURRENT_CTYPE struct MMap *
+#define CURRENT_NAME  self
+
+static size_t _pagesize(void) {
+	static size_t pagesize = 0;
+	if (!pagesize) pagesize = sysconf(_SC_PAGESIZE);
+	return pagesize;
+}
+
+static void _mmap_gcscan(KrkInstance * _self) {
+	krk_markValue(((struct MMap*)_self)->base);
+}
+
+static void _mmap_gcsweep(KrkInstance * _self) {
+	struct MMap * self = (struct MMap*)_self;
+	if (self->addr) munmap(self->addr, self->maplen);
+	self->addr = NULL;
+}
+
+static struct MMap * _mmap_owner(struct MMap * self) {
+	return IS_OBJECT(self->base) ? AS_mmap(self->base) : self;
+}
+
+/**
+ * Every method that reads or writes through @c data calls this first, as
+ * the owner may have been closed since a view was created.
+ */
+static int _mmap_valid(struct MMap * self) {
+	if (!_mmap_owner(self)->addr) {
+		krk_runtimeError(vm.exceptions->valueError, "mmap closed or invalid");
+		return 0;
+	}
+	return 1;
+}
+
+static int _mmap_writable(struct MMap * self) {
+	if (!_mmap_valid(self)) return 0;
+	if (self->readonly) {
+		krk_runtimeError(vm.exceptions->typeError, "mmap can't modify a readonly memory map.");
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Clamp a start/end pair the way string searches do: negative values
+ * count from the end and anything past either end is pulled back in.
+ */
+static void _mmap_clamp(struct MMap * self, ssize_t * start, ssize_t * end) {
+	ssize_t size = self->size;
+	if (*start < 0) *start += size;
+	if (*start < 0) *start = 0;
+	if (*start > size) *start = size;
+	if (*end < 0) *end += size;
+	if (*end < 0) *end = 0;
+	if (*end > size) *end = size;
+}
+
+/**
+ * Round a range of this window out to whole pages, for msync and madvise,
+ * which both require a page-aligned address.
+ */
+static int _mmap_page_range(struct MMap * self, ssize_t start, ssize_t length, void ** addr, size_t * len) {
+	if (start < 0 || (size_t)start > self->size || length < 0 || (size_t)length > self->size - start) {
+		krk_runtimeError(vm.exceptions->valueError, "range out of bounds");
+		return 0;
+	}
+	uintptr_t first = (uintptr_t)(self->data + start);
+	uintptr_t aligned = first & ~(uintptr_t)(_pagesize() - 1);
+	*addr = (void*)aligned;
+	*len = length + (first - aligned);
+	return 1;
+}
+
+static int _mmap_getbuffer(KrkValue value, KrkBuffer * out) {
+	struct MMap * self = AS_mmap(value);
+	if (!_mmap_valid(self)) return 0;
+	out->buf = self->data;
+	out->len = self->size;
+	out->readonly = self->readonly;
+	return 1;
+}
+
+static KrkValue _mmap_view(struct MMap * self, size_t start, size_t length) {
+	struct MMap * view = (struct MMap*)krk_newInstance(mmapClass);
+	view->data = self->data + start;
+	view->size = length;
+	view->base = OBJECT_VAL(_mmap_owner(self));
+	view->offset = self->offset + start;
+	view->access = self->access;
+	view->readonly = self->readonly;
+	view->shared = self->shared;
+	return OBJECT_VAL(view);
+}
+
+KRK_Method(mmap,__init__) {
+	int fileno;
+	ssize_t length;
+	int flags = MAP_SHARED;
+	int prot = PROT_READ | PROT_WRITE;
+	int access = ACCESS_DEFAULT;
+	long long offset = 0;
+
+	if (!krk_parseArgs(".in|iiiL:mmap",
+		(const char*[]){"fileno","length","flags","prot","access","offset"},
+		&fileno, &length, &flags, &prot, &access, &offset)) {
+		return NONE_VAL();
+	}
+
+	if (self->addr || IS_OBJECT(self->base)) return krk_runtimeError(vm.exceptions->valueError, "mmap is already initialized");
+	if (length < 0) return krk_runtimeError(vm.exceptions->valueError, "memory mapped length must be positive");
+	if (offset < 0) return krk_runtimeError(vm.exceptions->valueError, "memory mapped offset must be positive");
+
+	switch (access) {
+		case ACCESS_DEFAULT: break;
+		case ACCESS_READ:  flags = MAP_SHARED;  prot = PROT_READ; break;
+		case ACCESS_WRITE: flags = MAP_SHARED;  prot = PROT_READ | PROT_WRITE; break;
+		case ACCESS_COPY:  flags = MAP_PRIVATE; prot = PROT_READ | PROT_WRITE; break;
+		default:
+			return krk_runtimeError(vm.exceptions->valueError, "mmap invalid access parameter.");
+	}
+
+	if (fileno == -1) {
+#ifdef MAP_ANONYMOUS
+		if (!length) return krk_runtimeError(vm.exceptions->valueError, "cannot mmap an empty file");
+		flags |= MAP_ANONYMOUS;
+#else
+		return krk_runtimeError(vm.exceptions->valueError, "anonymous mappings are not supported");
+#endif
+	} else {
+		struct stat st;
+		if (fstat(fileno, &st)) return krk_runtimeError(vm.exceptions->OSError, "%s", strerror(errno));
+		if (S_ISREG(st.st_mode)) {
+			if (offset > st.st_size) return krk_runtimeError(vm.exceptions->valueError, "mmap offset is greater than file size");
+			if (!length) {
+				length = st.st_size - offset;
+				if (!length) return krk_runtimeError(vm.exceptions->valueError, "cannot mmap an empty file");
+			} else if (length > st.st_size - offset) {
+				return krk_runtimeError(vm.exceptions->valueError, "mmap length is greater than file size");
+			}
+		} else if (!length) {
+			return krk_runtimeError(vm.exceptions->valueError, "cannot mmap an empty file");
+		}
+	}
+
+	/* mmap(2) wants a page-aligned offset; map from the page before and skip ahead. */
+	size_t skip = offset & (_pagesize() - 1);
+	void * addr = mmap(NULL, length + skip, prot, flags, fileno, offset - skip);
+	if (addr == MAP_FAILED) return krk_runtimeError(vm.exceptions->OSError, "%s", strerror(errno));
+
+	self->addr = addr;
+	self->maplen = length + skip;
+	self->data = (uint8_t*)addr + skip;
+	self->size = length;
+	self->offset = offset;
+	self->access = access;
+	self->readonly = !(prot & PROT_WRITE);
+	self->shared = fileno != -1 && !(flags & MAP_PRIVATE);
+	return NONE_VAL();
+}
+
+KRK_Method(mmap,__repr__) {
+	static const char * names[] = {"ACCESS_DEFAULT","ACCESS_READ","ACCESS_WRITE","ACCESS_COPY"};
+	if (!_mmap_owner(self)->addr) return OBJECT_VAL(S("<mmap.mmap closed=True>"));
+	struct StringBuilder sb = {0};
+	if (!krk_pushStringBuilderFormat(&sb, "<mmap.mmap closed=False, access=%s, length=%zu, pos=%zu, offset=%zu>",
+		names[self->access], self->size, self->pos, self->offset)) {
+		krk_discardStringBuilder(&sb);
+		return NONE_VAL();
+	}
+	return finishStringBuilder(&sb);
+}
+
+KRK_Method(mmap,__len__) {
+	if (!_mmap_valid(self)) return NONE_VAL();
+	return INTEGER_VAL(self->size);
+}
+
+KRK_Method(mmap,__getitem__) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!_mmap_valid(self)) return NONE_VAL();
+
+	if (IS_INTEGER(argv[1])) {
+		krk_integer_type i = AS_INTEGER(argv[1]);
+		if (i < 0) i += (krk_integer_type)self->size;
+		if (i < 0 || i >= (krk_integer_type)self->size) return krk_runtimeError(vm.exceptions->indexError, "mmap index out of range");
+		return INTEGER_VAL(self->data[i]);
+	} else if (IS_slice(argv[1])) {
+		KRK_SLICER(argv[1],self->size) {
+			return NONE_VAL();
+		}
+		if (step == 1) {
+			return _mmap_view(self, start, end > start ? end - start : 0);
+		}
+		struct StringBuilder sb = {0};
+		krk_integer_type i = start;
+		while ((step < 0) ? (i > end) : (i < end)) {
+			pushStringBuilder(&sb, self->data[i]);
+			i += step;
+		}
+		return finishStringBuilderBytes(&sb);
+	}
+
+	return TYPE_ERROR(int or slice, argv[1]);
+}
+
+KRK_Method(mmap,__setitem__) {
+	METHOD_TAKES_EXACTLY(2);
+	if (!_mmap_writable(self)) return NONE_VAL();
+
+	if (IS_INTEGER(argv[1])) {
+		krk_integer_type i = AS_INTEGER(argv[1]);
+		if (i < 0) i += (krk_integer_type)self->size;
+		if (i < 0 || i >= (krk_integer_type)self->size) return krk_runtimeError(vm.exceptions->indexError, "mmap index out of range");
+		if (!IS_INTEGER(argv[2])) return TYPE_ERROR(int, argv[2]);
+		if (AS_INTEGER(argv[2]) < 0 || AS_INTEGER(argv[2]) > 255) return krk_runtimeError(vm.exceptions->valueError, "mmap item value must be in range(0, 256)");
+		self->data[i] = AS_INTEGER(argv[2]);
+		return argv[2];
+	} else if (IS_slice(argv[1])) {
+		KRK_SLICER(argv[1],self->size) {
+			return NONE_VAL();
+		}
+		KrkBuffer source;
+		if (!krk_getBuffer(argv[2], &source, 0)) return NONE_VAL();
+		size_t count = 0;
+		if (step > 0 && end > start) count = (end - start + step - 1) / step;
+		else if (step < 0 && start > end) count = (start - end - step - 1) / -step;
+		if (count != source.len) return krk_runtimeError(vm.exceptions->indexError, "mmap slice assignment is wrong size");
+		if (step == 1) {
+			memmove(self->data + start, source.buf, count);
+		} else {
+			for (size_t j = 0; j < count; ++j) self->data[start + (krk_integer_type)j * step] = source.buf[j];
+		}
+		return argv[2];
+	}
+
+	return TYPE_ERROR(int or slice, argv[1]);
+}
+
+KRK_Method(mmap,__eq__) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!IS_BYTES(argv[1]) && !krk_getType(argv[1])->_getbuffer) return NOTIMPL_VAL();
+	if (!_mmap_owner(self)->addr) return BOOLEAN_VAL(0);
+	if (IS_mmap(argv[1]) && !_mmap_owner(AS_mmap(argv[1]))->addr) return BOOLEAN_VAL(0);
+	KrkBuffer them;
+	if (!krk_getBuffer(argv[1], &them, 0)) return NONE_VAL();
+	return BOOLEAN_VAL(them.len == self->size && !memcmp(self->data, them.buf, them.len));
+}
+
+KRK_Method(mmap,find) {
+	KrkValue needle;
+	ssize_t start = 0;
+	ssize_t end = self->size;
+	if (!krk_parseArgs(".V|nn", (const char*[]){"sub","start","end"},
+		&needle, &start, &end)) return NONE_VAL();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	KrkBuffer sub;
+	if (!krk_getBuffer(needle, &sub, 0)) return NONE_VAL();
+
+	_mmap_clamp(self, &start, &end);
+	if (end - start < (ssize_t)sub.len) return INTEGER_VAL(-1);
+	if (!sub.len) return INTEGER_VAL(start);
+
+	const uint8_t * found;
+	if (sub.len == 1) {
+		found = memchr(self->data + start, sub.buf[0], end - start);
+	} else {
+		found = memmem(self->data + start, end - start, sub.buf, sub.len);
+	}
+	return INTEGER_VAL(found ? found - self->data : -1);
+}
+
+KRK_Method(mmap,rfind) {
+	KrkValue needle;
+	ssize_t start = 0;
+	ssize_t end = self->size;
+	if (!krk_parseArgs(".V|nn", (const char*[]){"sub","start","end"},
+		&needle, &start, &end)) return NONE_VAL();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	KrkBuffer sub;
+	if (!krk_getBuffer(needle, &sub, 0)) return NONE_VAL();
+
+	_mmap_clamp(self, &start, &end);
+	if (end - start < (ssize_t)sub.len) return INTEGER_VAL(-1);
+	if (!sub.len) return INTEGER_VAL(end);
+
+	/* Find the first byte of each candidate from the right, then compare the rest. */
+	const uint8_t * lo = self->data + start;
+	size_t span = end - start - sub.len + 1;
+	while (span) {
+		const uint8_t * found = memrchr(lo, sub.buf[0], span);
+		if (!found) break;
+		if (!memcmp(found + 1, sub.buf + 1, sub.len - 1)) return INTEGER_VAL(found - self->data);
+		span = found - lo;
+	}
+	return INTEGER_VAL(-1);
+}
+
+KRK_Method(mmap,read) {
+	ssize_t n = -1;
+	if (!krk_parseArgs(".|n", (const char*[]){"n"}, &n)) return NONE_VAL();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	size_t avail = self->pos < self->size ? self->size - self->pos : 0;
+	if (n < 0 || (size_t)n > avail) n = avail;
+	KrkBytes * out = krk_newBytes(n, self->data + self->pos);
+	self->pos += n;
+	return OBJECT_VAL(out);
+}
+
+KRK_Method(mmap,readline) {
+	METHOD_TAKES_NONE();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	size_t avail = self->pos < self->size ? self->size - self->pos : 0;
+	const uint8_t * nl = memchr(self->data + self->pos, '\n', avail);
+	size_t n = nl ? (size_t)(nl - (self->data + self->pos)) + 1 : avail;
+	KrkBytes * out = krk_newBytes(n, self->data + self->pos);
+	self->pos += n;
+	return OBJECT_VAL(out);
+}
+
+KRK_Method(mmap,write) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!_mmap_writable(self)) return NONE_VAL();
+	KrkBuffer data;
+	if (!krk_getBuffer(argv[1], &data, 0)) return NONE_VAL();
+	if (self->pos > self->size || data.len > self->size - self->pos) {
+		return krk_runtimeError(vm.exceptions->valueError, "data out of range");
+	}
+	memmove(self->data + self->pos, data.buf, data.len);
+	self->pos += data.len;
+	return INTEGER_VAL(data.len);
+}
+
+KRK_Method(mmap,seek) {
+	ssize_t pos;
+	int whence = 0;
+	if (!krk_parseArgs(".n|i", (const char*[]){"pos","whence"}, &pos, &whence)) return NONE_VAL();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	switch (whence) {
+		case 0: break;
+		case 1: pos += self->pos; break;
+		case 2: pos += self->size; break;
+		default: return krk_runtimeError(vm.exceptions->valueError, "unknown seek type");
+	}
+	if (pos < 0 || (size_t)pos > self->size) return krk_runtimeError(vm.exceptions->valueError, "seek out of range");
+	self->pos = pos;
+	return INTEGER_VAL(pos);
+}
+
+KRK_Method(mmap,tell) {
+	METHOD_TAKES_NONE();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	return INTEGER_VAL(self->pos);
+}
+
+KRK_Method(mmap,flush) {
+	ssize_t offset = 0;
+	ssize_t size = -1;
+	if (!krk_parseArgs(".|nn", (const char*[]){"offset","size"}, &offset, &size)) return NONE_VAL();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	if (size < 0 && offset >= 0 && (size_t)offset <= self->size) size = self->size - offset;
+	void * addr;
+	size_t len;
+	if (!_mmap_page_range(self, offset, size, &addr, &len)) return NONE_VAL();
+	if (!self->shared || self->readonly || !len) return NONE_VAL();
+	if (msync(addr, len, MS_SYNC)) return krk_runtimeError(vm.exceptions->OSError, "%s", strerror(errno));
+	return NONE_VAL();
+}
+
+KRK_Method(mmap,madvise) {
+	int option;
+	ssize_t start = 0;
+	ssize_t length = -1;
+	if (!krk_parseArgs(".i|nn", (const char*[]){"option","start","length"}, &option, &start, &length)) return NONE_VAL();
+	if (!_mmap_valid(self)) return NONE_VAL();
+	if (length < 0 && start >= 0 && (size_t)start <= self->size) length = self->size - start;
+	if (start >= 0 && length >= 0 && (size_t)start <= self->size && (size_t)length > self->size - start) {
+		length = self->size - start;
+	}
+	void * addr;
+	size_t len;
+	if (!_mmap_page_range(self, start, length, &addr, &len)) return NONE_VAL();
+	if (!len) return NONE_VAL();
+	if (madvise(addr, len, option)) return krk_runtimeError(vm.exceptions->OSError, "%s", strerror(errno));
+	return NONE_VAL();
+}
+
+KRK_Method(mmap,close) {
+	METHOD_TAKES_NONE();
+	if (!IS_OBJECT(self->base)) {
+		if (self->addr) munmap(self->addr, self->maplen);
+		self->addr = NULL;
+	} else {
+		/* Closing a view detaches it without affecting the mapping or other views. */
+		self->base = OBJECT_VAL(self);
+	}
+	return NONE_VAL();
+}
+
+KRK_Method(mmap,closed) {
+	return BOOLEAN_VAL(!_mmap_owner(self)->addr);
+}
+
+KRK_Method(mmap,__enter__) {
+	return NONE_VAL();
+}
+
+KRK_Method(mmap,__exit__) {
+	return FUNC_NAME(mmap,close)(1,argv,0);
+}
+
+KrkValue krk_module_onload_mmap(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+
+	KRK_DOC(module, "@brief Memory-mapped file objects.");
+
+	KrkClass * mmap = krk_makeClass(module, &mmapClass, "mmap", vm.baseClasses->objectClass);
+	mmap->allocSize = sizeof(struct MMap);
+	mmap->_ongcscan = _mmap_gcscan;
+	mmap->_ongcsweep = _mmap_gcsweep;
+	mmap->_getbuffer = _mmap_getbuffer;
+	KRK_DOC(mmap, "@brief A memory-mapped file or block of anonymous memory.\n"
+		"@arguments fileno,length,flags=MAP_SHARED,prot=PROT_READ|PROT_WRITE,access=ACCESS_DEFAULT,offset=0\n\n"
+		"Maps @p length bytes of the file open as @p fileno, starting at @p offset. A @p length of 0 maps "
+		"the rest of the file. A @p fileno of -1 maps anonymous memory. @p access may be one of @c ACCESS_READ, "
+		"@c ACCESS_WRITE or @c ACCESS_COPY instead of passing @p flags and @p prot.\n\n"
+		"Indexing returns integers. Slicing with a step of 1 returns another @ref mmap viewing the same "
+		"memory, without copying; other slices return @ref bytes. An @ref mmap is a bytes-like object, "
+		"so it can be passed to @ref memoryview, @ref bytes and anything else that accepts one.");
+	KRK_DOC(BIND_METHOD(mmap,__init__), NULL);
+	BIND_METHOD(mmap,__repr__);
+	BIND_METHOD(mmap,__len__);
+	BIND_METHOD(mmap,__getitem__);
+	BIND_METHOD(mmap,__setitem__);
+	BIND_METHOD(mmap,__eq__);
+	KRK_DOC(BIND_METHOD(mmap,find), "@brief Find the lowest index of a byte sequence.\n"
+		"@arguments sub,start=0,end=len\n\n"
+		"Returns -1 if @p sub is not found between @p start and @p end.");
+	KRK_DOC(BIND_METHOD(mmap,rfind), "@brief Find the highest index of a byte sequence.\n"
+		"@arguments sub,start=0,end=len\n\n"
+		"Returns -1 if @p sub is not found between @p start and @p end.");
+	KRK_DOC(BIND_METHOD(mmap,read), "@brief Read bytes from the current position.\n"
+		"@arguments n=-1\n\n"
+		"Reads at most @p n bytes, or everything up to the end if @p n is negative.");
+	KRK_DOC(BIND_METHOD(mmap,readline), "@brief Read one line, up to and including a line feed, from the current position.");
+	KRK_DOC(BIND_METHOD(mmap,write), "@brief Write bytes at the current position.\n"
+		"@arguments data\n\n"
+		"The mapping can not grow; writing past the end raises @ref ValueError.");
+	KRK_DOC(BIND_METHOD(mmap,seek), "@brief Move the current position.\n"
+		"@arguments pos,whence=0");
+	KRK_DOC(BIND_METHOD(mmap,tell), "@brief Get the current position.");
+	KRK_DOC(BIND_METHOD(mmap,flush), "@brief Write changes back to the file.\n"
+		"@arguments offset=0,size=len\n\n"
+		"Does nothing for anonymous, read-only and @c ACCESS_COPY mappings.");
+	KRK_DOC(BIND_METHOD(mmap,madvise), "@brief Advise the kernel how a range will be used.\n"
+		"@arguments option,start=0,length=len\n\n"
+		"@p option is one of the @c MADV_ constants. The range is widened to whole pages.");
+	KRK_DOC(BIND_METHOD(mmap,close), "@brief Unmap the memory.\n\n"
+		"Closing a view only detaches that view. Closing the mapping itself invalidates every view of it.");
+	BIND_PROP(mmap,closed);
+	BIND_METHOD(mmap,__enter__);
+	KRK_DOC(BIND_METHOD(mmap,__exit__), "@brief Closes the mapping upon exit from a @c with block.");
+	krk_defineNative(&mmap->methods,"__str__", FUNC_NAME(mmap,__repr__));
+	krk_finalizeClass(mmap);
+
+#define MMAP_CONST(o) krk_attachNamedValue(&module->fields, #o, INTEGER_VAL(o));
+	krk_attachNamedValue(&module->fields, "PAGESIZE", INTEGER_VAL(_pagesize()));
+	krk_attachNamedValue(&module->fields, "ALLOCATIONGRANULARITY", INTEGER_VAL(_pagesize()));
+
+	MMAP_CONST(ACCESS_DEFAULT);
+	MMAP_CONST(ACCESS_READ);
+	MMAP_CONST(ACCESS_WRITE);
+	MMAP_CONST(ACCESS_COPY);
+
+	MMAP_CONST(PROT_READ);
+	MMAP_CONST(PROT_WRITE);
+	MMAP_CONST(PROT_EXEC);
+
+	MMAP_CONST(MAP_SHARED);
+	MMAP_CONST(MAP_PRIVATE);
+#ifdef MAP_ANONYMOUS
+	MMAP_CONST(MAP_ANONYMOUS);
+#endif
+#ifdef MAP_POPULATE
+	MMAP_CONST(MAP_POPULATE);
+#endif
+
+	MMAP_CONST(MADV_NORMAL);
+	MMAP_CONST(MADV_RANDOM);
+	MMAP_CONST(MADV_SEQUENTIAL);
+	MMAP_CONST(MADV_WILLNEED);
+	MMAP_CONST(MADV_DONTNEED);
+#ifdef MADV_FREE
+	MMAP_CONST(MADV_FREE);
+#endif
+#ifdef MADV_HUGEPAGE
+	MMAP_CONST(MADV_HUGEPAGE);
+	MMAP_CONST(MADV_NOHUGEPAGE);
+#endif
+
+	return krk_pop();
+}
@@ -13,6 +13,8 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 #ifdef AF_UNIX
 #include <sys/un.h>
@@ -21,8 +23,10 @@
 
 #include <kuroko/vm.h>
 #include <kuroko/util.h>
+#include <kuroko/memory.h>
 
 static KrkClass * SocketError = NULL;
+static KrkClass * BlockingIOError = NULL;
 static KrkClass * SocketClass = NULL;
 
 struct socket {
@@ -32,6 +36,8 @@ struct socket {
 	int family;
 	int type;
 	int proto;
+	int nonblocking;
+	int owned;      /**< Set while @c sockfd is open and should be closed by us */
 };
 
 #define IS_socket(o) (krk_isInstanceOf(o,SocketClass))
@@ -39,6 +45,30 @@ struct socket {
 #define CURRENT_CTYPE struct socket *
 #define CURRENT_NAME  self
 
+#ifdef _WIN32
+#define closesock closesocket
+#else
+#define closesock close
+#endif
+
+/**
+ * Raise a SocketError for the current errno, or a BlockingIOError if the
+ * call failed only because a non-blocking socket was not ready.
+ */
+static KrkValue _socket_error(void) {
+	int err = errno;
+	KrkClass * type = SocketError;
+	if (err == EAGAIN || err == EWOULDBLOCK || err == EINPROGRESS) type = BlockingIOError;
+	return krk_runtimeError(type, "Socket error: %s", strerror(err));
+}
+
+static void _socket_gcsweep(KrkInstance * _self) {
+	struct socket * self = (struct socket*)_self;
+	if (self->owned) closesock(self->sockfd);
+	self->owned = 0;
+	self->sockfd = -1;
+}
+
 KRK_Method(socket,__init__) {
 	METHOD_TAKES_AT_MOST(3);
 
@@ -55,10 +85,11 @@ KRK_Method(socket,__init__) {
 	int result = socket(family,type,proto);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	self->sockfd = result;
+	self->owned  = 1;
 	self->family = family;
 	self->type   = type;
 	self->proto  = proto;
@@ -268,15 +299,38 @@ KRK_Method(socket,connect) {
 		return NONE_VAL();
 	}
 
+	krk_beginBlockingCall();
 	int result = connect(self->sockfd, (struct sockaddr*)&sock_addr, sock_size);
+	krk_endBlockingCall();
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	return NONE_VAL();
 }
 
+KRK_Method(socket,connect_ex) {
+	METHOD_TAKES_EXACTLY(1);
+
+	struct sockaddr_storage sock_addr;
+	socklen_t sock_size = 0;
+
+	int parseResult = socket_parse_address(self, argv[1], &sock_addr, &sock_size);
+	if (parseResult) {
+		if (!(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION))
+			return krk_runtimeError(SocketError, "Unspecified error.");
+		return NONE_VAL();
+	}
+
+	krk_beginBlockingCall();
+	int result = connect(self->sockfd, (struct sockaddr*)&sock_addr, sock_size);
+	int err = errno;
+	krk_endBlockingCall();
+
+	return INTEGER_VAL(result < 0 ? err : 0);
+}
+
 KRK_Method(socket,bind) {
 	METHOD_TAKES_EXACTLY(1);
 
@@ -294,7 +348,7 @@ KRK_Method(socket,bind) {
 	int result = bind(self->sockfd, (struct sockaddr*)&sock_addr, sock_size);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	return NONE_VAL();
@@ -310,48 +364,27 @@ KRK_Method(socket,listen) {
 
 	int result = listen(self->sockfd, backlog);
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	return NONE_VAL();
 }
 
-KRK_Method(socket,accept) {
-	struct sockaddr_storage addr;
-	socklen_t addrlen;
-
-	int result = accept(self->sockfd, (struct sockaddr*)&addr, &addrlen);
-
-	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
-	}
-
-	KrkTuple * outTuple = krk_newTuple(2);
-	krk_push(OBJECT_VAL(outTuple));
-
-	struct socket * out = (struct socket*)krk_newInstance(SocketClass);
-	krk_push(OBJECT_VAL(out));
-
-	out->sockfd = result;
-	out->family = self->family;
-	out->type   = self->type;
-	out->proto  = self->proto;
-
-	outTuple->values.values[0] = krk_peek(0);
-	outTuple->values.count = 1;
-	krk_pop();
-
-
+/**
+ * Convert a socket address into the form Kuroko code sees it in,
+ * leaving the result on the stack.
+ */
+static void _socket_push_address(struct socket * self, struct sockaddr_storage * addr, socklen_t addrlen) {
 	if (self->family == AF_INET) {
 		KrkTuple * addrTuple = krk_newTuple(2); /* TODO: Other formats */
 		krk_push(OBJECT_VAL(addrTuple));
 
 		char hostname[NI_MAXHOST] = "";
-		getnameinfo((struct sockaddr*)&addr, addrlen, hostname, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
+		getnameinfo((struct sockaddr*)addr, addrlen, hostname, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
 
 		addrTuple->values.values[0] = OBJECT_VAL(krk_copyString(hostname,strlen(hostname)));
 		addrTuple->values.count = 1;
-		addrTuple->values.values[1] = INTEGER_VAL(htons(((struct sockaddr_in*)&addr)->sin_port));
+		addrTuple->values.values[1] = INTEGER_VAL(htons(((struct sockaddr_in*)addr)->sin_port));
 		addrTuple->values.count = 2;
 #ifdef AF_INET6
 	} else if (self->family == AF_INET6) {
@@ -359,11 +392,11 @@ KRK_Method(socket,accept) {
 		krk_push(OBJECT_VAL(addrTuple));
 
 		char hostname[NI_MAXHOST] = "";
-		getnameinfo((struct sockaddr*)&addr, addrlen, hostname, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
+		getnameinfo((struct sockaddr*)addr, addrlen, hostname, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
 
 		addrTuple->values.values[0] = OBJECT_VAL(krk_copyString(hostname,strlen(hostname)));
 		addrTuple->values.count = 1;
-		addrTuple->values.values[1] = INTEGER_VAL(htons(((struct sockaddr_in6*)&addr)->sin6_port));
+		addrTuple->values.values[1] = INTEGER_VAL(htons(((struct sockaddr_in6*)addr)->sin6_port));
 		addrTuple->values.count = 2;
 #endif
 #ifdef AF_UNIX
@@ -374,6 +407,38 @@ KRK_Method(socket,accept) {
 	} else {
 		krk_push(NONE_VAL());
 	}
+}
+
+KRK_Method(socket,accept) {
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+
+	krk_beginBlockingCall();
+	int result = accept(self->sockfd, (struct sockaddr*)&addr, &addrlen);
+	krk_endBlockingCall();
+
+	if (result < 0) {
+		return _socket_error();
+	}
+
+	KrkTuple * outTuple = krk_newTuple(2);
+	krk_push(OBJECT_VAL(outTuple));
+
+	struct socket * out = (struct socket*)krk_newInstance(SocketClass);
+	krk_push(OBJECT_VAL(out));
+
+	out->sockfd = result;
+	out->owned = 1;
+	out->family = self->family;
+	out->type   = self->type;
+	out->proto  = self->proto;
+
+	outTuple->values.values[0] = krk_peek(0);
+	outTuple->values.count = 1;
+	krk_pop();
+
+
+	_socket_push_address(self, &addr, addrlen);
 
 	outTuple->values.values[1] = krk_peek(0);
 	outTuple->values.count = 2;
@@ -389,7 +454,7 @@ KRK_Method(socket,shutdown) {
 	int result = shutdown(self->sockfd, how);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	return NONE_VAL();
@@ -405,31 +470,66 @@ KRK_Method(socket,recv) {
 		flags = _flags;
 	}
 
-	void * buf = malloc(bufsize);
-	ssize_t result = recv(self->sockfd, buf, bufsize, flags);
+	if (bufsize < 0) return krk_runtimeError(vm.exceptions->valueError, "negative buffersize in recv");
+
+	/* Receive straight into the storage of the result, and trim it afterwards. */
+	uint8_t * buf = ALLOCATE(uint8_t, bufsize);
+	krk_beginBlockingCall();
+	ssize_t result = recv(self->sockfd, (void*)buf, bufsize, flags);
+	krk_endBlockingCall();
 	if (result < 0) {
-		free(buf);
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		int err = errno;
+		FREE_ARRAY(uint8_t, buf, bufsize);
+		errno = err;
+		return _socket_error();
 	}
 
-	KrkBytes * out = krk_newBytes(result,buf);
-	free(buf);
+	buf = krk_reallocate(buf, bufsize, result);
+	KrkBytes * out = krk_newBytes(0,NULL);
+	out->bytes = buf;
+	out->length = result;
 	return OBJECT_VAL(out);
 }
 
+KRK_Method(socket,recv_into) {
+	KrkValue target;
+	ssize_t nbytes = 0;
+	int flags = 0;
+	if (!krk_parseArgs(".V|ni:recv_into", (const char*[]){"buffer","nbytes","flags"},
+		&target, &nbytes, &flags)) return NONE_VAL();
+
+	KrkBuffer buf;
+	if (!krk_getBuffer(target, &buf, 1)) return NONE_VAL();
+	if (nbytes < 0) return krk_runtimeError(vm.exceptions->valueError, "negative buffersize in recv_into");
+	if ((size_t)nbytes > buf.len) return krk_runtimeError(vm.exceptions->valueError, "buffer too small for requested bytes");
+	if (!nbytes) nbytes = buf.len;
+
+	krk_beginBlockingCall();
+	ssize_t result = recv(self->sockfd, (void*)buf.buf, nbytes, flags);
+	krk_endBlockingCall();
+	if (result < 0) {
+		return _socket_error();
+	}
+
+	return INTEGER_VAL(result);
+}
+
 KRK_Method(socket,send) {
 	METHOD_TAKES_AT_LEAST(1);
 	METHOD_TAKES_AT_MOST(2);
-	CHECK_ARG(1,bytes,KrkBytes*,buf);
+	KrkBuffer buf;
+	if (!krk_getBuffer(argv[1], &buf, 0)) return NONE_VAL();
 	int flags = 0;
 	if (argc > 2) {
 		CHECK_ARG(2,int,krk_integer_type,_flags);
 		flags = _flags;
 	}
 
-	ssize_t result = send(self->sockfd, (void*)buf->bytes, buf->length, flags);
+	krk_beginBlockingCall();
+	ssize_t result = send(self->sockfd, (void*)buf.buf, buf.len, flags);
+	krk_endBlockingCall();
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	return INTEGER_VAL(result);
@@ -438,7 +538,8 @@ KRK_Method(socket,send) {
 KRK_Method(socket,sendto) {
 	METHOD_TAKES_AT_LEAST(1);
 	METHOD_TAKES_AT_MOST(3);
-	CHECK_ARG(1,bytes,KrkBytes*,buf);
+	KrkBuffer buf;
+	if (!krk_getBuffer(argv[1], &buf, 0)) return NONE_VAL();
 	int flags = 0;
 	if (argc > 3) {
 		CHECK_ARG(2,int,krk_integer_type,_flags);
@@ -456,9 +557,11 @@ KRK_Method(socket,sendto) {
 		return NONE_VAL();
 	}
 
-	ssize_t result = sendto(self->sockfd, (void*)buf->bytes, buf->length, flags, (struct sockaddr*)&sock_addr, sock_size);
+	krk_beginBlockingCall();
+	ssize_t result = sendto(self->sockfd, (void*)buf.buf, buf.len, flags, (struct sockaddr*)&sock_addr, sock_size);
+	krk_endBlockingCall();
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	return INTEGER_VAL(result);
@@ -469,6 +572,70 @@ KRK_Method(socket,fileno) {
 	return INTEGER_VAL(self->sockfd);
 }
 
+KRK_Method(socket,getsockname) {
+	METHOD_TAKES_NONE();
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	if (getsockname(self->sockfd, (struct sockaddr*)&addr, &addrlen) < 0) {
+		return _socket_error();
+	}
+	_socket_push_address(self, &addr, addrlen);
+	return krk_pop();
+}
+
+KRK_Method(socket,getpeername) {
+	METHOD_TAKES_NONE();
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	if (getpeername(self->sockfd, (struct sockaddr*)&addr, &addrlen) < 0) {
+		return _socket_error();
+	}
+	_socket_push_address(self, &addr, addrlen);
+	return krk_pop();
+}
+
+KRK_Method(socket,setblocking) {
+	METHOD_TAKES_EXACTLY(1);
+	int nonblocking = krk_isFalsey(argv[1]);
+#ifdef _WIN32
+	u_long mode = nonblocking;
+	if (ioctlsocket(self->sockfd, FIONBIO, &mode) != 0) {
+		return krk_runtimeError(SocketError, "Socket error: %d", WSAGetLastError());
+	}
+#else
+	int flags = fcntl(self->sockfd, F_GETFL, 0);
+	if (flags < 0 || fcntl(self->sockfd, F_SETFL, nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) < 0) {
+		return _socket_error();
+	}
+#endif
+	self->nonblocking = nonblocking;
+	return NONE_VAL();
+}
+
+KRK_Method(socket,getblocking) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(!self->nonblocking);
+}
+
+KRK_Method(socket,close) {
+	METHOD_TAKES_NONE();
+	if (self->owned && closesock(self->sockfd) < 0) {
+		self->owned = 0;
+		return _socket_error();
+	}
+	self->owned = 0;
+	self->sockfd = -1;
+	return NONE_VAL();
+}
+
+KRK_Method(socket,__enter__) {
+	return NONE_VAL();
+}
+
+KRK_Method(socket,__exit__) {
+	return FUNC_NAME(socket,close)(1,argv,0);
+}
+
 KRK_Method(socket,setsockopt) {
 	METHOD_TAKES_EXACTLY(3);
 	CHECK_ARG(1,int,krk_integer_type,level);
@@ -486,7 +653,7 @@ KRK_Method(socket,setsockopt) {
 	}
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return _socket_error();
 	}
 
 	return NONE_VAL();
@@ -521,6 +688,7 @@ KrkValue krk_module_onload_socket(void) {
 
 	KrkClass * socket = krk_makeClass(module, &SocketClass, "socket", vm.baseClasses->objectClass);
 	SocketClass->allocSize = sizeof(struct socket);
+	SocketClass->_ongcsweep = _socket_gcsweep;
 	KRK_DOC(BIND_METHOD(socket,__init__),
 		"@brief Create a socket object.\n"
 		"@arguments family=AF_INET,type=SOCK_STREAM,proto=0\n\n"
@@ -543,6 +711,11 @@ KrkValue krk_module_onload_socket(void) {
 		"@brief Connect a socket to a remote endpoint.\n"
 		"@arguments address\n\n"
 		"As with @ref socket_bind, the format of @p address varies.");
+	KRK_DOC(BIND_METHOD(socket,connect_ex),
+		"@brief Connect a socket to a remote endpoint, returning an error code instead of raising.\n"
+		"@arguments address\n\n"
+		"Returns 0 on success, or the @c errno value describing the failure. On a non-blocking "
+		"socket, a connection that is still being established reports @c EINPROGRESS.");
 	KRK_DOC(BIND_METHOD(socket,shutdown),
 		"@brief Shut down an active socket.\n"
 		"@arguments how\n\n"
@@ -551,18 +724,40 @@ KrkValue krk_module_onload_socket(void) {
 		"@brief Receive data from a connected socket.\n"
 		"@arguments bufsize,[flags]\n\n"
 		"Receive up to @p bufsize bytes of data, which is returned as a @ref bytes object.");
+	KRK_DOC(BIND_METHOD(socket,recv_into),
+		"@brief Receive data from a connected socket into an existing buffer.\n"
+		"@arguments buffer,nbytes=0,flags=0\n\n"
+		"Receive up to @p nbytes bytes, or as many as fit if @p nbytes is 0, into the writable "
+		"bytes-like object @p buffer, such as a @ref bytearray or a @ref memoryview of one. "
+		"Returns the number of bytes received.");
 	KRK_DOC(BIND_METHOD(socket,send),
 		"@brief Send data to a connected socket.\n"
 		"@arguments buf,[flags]\n\n"
-		"Send the data in the @ref bytes object @p buf to the socket. Returns the number "
+		"Send the data in the bytes-like object @p buf to the socket. Returns the number "
 		"of bytes written to the socket.");
 	KRK_DOC(BIND_METHOD(socket,sendto),
 		"@brief Send data to an socket with a particular destination.\n"
 		"@arguments buf,[flags],addr\n\n"
-		"Send the data in the @ref bytes object @p buf to the socket. Returns the number "
+		"Send the data in the bytes-like object @p buf to the socket. Returns the number "
 		"of bytes written to the socket.");
 	KRK_DOC(BIND_METHOD(socket,fileno),
 		"@brief Get the file descriptor number for the underlying socket.");
+	KRK_DOC(BIND_METHOD(socket,getsockname),
+		"@brief Get the local address the socket is bound to.");
+	KRK_DOC(BIND_METHOD(socket,getpeername),
+		"@brief Get the address of the remote endpoint the socket is connected to.");
+	KRK_DOC(BIND_METHOD(socket,setblocking),
+		"@brief Set whether socket operations block.\n"
+		"@arguments flag\n\n"
+		"When @p flag is false, operations that can not complete immediately raise "
+		"@ref BlockingIOError instead of waiting.");
+	KRK_DOC(BIND_METHOD(socket,getblocking),
+		"@brief Check whether the socket is in blocking mode.");
+	KRK_DOC(BIND_METHOD(socket,close),
+		"@brief Close the socket.\n\n"
+		"Sockets that are not closed explicitly are closed when they are garbage collected.");
+	BIND_METHOD(socket,__enter__);
+	KRK_DOC(BIND_METHOD(socket,__exit__), "@brief Closes the socket upon exit from a @c with block.");
 	KRK_DOC(BIND_METHOD(socket,setsockopt),
 		"@brief Set socket options.\n"
 		"@arguments level,optname,value\n\n"
@@ -624,5 +819,9 @@ KrkValue krk_module_onload_socket(void) {
 	KRK_DOC(SocketError, "Raised on faults from socket functions.");
 	krk_finalizeClass(SocketError);
 
+	krk_makeClass(module, &BlockingIOError, "BlockingIOError", SocketError);
+	KRK_DOC(BlockingIOError, "Raised when an operation on a non-blocking socket would have blocked.");
+	krk_finalizeClass(BlockingIOError);
+
 	return krk_pop();
 }
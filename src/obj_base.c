@@ -4,6 +4,8 @@
 #include <kuroko/memory.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 #define CURRENT_NAME  self
 
 #define IS_type(o) (IS_CLASS(o))
@@ -17,7 +19,7 @@ static void _callSetName(KrkClass * _class) {
 	extern FUNC_SIG(list,append);
 
 	/* The semantics of this require that we first collect all of the relevant items... */
-	for (size_t i = 0; i < _class->methods.capacity; ++i) {
+	for (size_t i = 0; i < _class->methods.used; ++i) {
 		KrkTableEntry * entry = &_class->methods.entries[i];
 		if (!IS_KWARGS(entry->key)) {
 			KrkClass * type = krk_getType(entry->value);
@@ -76,6 +78,11 @@ KRK_StaticMethod(type,__new__) {
 	krk_push(OBJECT_VAL(_class));
 	_class->_class = metaclass;
 
+	/* Only C code that knows about shapes touches instances of managed classes. */
+	if (base == vm.baseClasses->objectClass || base->shape) {
+		_class->shape = krk_newShape(NULL, NULL);
+	}
+
 	/* Now copy the values over */
 	krk_tableAddAll(&nspace->entries, &_class->methods);
 
@@ -156,7 +163,7 @@ KRK_Method(type,__subclasses__) {
 	KrkValue myList = krk_list_of(0,NULL,0);
 	krk_push(myList);
 
-	for (size_t i = 0; i < self->subclasses.capacity; ++i) {
+	for (size_t i = 0; i < self->subclasses.used; ++i) {
 		KrkTableEntry * entry = &self->subclasses.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
 		krk_writeValueArray(AS_LIST(myList), entry->key);
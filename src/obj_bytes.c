@@ -6,11 +6,6 @@
 
 #include "private.h"
 
-struct ByteArray {
-	KrkInstance inst;
-	KrkValue actual;
-};
-
 #define AS_bytes(o) AS_BYTES(o)
 #define CURRENT_CTYPE KrkBytes *
 #define CURRENT_NAME  self
@@ -46,7 +41,13 @@ KRK_StaticMethod(bytes,__new__) {
 		return OBJECT_VAL(krk_newBytes(AS_STRING(argv[1])->length, (uint8_t*)AS_CSTRING(argv[1])));
 	} else if (IS_INTEGER(argv[1])) {
 		if (AS_INTEGER(argv[1]) < 0) return krk_runtimeError(vm.exceptions->valueError, "negative count");
-		return OBJECT_VAL(krk_newBytes(AS_INTEGER(argv[1]),NULL));
+		KrkBytes * out = krk_newBytes(AS_INTEGER(argv[1]),NULL);
+		memset(out->bytes, 0, out->length);
+		return OBJECT_VAL(out);
+	} else if (krk_getType(argv[1])->_getbuffer) {
+		KrkBuffer buffer;
+		if (!krk_getBuffer(argv[1], &buffer, 0)) return NONE_VAL();
+		return OBJECT_VAL(krk_newBytes(buffer.len, buffer.buf));
 	} else {
 		struct StringBuilder sb = {0};
 		if (krk_unpackIterable(argv[1], &sb, _bytes_callback)) return NONE_VAL();
@@ -57,6 +58,13 @@ KRK_StaticMethod(bytes,__new__) {
 #undef IS_bytes
 #define IS_bytes(o) IS_BYTES(o)
 
+static int _bytes_getbuffer(KrkValue value, KrkBuffer * out) {
+	out->buf = AS_BYTES(value)->bytes;
+	out->len = AS_BYTES(value)->length;
+	out->readonly = 1;
+	return 1;
+}
+
 KRK_Method(bytes,__hash__) {
 	METHOD_TAKES_NONE();
 	uint32_t hash = 0;
@@ -232,11 +240,12 @@ KRK_Method(bytes,join) {
 
 KRK_Method(bytes,__add__) {
 	METHOD_TAKES_EXACTLY(1);
-	CHECK_ARG(1,bytes,KrkBytes*,them);
+	KrkBuffer them;
+	if (!krk_getBuffer(argv[1], &them, 0)) return NONE_VAL();
 
 	struct StringBuilder sb = {0};
 	pushStringBuilderStr(&sb, (char*)self->bytes, self->length);
-	pushStringBuilderStr(&sb, (char*)them->bytes, them->length);
+	pushStringBuilderStr(&sb, (char*)them.buf, them.len);
 
 	return finishStringBuilderBytes(&sb);
 }
@@ -296,14 +305,30 @@ static void _bytearray_gcscan(KrkInstance * self) {
 	krk_markValue(((struct ByteArray*)self)->actual);
 }
 
+static int _bytearray_getbuffer(KrkValue value, KrkBuffer * out) {
+	KrkValue actual = AS_bytearray(value)->actual;
+	if (!IS_BYTES(actual)) {
+		krk_runtimeError(vm.exceptions->valueError, "bytearray is not initialized");
+		return 0;
+	}
+	out->buf = AS_BYTES(actual)->bytes;
+	out->len = AS_BYTES(actual)->length;
+	out->readonly = 0;
+	return 1;
+}
+
 KRK_Method(bytearray,__init__) {
 	METHOD_TAKES_AT_MOST(1);
 	if (argc < 2) {
 		self->actual = OBJECT_VAL(krk_newBytes(0,NULL));
-	} else if (IS_BYTES(argv[1])) {
-		self->actual = OBJECT_VAL(krk_newBytes(AS_BYTES(argv[1])->length, AS_BYTES(argv[1])->bytes));
 	} else if (IS_INTEGER(argv[1])) {
+		if (AS_INTEGER(argv[1]) < 0) return krk_runtimeError(vm.exceptions->valueError, "negative count");
 		self->actual = OBJECT_VAL(krk_newBytes(AS_INTEGER(argv[1]),NULL));
+		memset(AS_BYTES(self->actual)->bytes, 0, AS_BYTES(self->actual)->length);
+	} else if (IS_BYTES(argv[1]) || krk_getType(argv[1])->_getbuffer) {
+		KrkBuffer buffer;
+		if (!krk_getBuffer(argv[1], &buffer, 0)) return NONE_VAL();
+		self->actual = OBJECT_VAL(krk_newBytes(buffer.len, buffer.buf));
 	} else {
 		return krk_runtimeError(vm.exceptions->valueError, "expected bytes");
 	}
@@ -421,11 +446,13 @@ void _createAndBind_bytesClass(void) {
 	KrkClass * bytes = ADD_BASE_CLASS(vm.baseClasses->bytesClass, "bytes", vm.baseClasses->objectClass);
 	bytes->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
 	bytes->allocSize = 0;
+	bytes->_getbuffer = _bytes_getbuffer;
 	KRK_DOC(BIND_STATICMETHOD(bytes,__new__),
 		"@brief An array of bytes.\n"
 		"@arguments iter=None\n\n"
 		"Creates a new @ref bytes object. If @p iter is provided, it should be a @ref tuple or @ref list "
-		"of integers within the range @c 0 and @c 255.");
+		"of integers within the range @c 0 and @c 255, or a bytes-like object such as a @ref memoryview, whose "
+		"contents are copied.");
 	BIND_METHOD(bytes,__repr__);
 	BIND_METHOD(bytes,__len__);
 	BIND_METHOD(bytes,__contains__);
@@ -450,6 +477,7 @@ void _createAndBind_bytesClass(void) {
 	KrkClass * bytearray = ADD_BASE_CLASS(vm.baseClasses->bytearrayClass, "bytearray", vm.baseClasses->objectClass);
 	bytearray->allocSize = sizeof(struct ByteArray);
 	bytearray->_ongcscan = _bytearray_gcscan;
+	bytearray->_getbuffer = _bytearray_getbuffer;
 	KRK_DOC(BIND_METHOD(bytearray,__init__),
 		"@brief A mutable array of bytes.\n"
 		"@arguments bytes=None");
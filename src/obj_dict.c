@@ -13,7 +13,7 @@ KrkValue krk_dict_of(int argc, const KrkValue argv[], int hasKw) {
 	KrkInstance * outDict = krk_newInstance(vm.baseClasses->dictClass);
 	krk_push(OBJECT_VAL(outDict));
 	krk_initTable(&((KrkDict*)outDict)->entries);
-	krk_tableAdjustCapacity(&((KrkDict*)outDict)->entries, argc);
+	krk_tableAdjustCapacity(&((KrkDict*)outDict)->entries, argc / 2);
 	for (int ind = 0; ind < argc; ind += 2) {
 		krk_tableSet(&((KrkDict*)outDict)->entries, argv[ind], argv[ind+1]);
 	}
@@ -52,6 +52,7 @@ static int _keyvalue_pair_callback(void * context, const KrkValue * entries, siz
 		} else if (_context->counter == 1) {
 			_context->counter = 2;
 			krk_tableSet(&_context->self->entries, _context->key, entries[i]);
+			krk_writeBarrier((KrkObj*)_context->self);
 		} else {
 			_context->counter = -1;
 			return 1;
@@ -86,6 +87,7 @@ KRK_Method(dict,__init__) {
 
 	if (hasKw) {
 		krk_tableAddAll(AS_DICT(argv[argc]), &self->entries);
+		krk_writeBarrier((KrkObj*)self);
 	}
 
 	return NONE_VAL();
@@ -100,7 +102,7 @@ KRK_Method(dict,__eq__) {
 		return BOOLEAN_VAL(0);
 
 
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
+	for (unsigned int i = 0; i < self->entries.used; ++i) {
 		if (IS_KWARGS(self->entries.entries[i].key)) continue;
 		KrkValue val;
 		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &val)) return BOOLEAN_VAL(0);
@@ -124,6 +126,7 @@ KRK_Method(dict,__getitem__) {
 KRK_Method(dict,__setitem__) {
 	METHOD_TAKES_EXACTLY(2);
 	krk_tableSet(&self->entries, argv[1], argv[2]);
+	krk_writeBarrier((KrkObj*)self);
 	return argv[2];
 }
 
@@ -170,7 +173,7 @@ KRK_Method(dict,__repr__) {
 	pushStringBuilder(&sb,'{');
 
 	size_t c = 0;
-	size_t len = self->entries.capacity;
+	size_t len = self->entries.used;
 	for (size_t i = 0; i < len; ++i) {
 		KrkTableEntry * entry = &self->entries.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
@@ -237,6 +240,7 @@ KRK_Method(dict,setdefault) {
 	/* TODO this is slow; use findEntry instead! */
 	if (!krk_tableGet(&self->entries, argv[1], &out)) {
 		krk_tableSet(&self->entries, argv[1], out);
+		krk_writeBarrier((KrkObj*)self);
 	}
 
 	return out;
@@ -252,6 +256,7 @@ KRK_Method(dict,update) {
 	if (hasKw) {
 		krk_tableAddAll(AS_DICT(argv[argc]), &self->entries);
 	}
+	krk_writeBarrier((KrkObj*)self);
 	return NONE_VAL();
 }
 
@@ -259,6 +264,7 @@ KRK_Method(dict,__ior__) {
 	METHOD_TAKES_EXACTLY(1);
 	CHECK_ARG(1,dict,KrkDict*,other);
 	krk_tableAddAll(&other->entries, &self->entries);
+	krk_writeBarrier((KrkObj*)self);
 	return argv[0];
 }
 
@@ -328,7 +334,7 @@ KRK_Method(dictitems,__iter__) {
 
 KRK_Method(dictitems,__call__) {
 	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
+		if (self->i >= AS_DICT(self->dict)->used) return argv[0];
 		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
 			KrkTuple * outValue = krk_newTuple(2);
 			krk_push(OBJECT_VAL(outValue));
@@ -350,7 +356,7 @@ KRK_Method(dictitems,__repr__) {
 	pushStringBuilderStr(&sb,"dictitems([",11);
 
 	size_t c = 0;
-	size_t len = AS_DICT(self->dict)->capacity;
+	size_t len = AS_DICT(self->dict)->used;
 	for (size_t i = 0; i < len; ++i) {
 		KrkTableEntry * entry = &AS_DICT(self->dict)->entries[i];
 		if (IS_KWARGS(entry->key)) continue;
@@ -413,7 +419,7 @@ KRK_Method(dictkeys,__iter__) {
 KRK_Method(dictkeys,__call__) {
 	METHOD_TAKES_NONE();
 	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
+		if (self->i >= AS_DICT(self->dict)->used) return argv[0];
 		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
 			krk_push(AS_DICT(self->dict)->entries[self->i].key);
 			self->i++;
@@ -431,7 +437,7 @@ KRK_Method(dictkeys,__repr__) {
 	pushStringBuilderStr(&sb,"dictkeys([",10);
 
 	size_t c = 0;
-	size_t len = AS_DICT(self->dict)->capacity;
+	size_t len = AS_DICT(self->dict)->used;
 	for (size_t i = 0; i < len; ++i) {
 		KrkTableEntry * entry = &AS_DICT(self->dict)->entries[i];
 		if (IS_KWARGS(entry->key)) continue;
@@ -479,7 +485,7 @@ KRK_Method(dictvalues,__iter__) {
 KRK_Method(dictvalues,__call__) {
 	METHOD_TAKES_NONE();
 	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
+		if (self->i >= AS_DICT(self->dict)->used) return argv[0];
 		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
 			krk_push(AS_DICT(self->dict)->entries[self->i].value);
 			self->i++;
@@ -497,7 +503,7 @@ KRK_Method(dictvalues,__repr__) {
 	pushStringBuilderStr(&sb,"dictvalues([",12);
 
 	size_t c = 0;
-	size_t len = AS_DICT(self->dict)->capacity;
+	size_t len = AS_DICT(self->dict)->used;
 	for (size_t i = 0; i < len; ++i) {
 		KrkTableEntry * entry = &AS_DICT(self->dict)->entries[i];
 		if (IS_KWARGS(entry->key)) continue;
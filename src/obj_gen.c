@@ -16,19 +16,20 @@
 /**
  * @brief Generator object implementation.
  * @extends KrkInstance
+ *
+ * A generator runs on its own stack segment. Resuming it switches the
+ * thread over to that segment and suspending it switches back, so the
+ * generator's locals and any upvalues captured from them never move.
  */
 struct generator {
 	KrkInstance inst;
 	KrkClosure * closure;
-	KrkValue * args;
-	size_t argCount;
 	uint8_t * ip;
 	int running;
 	int started;
 	KrkValue result;
 	int type;
-	KrkThreadState fakethread;
-	KrkUpvalue * capturedUpvalues;
+	KrkStackSegment segment;
 };
 
 #define AS_generator(o) ((struct generator *)AS_OBJECT(o))
@@ -38,41 +39,54 @@ struct generator {
 #define CURRENT_NAME  self
 
 static void _generator_close_upvalues(struct generator * self) {
-	while (self->capturedUpvalues) {
-		KrkUpvalue * upvalue = self->capturedUpvalues;
-		upvalue->closed = self->args[upvalue->location];
+	while (self->segment.openUpvalues) {
+		KrkUpvalue * upvalue = self->segment.openUpvalues;
+		upvalue->closed = self->segment.stack[upvalue->location];
 		upvalue->location = -1;
-		self->capturedUpvalues = upvalue->next;
+		krk_writeBarrier((KrkObj*)upvalue);
+		self->segment.openUpvalues = upvalue->next;
 	}
 }
 
+static void _generator_free_stack(struct generator * self) {
+	FREE_ARRAY(KrkValue, self->segment.stack, self->segment.stackSize);
+	self->segment.stack = NULL;
+	self->segment.stackTop = NULL;
+	self->segment.stackSize = 0;
+}
+
 static void _generator_gcscan(KrkInstance * _self) {
 	struct generator * self = (struct generator*)_self;
 	krk_markObject((KrkObj*)self->closure);
-	for (size_t i = 0; i < self->argCount; ++i) {
-		krk_markValue(self->args[i]);
-	}
-	for (KrkUpvalue * upvalue = self->capturedUpvalues; upvalue; upvalue = upvalue->next) {
-		krk_markObject((KrkObj*)upvalue);
+	/* While running, our segment belongs to the thread and is marked with it. */
+	if (!self->running) {
+		for (KrkValue * slot = self->segment.stack; slot && slot < self->segment.stackTop; ++slot) {
+			krk_markValue(*slot);
+		}
+		for (KrkUpvalue * upvalue = self->segment.openUpvalues; upvalue; upvalue = upvalue->next) {
+			krk_markObject((KrkObj*)upvalue);
+		}
 	}
 	krk_markValue(self->result);
 }
 
 static void _generator_gcsweep(KrkInstance * self) {
 	_generator_close_upvalues((struct generator*)self);
-	free(((struct generator*)self)->args);
+	_generator_free_stack((struct generator*)self);
 }
 
 static void _set_generator_done(struct generator * self) {
 	self->ip = NULL;
 	_generator_close_upvalues(self);
+	_generator_free_stack(self);
 }
 
 /**
  * @brief Create a generator object from a closure and set of arguments.
  *
- * Initializes the generator object, attaches the argument list, and sets up
- * the execution state to point to the start of the function's code object.
+ * Initializes the generator object, gives it a stack segment holding the
+ * argument list, and sets up the execution state to point to the start of
+ * the function's code object.
  *
  * @param closure  Function object to transform.
  * @param argsIn   Array of arguments passed to the call.
@@ -81,13 +95,15 @@ static void _set_generator_done(struct generator * self) {
  */
 KrkInstance * krk_buildGenerator(KrkClosure * closure, KrkValue * argsIn, size_t argCount) {
 	/* Copy the args */
-	KrkValue * args = malloc(sizeof(KrkValue) * (argCount));
-	memcpy(args, argsIn, sizeof(KrkValue) * argCount);
+	size_t stackSize = GROW_CAPACITY(argCount);
+	KrkValue * stack = GROW_ARRAY(KrkValue, NULL, 0, stackSize);
+	memcpy(stack, argsIn, sizeof(KrkValue) * argCount);
 
 	/* Create a generator object */
 	struct generator * self = (struct generator *)krk_newInstance(KRK_BASE_CLASS(generator));
-	self->args = args;
-	self->argCount = argCount;
+	self->segment.stack = stack;
+	self->segment.stackTop = stack + argCount;
+	self->segment.stackSize = stackSize;
 	self->closure = closure;
 	self->ip = self->closure->function->chunk.code;
 	self->result = NONE_VAL();
@@ -119,56 +135,72 @@ KRK_Method(generator,__iter__) {
 	return OBJECT_VAL(self);
 }
 
+/**
+ * Make @p segment the thread's current stack, saving the registers of the
+ * segment being left. Nothing here allocates, so no collection can observe
+ * the thread halfway between the two.
+ */
+static void _switch_segment(KrkStackSegment * segment) {
+	KrkStackSegment * current = krk_currentThread.segment;
+	current->stack = krk_currentThread.stack;
+	current->stackTop = krk_currentThread.stackTop;
+	current->stackSize = krk_currentThread.stackSize;
+	current->openUpvalues = krk_currentThread.openUpvalues;
+
+	krk_currentThread.segment = segment;
+	krk_currentThread.stack = segment->stack;
+	krk_currentThread.stackTop = segment->stackTop;
+	krk_currentThread.stackSize = segment->stackSize;
+	krk_currentThread.stackMax = segment->stack + segment->stackSize;
+	krk_currentThread.openUpvalues = segment->openUpvalues;
+}
+
 KRK_Method(generator,__call__) {
 	METHOD_TAKES_AT_MOST(1);
 	if (!self->ip) return OBJECT_VAL(self);
 	if (self->running) {
 		return krk_runtimeError(vm.exceptions->valueError, "generator already executing");
 	}
+
+	/*
+	 * Our caller's arguments live on the segment we are about to leave, which
+	 * can not be reallocated while we run, so growing our own stack does not
+	 * need to wait for the caller to free anything.
+	 */
+	int deferFree = krk_currentThread.flags & KRK_THREAD_DEFER_STACK_FREE;
+	krk_currentThread.flags &= ~(KRK_THREAD_DEFER_STACK_FREE);
+
+	KrkStackSegment * outer = krk_currentThread.segment;
+	self->segment.outer = outer;
+	self->segment.frameBase = krk_currentThread.frameCount;
+	_switch_segment(&self->segment);
+
 	/* Prepare frame */
 	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount++];
 	frame->closure = self->closure;
 	frame->ip      = self->ip;
-	frame->slots   = krk_currentThread.stackTop - krk_currentThread.stack;
-	frame->outSlots = frame->slots;
+	frame->slots   = 0;
+	frame->outSlots = 0;
 	frame->globals = self->closure->globalsTable;
 	frame->globalsOwner = self->closure->globalsOwner;
 
-	/* Stick our stack on their stack */
-	for (size_t i = 0; i < self->argCount; ++i) {
-		krk_push(self->args[i]);
-	}
-
-	/* Point any of our captured upvalues back to their actual stack locations */
-	while (self->capturedUpvalues) {
-		KrkUpvalue * upvalue = self->capturedUpvalues;
-		upvalue->owner = &krk_currentThread;
-		upvalue->location = upvalue->location + frame->slots;
-		self->capturedUpvalues = upvalue->next;
-		upvalue->next = krk_currentThread.openUpvalues;
-		krk_currentThread.openUpvalues = upvalue;
-	}
-
+	/* Replace the value we last yielded with the one we were sent */
 	if (self->started) {
-		krk_pop();
-		if (argc > 1) {
-			krk_push(argv[1]);
-		} else {
-			krk_push(NONE_VAL());
-		}
+		krk_currentThread.stackTop[-1] = (argc > 1) ? argv[1] : NONE_VAL();
 	}
 
 	/* Jump into the iterator */
 	self->running = 1;
-	size_t stackBefore = krk_currentThread.stackTop - krk_currentThread.stack;
 	KrkValue result = krk_runNext();
-	size_t stackAfter = krk_currentThread.stackTop - krk_currentThread.stack;
+	self->ip = frame->ip;
+	_switch_segment(outer);
+	self->segment.outer = NULL;
 	self->running = 0;
-
 	self->started = 1;
+	krk_currentThread.flags |= deferFree;
 
 	if (IS_KWARGS(result) && AS_INTEGER(result) == 0) {
-		self->result = krk_pop();
+		self->result = self->segment.stackTop[-1];
 		_set_generator_done(self);
 		return OBJECT_VAL(self);
 	}
@@ -176,38 +208,9 @@ KRK_Method(generator,__call__) {
 	/* Was there an exception? */
 	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
 		_set_generator_done(self);
-		krk_currentThread.stackTop = krk_currentThread.stack + frame->slots;
 		return NONE_VAL();
 	}
 
-	/* Redirect any remaining upvalues captured from us, and release them from the VM */
-	while (krk_currentThread.openUpvalues != NULL && krk_currentThread.openUpvalues->location >= (int)frame->slots) {
-		KrkUpvalue * upvalue = krk_currentThread.openUpvalues;
-		upvalue->location = upvalue->location - frame->slots;
-		upvalue->owner = &self->fakethread;
-		krk_currentThread.openUpvalues = upvalue->next;
-		upvalue->next = self->capturedUpvalues;
-		self->capturedUpvalues = upvalue;
-	}
-
-	/* Determine the stack state */
-	if (stackAfter > stackBefore) {
-		size_t newArgs = stackAfter - stackBefore;
-		self->args = realloc(self->args, sizeof(KrkValue) * (self->argCount + newArgs));
-		self->argCount += newArgs;
-	} else if (stackAfter < stackBefore) {
-		size_t deadArgs = stackBefore - stackAfter;
-		self->args = realloc(self->args, sizeof(KrkValue) * (self->argCount - deadArgs));
-		self->argCount -= deadArgs;
-	}
-
-	/* Save stack entries */
-	memcpy(self->args, krk_currentThread.stackTop - self->argCount, sizeof(KrkValue) * self->argCount);
-	self->ip      = frame->ip;
-	self->fakethread.stack = self->args;
-
-	krk_currentThread.stackTop = krk_currentThread.stack + frame->slots;
-
 	return result;
 }
 
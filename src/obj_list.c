@@ -5,6 +5,8 @@
 #include <kuroko/util.h>
 #include <kuroko/threads.h>
 
+#include "private.h"
+
 #define LIST_WRAP_INDEX() \
 	if (index < 0) index += self->values.count; \
 	if (unlikely(index < 0 || index >= (krk_integer_type)self->values.count)) return krk_runtimeError(vm.exceptions->indexError, "list index out of range: %zd", (ssize_t)index)
@@ -110,6 +112,7 @@ KRK_Method(list,append) {
 	METHOD_TAKES_EXACTLY(1);
 	pthread_rwlock_wrlock(&self->rwlock);
 	krk_writeValueArray(&self->values, argv[1]);
+	krk_writeBarrier((KrkObj*)self);
 	pthread_rwlock_unlock(&self->rwlock);
 	return NONE_VAL();
 }
@@ -126,6 +129,7 @@ KRK_Method(list,insert) {
 		sizeof(KrkValue) * (self->values.count - index - 1)
 	);
 	self->values.values[index] = argv[2];
+	krk_writeBarrier((KrkObj*)self);
 	pthread_rwlock_unlock(&self->rwlock);
 	return NONE_VAL();
 }
@@ -159,7 +163,7 @@ KRK_Method(list,__repr__) {
 }
 
 static int _list_extend_callback(void * context, const KrkValue * values, size_t count) {
-	KrkValueArray * positionals = context;
+	KrkValueArray * positionals = &((KrkList*)context)->values;
 	if (positionals->count + count > positionals->capacity) {
 		size_t old = positionals->capacity;
 		positionals->capacity = (count == 1) ? GROW_CAPACITY(old) : (positionals->count + count);
@@ -170,19 +174,20 @@ static int _list_extend_callback(void * context, const KrkValue * values, size_t
 		positionals->values[positionals->count++] = values[i];
 	}
 
+	/* The iterable may run managed code between calls, so remember the list every time. */
+	krk_writeBarrier((KrkObj*)context);
 	return 0;
 }
 
 KRK_Method(list,extend) {
 	METHOD_TAKES_EXACTLY(1);
 	pthread_rwlock_wrlock(&self->rwlock);
-	KrkValueArray *  positionals = AS_LIST(argv[0]);
 	KrkValue other = argv[1];
 	if (krk_valuesSame(argv[0],other)) {
 		other = krk_list_of(self->values.count, self->values.values, 0);
 	}
 
-	krk_unpackIterable(other, positionals, _list_extend_callback);
+	krk_unpackIterable(other, self, _list_extend_callback);
 
 	pthread_rwlock_unlock(&self->rwlock);
 	return NONE_VAL();
@@ -264,6 +269,7 @@ KRK_Method(list,__setitem__) {
 		if (vm.globalFlags & KRK_GLOBAL_THREADS) pthread_rwlock_rdlock(&self->rwlock);
 		LIST_WRAP_INDEX();
 		self->values.values[index] = argv[2];
+		krk_writeBarrier((KrkObj*)self);
 		if (vm.globalFlags & KRK_GLOBAL_THREADS) pthread_rwlock_unlock(&self->rwlock);
 		return argv[2];
 	} else if (IS_slice(argv[1])) {
@@ -285,6 +291,7 @@ KRK_Method(list,__setitem__) {
 		for (krk_integer_type i = 0; (i < len && i < newLen); ++i) {
 			AS_LIST(argv[0])->values[start+i] = AS_LIST(argv[2])->values[i];
 		}
+		krk_writeBarrier((KrkObj*)self);
 
 		while (len < newLen) {
 			FUNC_NAME(list,insert)(3, (KrkValue[]){argv[0], INTEGER_VAL(start + len), AS_LIST(argv[2])->values[len]}, 0);
@@ -428,26 +435,385 @@ KRK_Method(list,reverse) {
 	return NONE_VAL();
 }
 
-static int _list_sorter(const void * _a, const void * _b) {
-	KrkValue a = *(KrkValue*)_a;
-	KrkValue b = *(KrkValue*)_b;
+/**
+ * Sorting.
+ *
+ * @c list.sort and @c sorted() share a stable merge sort in the style of Timsort:
+ * the list is split into runs that are already in order (strictly descending
+ * runs are reversed in place), short runs are extended to a minimum length with
+ * a binary insertion sort, and pending runs are merged while keeping their
+ * lengths balanced. Elements are only ever asked whether they are "less than"
+ * one another.
+ *
+ * With @c key= the key function is called once per element and the resulting
+ * keys are sorted with the values following along. Before sorting, the keys are
+ * scanned and, if they are all ints, all floats, or all ASCII strings, they are
+ * compared directly instead of going through the generic operator.
+ */
+#define SORT_MAX_RUNS 85
+
+typedef int (*SortLessThan)(KrkValue a, KrkValue b);
+
+struct SortState {
+	SortLessThan lt;
+	KrkValue * keys;      /**< What is compared */
+	KrkValue * values;    /**< Moved in step with @c keys, or NULL if they are the same */
+	KrkValue * tmpKeys;   /**< Merge scratch space, half the list */
+	KrkValue * tmpValues;
+	size_t pending;
+	struct { size_t base, len; } runs[SORT_MAX_RUNS];
+};
 
-	/* Avoid actually calling the sort function if there's an active exception */
+static int _sort_generic(KrkValue a, KrkValue b) {
+	KrkValue result = krk_operator_lt(a,b);
 	if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return -1;
-	KrkValue ltComp = krk_operator_lt(a,b);
-	if (IS_NONE(ltComp) || (IS_BOOLEAN(ltComp) && AS_BOOLEAN(ltComp))) return -1;
-	KrkValue gtComp = krk_operator_gt(a,b);
-	if (IS_NONE(gtComp) || (IS_BOOLEAN(gtComp) && AS_BOOLEAN(gtComp))) return 1;
+	if (IS_BOOLEAN(result)) return AS_BOOLEAN(result);
+	return !krk_isFalsey(result);
+}
+
+static int _sort_ints(KrkValue a, KrkValue b) {
+	return AS_INTEGER(a) < AS_INTEGER(b);
+}
+
+#ifndef KRK_NO_FLOAT
+static int _sort_floats(KrkValue a, KrkValue b) {
+	return AS_FLOATING(a) < AS_FLOATING(b);
+}
+#endif
+
+static int _sort_ascii(KrkValue a, KrkValue b) {
+	KrkString * sa = AS_STRING(a);
+	KrkString * sb = AS_STRING(b);
+	size_t len = sa->length < sb->length ? sa->length : sb->length;
+	int cmp = memcmp(sa->chars, sb->chars, len);
+	return cmp < 0 || (cmp == 0 && sa->length < sb->length);
+}
+
+static SortLessThan _sort_pick(const KrkValue * keys, size_t count) {
+	int ints = 1, floats = 1, ascii = 1;
+	for (size_t i = 0; i < count && (ints || floats || ascii); ++i) {
+		KrkValue k = keys[i];
+		if (!IS_INTEGER(k)) ints = 0;
+		if (!IS_FLOATING(k)) floats = 0;
+		if (!IS_STRING(k) || (AS_OBJECT(k)->flags & KRK_OBJ_FLAGS_STRING_MASK) != KRK_OBJ_FLAGS_STRING_ASCII) ascii = 0;
+	}
+	if (ints) return _sort_ints;
+#ifndef KRK_NO_FLOAT
+	if (floats) return _sort_floats;
+#endif
+	if (ascii) return _sort_ascii;
+	return _sort_generic;
+}
+
+/* Move @p n entries (keys and values) from @p src to @p dest; ranges may overlap. */
+static inline void _sort_move(struct SortState * s, KrkValue * destKeys, KrkValue * destValues, const KrkValue * srcKeys, const KrkValue * srcValues, size_t n) {
+	memmove(destKeys, srcKeys, n * sizeof(KrkValue));
+	if (s->values) memmove(destValues, srcValues, n * sizeof(KrkValue));
+}
+
+static void _sort_reverse(KrkValue * values, size_t lo, size_t hi) {
+	while (lo + 1 < hi) {
+		KrkValue tmp = values[lo];
+		values[lo++] = values[--hi];
+		values[hi] = tmp;
+	}
+}
+
+/* Sort [lo,hi) given that [lo,start) is already sorted. */
+static int _sort_insertion(struct SortState * s, size_t lo, size_t hi, size_t start) {
+	for (; start < hi; ++start) {
+		KrkValue pivot = s->keys[start];
+		size_t l = lo, r = start;
+		while (l < r) {
+			size_t m = l + (r - l) / 2;
+			int c = s->lt(pivot, s->keys[m]);
+			if (c < 0) return 1;
+			if (c) r = m;
+			else l = m + 1;
+		}
+		if (l == start) continue;
+		memmove(&s->keys[l+1], &s->keys[l], (start - l) * sizeof(KrkValue));
+		s->keys[l] = pivot;
+		if (s->values) {
+			KrkValue pivotValue = s->values[start];
+			memmove(&s->values[l+1], &s->values[l], (start - l) * sizeof(KrkValue));
+			s->values[l] = pivotValue;
+		}
+	}
 	return 0;
 }
 
-KRK_Method(list,sort) {
-	METHOD_TAKES_NONE();
+/* Length of the run starting at @p lo; strictly descending runs are reversed. */
+static ssize_t _sort_count_run(struct SortState * s, size_t lo, size_t hi) {
+	if (lo + 1 == hi) return 1;
+	size_t n = 2;
+	int c = s->lt(s->keys[lo+1], s->keys[lo]);
+	if (c < 0) return -1;
+	if (c) {
+		for (; lo + n < hi; ++n) {
+			c = s->lt(s->keys[lo+n], s->keys[lo+n-1]);
+			if (c < 0) return -1;
+			if (!c) break;
+		}
+		_sort_reverse(s->keys, lo, lo + n);
+		if (s->values) _sort_reverse(s->values, lo, lo + n);
+	} else {
+		for (; lo + n < hi; ++n) {
+			c = s->lt(s->keys[lo+n], s->keys[lo+n-1]);
+			if (c < 0) return -1;
+			if (c) break;
+		}
+	}
+	return n;
+}
+
+/* First index in base[0:n] whose entry is greater than @p key. */
+static ssize_t _sort_bisect_right(struct SortState * s, KrkValue key, const KrkValue * base, size_t n) {
+	size_t l = 0, r = n;
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		int c = s->lt(key, base[m]);
+		if (c < 0) return -1;
+		if (c) r = m;
+		else l = m + 1;
+	}
+	return l;
+}
+
+/* First index in base[0:n] whose entry is not less than @p key. */
+static ssize_t _sort_bisect_left(struct SortState * s, KrkValue key, const KrkValue * base, size_t n) {
+	size_t l = 0, r = n;
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		int c = s->lt(base[m], key);
+		if (c < 0) return -1;
+		if (c) l = m + 1;
+		else r = m;
+	}
+	return l;
+}
+
+/*
+ * Merge adjacent runs a and b, na <= nb, by copying a out of the way and filling
+ * from the left. If a comparison raises, whatever is left in scratch space is
+ * copied back so the list always remains a permutation of its original contents.
+ */
+static int _sort_merge_lo(struct SortState * s, size_t a, size_t na, size_t b, size_t nb) {
+	KrkValue * keys = s->keys, * values = s->values;
+	_sort_move(s, s->tmpKeys, s->tmpValues, &keys[a], values ? &values[a] : NULL, na);
+	size_t i = 0, j = b, d = a, end = b + nb;
+	int c = 0;
+	while (i < na && j < end) {
+		c = s->lt(keys[j], s->tmpKeys[i]);
+		if (c < 0) break;
+		if (c) {
+			keys[d] = keys[j];
+			if (values) values[d] = values[j];
+			j++;
+		} else {
+			keys[d] = s->tmpKeys[i];
+			if (values) values[d] = s->tmpValues[i];
+			i++;
+		}
+		d++;
+	}
+	_sort_move(s, &keys[d], values ? &values[d] : NULL, &s->tmpKeys[i], values ? &s->tmpValues[i] : NULL, na - i);
+	return c < 0;
+}
+
+/* As above, for nb < na: copy b out of the way and fill from the right. */
+static int _sort_merge_hi(struct SortState * s, size_t a, size_t na, size_t b, size_t nb) {
+	KrkValue * keys = s->keys, * values = s->values;
+	_sort_move(s, s->tmpKeys, s->tmpValues, &keys[b], values ? &values[b] : NULL, nb);
+	size_t i = a + na, j = nb, d = b + nb;
+	int c = 0;
+	while (i > a && j > 0) {
+		c = s->lt(s->tmpKeys[j-1], keys[i-1]);
+		if (c < 0) break;
+		d--;
+		if (c) {
+			i--;
+			keys[d] = keys[i];
+			if (values) values[d] = values[i];
+		} else {
+			j--;
+			keys[d] = s->tmpKeys[j];
+			if (values) values[d] = s->tmpValues[j];
+		}
+	}
+	_sort_move(s, &keys[d-j], values ? &values[d-j] : NULL, s->tmpKeys, s->tmpValues, j);
+	return c < 0;
+}
 
+static int _sort_merge_at(struct SortState * s, size_t n) {
+	size_t a = s->runs[n].base, na = s->runs[n].len;
+	size_t b = s->runs[n+1].base, nb = s->runs[n+1].len;
+
+	s->runs[n].len = na + nb;
+	if (n + 3 == s->pending) s->runs[n+1] = s->runs[n+2];
+	s->pending--;
+
+	/* Entries of a that are not greater than b[0] are already in place... */
+	ssize_t k = _sort_bisect_right(s, s->keys[b], &s->keys[a], na);
+	if (k < 0) return 1;
+	a += k;
+	na -= k;
+	if (!na) return 0;
+
+	/* ...as are entries of b that are not less than the last entry of a. */
+	k = _sort_bisect_left(s, s->keys[a+na-1], &s->keys[b], nb);
+	if (k < 0) return 1;
+	nb = k;
+	if (!nb) return 0;
+
+	return na <= nb ? _sort_merge_lo(s, a, na, b, nb) : _sort_merge_hi(s, a, na, b, nb);
+}
+
+static int _sort_merge_collapse(struct SortState * s) {
+	while (s->pending > 1) {
+		size_t n = s->pending - 2;
+		if ((n > 0 && s->runs[n-1].len <= s->runs[n].len + s->runs[n+1].len) ||
+		    (n > 1 && s->runs[n-2].len <= s->runs[n-1].len + s->runs[n].len)) {
+			if (s->runs[n-1].len < s->runs[n+1].len) n--;
+		} else if (s->runs[n].len > s->runs[n+1].len) {
+			break;
+		}
+		if (_sort_merge_at(s, n)) return 1;
+	}
+	return 0;
+}
+
+static int _sort_merge_force(struct SortState * s) {
+	while (s->pending > 1) {
+		size_t n = s->pending - 2;
+		if (n > 0 && s->runs[n-1].len < s->runs[n+1].len) n--;
+		if (_sort_merge_at(s, n)) return 1;
+	}
+	return 0;
+}
+
+static size_t _sort_min_run(size_t n) {
+	size_t r = 0;
+	while (n >= 64) {
+		r |= n & 1;
+		n >>= 1;
+	}
+	return n + r;
+}
+
+static int _sort_runs(struct SortState * s, size_t count) {
+	size_t minRun = _sort_min_run(count);
+	size_t lo = 0;
+	while (lo < count) {
+		ssize_t run = _sort_count_run(s, lo, count);
+		if (run < 0) return 1;
+		if ((size_t)run < minRun) {
+			size_t force = count - lo < minRun ? count - lo : minRun;
+			if (_sort_insertion(s, lo, lo + force, lo + run)) return 1;
+			run = force;
+		}
+		s->runs[s->pending].base = lo;
+		s->runs[s->pending].len = run;
+		s->pending++;
+		if (_sort_merge_collapse(s)) return 1;
+		lo += run;
+	}
+	return _sort_merge_force(s);
+}
+
+/**
+ * @brief Sort a list in place.
+ *
+ * The list is emptied while it is being sorted so that key functions and
+ * comparison methods can not observe or corrupt it half-way through; changes
+ * they make to it are discarded and reported as a @ref ValueError.
+ * Returns nonzero with an exception set on failure.
+ */
+static int _sort_list(KrkList * self, KrkValue key, int reverse) {
+	/* Working space; all of these stay on the stack so the collector sees them. */
+	KrkValue work = krk_list_of(0,NULL,0);
+	krk_push(work);
+	KrkValue keyList = NONE_VAL();
+	KrkValue scratch = krk_list_of(0,NULL,0);
+	krk_push(scratch);
+
+	pthread_rwlock_wrlock(&self->rwlock);
+	KrkValueArray sorting = self->values;
+	krk_initValueArray(&self->values);
+	pthread_rwlock_unlock(&self->rwlock);
+	*AS_LIST(work) = sorting;
+
+	size_t count = sorting.count;
+	int failed = 0;
+
+	if (reverse) _sort_reverse(AS_LIST(work)->values, 0, count);
+
+	if (!IS_NONE(key)) {
+		keyList = krk_list_of(0,NULL,0);
+		krk_push(keyList);
+		KrkValueArray * keys = AS_LIST(keyList);
+		keys->values = GROW_ARRAY(KrkValue, keys->values, 0, count);
+		keys->capacity = count;
+		for (size_t i = 0; i < count; ++i) {
+			krk_push(key);
+			krk_push(AS_LIST(work)->values[i]);
+			KrkValue result = krk_callStack(1);
+			if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) {
+				failed = 1;
+				break;
+			}
+			keys->values[keys->count++] = result;
+		}
+	}
+
+	if (!failed && count > 1) {
+		struct SortState s;
+		s.pending = 0;
+		s.values = IS_NONE(keyList) ? NULL : AS_LIST(work)->values;
+		s.keys = IS_NONE(keyList) ? AS_LIST(work)->values : AS_LIST(keyList)->values;
+		s.lt = _sort_pick(s.keys, count);
+
+		size_t half = count / 2 + 1;
+		size_t scratchSize = s.values ? half * 2 : half;
+		KrkValueArray * tmp = AS_LIST(scratch);
+		tmp->values = GROW_ARRAY(KrkValue, tmp->values, 0, scratchSize);
+		tmp->capacity = scratchSize;
+		for (size_t i = 0; i < scratchSize; ++i) tmp->values[i] = NONE_VAL();
+		tmp->count = scratchSize;
+		s.tmpKeys = tmp->values;
+		s.tmpValues = s.values ? tmp->values + half : NULL;
+
+		failed = _sort_runs(&s, count);
+	}
+
+	if (reverse) _sort_reverse(AS_LIST(work)->values, 0, count);
+
+	/* Anything added to the list while it was detached is dropped with the working list. */
+	sorting = *AS_LIST(work);
 	pthread_rwlock_wrlock(&self->rwlock);
-	qsort(self->values.values, self->values.count, sizeof(KrkValue), _list_sorter);
+	int modified = self->values.count != 0 || self->values.capacity != 0;
+	*AS_LIST(work) = self->values;
+	self->values = sorting;
 	pthread_rwlock_unlock(&self->rwlock);
+	krk_writeBarrier((KrkObj*)self);
 
+	if (!IS_NONE(keyList)) krk_pop();
+	krk_pop(); /* scratch */
+	krk_pop(); /* work */
+
+	if (!failed && modified) {
+		krk_runtimeError(vm.exceptions->valueError, "list modified during sort");
+		failed = 1;
+	}
+
+	return failed;
+}
+
+KRK_Method(list,sort) {
+	KrkValue key = NONE_VAL();
+	int reverse = 0;
+	if (!krk_parseArgs(".|$Vp", (const char*[]){"key","reverse"}, &key, &reverse)) return NONE_VAL();
+	_sort_list(self, key, reverse);
 	return NONE_VAL();
 }
 
@@ -498,12 +864,6 @@ MAKE_LIST_COMPARE(le,<=)
 
 #undef CURRENT_CTYPE
 
-struct ListIterator {
-	KrkInstance inst;
-	KrkValue l;
-	size_t i;
-};
-
 #define CURRENT_CTYPE struct ListIterator *
 #define IS_listiterator(o) (likely(IS_INSTANCE(o) && AS_INSTANCE(o)->_class == vm.baseClasses->listiteratorClass) || krk_isInstanceOf(o,vm.baseClasses->listiteratorClass))
 #define AS_listiterator(o) (struct ListIterator*)AS_OBJECT(o)
@@ -544,14 +904,16 @@ _bad:
 	goto _maybeGood;
 }
 
-static KrkValue _sorted(int argc, const KrkValue argv[], int hasKw) {
-	if (argc != 1) return krk_runtimeError(vm.exceptions->argumentError,"%s() takes %s %d argument%s (%d given)","sorted","exactly",1,"",argc);
+KRK_Function(sorted) {
+	KrkValue iterable;
+	KrkValue key = NONE_VAL();
+	int reverse = 0;
+	if (!krk_parseArgs("V|$Vp", (const char*[]){"iterable","key","reverse"}, &iterable, &key, &reverse)) return NONE_VAL();
 	KrkValue listOut = krk_list_of(0,NULL,0);
 	krk_push(listOut);
-	FUNC_NAME(list,extend)(2,(KrkValue[]){listOut,argv[0]},0);
-	if (!IS_NONE(krk_currentThread.currentException)) return NONE_VAL();
-	FUNC_NAME(list,sort)(1,&listOut,0);
+	FUNC_NAME(list,extend)(2,(KrkValue[]){listOut,iterable},0);
 	if (!IS_NONE(krk_currentThread.currentException)) return NONE_VAL();
+	if (_sort_list((KrkList*)AS_OBJECT(listOut), key, reverse)) return NONE_VAL();
 	return krk_pop();
 }
 
@@ -637,19 +999,24 @@ void _createAndBind_listClass(void) {
 		"@brief Reverse the contents of a list.\n\n"
 		"Reverses the elements of the list in-place.");
 	KRK_DOC(BIND_METHOD(list,sort),
-		"@brief Sort the contents of a list.\n\n"
+		"@brief Sort the contents of a list.\n"
+		"@arguments key=None,reverse=False\n\n"
 		"Performs an in-place sort of the elements in the list, returning @c None as a gentle reminder "
-		"that the sort is in-place. If a sorted copy is desired, use @ref sorted instead.");
+		"that the sort is in-place. If a sorted copy is desired, use @ref sorted instead.\n\n"
+		"The sort is stable. If @p key is given, it is called once for each element and the results "
+		"are compared instead of the elements themselves. If @p reverse is @c True, the list is sorted "
+		"in descending order while equal elements keep their original order.");
 	krk_defineNative(&list->methods, "__str__", FUNC_NAME(list,__repr__));
 	krk_defineNative(&list->methods, "__class_getitem__", krk_GenericAlias)->obj.flags |= KRK_OBJ_FLAGS_FUNCTION_IS_CLASS_METHOD;
 	krk_attachNamedValue(&list->methods, "__hash__", NONE_VAL());
 	krk_finalizeClass(list);
 	KRK_DOC(list, "Mutable sequence of arbitrary values.");
 
-	BUILTIN_FUNCTION("sorted", _sorted,
+	BUILTIN_FUNCTION("sorted", FUNC_NAME(krk,sorted),
 		"@brief Return a sorted representation of an iterable.\n"
-		"@arguments iterable\n\n"
-		"Creates a new, sorted list from the elements of @p iterable.");
+		"@arguments iterable,key=None,reverse=False\n\n"
+		"Creates a new, sorted list from the elements of @p iterable. "
+		"@p key and @p reverse have the same meaning as for @c list.sort.");
 	BUILTIN_FUNCTION("reversed", _reversed,
 		"@brief Return a reversed representation of an iterable.\n"
 		"@arguments iterable\n\n"
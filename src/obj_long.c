@@ -14,7 +14,6 @@
  * - Expose better functions for extracting and converting native integers,
  *   which would be useful in modules that want to take 64-bit values,
  *   extracted unsigned values, etc.
- * - Faster division for large divisors?
  * - Shifts without multiply/divide...
  */
 #include <kuroko/vm.h>
@@ -48,7 +47,7 @@ static int krk_long_init_si(KrkLong * num, int64_t val) {
 
 	/* Digits store unsigned values, so flip things over. */
 	int sign = (val < 0) ? -1 : 1;
-	uint64_t abs = (val < 0) ? -val : val;
+	uint64_t abs = (val < 0) ? -(uint64_t)val : (uint64_t)val;
 
 	/* Quick case for things that fit in our digits... */
 	if (abs <= DIGIT_MAX) {
@@ -491,11 +490,170 @@ static int krk_long_zero(KrkLong * num) {
 	return 0;
 }
 
+/**
+ * @brief Operand size, in digits, below which multiplication is done the
+ *        schoolbook way. Karatsuba only pays off for fairly large values.
+ */
+#define KARATSUBA_CUTOFF 40
+
+/**
+ * @brief Number of significant digits in a raw digit array.
+ */
+static size_t _digits_len(const uint32_t * d, size_t n) {
+	while (n && !d[n-1]) n--;
+	return n;
+}
+
+/**
+ * @brief Add @p b into @p acc in place, propagating the carry through @p acc.
+ *
+ * @return The carry out of the top of @p acc
+ */
+static uint32_t _digits_add_into(uint32_t * acc, size_t accn, const uint32_t * b, size_t bn) {
+	uint32_t carry = 0;
+	size_t i = 0;
+	for (; i < bn; ++i) {
+		uint32_t s = acc[i] + b[i] + carry;
+		acc[i] = s & DIGIT_MAX;
+		carry = s >> DIGIT_SHIFT;
+	}
+	for (; carry && i < accn; ++i) {
+		uint32_t s = acc[i] + carry;
+		acc[i] = s & DIGIT_MAX;
+		carry = s >> DIGIT_SHIFT;
+	}
+	return carry;
+}
+
+/**
+ * @brief Subtract @p b from @p acc in place, propagating the borrow through @p acc.
+ *
+ * @return The borrow out of the top of @p acc
+ */
+static uint32_t _digits_sub_from(uint32_t * acc, size_t accn, const uint32_t * b, size_t bn) {
+	uint32_t borrow = 0;
+	size_t i = 0;
+	for (; i < bn; ++i) {
+		uint32_t d = acc[i] - b[i] - borrow;
+		acc[i] = d & DIGIT_MAX;
+		borrow = (d >> DIGIT_SHIFT) & 1;
+	}
+	for (; borrow && i < accn; ++i) {
+		uint32_t d = acc[i] - borrow;
+		acc[i] = d & DIGIT_MAX;
+		borrow = (d >> DIGIT_SHIFT) & 1;
+	}
+	return borrow;
+}
+
+/**
+ * @brief Chalkboard long multiplication of raw digit arrays.
+ *
+ * @p out must have room for @p an + @p bn digits and be zeroed.
+ */
+static void _mul_digits_school(uint32_t * out, const uint32_t * a, size_t an, const uint32_t * b, size_t bn) {
+	for (size_t i = 0; i < bn; ++i) {
+		uint64_t b_digit = b[i];
+		uint64_t carry = 0;
+		for (size_t j = 0; j < an; ++j) {
+			uint64_t a_digit = a[j];
+			uint64_t tmp = carry + a_digit * b_digit + out[i+j];
+			carry = tmp >> DIGIT_SHIFT;
+			out[i+j] = tmp & DIGIT_MAX;
+		}
+		out[i + an] = carry;
+	}
+}
+
+static void _mul_digits(uint32_t * out, const uint32_t * a, size_t an, const uint32_t * b, size_t bn);
+
+/**
+ * @brief Multiply a long value by a much shorter one.
+ *
+ * Karatsuba wants balanced operands, so @p a is cut into slices the size of
+ * @p b and the partial products are added in at the right offsets.
+ */
+static void _mul_digits_lopsided(uint32_t * out, const uint32_t * a, size_t an, const uint32_t * b, size_t bn) {
+	uint32_t * partial = malloc(sizeof(uint32_t) * 2 * bn);
+	for (size_t offset = 0; offset < an; offset += bn) {
+		size_t cn = an - offset < bn ? an - offset : bn;
+		memset(partial, 0, sizeof(uint32_t) * (cn + bn));
+		_mul_digits(partial, a + offset, cn, b, bn);
+		_digits_add_into(out + offset, an + bn - offset, partial, cn + bn);
+	}
+	free(partial);
+}
+
+/**
+ * @brief Multiply raw digit arrays.
+ *
+ * Uses Karatsuba's method above @c KARATSUBA_CUTOFF digits: with
+ * a = a1*B^s + a0 and b = b1*B^s + b0, the product is built from the
+ * three half-size products a0*b0, a1*b1 and (a0+a1)*(b0+b1).
+ *
+ * @p out must have room for @p an + @p bn digits and be zeroed.
+ */
+static void _mul_digits(uint32_t * out, const uint32_t * a, size_t an, const uint32_t * b, size_t bn) {
+	an = _digits_len(a, an);
+	bn = _digits_len(b, bn);
+
+	if (an < bn) {
+		const uint32_t * t = a; a = b; b = t;
+		size_t tn = an; an = bn; bn = tn;
+	}
+
+	if (!bn) return;
+
+	if (bn < KARATSUBA_CUTOFF) {
+		_mul_digits_school(out, a, an, b, bn);
+		return;
+	}
+
+	if (an >= 2 * bn) {
+		_mul_digits_lopsided(out, a, an, b, bn);
+		return;
+	}
+
+	/* Since 2*bn > an, both operands have digits above the split. */
+	size_t s = an / 2;
+	const uint32_t * a1 = a + s, * b1 = b + s;
+	size_t a1n = an - s, b1n = bn - s;
+
+	/* z0 = a0*b0 in out[0:2s], z2 = a1*b1 in out[2s:] */
+	_mul_digits(out, a, s, b, s);
+	_mul_digits(out + 2 * s, a1, a1n, b1, b1n);
+
+	size_t san = a1n + 1;
+	size_t sbn = (b1n > s ? b1n : s) + 1;
+	size_t tn  = san + sbn;
+	uint32_t * sa = calloc(san + sbn + tn, sizeof(uint32_t));
+	uint32_t * sb = sa + san;
+	uint32_t * t  = sb + sbn;
+
+	memcpy(sa, a1, sizeof(uint32_t) * a1n);
+	_digits_add_into(sa, san, a, s);
+	if (b1n > s) {
+		memcpy(sb, b1, sizeof(uint32_t) * b1n);
+		_digits_add_into(sb, sbn, b, s);
+	} else {
+		memcpy(sb, b, sizeof(uint32_t) * s);
+		_digits_add_into(sb, sbn, b1, b1n);
+	}
+
+	/* z1 = (a0+a1)*(b0+b1) - z0 - z2, added in at B^s */
+	_mul_digits(t, sa, san, sb, sbn);
+	_digits_sub_from(t, tn, out, 2 * s);
+	_digits_sub_from(t, tn, out + 2 * s, a1n + b1n);
+	_digits_add_into(out + s, an + bn - s, t, _digits_len(t, tn));
+
+	free(sa);
+}
+
 /**
  * @brief Multiply the absolute values of two longs.
  *
- * Performs a simple chalkboard long multiplication, using the
- * result as the accumulator.
+ * Small values get a simple chalkboard long multiplication; larger ones
+ * go through @c _mul_digits and Karatsuba.
  *
  * @p res must be initialized, but will be resized and zeroed on entry; it
  * must not be equal to either of @p a or @p b.
@@ -508,17 +666,7 @@ static int _mul_abs(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 	krk_long_resize(res, awidth+bwidth);
 	krk_long_zero(res);
 
-	for (size_t i = 0; i < bwidth; ++i) {
-		uint64_t b_digit = b->digits[i];
-		uint64_t carry = 0;
-		for (size_t j = 0; j < awidth; ++j) {
-			uint64_t a_digit = a->digits[j];
-			uint64_t tmp = carry + a_digit * b_digit + res->digits[i+j];
-			carry = tmp >> DIGIT_SHIFT;
-			res->digits[i+j] = tmp & DIGIT_MAX;
-		}
-		res->digits[i + awidth] = carry;
-	}
+	_mul_digits(res->digits, a->digits, awidth, b->digits, bwidth);
 
 	krk_long_trim(res);
 
@@ -562,40 +710,6 @@ static int krk_long_mul(KrkLong * res, const KrkLong * a, const KrkLong * b) {
 	return 0;
 }
 
-/**
- * @brief Shift a long one bit left.
- *
- * Shifts @p in left one bit in-place, resizing as needed.
- */
-static int _lshift_one(KrkLong * in) {
-	if (in->width == 0) {
-		return 0;
-	}
-
-	size_t abs_width = in->width < 0 ? -in->width : in->width;
-	size_t out_width = abs_width;
-
-	if (in->digits[abs_width-1] >> (DIGIT_SHIFT - 1)) {
-		out_width += 1;
-	}
-
-	krk_long_resize(in, out_width);
-
-	int carry = 0;
-
-	for (size_t i = 0; i < abs_width; ++i) {
-		uint32_t digit = in->digits[i];
-		in->digits[i] = ((digit << 1) + carry) & DIGIT_MAX;
-		carry = (digit >> (DIGIT_SHIFT -1));
-	}
-
-	if (carry) {
-		in->digits[out_width-1] = 1;
-	}
-
-	return 0;
-}
-
 /**
  * @brief Calculate the highest set bit of a long.
  *
@@ -628,20 +742,6 @@ static size_t _bit_is_set(const KrkLong * num, size_t bit) {
 	return !!(num->digits[digit_offset] & (1 << digit_bit));
 }
 
-/**
- * @brief Set or unset the least significant bit of a long.
- */
-static int _bit_set_zero(KrkLong * num, int val) {
-	if (num->width == 0) {
-		krk_long_clear(num);
-		krk_long_init_si(num, !!val);
-		return 0;
-	}
-
-	num->digits[0] = (num->digits[0] & ~1) | (!!val);
-	return 0;
-}
-
 /**
  * @brief Set a given bit in a long.
  *
@@ -666,14 +766,267 @@ static int krk_long_bit_set(KrkLong * num, size_t bit) {
 	return 0;
 }
 
+static int _div_abs(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkLong * b);
+
+/**
+ * @brief Divisor size, in digits, above which division switches from
+ *        Knuth's Algorithm D to Burnikel-Ziegler recursive division.
+ */
+#define BURNIKEL_CUTOFF 80
+
+/**
+ * @brief Word-level long division of raw digit arrays.
+ *
+ * Knuth's Algorithm D (TAOCP vol. 2, 4.3.1): the divisor is normalized
+ * so its top digit has its high bit set, which lets each quotient digit be
+ * estimated from the top two digits of the running remainder and be off by
+ * at most one, which is corrected with an add-back.
+ *
+ * Requires @p bn >= 2 and @p an >= @p bn. @p q must have room for
+ * @p an - @p bn + 1 digits and @p r for @p bn digits.
+ */
+static void _div_digits_knuth(uint32_t * q, uint32_t * r, const uint32_t * a, size_t an, const uint32_t * b, size_t bn) {
+	uint32_t top = b[bn-1];
+	int shift = 0;
+	while (!(top & (1U << (DIGIT_SHIFT - 1)))) {
+		top <<= 1;
+		shift++;
+	}
+
+	uint32_t * u = malloc(sizeof(uint32_t) * (an + 1 + bn));
+	uint32_t * v = u + an + 1;
+
+	for (size_t i = 0; i < bn; ++i) {
+		v[i] = ((b[i] << shift) | (i ? (uint64_t)b[i-1] >> (DIGIT_SHIFT - shift) : 0)) & DIGIT_MAX;
+	}
+	for (size_t i = 0; i < an; ++i) {
+		u[i] = ((a[i] << shift) | (i ? (uint64_t)a[i-1] >> (DIGIT_SHIFT - shift) : 0)) & DIGIT_MAX;
+	}
+	u[an] = (uint64_t)a[an-1] >> (DIGIT_SHIFT - shift);
+
+	uint64_t vtop = v[bn-1];
+	uint64_t vnext = v[bn-2];
+
+	for (size_t _j = 0; _j <= an - bn; ++_j) {
+		size_t j = an - bn - _j;
+
+		uint64_t num  = ((uint64_t)u[j+bn] << DIGIT_SHIFT) | u[j+bn-1];
+		uint64_t qhat = num / vtop;
+		uint64_t rhat = num % vtop;
+
+		while (qhat > DIGIT_MAX || qhat * vnext > ((rhat << DIGIT_SHIFT) | u[j+bn-2])) {
+			qhat--;
+			rhat += vtop;
+			if (rhat > DIGIT_MAX) break;
+		}
+
+		/* u[j:j+bn+1] -= qhat * v */
+		int64_t borrow = 0;
+		uint64_t carry = 0;
+		for (size_t i = 0; i < bn; ++i) {
+			uint64_t p = qhat * v[i] + carry;
+			carry = p >> DIGIT_SHIFT;
+			int64_t t = (int64_t)u[i+j] - (int64_t)(p & DIGIT_MAX) + borrow;
+			u[i+j] = t & DIGIT_MAX;
+			borrow = t >> DIGIT_SHIFT;
+		}
+		int64_t t = (int64_t)u[j+bn] - (int64_t)carry + borrow;
+		u[j+bn] = t & DIGIT_MAX;
+
+		if (t < 0) {
+			/* Estimate was one too large; add the divisor back. */
+			qhat--;
+			uint32_t c = 0;
+			for (size_t i = 0; i < bn; ++i) {
+				uint32_t s = u[i+j] + v[i] + c;
+				u[i+j] = s & DIGIT_MAX;
+				c = s >> DIGIT_SHIFT;
+			}
+			u[j+bn] = (u[j+bn] + c) & DIGIT_MAX;
+		}
+
+		q[j] = qhat;
+	}
+
+	for (size_t i = 0; i < bn; ++i) {
+		r[i] = ((u[i] >> shift) | ((uint64_t)u[i+1] << (DIGIT_SHIFT - shift))) & DIGIT_MAX;
+	}
+
+	free(u);
+}
+
+/**
+ * @brief Set @p out to @p in * B^n, where B is the digit base. @p in must be non-negative.
+ */
+static void _digits_shift_up(KrkLong * out, const KrkLong * in, size_t n) {
+	krk_long_clear(out);
+	if (!in->width) return;
+	krk_long_resize(out, in->width + n);
+	memset(out->digits, 0, sizeof(uint32_t) * n);
+	memcpy(out->digits + n, in->digits, sizeof(uint32_t) * in->width);
+}
+
+/**
+ * @brief Set @p out to digits [@p start, @p start + @p n) of non-negative @p in.
+ */
+static void _digits_slice(KrkLong * out, const KrkLong * in, size_t start, size_t n) {
+	krk_long_clear(out);
+	if ((size_t)in->width <= start) return;
+	if (start + n > (size_t)in->width) n = in->width - start;
+	krk_long_resize(out, n);
+	memcpy(out->digits, in->digits + start, sizeof(uint32_t) * n);
+	krk_long_trim(out);
+}
+
+static void _div_bz_2n1n(KrkLong * q, KrkLong * r, const KrkLong * a, const KrkLong * b, size_t n);
+
+/**
+ * @brief Burnikel-Ziegler 3n/2n step.
+ *
+ * Divides [a12,a3] (a12 holding the top two thirds, a3 the bottom n digits)
+ * by b = [b1,b2], each half n digits wide. The quotient estimate from b1
+ * alone is at most two too large since b is normalized.
+ */
+static void _div_bz_3n2n(KrkLong * q, KrkLong * r, const KrkLong * a12, const KrkLong * a3, const KrkLong * b, const KrkLong * b1, const KrkLong * b2, size_t n) {
+	KrkLong top, tmp;
+	krk_long_init_many(&top, &tmp, NULL);
+
+	_digits_slice(&top, a12, n, a12->width);
+	if (krk_long_compare(&top, b1) == 0) {
+		/* q = B^n - 1, r = a12 - b1*B^n + b1 */
+		krk_long_clear(q);
+		krk_long_resize(q, n);
+		for (size_t i = 0; i < n; ++i) q->digits[i] = DIGIT_MAX;
+		_digits_shift_up(&tmp, b1, n);
+		krk_long_sub(r, a12, &tmp);
+		krk_long_add(r, r, b1);
+	} else {
+		_div_bz_2n1n(q, r, a12, b1, n);
+	}
+
+	/* r = r*B^n + a3 - q*b2 */
+	_digits_shift_up(&tmp, r, n);
+	krk_long_add(r, &tmp, a3);
+	krk_long_mul(&tmp, q, b2);
+	krk_long_sub(r, r, &tmp);
+
+	if (r->width < 0) {
+		KrkLong one;
+		krk_long_init_si(&one, 1);
+		while (r->width < 0) {
+			krk_long_sub(q, q, &one);
+			krk_long_add(r, r, b);
+		}
+		krk_long_clear(&one);
+	}
+
+	krk_long_clear_many(&top, &tmp, NULL);
+}
+
+/**
+ * @brief Burnikel-Ziegler 2n/1n step.
+ *
+ * Divides @p a by the normalized @p n digit value @p b, where a < b*B^n, by
+ * splitting it into two 3n/2n half-size divisions. Small divisors go to
+ * Algorithm D.
+ */
+static void _div_bz_2n1n(KrkLong * q, KrkLong * r, const KrkLong * a, const KrkLong * b, size_t n) {
+	if (n < BURNIKEL_CUTOFF) {
+		KrkLong quot, rem;
+		krk_long_init_many(&quot, &rem, NULL);
+		_div_abs(&quot, &rem, a, b);
+		_swap(q, &quot);
+		_swap(r, &rem);
+		krk_long_clear_many(&quot, &rem, NULL);
+		return;
+	}
+
+	KrkLong pa, pb, a12, a3, b1, b2, q1, q2, r1;
+	krk_long_init_many(&pa, &pb, &a12, &a3, &b1, &b2, &q1, &q2, &r1, NULL);
+
+	/* Odd sizes are padded by a digit on both sides; the remainder is shifted back after. */
+	int pad = n & 1;
+	if (pad) {
+		_digits_shift_up(&pa, a, 1);
+		_digits_shift_up(&pb, b, 1);
+		n++;
+	} else {
+		krk_long_init_copy(&pa, a);
+		krk_long_init_copy(&pb, b);
+	}
+
+	size_t half = n / 2;
+	_digits_slice(&b1, &pb, half, half);
+	_digits_slice(&b2, &pb, 0, half);
+
+	/* Top half of the quotient from the top three quarters of a... */
+	_digits_slice(&a12, &pa, n, n);
+	_digits_slice(&a3, &pa, half, half);
+	_div_bz_3n2n(&q1, &r1, &a12, &a3, &pb, &b1, &b2, half);
+
+	/* ...and the bottom half from what remains. */
+	_digits_slice(&a3, &pa, 0, half);
+	_div_bz_3n2n(&q2, r, &r1, &a3, &pb, &b1, &b2, half);
+
+	_digits_shift_up(q, &q1, half);
+	krk_long_add(q, q, &q2);
+
+	if (pad) {
+		_digits_slice(&r1, r, 1, r->width);
+		_swap(r, &r1);
+	}
+
+	krk_long_clear_many(&pa, &pb, &a12, &a3, &b1, &b2, &q1, &q2, &r1, NULL);
+}
+
+/**
+ * @brief Divide non-negative @p a by @p b with Burnikel-Ziegler recursive division.
+ *
+ * The divisor is normalized and the dividend is consumed in chunks of as many
+ * digits as the divisor has, each step being a 2n/1n division; with Karatsuba
+ * multiplication underneath this is subquadratic.
+ */
+static void _div_burnikel(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkLong * b) {
+	size_t n = b->width;
+	uint32_t top = b->digits[n-1];
+	int shift = 0;
+	while (!(top & (1U << (DIGIT_SHIFT - 1)))) {
+		top <<= 1;
+		shift++;
+	}
+
+	KrkLong scale, na, nb, r, chunk, qd, tmp;
+	krk_long_init_many(&na, &nb, &r, &chunk, &qd, &tmp, NULL);
+	krk_long_init_si(&scale, (int64_t)1 << shift);
+	krk_long_mul(&na, a, &scale);
+	krk_long_mul(&nb, b, &scale);
+
+	size_t chunks = (na.width + n - 1) / n;
+	krk_long_resize(quot, chunks * n);
+	krk_long_zero(quot);
+
+	for (size_t i = chunks; i-- > 0;) {
+		_digits_slice(&chunk, &na, i * n, n);
+		_digits_shift_up(&tmp, &r, n);
+		krk_long_add(&tmp, &tmp, &chunk);
+		_div_bz_2n1n(&qd, &r, &tmp, &nb, n);
+		if (qd.width) memcpy(quot->digits + i * n, qd.digits, sizeof(uint32_t) * qd.width);
+	}
+
+	krk_long_trim(quot);
+	_div_abs(rem, &tmp, &r, &scale);
+
+	krk_long_clear_many(&scale, &na, &nb, &r, &chunk, &qd, &tmp, NULL);
+}
+
 /**
  * @brief Internal division implementation.
  *
  * Divides @p |a| by @p |b| placing the remainder in @p rem and the quotient in @p quot.
  *
- * Performs one of two division operations. For single-digit divisor, we perform
- * a quicker division. For anything else, performs a binary long division, which
- * is terribly slow, but is at least correct...
+ * Single-digit divisors get a quick one-pass division, other divisors use
+ * Knuth's Algorithm D, and large divisions with large quotients are done
+ * with Burnikel-Ziegler.
  *
  * @return 1 if divisor is 0, otherwise 0.
  */
@@ -725,21 +1078,17 @@ static int _div_abs(KrkLong * quot, KrkLong * rem, const KrkLong * a, const KrkL
 		return 0;
 	}
 
-	size_t bits = _bits_in(a);
-	for (size_t i = 0; i < bits; ++i) {
-		size_t _i = bits - i - 1;
-
-		/* Shift remainder by one */
-		_lshift_one(rem);
-
-		int is_set = _bit_is_set(&absa, _i);
-		_bit_set_zero(rem, is_set);
-		if (krk_long_compare(rem,&absb) >= 0) {
-			_sub_big_small(rem,rem,&absb);
-			krk_long_bit_set(quot, _i);
-		}
+	if (bwidth >= BURNIKEL_CUTOFF && awidth - bwidth >= BURNIKEL_CUTOFF) {
+		_div_burnikel(quot, rem, &absa, &absb);
+		krk_long_clear_many(&absa,&absb,NULL);
+		return 0;
 	}
 
+	krk_long_resize(quot, awidth - bwidth + 1);
+	krk_long_resize(rem, bwidth);
+	_div_digits_knuth(quot->digits, rem->digits, absa.digits, awidth, absb.digits, bwidth);
+	krk_long_trim(rem);
+
 	krk_long_trim(quot);
 	krk_long_clear_many(&absa,&absb,NULL);
 
@@ -1008,6 +1357,79 @@ static char * _fast_conversion(const KrkLong * abs, unsigned int bits, char * wr
 	return writer;
 }
 
+/**
+ * @brief Width, in digits, below which radix conversion is done directly
+ *        instead of by divide and conquer.
+ */
+#define CONVERSION_CUTOFF 30
+
+/**
+ * @brief Find the largest power of @p base that fits in a single digit.
+ *
+ * @return How many digits in @p base that power spans.
+ */
+static size_t _base_chunk(unsigned int base, uint32_t * power) {
+	uint64_t p = base;
+	size_t n = 1;
+	while (p * base <= DIGIT_MAX) {
+		p *= base;
+		n++;
+	}
+	*power = p;
+	return n;
+}
+
+/**
+ * @brief Extend a table of powers[k] = power^(2^k) by repeated squaring.
+ */
+static void _base_power_next(KrkLong * powers, size_t k) {
+	krk_long_init_si(&powers[k], 0);
+	krk_long_mul(&powers[k], &powers[k-1], &powers[k-1]);
+}
+
+/**
+ * @brief Write the digits of non-negative @p n in reverse, zero-padded to @p pad digits.
+ *
+ * @p n is consumed. Values that are too big to convert directly are split by
+ * the largest entry of @p powers that is at most half their size and the two
+ * halves converted recursively, so most of the work is in a few large
+ * divisions rather than one small division per output chunk.
+ */
+static char * _convert_recursive(KrkLong * n, unsigned int base, uint32_t power, size_t chunk, KrkLong * powers, ssize_t k, size_t pad, char * writer) {
+	while (k >= 0 && (size_t)powers[k].width * 2 > (size_t)n->width + 1) k--;
+
+	if (k < 0 || n->width <= CONVERSION_CUTOFF) {
+		char * start = writer;
+		while (n->width) {
+			uint32_t rem = _div_inplace(n, power);
+			if (n->width) {
+				for (size_t i = 0; i < chunk; ++i) {
+					*writer++ = _vals[rem % base];
+					rem /= base;
+				}
+			} else {
+				/* No leading zeros from the top chunk. */
+				while (rem) {
+					*writer++ = _vals[rem % base];
+					rem /= base;
+				}
+			}
+		}
+		while ((size_t)(writer - start) < pad) *writer++ = '0';
+		return writer;
+	}
+
+	KrkLong q, r;
+	krk_long_init_many(&q, &r, NULL);
+	krk_long_div_rem(&q, &r, n, &powers[k]);
+	krk_long_clear(n);
+
+	size_t low = chunk << k;
+	writer = _convert_recursive(&r, base, power, chunk, powers, k - 1, low, writer);
+	writer = _convert_recursive(&q, base, power, chunk, powers, k - 1, pad > low ? pad - low : 0, writer);
+	return writer;
+}
+
 /**
  * @brief Convert a long to a string in a given base.
  */
@@ -1031,11 +1453,20 @@ static char * krk_long_to_str(const KrkLong * n, int _base, const char * prefix,
 			case 4:  writer = _fast_conversion(&abs,2,writer); break;
 			case 8:  writer = _fast_conversion(&abs,3,writer); break;
 			case 16: writer = _fast_conversion(&abs,4,writer); break;
-			default:
-				while (krk_long_sign(&abs) > 0) {
-					uint32_t rem = _div_inplace(&abs,_base);
-					*writer++ = _vals[rem];
+			default: {
+				uint32_t power;
+				size_t chunk = _base_chunk(_base, &power);
+				KrkLong powers[64];
+				ssize_t count = 0;
+				if (abs.width > CONVERSION_CUTOFF) {
+					krk_long_init_ui(&powers[count++], power);
+					while (count < 64 && (size_t)powers[count-1].width * 2 <= (size_t)abs.width + 1) {
+						_base_power_next(powers, count++);
+					}
 				}
+				writer = _convert_recursive(&abs, _base, power, chunk, powers, count - 1, 0, writer);
+				for (ssize_t i = 0; i < count; ++i) krk_long_clear(&powers[i]);
+			}
 		}
 	}
 
@@ -1085,6 +1516,58 @@ static int is_whitespace(char c) {
 	return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
 }
 
+/**
+ * @brief Accumulate a sequence of digit values into @p num, several at a time.
+ */
+static void _parse_digits(KrkLong * num, const uint8_t * digits, size_t len, unsigned int base) {
+	KrkLong _base, scratch;
+	krk_long_init_si(&_base, 0);
+	krk_long_init_si(&scratch, 0);
+
+	size_t i = 0;
+	while (i < len) {
+		uint64_t accum = 0;
+		uint64_t basediv = 1;
+		while (i < len && (basediv * base < 0x10000000000000UL)) {
+			basediv *= base;
+			accum *= base;
+			accum += digits[i++];
+		}
+		krk_long_init_ui(&_base, basediv);
+		krk_long_mul(num, num, &_base);
+		krk_long_clear_many(&scratch, &_base, NULL);
+		krk_long_init_ui(&scratch, accum);
+		krk_long_add(num, num, &scratch);
+	}
+
+	krk_long_clear_many(&_base, &scratch, NULL);
+}
+
+/**
+ * @brief Parse digit values into @p num by divide and conquer.
+ *
+ * Long inputs are split so the low part is exactly chunk*2^k digits, and the
+ * result is high * powers[k] + low; the multiplications are balanced, which
+ * lets Karatsuba do the heavy lifting.
+ */
+static void _parse_recursive(KrkLong * num, const uint8_t * digits, size_t len, unsigned int base, size_t chunk, KrkLong * powers, ssize_t k) {
+	while (k >= 0 && (chunk << k) >= len) k--;
+
+	if (k < 0 || len <= chunk * CONVERSION_CUTOFF) {
+		_parse_digits(num, digits, len, base);
+		return;
+	}
+
+	size_t low = chunk << k;
+	KrkLong hi, lo;
+	krk_long_init_many(&hi, &lo, NULL);
+	_parse_recursive(&hi, digits, len - low, base, chunk, powers, k - 1);
+	_parse_recursive(&lo, digits + len - low, low, base, chunk, powers, k - 1);
+	krk_long_mul(num, &hi, &powers[k]);
+	krk_long_add(num, num, &lo);
+	krk_long_clear_many(&hi, &lo, NULL);
+}
+
 /**
  * @brief Parse a number into a long.
  *
@@ -1207,33 +1690,33 @@ static int krk_long_parse_string(const char * str, KrkLong * num, unsigned int b
 
 		krk_long_trim(num);
 	} else {
-		KrkLong _base, scratch;
-		krk_long_init_si(&_base, 0);
-		krk_long_init_si(&scratch, 0);
-
-		while (c < end && *c) {
-			uint64_t accum = 0;
-			uint64_t basediv = 1;
-			while (c < end && *c && (basediv * base < 0x10000000000000UL)) {
-				if (*c == '_') { c++; continue; }
-				if (!is_valid(base, *c)) {
-					krk_long_clear_many(&_base, &scratch, num, NULL);
-					return 1;
-				}
+		uint8_t * digits = malloc(end - c);
+		size_t len = 0;
+		for (const char * x = c; x < end && *x; ++x) {
+			if (*x == '_') continue;
+			if (!is_valid(base, *x)) {
+				free(digits);
+				krk_long_clear(num);
+				return 1;
+			}
+			digits[len++] = convert_digit(*x);
+		}
 
-				basediv *= base;
-				accum *= base;
-				accum += convert_digit(*c);
-				c++;
+		uint32_t power;
+		size_t chunk = _base_chunk(base, &power);
+		KrkLong powers[64];
+		ssize_t count = 0;
+		if (len > chunk * CONVERSION_CUTOFF) {
+			krk_long_init_ui(&powers[count++], power);
+			while (count < 64 && (chunk << count) < len) {
+				_base_power_next(powers, count++);
 			}
-			krk_long_init_ui(&_base, basediv);
-			krk_long_mul(num, num, &_base);
-			krk_long_clear_many(&scratch, &_base, NULL);
-			krk_long_init_ui(&scratch, accum);
-			krk_long_add(num, num, &scratch);
 		}
 
-		krk_long_clear_many(&_base, &scratch, NULL);
+		_parse_recursive(num, digits, len, base, chunk, powers, count - 1);
+
+		for (ssize_t i = 0; i < count; ++i) krk_long_clear(&powers[i]);
+		free(digits);
 	}
 
 	if (sign == -1) {
@@ -1256,15 +1739,30 @@ struct BigInt {
 #define CURRENT_CTYPE struct BigInt *
 #define CURRENT_NAME  self
 
+/**
+ * @brief Count the digits of a new long object against the heap.
+ *
+ * Digits are allocated outside of the VM allocator; without this, a loop
+ * churning through large temporary values would never trigger a collection.
+ */
+static void _long_take_digits(struct BigInt * self) {
+	KrkLong * value = self->value;
+	if (value->digits) krk_gcTakeBytes(value->digits, sizeof(uint32_t) * (value->width < 0 ? -value->width : value->width));
+}
+
 static KrkValue make_long(krk_integer_type t) {
 	struct BigInt * self = (struct BigInt*)krk_newInstance(KRK_BASE_CLASS(long));
 	krk_push(OBJECT_VAL(self));
 	krk_long_init_si(self->value, t);
+	_long_take_digits(self);
 	return krk_pop();
 }
 
 static void _long_gcsweep(KrkInstance * self) {
-	krk_long_clear(((struct BigInt*)self)->value);
+	KrkLong * value = ((struct BigInt*)self)->value;
+	if (value->digits) krk_reallocate(value->digits, sizeof(uint32_t) * (value->width < 0 ? -value->width : value->width), 0);
+	value->digits = NULL;
+	value->width = 0;
 }
 
 #ifndef KRK_NO_FLOAT
@@ -1291,11 +1789,13 @@ KRK_StaticMethod(long,__new__) {
 		if (krk_long_parse_string(AS_CSTRING(argv[1]),self->value,0,AS_STRING(argv[1])->length)) {
 			return krk_runtimeError(vm.exceptions->valueError, "invalid literal for long() with base 0: %R", argv[1]);
 		}
+		_long_take_digits(self);
 		return krk_pop();
 	} else if (IS_long(argv[1])) {
 		struct BigInt * self = (struct BigInt*)krk_newInstance(KRK_BASE_CLASS(long));
 		krk_push(OBJECT_VAL(self));
 		krk_long_init_copy(self->value,AS_long(argv[1])->value);
+		_long_take_digits(self);
 		return krk_pop();
 	} else {
 		return krk_runtimeError(vm.exceptions->typeError, "%s() argument must be a string or a number, not '%T'", "int", argv[1]);
@@ -1428,6 +1928,7 @@ static KrkValue make_long_obj(KrkLong * val) {
 	} else {
 		krk_push(OBJECT_VAL(krk_newInstance(KRK_BASE_CLASS(long))));
 		*AS_long(krk_peek(0))->value = *val;
+		_long_take_digits(AS_long(krk_peek(0)));
 		return krk_pop();
 	}
 
@@ -1536,11 +2037,6 @@ static void _krk_long_pow(krk_long out, krk_long a, krk_long b) {
 		return;
 	}
 
-	if (krk_long_sign(b) < 0) {
-		krk_runtimeError(vm.exceptions->notImplementedError, "TODO: negative exponent");
-		return;
-	}
-
 	/**
 	 * CPython sources link here as a reference:
 	 * Handbook of Applied Cryptography
@@ -1592,7 +2088,360 @@ BASIC_BIN_OP(lshift,_krk_long_lshift)
 BASIC_BIN_OP(rshift,_krk_long_rshift)
 BASIC_BIN_OP(mod,_krk_long_mod)
 BASIC_BIN_OP(floordiv,_krk_long_div)
-BASIC_BIN_OP(pow,_krk_long_pow)
+
+/**
+ * @brief Modulus size, in digits, above which modular multiplication is a
+ *        full (Karatsuba) multiply and division rather than Montgomery's.
+ */
+#define MONTGOMERY_CUTOFF 200
+
+/**
+ * @brief State for multiplication modulo a fixed value.
+ *
+ * Odd moduli use Montgomery multiplication, with residues kept multiplied
+ * by R = B^n, so that reduction needs no division at all. Even and very
+ * large moduli reduce the full product by division instead.
+ */
+struct ModContext {
+	size_t     n;           /**< Digits in the modulus; every residue is stored in exactly this many */
+	KrkLong    mod;         /**< The (positive) modulus */
+	int        montgomery;  /**< Whether residues are in Montgomery form */
+	uint32_t   mprime;      /**< -1/mod modulo B, for Montgomery reduction */
+	uint32_t * scratch;     /**< 2n+2 digits of working space */
+};
+
+static int _digits_compare(const uint32_t * a, const uint32_t * b, size_t n) {
+	for (size_t i = n; i > 0; --i) {
+		if (a[i-1] != b[i-1]) return a[i-1] > b[i-1] ? 1 : -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Reduce non-negative @p in modulo the context and store it as @p n digits in @p out.
+ */
+static void _mod_store(struct ModContext * ctx, uint32_t * out, const KrkLong * in) {
+	KrkLong quot, rem;
+	krk_long_init_many(&quot, &rem, NULL);
+	_div_abs(&quot, &rem, in, &ctx->mod);
+	memset(out, 0, sizeof(uint32_t) * ctx->n);
+	if (rem.width) memcpy(out, rem.digits, sizeof(uint32_t) * rem.width);
+	krk_long_clear_many(&quot, &rem, NULL);
+}
+
+/**
+ * @brief out = a * b modulo the context. @p out may be the same as @p a or @p b.
+ */
+static void _mod_mul(struct ModContext * ctx, uint32_t * out, const uint32_t * a, const uint32_t * b) {
+	size_t n = ctx->n;
+	uint32_t * t = ctx->scratch;
+
+	if (!ctx->montgomery) {
+		memset(t, 0, sizeof(uint32_t) * 2 * n);
+		_mul_digits(t, a, n, b, n);
+		KrkLong product = { (ssize_t)_digits_len(t, 2 * n), t };
+		_mod_store(ctx, out, &product);
+		return;
+	}
+
+	/* Montgomery's CIOS method: interleave multiplying by each digit of b with
+	 * adding the multiple of m that clears the low digit, then shifting it away. */
+	const uint32_t * m = ctx->mod.digits;
+	memset(t, 0, sizeof(uint32_t) * (n + 2));
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t carry = 0;
+		uint64_t b_digit = b[i];
+		for (size_t j = 0; j < n; ++j) {
+			uint64_t s = t[j] + a[j] * b_digit + carry;
+			t[j] = s & DIGIT_MAX;
+			carry = s >> DIGIT_SHIFT;
+		}
+		uint64_t s = t[n] + carry;
+		t[n] = s & DIGIT_MAX;
+		t[n+1] = s >> DIGIT_SHIFT;
+
+		uint64_t u = ((uint64_t)t[0] * ctx->mprime) & DIGIT_MAX;
+		carry = (t[0] + u * m[0]) >> DIGIT_SHIFT;
+		for (size_t j = 1; j < n; ++j) {
+			s = t[j] + u * m[j] + carry;
+			t[j-1] = s & DIGIT_MAX;
+			carry = s >> DIGIT_SHIFT;
+		}
+		s = t[n] + carry;
+		t[n-1] = s & DIGIT_MAX;
+		t[n] = t[n+1] + (s >> DIGIT_SHIFT);
+	}
+
+	/* The result is below 2m, so one subtraction is enough. */
+	if (t[n] || _digits_compare(t, m, n) >= 0) _digits_sub_from(t, n + 1, m, n);
+	memcpy(out, t, sizeof(uint32_t) * n);
+}
+
+/**
+ * @brief Compute @p base ** @p exp % @p mod for 0 <= base < mod, exp > 0 and mod > 1.
+ *
+ * The exponent is scanned from the top with a sliding window (HAC 14.85):
+ * runs of zero bits cost one squaring each, and each window of up to k bits
+ * ending in a one costs one multiplication by a precomputed odd power of base.
+ */
+static void _krk_long_pow_mod(KrkLong * out, const KrkLong * base, const KrkLong * exp, const KrkLong * mod) {
+	struct ModContext ctx;
+	size_t n = mod->width;
+	ctx.n = n;
+	ctx.mod = *mod;
+	ctx.montgomery = (mod->digits[0] & 1) && n <= MONTGOMERY_CUTOFF;
+	ctx.scratch = malloc(sizeof(uint32_t) * (2 * n + 2));
+
+	if (ctx.montgomery) {
+		/* Newton's iteration for 1/m mod 2^32; each step doubles the correct bits. */
+		uint32_t m0 = mod->digits[0];
+		uint32_t inv = m0;
+		for (int i = 0; i < 5; ++i) inv *= 2 - m0 * inv;
+		ctx.mprime = (0 - inv) & DIGIT_MAX;
+	}
+
+	size_t bits = _bits_in(exp);
+	int window = bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4 : bits > 23 ? 3 : bits > 7 ? 2 : 1;
+	size_t tableSize = (size_t)1 << (window - 1);
+
+	/* table[i] = base^(2i+1), then the accumulator and base^2 */
+	uint32_t * table = malloc(sizeof(uint32_t) * n * (tableSize + 2));
+	uint32_t * acc = table + n * tableSize;
+	uint32_t * square = acc + n;
+
+	KrkLong tmp;
+	krk_long_init_si(&tmp, 0);
+	if (ctx.montgomery) {
+		_digits_shift_up(&tmp, base, n);
+		_mod_store(&ctx, table, &tmp);
+	} else {
+		_mod_store(&ctx, table, base);
+	}
+
+	_mod_mul(&ctx, square, table, table);
+	for (size_t i = 1; i < tableSize; ++i) {
+		_mod_mul(&ctx, table + n * i, table + n * (i - 1), square);
+	}
+
+	int started = 0;
+	ssize_t i = bits - 1;
+	while (i >= 0) {
+		if (!_bit_is_set(exp, i)) {
+			if (started) _mod_mul(&ctx, acc, acc, acc);
+			i--;
+			continue;
+		}
+
+		ssize_t j = i - window + 1;
+		if (j < 0) j = 0;
+		while (!_bit_is_set(exp, j)) j++;
+
+		size_t w = 0;
+		for (ssize_t k = i; k >= j; --k) {
+			w = (w << 1) | _bit_is_set(exp, k);
+			if (started) _mod_mul(&ctx, acc, acc, acc);
+		}
+
+		if (started) {
+			_mod_mul(&ctx, acc, acc, table + n * (w >> 1));
+		} else {
+			memcpy(acc, table + n * (w >> 1), sizeof(uint32_t) * n);
+			started = 1;
+		}
+		i = j - 1;
+
+		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
+	}
+
+	if (ctx.montgomery) {
+		/* Multiplying by plain 1 divides out the R factor. */
+		memset(square, 0, sizeof(uint32_t) * n);
+		square[0] = 1;
+		_mod_mul(&ctx, acc, acc, square);
+	}
+
+	krk_long_clear(&tmp);
+	krk_long_clear(out);
+	krk_long_resize(out, n);
+	memcpy(out->digits, acc, sizeof(uint32_t) * n);
+	krk_long_trim(out);
+
+	free(table);
+	free(ctx.scratch);
+}
+
+/**
+ * @brief Find the inverse of @p a modulo @p m, for 0 <= a < m.
+ *
+ * Extended Euclidean algorithm.
+ *
+ * @return 1 if @p a and @p m are not coprime, 0 otherwise.
+ */
+static int _krk_long_mod_inverse(KrkLong * out, const KrkLong * a, const KrkLong * m) {
+	KrkLong r0, r1, t0, t1, q, r, tmp;
+	krk_long_init_many(&q, &r, &tmp, &t0, NULL);
+	krk_long_init_copy(&r0, m);
+	krk_long_init_copy(&r1, a);
+	krk_long_init_si(&t1, 1);
+
+	while (r1.width) {
+		krk_long_div_rem(&q, &r, &r0, &r1);
+		_swap(&r0, &r1);
+		_swap(&r1, &r);
+		krk_long_mul(&tmp, &q, &t1);
+		krk_long_sub(&tmp, &t0, &tmp);
+		_swap(&t0, &t1);
+		_swap(&t1, &tmp);
+	}
+
+	int failed = !(r0.width == 1 && r0.digits[0] == 1);
+	if (!failed) {
+		if (t0.width < 0) krk_long_add(&t0, &t0, m);
+		_swap(out, &t0);
+	}
+
+	krk_long_clear_many(&r0, &r1, &t0, &t1, &q, &r, &tmp, NULL);
+	return failed;
+}
+
+static int _long_from_value(KrkLong * out, KrkValue value) {
+	if (IS_INTEGER(value)) {
+		krk_long_init_si(out, AS_INTEGER(value));
+		return 1;
+	} else if (IS_long(value)) {
+		krk_long_init_copy(out, AS_long(value)->value);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Three-argument pow() for ints and longs.
+ *
+ * The result takes the sign of @p modValue, as with %. A negative exponent
+ * raises the modular inverse of the base to the corresponding positive power.
+ */
+_noexport
+KrkValue krk_long_pow_mod(KrkValue baseValue, KrkValue expValue, KrkValue modValue) {
+	/* Anything with a modulus that fits in 32 bits can be done in machine words. */
+	if (IS_INTEGER(baseValue) && IS_INTEGER(expValue) && IS_INTEGER(modValue) && AS_INTEGER(expValue) >= 0) {
+		krk_integer_type m = AS_INTEGER(modValue);
+		uint64_t um = m < 0 ? -(uint64_t)m : (uint64_t)m;
+		if (um && um <= UINT32_MAX) {
+			krk_integer_type b = AS_INTEGER(baseValue) % (krk_integer_type)um;
+			uint64_t x = b < 0 ? (uint64_t)(b + (krk_integer_type)um) : (uint64_t)b;
+			uint64_t e = AS_INTEGER(expValue);
+			uint64_t r = 1 % um;
+			while (e) {
+				if (e & 1) r = r * x % um;
+				x = x * x % um;
+				e >>= 1;
+			}
+			if (m < 0 && r) return INTEGER_VAL((krk_integer_type)r - (krk_integer_type)um);
+			return INTEGER_VAL(r);
+		}
+	}
+
+	krk_long base, exp, mod, absmod, result;
+	krk_long_init_many(base, exp, mod, absmod, result, NULL);
+	if (!_long_from_value(base, baseValue) || !_long_from_value(exp, expValue) || !_long_from_value(mod, modValue)) {
+		krk_long_clear_many(base, exp, mod, absmod, result, NULL);
+		return NOTIMPL_VAL();
+	}
+
+	if (!mod->width) {
+		krk_long_clear_many(base, exp, mod, absmod, result, NULL);
+		return krk_runtimeError(vm.exceptions->valueError, "pow() 3rd argument cannot be 0");
+	}
+
+	krk_long_abs(absmod, mod);
+
+	/* Reduce the base into [0,|mod|) */
+	krk_long_div_rem(result, base, base, absmod);
+
+	if (exp->width < 0) {
+		if (_krk_long_mod_inverse(result, base, absmod)) {
+			krk_long_clear_many(base, exp, mod, absmod, result, NULL);
+			return krk_runtimeError(vm.exceptions->valueError, "base is not invertible for the given modulus");
+		}
+		_swap(base, result);
+		krk_long_set_sign(exp, 1);
+	}
+
+	krk_long_clear(result);
+	if (absmod->width == 1 && absmod->digits[0] == 1) {
+		/* Everything is 0 mod 1 */
+	} else if (!exp->width) {
+		krk_long_init_si(result, 1);
+	} else if (base->width) {
+		_krk_long_pow_mod(result, base, exp, absmod);
+	}
+
+	if (mod->width < 0 && result->width) {
+		krk_long_add(result, result, mod);
+	}
+
+	krk_long_clear_many(base, exp, mod, absmod, NULL);
+	return make_long_obj(result);
+}
+
+/**
+ * @brief Two-argument ** for longs.
+ *
+ * Negative exponents produce a float, as with true division. @p a and @p b are consumed.
+ */
+static KrkValue _long_pow(krk_long a, krk_long b) {
+	if (b->width < 0) {
+#ifndef KRK_NO_FLOAT
+		double base = krk_long_get_double(a);
+		if (base == 0.0) {
+			krk_long_clear_many(a, b, NULL);
+			return krk_runtimeError(vm.exceptions->zeroDivisionError, "0.0 cannot be raised to a negative power");
+		}
+		/* Square and multiply in floating point; this saturates long before the exponent gets large. */
+		double result = 1.0;
+		for (size_t i = _bits_in(b); i > 0; --i) {
+			result *= result;
+			if (_bit_is_set(b, i - 1)) result *= base;
+		}
+		krk_long_clear_many(a, b, NULL);
+		return FLOATING_VAL(1.0 / result);
+#else
+		krk_long_clear_many(a, b, NULL);
+		return krk_runtimeError(vm.exceptions->valueError, "no float support");
+#endif
+	}
+
+	krk_long out;
+	krk_long_init_si(out, 0);
+	_krk_long_pow(out, a, b);
+	krk_long_clear_many(a, b, NULL);
+	return make_long_obj(out);
+}
+
+KRK_Method(long,__pow__) {
+	METHOD_TAKES_AT_MOST(2);
+	if (argc == 3 && !IS_NONE(argv[2])) return krk_long_pow_mod(argv[0], argv[1], argv[2]);
+	krk_long a, b;
+	if (!_long_from_value(b, argv[1])) return NOTIMPL_VAL();
+	krk_long_init_copy(a, self->value);
+	return _long_pow(a, b);
+}
+
+KRK_Method(long,__rpow__) {
+	krk_long a, b;
+	if (!_long_from_value(a, argv[1])) return NOTIMPL_VAL();
+	krk_long_init_copy(b, self->value);
+	return _long_pow(a, b);
+}
+
+_noexport
+KrkValue krk_long_coerced_pow(krk_integer_type a, krk_integer_type b) {
+	krk_long tmp_a, tmp_b;
+	krk_long_init_si(tmp_a, a);
+	krk_long_init_si(tmp_b, b);
+	return _long_pow(tmp_a, tmp_b);
+}
 
 #ifndef KRK_NO_FLOAT
 #define KRK_FLOAT_COMPARE(comp) else if (IS_FLOATING(argv[1])) return BOOLEAN_VAL(krk_long_get_double(self->value) comp AS_FLOATING(argv[1]));
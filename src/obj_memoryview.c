@@ -0,0 +1,309 @@
+#include <string.h>
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/memory.h>
+#include <kuroko/util.h>
+
+#include "private.h"
+
+/**
+ * A memoryview does not hold on to the pointer it was created from.
+ * It holds the exporting object and a window into it, and asks the
+ * exporter for its memory again on each access, so a view can not
+ * outlive the memory it refers to and slicing one never copies.
+ */
+struct MemoryView {
+	KrkInstance inst;
+	KrkValue obj;    /**< Exporting object, never itself a memoryview */
+	size_t start;    /**< Offset of the window into the exporter's memory */
+	size_t len;      /**< Length of the window */
+	int readonly;    /**< Set by toreadonly, or if the exporter was read-only */
+	int released;
+};
+
+#define IS_memoryview(o) (krk_isInstanceOf(o,vm.baseClasses->memoryviewClass))
+#define AS_memoryview(o) ((struct MemoryView*)AS_OBJECT(o))
+#define CURRENT_CTYPE struct MemoryView *
+#define CURRENT_NAME  self
+
+int krk_getBuffer(KrkValue value, KrkBuffer * out, int writable) {
+	if (IS_BYTES(value) && !writable) {
+		out->buf = AS_BYTES(value)->bytes;
+		out->len = AS_BYTES(value)->length;
+		out->readonly = 1;
+		return 1;
+	}
+	KrkClass * type = krk_getType(value);
+	if (!type->_getbuffer) {
+		krk_runtimeError(vm.exceptions->typeError, "a bytes-like object is required, not '%T'", value);
+		return 0;
+	}
+	if (!type->_getbuffer(value, out)) return 0;
+	if (writable && out->readonly) {
+		krk_runtimeError(vm.exceptions->typeError, "a writable bytes-like object is required, not '%T'", value);
+		return 0;
+	}
+	return 1;
+}
+
+static void _memoryview_gcscan(KrkInstance * self) {
+	krk_markValue(((struct MemoryView*)self)->obj);
+}
+
+static int _memoryview_getbuffer(KrkValue value, KrkBuffer * out) {
+	struct MemoryView * self = AS_memoryview(value);
+	if (self->released) {
+		krk_runtimeError(vm.exceptions->valueError, "operation forbidden on released memoryview object");
+		return 0;
+	}
+	KrkBuffer base;
+	if (!krk_getBuffer(self->obj, &base, 0)) return 0;
+	if (self->start > base.len || self->len > base.len - self->start) {
+		krk_runtimeError(vm.exceptions->valueError, "memoryview: underlying buffer has shrunk");
+		return 0;
+	}
+	out->buf = base.buf + self->start;
+	out->len = self->len;
+	out->readonly = base.readonly || self->readonly;
+	return 1;
+}
+
+static KrkValue _memoryview_window(struct MemoryView * self, size_t start, size_t len, int readonly) {
+	struct MemoryView * out = (struct MemoryView*)krk_newInstance(vm.baseClasses->memoryviewClass);
+	out->obj = self->obj;
+	out->start = self->start + start;
+	out->len = len;
+	out->readonly = readonly;
+	return OBJECT_VAL(out);
+}
+
+KRK_Method(memoryview,__init__) {
+	KrkValue obj;
+	if (!krk_parseArgs(".V:memoryview", (const char*[]){"object"}, &obj)) return NONE_VAL();
+	KrkBuffer buffer;
+	if (!krk_getBuffer(obj, &buffer, 0)) return NONE_VAL();
+	krk_writeBarrier((KrkObj*)self);
+	if (IS_memoryview(obj)) {
+		self->obj = AS_memoryview(obj)->obj;
+		self->start = AS_memoryview(obj)->start;
+	} else {
+		self->obj = obj;
+		self->start = 0;
+	}
+	self->len = buffer.len;
+	self->readonly = buffer.readonly;
+	self->released = 0;
+	return NONE_VAL();
+}
+
+KRK_Method(memoryview,__len__) {
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	return INTEGER_VAL(buffer.len);
+}
+
+KRK_Method(memoryview,__getitem__) {
+	METHOD_TAKES_EXACTLY(1);
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+
+	if (IS_INTEGER(argv[1])) {
+		krk_integer_type i = AS_INTEGER(argv[1]);
+		if (i < 0) i += (krk_integer_type)buffer.len;
+		if (i < 0 || i >= (krk_integer_type)buffer.len) {
+			return krk_runtimeError(vm.exceptions->indexError, "index out of bounds on dimension 1");
+		}
+		return INTEGER_VAL(buffer.buf[i]);
+	} else if (IS_slice(argv[1])) {
+		KRK_SLICER(argv[1],buffer.len) {
+			return NONE_VAL();
+		}
+		if (step != 1) {
+			return krk_runtimeError(vm.exceptions->notImplementedError, "memoryview: only slices with a step of 1 are supported");
+		}
+		return _memoryview_window(self, start, end > start ? end - start : 0, self->readonly);
+	}
+
+	return TYPE_ERROR(int or slice, argv[1]);
+}
+
+KRK_Method(memoryview,__setitem__) {
+	METHOD_TAKES_EXACTLY(2);
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	if (buffer.readonly) return krk_runtimeError(vm.exceptions->typeError, "cannot modify read-only memory");
+
+	if (IS_INTEGER(argv[1])) {
+		krk_integer_type i = AS_INTEGER(argv[1]);
+		if (i < 0) i += (krk_integer_type)buffer.len;
+		if (i < 0 || i >= (krk_integer_type)buffer.len) {
+			return krk_runtimeError(vm.exceptions->indexError, "index out of bounds on dimension 1");
+		}
+		if (!IS_INTEGER(argv[2])) return TYPE_ERROR(int,argv[2]);
+		if (AS_INTEGER(argv[2]) < 0 || AS_INTEGER(argv[2]) > 255) {
+			return krk_runtimeError(vm.exceptions->valueError, "memoryview: invalid value for format 'B'");
+		}
+		buffer.buf[i] = AS_INTEGER(argv[2]);
+		return argv[2];
+	} else if (IS_slice(argv[1])) {
+		KRK_SLICER(argv[1],buffer.len) {
+			return NONE_VAL();
+		}
+		if (step != 1) {
+			return krk_runtimeError(vm.exceptions->notImplementedError, "memoryview: only slices with a step of 1 are supported");
+		}
+		KrkBuffer source;
+		if (!krk_getBuffer(argv[2], &source, 0)) return NONE_VAL();
+		size_t len = end > start ? end - start : 0;
+		if (source.len != len) {
+			return krk_runtimeError(vm.exceptions->valueError, "memoryview assignment: lvalue and rvalue have different structures");
+		}
+		memmove(buffer.buf + start, source.buf, len);
+		return argv[2];
+	}
+
+	return TYPE_ERROR(int or slice, argv[1]);
+}
+
+KRK_Method(memoryview,__eq__) {
+	METHOD_TAKES_EXACTLY(1);
+	if (argv[0] == argv[1]) return BOOLEAN_VAL(1);
+	if (!krk_getType(argv[1])->_getbuffer && !IS_BYTES(argv[1])) return NOTIMPL_VAL();
+	if (self->released || (IS_memoryview(argv[1]) && AS_memoryview(argv[1])->released)) return BOOLEAN_VAL(0);
+	KrkBuffer mine, theirs;
+	if (!_memoryview_getbuffer(argv[0], &mine)) return NONE_VAL();
+	if (!krk_getBuffer(argv[1], &theirs, 0)) return NONE_VAL();
+	return BOOLEAN_VAL(mine.len == theirs.len && !memcmp(mine.buf, theirs.buf, mine.len));
+}
+
+KRK_Method(memoryview,__hash__) {
+	METHOD_TAKES_NONE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	if (!buffer.readonly) return krk_runtimeError(vm.exceptions->valueError, "cannot hash writable memoryview object");
+	/* Same as bytes.__hash__, so views hash equal to the bytes they compare equal to. */
+	uint32_t hash = 0;
+	for (size_t i = 0; i < buffer.len; ++i) {
+		krk_hash_advance(hash,buffer.buf[i]);
+	}
+	return INTEGER_VAL(hash);
+}
+
+KRK_Method(memoryview,__repr__) {
+	METHOD_TAKES_NONE();
+	struct StringBuilder sb = {0};
+	if (!krk_pushStringBuilderFormat(&sb, self->released ? "<released memory at %p>" : "<memory at %p>", (void*)self)) {
+		discardStringBuilder(&sb);
+		return NONE_VAL();
+	}
+	return finishStringBuilder(&sb);
+}
+
+KRK_Method(memoryview,tobytes) {
+	METHOD_TAKES_NONE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	return OBJECT_VAL(krk_newBytes(buffer.len, buffer.buf));
+}
+
+KRK_Method(memoryview,tolist) {
+	METHOD_TAKES_NONE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	KrkValue myList = krk_list_of(0,NULL,0);
+	krk_push(myList);
+	for (size_t i = 0; i < buffer.len; ++i) {
+		krk_writeValueArray(AS_LIST(myList), INTEGER_VAL(buffer.buf[i]));
+	}
+	return krk_pop();
+}
+
+KRK_Method(memoryview,hex) {
+	METHOD_TAKES_NONE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	static const char digits[] = "0123456789abcdef";
+	struct StringBuilder sb = {0};
+	for (size_t i = 0; i < buffer.len; ++i) {
+		pushStringBuilder(&sb, digits[buffer.buf[i] >> 4]);
+		pushStringBuilder(&sb, digits[buffer.buf[i] & 0xF]);
+	}
+	return finishStringBuilder(&sb);
+}
+
+KRK_Method(memoryview,toreadonly) {
+	METHOD_TAKES_NONE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	return _memoryview_window(self, 0, self->len, 1);
+}
+
+KRK_Method(memoryview,release) {
+	METHOD_TAKES_NONE();
+	self->released = 1;
+	self->obj = NONE_VAL();
+	return NONE_VAL();
+}
+
+KRK_Method(memoryview,__enter__) {
+	return NONE_VAL();
+}
+
+KRK_Method(memoryview,__exit__) {
+	return FUNC_NAME(memoryview,release)(1,argv,0);
+}
+
+KRK_Method(memoryview,obj) {
+	ATTRIBUTE_NOT_ASSIGNABLE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	return self->obj;
+}
+
+KRK_Method(memoryview,nbytes) {
+	ATTRIBUTE_NOT_ASSIGNABLE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	return INTEGER_VAL(buffer.len);
+}
+
+KRK_Method(memoryview,readonly) {
+	ATTRIBUTE_NOT_ASSIGNABLE();
+	KrkBuffer buffer;
+	if (!_memoryview_getbuffer(argv[0], &buffer)) return NONE_VAL();
+	return BOOLEAN_VAL(buffer.readonly);
+}
+
+_noexport
+void _createAndBind_memoryviewClass(void) {
+	KrkClass * memoryview = ADD_BASE_CLASS(vm.baseClasses->memoryviewClass, "memoryview", vm.baseClasses->objectClass);
+	memoryview->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	memoryview->allocSize = sizeof(struct MemoryView);
+	memoryview->_ongcscan = _memoryview_gcscan;
+	memoryview->_getbuffer = _memoryview_getbuffer;
+	KRK_DOC(BIND_METHOD(memoryview,__init__),
+		"@brief A view of the memory of a bytes-like object.\n"
+		"@arguments object\n\n"
+		"Creates a @ref memoryview of @p object, which may be a @ref bytes, @ref bytearray, another "
+		"@ref memoryview, or any type that supports the buffer protocol. Slicing a @ref memoryview "
+		"with a step of 1 returns a new view of the same memory without copying it.");
+	BIND_METHOD(memoryview,__len__);
+	BIND_METHOD(memoryview,__getitem__);
+	BIND_METHOD(memoryview,__setitem__);
+	BIND_METHOD(memoryview,__eq__);
+	BIND_METHOD(memoryview,__hash__);
+	BIND_METHOD(memoryview,__repr__);
+	KRK_DOC(BIND_METHOD(memoryview,tobytes), "@brief Copy the viewed memory into a new @ref bytes object.");
+	KRK_DOC(BIND_METHOD(memoryview,tolist), "@brief Get the viewed bytes as a @ref list of integers.");
+	KRK_DOC(BIND_METHOD(memoryview,hex), "@brief Get the viewed bytes as a string of hexadecimal digits.");
+	KRK_DOC(BIND_METHOD(memoryview,toreadonly), "@brief Get a read-only view of the same memory.");
+	KRK_DOC(BIND_METHOD(memoryview,release), "@brief Release the view.\n\n"
+		"Further operations on the view raise @ref ValueError. The exporting object is no longer kept alive by this view.");
+	BIND_METHOD(memoryview,__enter__);
+	KRK_DOC(BIND_METHOD(memoryview,__exit__), "@brief Releases the view upon exit from a @c with block.");
+	BIND_PROP(memoryview,obj);
+	BIND_PROP(memoryview,nbytes);
+	BIND_PROP(memoryview,readonly);
+	krk_defineNative(&memoryview->methods,"__str__",FUNC_NAME(memoryview,__repr__)); /* alias */
+	krk_finalizeClass(memoryview);
+}
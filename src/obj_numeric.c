@@ -417,7 +417,19 @@ INT_ONLY_BIN_OP(and,&)
 
 DEFER_TO_LONG(lshift)
 DEFER_TO_LONG(rshift)
-DEFER_TO_LONG(pow)
+
+extern KrkValue krk_long_coerced_pow(krk_integer_type a, krk_integer_type b);
+extern KrkValue krk_long_pow_mod(KrkValue base, KrkValue exp, KrkValue mod);
+KRK_Method(int,__pow__) {
+	METHOD_TAKES_AT_MOST(2);
+	if (argc == 3 && !IS_NONE(argv[2])) return krk_long_pow_mod(argv[0], argv[1], argv[2]);
+	if (likely(IS_INTEGER(argv[1]))) return krk_long_coerced_pow(self, AS_INTEGER(argv[1]));
+	return NOTIMPL_VAL();
+}
+KRK_Method(int,__rpow__) {
+	if (likely(IS_INTEGER(argv[1]))) return krk_long_coerced_pow(AS_INTEGER(argv[1]), self);
+	return NOTIMPL_VAL();
+}
 
 COMPARE_OP(lt, <)
 COMPARE_OP(gt, >)
@@ -4,6 +4,8 @@
 #include <kuroko/memory.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 /**
  * @brief `range` object.
  * @extends KrkInstance
@@ -19,12 +21,6 @@ struct Range {
 #define IS_range(o)   (krk_isInstanceOf(o,KRK_BASE_CLASS(range)))
 #define AS_range(o)   ((struct Range*)AS_OBJECT(o))
 
-struct RangeIterator {
-	KrkInstance inst;
-	krk_integer_type i;
-	krk_integer_type max;
-	krk_integer_type step;
-};
 #define IS_rangeiterator(o) (krk_isInstanceOf(o,KRK_BASE_CLASS(rangeiterator)))
 #define AS_rangeiterator(o) ((struct RangeIterator*)AS_OBJECT(o))
 
@@ -76,7 +76,7 @@ KRK_Method(set,__repr__) {
 	pushStringBuilder(&sb,'{');
 
 	size_t c = 0;
-	size_t len = self->entries.capacity;
+	size_t len = self->entries.used;
 	for (size_t i = 0; i < len; ++i) {
 		KrkTableEntry * entry = &self->entries.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
@@ -110,7 +110,7 @@ KRK_Method(set,__and__) {
 	if (!type->_contains)
 		return krk_runtimeError(vm.exceptions->typeError, "unsupported operand types for %s: '%T' and '%T'", "&", argv[0], argv[1]);
 
-	for (size_t i = 0; i < self->entries.capacity; ++i) {
+	for (size_t i = 0; i < self->entries.used; ++i) {
 		KrkTableEntry * entry = &self->entries.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
 
@@ -138,7 +138,7 @@ KRK_Method(set,__xor__) {
 	if (!type->_contains)
 		return krk_runtimeError(vm.exceptions->typeError, "unsupported operand types for %s: '%T' and '%T'", "&", argv[0], argv[1]);
 
-	for (size_t i = 0; i < self->entries.capacity; ++i) {
+	for (size_t i = 0; i < self->entries.used; ++i) {
 		KrkTableEntry * entry = &self->entries.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
 
@@ -154,7 +154,7 @@ KRK_Method(set,__xor__) {
 	/* Ours better have something... */
 	type = krk_getType(argv[0]);
 
-	for (size_t i = 0; i < them->entries.capacity; ++i) {
+	for (size_t i = 0; i < them->entries.used; ++i) {
 		KrkTableEntry * entry = &them->entries.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
 
@@ -200,7 +200,7 @@ KRK_Method(set,__eq__) {
 
 	KrkValue _unused;
 
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
+	for (unsigned int i = 0; i < self->entries.used; ++i) {
 		if (IS_KWARGS(self->entries.entries[i].key)) continue;
 		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
 	}
@@ -217,7 +217,7 @@ KRK_Method(set,__lt__) {
 	if (self->entries.count == them->entries.count)
 		return BOOLEAN_VAL(0);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
+	for (unsigned int i = 0; i < self->entries.used; ++i) {
 		if (IS_KWARGS(self->entries.entries[i].key)) continue;
 		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
 	}
@@ -231,7 +231,7 @@ KRK_Method(set,__le__) {
 		return NOTIMPL_VAL();
 	struct Set * them = AS_set(argv[1]);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
+	for (unsigned int i = 0; i < self->entries.used; ++i) {
 		if (IS_KWARGS(self->entries.entries[i].key)) continue;
 		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
 	}
@@ -247,7 +247,7 @@ KRK_Method(set,__gt__) {
 	if (self->entries.count == them->entries.count)
 		return BOOLEAN_VAL(0);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < them->entries.capacity; ++i) {
+	for (unsigned int i = 0; i < them->entries.used; ++i) {
 		if (IS_KWARGS(them->entries.entries[i].key)) continue;
 		if (!krk_tableGet(&self->entries, them->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
 	}
@@ -260,7 +260,7 @@ KRK_Method(set,__ge__) {
 		return NOTIMPL_VAL();
 	struct Set * them = AS_set(argv[1]);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < them->entries.capacity; ++i) {
+	for (unsigned int i = 0; i < them->entries.used; ++i) {
 		if (IS_KWARGS(them->entries.entries[i].key)) continue;
 		if (!krk_tableGet(&self->entries, them->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
 	}
@@ -333,7 +333,7 @@ KRK_Method(setiterator,__call__) {
 	if (unlikely(!IS_set(self->set))) return argv[0];
 
 	do {
-		if (self->i >= AS_set(self->set)->entries.capacity) return argv[0];
+		if (self->i >= AS_set(self->set)->entries.used) return argv[0];
 		if (!IS_KWARGS(AS_set(self->set)->entries.entries[self->i].key)) {
 			krk_push(AS_set(self->set)->entries.entries[self->i].key);
 			self->i++;
@@ -68,19 +68,19 @@ KRK_Method(str,__add__) {
 
 	KrkStringType type = self_type > them_type ? self_type : them_type;
 
-	/* Hashes can be extended, which saves us calculating the whole thing */
-	uint32_t hash = self->obj.hash;
-	for (size_t i = 0; i < bl; ++i) {
-		krk_hash_advance(hash,b[i]);
-	}
-
-	KrkString * result = krk_takeStringVetted(chars, length, cpLength, type, hash);
+	KrkString * result = krk_takeStringUninterned(chars, length, cpLength, type);
 	if (needsPop) krk_pop();
 	return OBJECT_VAL(result);
 }
 
 KRK_Method(str,__hash__) {
-	return INTEGER_VAL(self->obj.hash);
+	return INTEGER_VAL(krk_stringHash(self));
+}
+
+KRK_Method(str,__eq__) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!IS_STRING(argv[1])) return NOTIMPL_VAL();
+	return BOOLEAN_VAL(krk_stringsEqual(self, AS_STRING(argv[1])));
 }
 
 KRK_Method(str,__len__) {
@@ -132,7 +132,11 @@ KRK_Method(str,__getitem__) {
 		if (step == 1) {
 			long len = end - start;
 			if ((self->obj.flags & KRK_OBJ_FLAGS_STRING_MASK) == KRK_OBJ_FLAGS_STRING_ASCII) {
-				return OBJECT_VAL(krk_copyString(self->chars + start, len));
+				/* Slices of ASCII strings are ASCII, so there is nothing to decode. */
+				char * chars = ALLOCATE(char, len + 1);
+				memcpy(chars, self->chars + start, len);
+				chars[len] = '\0';
+				return OBJECT_VAL(krk_takeStringUninterned(chars, len, len, KRK_STRING_ASCII));
 			} else {
 				size_t offset = 0;
 				size_t length = 0;
@@ -146,7 +150,7 @@ KRK_Method(str,__getitem__) {
 					uint32_t cp = KRK_STRING_FAST(self,i);
 					length += CODEPOINT_BYTES(cp);
 				}
-				return OBJECT_VAL(krk_copyString(self->chars + offset, length));
+				return OBJECT_VAL(krk_copyStringUninterned(self->chars + offset, length));
 			}
 		} else {
 			struct StringBuilder sb = {0};
@@ -386,21 +390,16 @@ KRK_Method(str,__mul__) {
 	if (howMany < 0) howMany = 0;
 
 	size_t totalLength = self->length * howMany;
-	char * out = malloc(totalLength + 1);
+	char * out = ALLOCATE(char, totalLength + 1);
 	char * c = out;
 
-	uint32_t hash = 0;
-
 	for (krk_integer_type i = 0; i < howMany; ++i) {
-		for (size_t j = 0; j < self->length; ++j) {
-			*c = self->chars[j];
-			krk_hash_advance(hash, *c);
-			c++;
-		}
+		memcpy(c, self->chars, self->length);
+		c += self->length;
 	}
 
 	*c = '\0';
-	return OBJECT_VAL(krk_takeStringVetted(out, totalLength, self->codesLength * howMany, (self->obj.flags & KRK_OBJ_FLAGS_STRING_MASK), hash));
+	return OBJECT_VAL(krk_takeStringUninterned(out, totalLength, self->codesLength * howMany, (self->obj.flags & KRK_OBJ_FLAGS_STRING_MASK)));
 }
 
 KRK_Method(str,__rmul__) {
@@ -511,7 +510,7 @@ static KrkValue _string_strip_shared(int argc, const KrkValue argv[], int which)
 	if (which < 2) while (start < end && charIn((c = KRK_STRING_FAST(self, j)), subset)) { j++; start += CODEPOINT_BYTES(c); }
 	if (which != 1) while (end > start && charIn((c = KRK_STRING_FAST(self, k)), subset)) { k--; end -= CODEPOINT_BYTES(c); }
 
-	return OBJECT_VAL(krk_copyString(&self->chars[start], end-start));
+	return OBJECT_VAL(krk_copyStringUninterned(&self->chars[start], end-start));
 }
 
 KRK_Method(str,strip) {
@@ -686,7 +685,7 @@ KRK_Method(str,split) {
 			if (i == self->length) break;
 
 			if (count == maxsplit) {
-				krk_push(OBJECT_VAL(krk_copyString(&self->chars[i], self->length - i)));
+				krk_push(OBJECT_VAL(krk_copyStringUninterned(&self->chars[i], self->length - i)));
 				krk_writeValueArray(AS_LIST(myList), krk_peek(0));
 				krk_pop();
 				break;
@@ -725,7 +724,7 @@ KRK_Method(str,split) {
 			c += sepLen;
 			count++;
 			if (count == maxsplit || i == self->length) {
-				krk_push(OBJECT_VAL(krk_copyString(&self->chars[i], self->length - i)));
+				krk_push(OBJECT_VAL(krk_copyStringUninterned(&self->chars[i], self->length - i)));
 				krk_writeValueArray(AS_LIST(myList), krk_peek(0));
 				krk_pop();
 				break;
@@ -1077,7 +1076,7 @@ static void _freeStringBuilder(struct StringBuilder * sb) {
 	sb->capacity = 0;
 }
 KrkValue krk_finishStringBuilder(struct StringBuilder * sb) {
-	KrkValue out = OBJECT_VAL(krk_copyString(sb->bytes, sb->length));
+	KrkValue out = OBJECT_VAL(krk_copyStringUninterned(sb->bytes, sb->length));
 	_freeStringBuilder(sb);
 	return out;
 }
@@ -1265,6 +1264,7 @@ void _createAndBind_strClass(void) {
 	BIND_METHOD(str,__repr__);
 	BIND_METHOD(str,__str__);
 	BIND_METHOD(str,__hash__);
+	BIND_METHOD(str,__eq__);
 	BIND_METHOD(str,__format__);
 	BIND_METHOD(str,encode);
 	BIND_METHOD(str,split);
@@ -13,21 +13,47 @@
 #define ALLOCATE_OBJECT(type, objectType) \
 	(type*)allocateObject(sizeof(type), objectType)
 
+/*
+ * The interned string table and the shape tree are shared by every thread,
+ * so adding to them needs mutual exclusion that the safe-point protocol can
+ * not provide: it only keeps mutators away from the collector, not from
+ * each other. These are ordinary mutexes, held for one table insertion or
+ * one new shape. The rules that keep them from deadlocking with a
+ * stop-the-world collection:
+ *
+ *  - A thread raises noSafepoint before taking either lock and lowers it
+ *    after releasing it, so neither the holder nor a waiter ever parks for
+ *    a collection. The collector waits for them to reach a safe point,
+ *    which they do shortly after the lock is released.
+ *  - The holder may allocate, but allocation will not start a collection
+ *    while noSafepoint is raised.
+ *  - Neither lock is held across a call into managed code, a blocking call,
+ *    or the other lock.
+ */
 #ifndef KRK_DISABLE_THREADS
-static volatile int _stringLock = 0;
-static volatile int _objectLock = 0;
+static pthread_mutex_t _stringLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t _shapeLock = PTHREAD_MUTEX_INITIALIZER;
+# define _obtain_object_lock(l) do { krk_currentThread.noSafepoint++; pthread_mutex_lock(&l); } while (0)
+# define _release_object_lock(l) do { pthread_mutex_unlock(&l); krk_currentThread.noSafepoint--; } while (0)
+#else
+# define _obtain_object_lock(l) do { } while (0)
+# define _release_object_lock(l) do { } while (0)
 #endif
 
+#define _obtain_string_lock() _obtain_object_lock(_stringLock)
+#define _release_string_lock() _release_object_lock(_stringLock)
+
 static KrkObj * allocateObject(size_t size, KrkObjType type) {
-	KrkObj * object = (KrkObj*)krk_reallocate(NULL, 0, size);
+	KrkObj * object = (KrkObj*)krk_allocateObjectMemory(size);
 	memset(object,0,size);
 	object->type = type;
 
-	_obtain_lock(_objectLock);
-	object->next = vm.objects;
 	krk_currentThread.scratchSpace[2] = OBJECT_VAL(object);
-	vm.objects = object;
-	_release_lock(_objectLock);
+	KrkObj * head;
+	do {
+		head = vm.youngObjects;
+		object->next = head;
+	} while (!__sync_bool_compare_and_swap(&vm.youngObjects, head, object));
 
 	object->hash = (uint32_t)((intptr_t)(object) >> 4 | ((intptr_t)object & 0xf) << 28);
 
@@ -112,8 +138,6 @@ static int checkString(const char * chars, size_t length, size_t *codepointCount
 			if (codepoint > maxCodepoint) maxCodepoint = codepoint;
 			(*codepointCount)++;
 		} else if (state == UTF8_REJECT) {
-			_release_lock(_stringLock);
-			krk_runtimeError(vm.exceptions->valueError, "Invalid UTF-8 sequence in string.");
 			*codepointCount = 0;
 			return -1;
 		}
@@ -171,24 +195,37 @@ uint32_t krk_unicodeCodepoint(KrkString * string, size_t index) {
 	}
 }
 
-static KrkString * allocateString(char * chars, size_t length, uint32_t hash) {
-	size_t codesLength = 0;
-	int type = checkString(chars,length,&codesLength);
-	if (type == -1) {
-		return krk_copyString("",0);
-	}
+static KrkString * newString(char * chars, size_t length, size_t codesLength, int type) {
 	KrkString * string = ALLOCATE_OBJECT(KrkString, KRK_OBJ_STRING);
 	string->length = length;
 	string->chars = chars;
-	string->obj.hash = hash;
-	string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH | type;
+	string->obj.flags |= type;
 	string->codesLength = codesLength;
 	string->codes = NULL;
 	if (type == KRK_OBJ_FLAGS_STRING_ASCII) string->codes = string->chars;
+	return string;
+}
+
+/* Must be called with _stringLock held. */
+static void internNewString(KrkString * string, uint32_t hash) {
+	string->obj.hash = hash;
+	string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH | KRK_OBJ_FLAGS_STRING_INTERNED;
 	krk_push(OBJECT_VAL(string));
 	krk_tableSet(&vm.strings, OBJECT_VAL(string), NONE_VAL());
 	krk_pop();
-	_release_lock(_stringLock);
+}
+
+static KrkString * allocateString(char * chars, size_t length, uint32_t hash) {
+	size_t codesLength = 0;
+	int type = checkString(chars,length,&codesLength);
+	if (type == -1) {
+		_release_string_lock();
+		krk_runtimeError(vm.exceptions->valueError, "Invalid UTF-8 sequence in string.");
+		return krk_copyString("",0);
+	}
+	KrkString * string = newString(chars, length, codesLength, type);
+	internNewString(string, hash);
+	_release_string_lock();
 	return string;
 }
 
@@ -204,11 +241,11 @@ static uint32_t hashString(const char * key, size_t length) {
 
 KrkString * krk_takeString(char * chars, size_t length) {
 	uint32_t hash = hashString(chars, length);
-	_obtain_lock(_stringLock);
+	_obtain_string_lock();
 	KrkString * interned = krk_tableFindString(&vm.strings, chars, length, hash);
 	if (interned != NULL) {
 		free(chars); /* This string isn't owned by us yet, so free, not FREE_ARRAY */
-		_release_lock(_stringLock);
+		_release_string_lock();
 		return interned;
 	}
 
@@ -220,10 +257,10 @@ KrkString * krk_takeString(char * chars, size_t length) {
 
 KrkString * krk_copyString(const char * chars, size_t length) {
 	uint32_t hash = hashString(chars, length);
-	_obtain_lock(_stringLock);
+	_obtain_string_lock();
 	KrkString * interned = krk_tableFindString(&vm.strings, chars ? chars : "", length, hash);
 	if (interned) {
-		_release_lock(_stringLock);
+		_release_string_lock();
 		return interned;
 	}
 	char * heapChars = ALLOCATE(char, length + 1);
@@ -231,35 +268,86 @@ KrkString * krk_copyString(const char * chars, size_t length) {
 	heapChars[length] = '\0';
 	KrkString * result = allocateString(heapChars, length, hash);
 	if (result->chars != heapChars) free(heapChars);
-	_release_lock(_stringLock);
 	return result;
 }
 
 KrkString * krk_takeStringVetted(char * chars, size_t length, size_t codesLength, KrkStringType type, uint32_t hash) {
-	_obtain_lock(_stringLock);
+	_obtain_string_lock();
 	KrkString * interned = krk_tableFindString(&vm.strings, chars, length, hash);
 	if (interned != NULL) {
 		FREE_ARRAY(char, chars, length + 1);
-		_release_lock(_stringLock);
+		_release_string_lock();
 		return interned;
 	}
-	KrkString * string = ALLOCATE_OBJECT(KrkString, KRK_OBJ_STRING);
-	string->length = length;
-	string->chars = chars;
-	string->obj.hash = hash;
-	string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH | type;
-	string->codesLength = codesLength;
-	string->codes = NULL;
-	if (type == KRK_OBJ_FLAGS_STRING_ASCII) string->codes = string->chars;
-	krk_push(OBJECT_VAL(string));
-	krk_tableSet(&vm.strings, OBJECT_VAL(string), NONE_VAL());
-	krk_pop();
-	_release_lock(_stringLock);
+	KrkString * string = newString(chars, length, codesLength, type);
+	internNewString(string, hash);
+	_release_string_lock();
 	return string;
 }
 
+KrkString * krk_takeStringUninterned(char * chars, size_t length, size_t codesLength, KrkStringType type) {
+	return newString(chars, length, codesLength, type);
+}
+
+KrkString * krk_copyStringUninterned(const char * chars, size_t length) {
+	size_t codesLength = 0;
+	int type = checkString(chars ? chars : "", length, &codesLength);
+	if (type == -1) {
+		krk_runtimeError(vm.exceptions->valueError, "Invalid UTF-8 sequence in string.");
+		return krk_copyString("",0);
+	}
+	char * heapChars = ALLOCATE(char, length + 1);
+	memcpy(heapChars, chars ? chars : "", length);
+	heapChars[length] = '\0';
+	return newString(heapChars, length, codesLength, type);
+}
+
+KrkString * krk_takeStringChecked(char * chars, size_t length) {
+	size_t codesLength = 0;
+	int type = checkString(chars, length, &codesLength);
+	if (type == -1) {
+		FREE_ARRAY(char, chars, length + 1);
+		krk_runtimeError(vm.exceptions->valueError, "Invalid UTF-8 sequence in string.");
+		return krk_copyString("",0);
+	}
+	chars[length] = '\0';
+	return newString(chars, length, codesLength, type);
+}
+
+KrkString * krk_internString(KrkString * string) {
+	if (string->obj.flags & KRK_OBJ_FLAGS_STRING_INTERNED) return string;
+	uint32_t hash = krk_stringHash(string);
+	_obtain_string_lock();
+	KrkString * interned = krk_tableFindString(&vm.strings, string->chars, string->length, hash);
+	if (!interned) {
+		internNewString(string, hash);
+		interned = string;
+	}
+	_release_string_lock();
+	return interned;
+}
+
+uint32_t krk_stringHash(KrkString * string) {
+	if (!(string->obj.flags & KRK_OBJ_FLAGS_VALID_HASH)) {
+		string->obj.hash = hashString(string->chars, string->length);
+		string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH;
+	}
+	return string->obj.hash;
+}
+
+int krk_stringsEqual(KrkString * a, KrkString * b) {
+	if (a == b) return 1;
+	/* Two distinct interned strings can never have the same contents. */
+	if (a->obj.flags & b->obj.flags & KRK_OBJ_FLAGS_STRING_INTERNED) return 0;
+	if (a->length != b->length) return 0;
+	if ((a->obj.flags & b->obj.flags & KRK_OBJ_FLAGS_VALID_HASH) && a->obj.hash != b->obj.hash) return 0;
+	return memcmp(a->chars, b->chars, a->length) == 0;
+}
+
 KrkCodeObject * krk_newCodeObject(void) {
 	KrkCodeObject * codeobject = ALLOCATE_OBJECT(KrkCodeObject, KRK_OBJ_CODEOBJECT);
+	/* Builders fill these in over many allocations; they enable the barrier when done. */
+	codeobject->obj.flags |= KRK_OBJ_FLAGS_NO_BARRIER;
 	codeobject->requiredArgs = 0;
 	codeobject->keywordArgs = 0;
 	codeobject->potentialPositionals = 0;
@@ -296,8 +384,11 @@ KrkClosure * krk_newClosure(KrkCodeObject * function, KrkValue globals) {
 	closure->globalsOwner = globals;
 	if (IS_INSTANCE(globals)) {
 		if (AS_INSTANCE(globals)->_class == vm.baseClasses->dictClass) {
+			/* Global stores go straight to the table. */
+			krk_disableWriteBarrier(AS_OBJECT(globals));
 			closure->globalsTable = AS_DICT(globals);
 		} else {
+			krk_instanceDropShape(AS_INSTANCE(globals));
 			closure->globalsTable = &AS_INSTANCE(globals)->fields;
 		}
 	} else {
@@ -313,7 +404,7 @@ KrkUpvalue * krk_newUpvalue(int slot) {
 	upvalue->location = slot;
 	upvalue->next = NULL;
 	upvalue->closed = NONE_VAL();
-	upvalue->owner = &krk_currentThread;
+	upvalue->owner = krk_currentThread.segment;
 	return upvalue;
 }
 
@@ -329,6 +420,7 @@ KrkClass * krk_newClass(KrkString * name, KrkClass * baseClass) {
 		_class->allocSize = baseClass->allocSize;
 		_class->_ongcscan = baseClass->_ongcscan;
 		_class->_ongcsweep = baseClass->_ongcsweep;
+		_class->_getbuffer = baseClass->_getbuffer;
 
 		krk_tableSet(&baseClass->subclasses, OBJECT_VAL(_class), NONE_VAL());
 	}
@@ -340,9 +432,156 @@ KrkInstance * krk_newInstance(KrkClass * _class) {
 	KrkInstance * instance = (KrkInstance*)allocateObject(_class->allocSize, KRK_OBJ_INSTANCE);
 	instance->_class = _class;
 	krk_initTable(&instance->fields);
+	instance->shape = _class->shape;
 	return instance;
 }
 
+KrkShape * krk_newShape(KrkShape * parent, KrkString * name) {
+	static size_t nextShapeId = 1;
+	KrkShape * shape = ALLOCATE(KrkShape, 1);
+	shape->parent = parent;
+	shape->children = NULL;
+	shape->sibling = NULL;
+	shape->name = name;
+	shape->count = parent ? parent->count + 1 : 0;
+	shape->childCount = 0;
+	shape->id = __sync_fetch_and_add(&nextShapeId, 1);
+	return shape;
+}
+
+void krk_freeShape(KrkShape * shape) {
+	while (shape->children) {
+		KrkShape * child = shape->children;
+		shape->children = child->sibling;
+		krk_freeShape(child);
+	}
+	FREE(KrkShape, shape);
+}
+
+/**
+ * Slots are allocated in powers of two so that the capacity
+ * can always be recovered from the shape's attribute count.
+ */
+static size_t slotCapacity(size_t count) {
+	if (!count) return 0;
+	size_t capacity = 4;
+	while (capacity < count) capacity <<= 1;
+	return capacity;
+}
+
+void krk_freeSlots(KrkInstance * instance) {
+	if (instance->slots) FREE_ARRAY(KrkValue, instance->slots, slotCapacity(instance->shape->count));
+	instance->slots = NULL;
+}
+
+int krk_shapeFind(KrkShape * shape, KrkString * name) {
+	/* Shapes hold interned names; anything else has to be compared by contents. */
+	if (!(name->obj.flags & KRK_OBJ_FLAGS_STRING_INTERNED)) {
+		for (; shape->parent; shape = shape->parent) {
+			if (krk_stringsEqual(shape->name, name)) return shape->count - 1;
+		}
+		return -1;
+	}
+	for (; shape->parent; shape = shape->parent) {
+		if (shape->name == name) return shape->count - 1;
+	}
+	return -1;
+}
+
+static KrkShape * shapeTransition(KrkShape * shape, KrkString * name) {
+	for (KrkShape * child = shape->children; child; child = child->sibling) {
+		if (child->name == name) return child;
+	}
+
+	if (shape->count >= KRK_SHAPE_MAX_SLOTS || shape->childCount >= KRK_SHAPE_MAX_TRANSITIONS) return NULL;
+
+	_obtain_object_lock(_shapeLock);
+	/* Someone may have added it while we were waiting. */
+	KrkShape * child;
+	for (child = shape->children; child; child = child->sibling) {
+		if (child->name == name) break;
+	}
+	if (!child) {
+		child = krk_newShape(shape, name);
+		child->sibling = shape->children;
+		shape->children = child;
+		shape->childCount++;
+	}
+	_release_object_lock(_shapeLock);
+	return child;
+}
+
+void krk_instanceDropShape(KrkInstance * instance) {
+	KrkShape * shape = instance->shape;
+	if (!shape) return;
+
+	/* Existing table entries were written by C code and are older than any slot. */
+	KrkString * names[KRK_SHAPE_MAX_SLOTS];
+	for (KrkShape * s = shape; s->parent; s = s->parent) {
+		names[s->count - 1] = s->name;
+	}
+	for (size_t i = 0; i < shape->count; ++i) {
+		krk_tableSet(&instance->fields, OBJECT_VAL(names[i]), instance->slots[i]);
+	}
+
+	krk_freeSlots(instance);
+	instance->shape = NULL;
+
+	/* Without a shape, the instance is no longer covered by barriers. */
+	krk_writeBarrier((KrkObj*)instance);
+}
+
+int krk_instanceGetField(KrkInstance * instance, KrkString * name, KrkValue * value) {
+	if (instance->shape) {
+		int slot = krk_shapeFind(instance->shape, name);
+		if (slot >= 0) {
+			*value = instance->slots[slot];
+			return 1;
+		}
+	}
+	return krk_tableGet_fast(&instance->fields, name, value);
+}
+
+void krk_instanceSetField(KrkInstance * instance, KrkString * name, KrkValue value) {
+	KrkShape * shape = instance->shape;
+	if (shape) {
+		/* Names stored in shapes are compared by identity. */
+		name = krk_internString(name);
+		int slot = krk_shapeFind(shape, name);
+		if (slot >= 0) {
+			instance->slots[slot] = value;
+			krk_writeBarrier((KrkObj*)instance);
+			return;
+		}
+
+		KrkShape * next = shapeTransition(shape, name);
+		if (next) {
+			size_t capacity = slotCapacity(shape->count);
+			if (slotCapacity(next->count) != capacity) {
+				instance->slots = GROW_ARRAY(KrkValue, instance->slots, capacity, slotCapacity(next->count));
+			}
+			instance->slots[shape->count] = value;
+			instance->shape = next;
+			krk_writeBarrier((KrkObj*)instance);
+			return;
+		}
+
+		krk_instanceDropShape(instance);
+	}
+	krk_tableSet(&instance->fields, OBJECT_VAL(name), value);
+	krk_writeBarrier((KrkObj*)instance);
+}
+
+int krk_instanceDeleteField(KrkInstance * instance, KrkString * name) {
+	if (instance->shape) {
+		if (krk_shapeFind(instance->shape, name) < 0) {
+			return krk_tableDelete(&instance->fields, OBJECT_VAL(name));
+		}
+		krk_instanceDropShape(instance);
+	}
+	return krk_tableDelete(&instance->fields, OBJECT_VAL(name));
+}
+
 KrkBoundMethod * krk_newBoundMethod(KrkValue receiver, KrkObj * method) {
 	KrkBoundMethod * bound = ALLOCATE_OBJECT(KrkBoundMethod, KRK_OBJ_BOUND_METHOD);
 	bound->receiver = receiver;
@@ -18,6 +18,18 @@
  * it is recommended that this property remain true.
  *
  * 2-operand opcodes are generally jump instructions.
+ *
+ * Fused opcodes are superinstructions the compiler substitutes for common
+ * sequences. Their operands are described by a string with one character
+ * per operand: L (one-byte local slot), C (one-byte constant index),
+ * K (one-byte comparison opcode), and J (two-byte forward jump, relative
+ * to the end of the instruction).
+ *
+ * Quickened opcodes are specialized forms of a generic instruction that
+ * the VM writes over it at runtime once it has seen what types it works
+ * on. They have exactly the same size and operands as their generic
+ * instruction, so anything that walks bytecode can treat them as that
+ * instruction; see krk_genericOpcode().
  */
 typedef enum {
 #define OPCODE(opc)         opc,
@@ -25,6 +37,8 @@ typedef enum {
 #define CONSTANT(opc,more)  OPCODE(opc) OPCODE(opc ## _LONG)
 #define OPERAND(opc,more)   OPCODE(opc) OPCODE(opc ## _LONG)
 #define JUMP(opc,sign)      OPCODE(opc)
+#define FUSED(opc,kinds)    OPCODE(opc)
+#define QUICK(opc,generic)  OPCODE(opc)
 #define CLOSURE_MORE
 #define EXPAND_ARGS_MORE
 #define FORMAT_VALUE_MORE
@@ -35,9 +49,46 @@ typedef enum {
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
+#undef FUSED
+#undef QUICK
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
 #undef EXPAND_ARGS_MORE
 #undef FORMAT_VALUE_MORE
 #undef OPCODE
 } KrkOpCode;
+
+/**
+ * @brief Size in bytes of a fused instruction with the given operand kinds.
+ *
+ * A J operand, when present, is always last.
+ */
+static inline size_t krk_fusedSize(const char * kinds) {
+	size_t size = 1;
+	for (; *kinds; ++kinds) size += (*kinds == 'J') ? 2 : 1;
+	return size;
+}
+
+/**
+ * @brief The generic instruction a quickened opcode specializes.
+ *
+ * Returns @p opcode itself for anything that is not quickened.
+ */
+static inline uint8_t krk_genericOpcode(uint8_t opcode) {
+	switch (opcode) {
+#define SIMPLE(opc)
+#define CONSTANT(opc,more)
+#define OPERAND(opc,more)
+#define JUMP(opc,sign)
+#define FUSED(opc,kinds)
+#define QUICK(opc,generic) case opc: return generic;
+#include "opcodes.h"
+#undef SIMPLE
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+#undef FUSED
+#undef QUICK
+	}
+	return opcode;
+}
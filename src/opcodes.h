@@ -120,3 +120,33 @@ SIMPLE(OP_SET_ADD_TOP)
 SIMPLE(OP_TUPLE_FROM_LIST)
 
 OPERAND(OP_UNPACK_EX,NOOP)
+
+FUSED(OP_GET_LOCAL_LOCAL,"LL")
+FUSED(OP_ADD_LOCAL_CONST,"LC")
+FUSED(OP_SUB_LOCAL_CONST,"LC")
+FUSED(OP_INPLACE_ADD_LOCAL_CONST,"LC")
+FUSED(OP_COMPARE_LOCAL_CONST_JUMP,"LCKJ")
+FUSED(OP_COMPARE_LOCAL_LOCAL_JUMP,"LLKJ")
+
+QUICK(OP_ADD_INT,OP_ADD)
+QUICK(OP_ADD_FLOAT,OP_ADD)
+QUICK(OP_ADD_STR,OP_ADD)
+QUICK(OP_SUB_INT,OP_SUBTRACT)
+QUICK(OP_SUB_FLOAT,OP_SUBTRACT)
+QUICK(OP_MUL_INT,OP_MULTIPLY)
+QUICK(OP_MUL_FLOAT,OP_MULTIPLY)
+QUICK(OP_DIV_FLOAT,OP_DIVIDE)
+QUICK(OP_LESS_INT,OP_LESS)
+QUICK(OP_LESS_FLOAT,OP_LESS)
+QUICK(OP_GREATER_INT,OP_GREATER)
+QUICK(OP_GREATER_FLOAT,OP_GREATER)
+QUICK(OP_LESS_EQUAL_INT,OP_LESS_EQUAL)
+QUICK(OP_LESS_EQUAL_FLOAT,OP_LESS_EQUAL)
+QUICK(OP_GREATER_EQUAL_INT,OP_GREATER_EQUAL)
+QUICK(OP_GREATER_EQUAL_FLOAT,OP_GREATER_EQUAL)
+QUICK(OP_EQUAL_INT,OP_EQUAL)
+QUICK(OP_GET_PROPERTY_INSTANCE_SLOT,OP_GET_PROPERTY)
+QUICK(OP_CALL_MANAGED_EXACT,OP_CALL)
+QUICK(OP_CALL_NATIVE,OP_CALL)
+QUICK(OP_CALL_METHOD_MANAGED_EXACT,OP_CALL_METHOD)
+QUICK(OP_CALL_METHOD_NATIVE,OP_CALL_METHOD)
@@ -0,0 +1,758 @@
+/**
+ * @file optimizer.c
+ * @brief Bytecode peephole optimizer.
+ *
+ * The compiler hands every finished code object to @ref krk_optimizeCodeObject
+ * before it is disassembled or run. The chunk is decoded into an array of
+ * instructions, passes are run over that array until none of them find
+ * anything more to do, and the chunk is then laid out again with its jumps,
+ * line table, and local name lifetimes rewritten to match.
+ *
+ * When the VM is started with @c KRK_GLOBAL_OPTIMIZE (-O), the passes are:
+ *  - folding of constant arithmetic and string concatenation,
+ *  - removal of redundant stack shuffling (DUP/POP, SWAP/SWAP, values
+ *    that are pushed only to be popped) and SET_LOCAL/POP pairs,
+ *  - threading of jumps that land on other jumps, including turning
+ *    JUMP_IF_FALSE_OR_POP into POP_JUMP_IF_FALSE when its target pops,
+ *  - removal of instructions that can not be reached.
+ *
+ * Whether or not -O is set, common sequences of local and constant loads
+ * followed by arithmetic or a comparison and branch are then replaced with
+ * the superinstructions described in opcode_enum.h.
+ *
+ * Instructions are only ever replaced by ones of the same size or smaller,
+ * so every jump that fit in the original chunk still fits afterwards.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/memory.h>
+#include <kuroko/util.h>
+
+#include "private.h"
+#include "opcode_enum.h"
+
+#define INST_DEAD      (1 << 0) /**< Removed from the output */
+#define INST_TARGET    (1 << 1) /**< Some live jump lands on this instruction */
+#define INST_JUMP      (1 << 2) /**< Has a relative jump operand in @c target */
+#define INST_REWRITTEN (1 << 3) /**< Encode from @c opcode and @c operand instead of copying */
+#define INST_REACHED   (1 << 4) /**< Scratch flag for the reachability pass */
+
+/**
+ * Longest string the folder will produce; anything longer is left for
+ * the VM to build at runtime rather than bloating the constant table.
+ */
+#define FOLD_MAX_STRING 4096
+
+/**
+ * How many jumps to follow when threading, to avoid spinning on
+ * code like `while True: pass` that jumps to itself.
+ */
+#define THREAD_MAX_HOPS 32
+
+struct Instruction {
+	size_t offset;    /**< Offset of the instruction in the original chunk */
+	size_t size;      /**< Size in bytes, including any trailing closure bytes */
+	size_t line;      /**< Source line */
+	size_t operand;   /**< Constant index or operand, when there is one */
+	size_t target;    /**< Index of the instruction a jump lands on; @c count means the end of the chunk */
+	size_t newOffset; /**< Offset in the rewritten chunk */
+	uint8_t opcode;
+	uint8_t flags;
+	uint8_t args[3];  /**< Operand bytes of a fused instruction, not counting its jump */
+};
+
+struct Optimizer {
+	KrkCodeObject * func;
+	struct Instruction * code;
+	size_t count;
+};
+
+static int isLive(struct Optimizer * opt, size_t i) {
+	return i < opt->count && !(opt->code[i].flags & INST_DEAD);
+}
+
+static size_t nextLive(struct Optimizer * opt, size_t i) {
+	while (i < opt->count && (opt->code[i].flags & INST_DEAD)) i++;
+	return i;
+}
+
+/**
+ * Split the chunk into instructions and resolve jump offsets to
+ * instruction indexes. Returns 0 if anything looks wrong, in which
+ * case the code object is left alone.
+ */
+static int decode(struct Optimizer * opt) {
+	KrkChunk * chunk = &opt->func->chunk;
+	uint8_t * code = chunk->code;
+	size_t * indexOf = malloc(sizeof(size_t) * (chunk->count + 1));
+	size_t * targetOffset = malloc(sizeof(size_t) * chunk->count);
+	size_t line = 0, nextLine = 0;
+	int okay = 1;
+
+	opt->code = malloc(sizeof(struct Instruction) * (chunk->count + 1));
+	opt->count = 0;
+
+	for (size_t i = 0; i <= chunk->count; ++i) indexOf[i] = (size_t)-1;
+
+#define SIMPLE(opc) case opc: size = 1; break;
+#define CONSTANT(opc,more) case opc: { operand = code[offset + 1]; size = 2; more; break; } \
+	case opc ## _LONG: { operand = (code[offset + 1] << 16) | (code[offset + 2] << 8) | (code[offset + 3]); size = 4; more; break; }
+#define OPERAND(opc,more) CONSTANT(opc,more)
+#define JUMP(opc,sign) case opc: { size_t jump = (code[offset + 1] << 8) | (code[offset + 2]); \
+	target = offset + 3 sign jump; isJump = 1; size = 3; break; }
+#define CLOSURE_MORE \
+	KrkCodeObject * inner = AS_codeobject(chunk->constants.values[operand]); \
+	for (size_t j = 0; j < inner->upvalueCount && offset + size < chunk->count; ++j) { \
+		size += (code[offset + size] & 2) ? 4 : 2; \
+	}
+#define FUSED(opc,kinds) case opc: { size = krk_fusedSize(kinds); \
+	for (size_t j = 0; j < sizeof(kinds) - 1; ++j) { \
+		if (kinds[j] == 'J') { target = offset + size + ((code[offset + 1 + j] << 8) | code[offset + 2 + j]); isJump = 1; } \
+		else args[j] = code[offset + 1 + j]; \
+	} break; }
+#define QUICK(opc,generic)
+#define NOOP (void)0
+#define EXPAND_ARGS_MORE
+#define FORMAT_VALUE_MORE
+#define LOCAL_MORE
+
+	size_t offset = 0;
+	while (offset < chunk->count) {
+		uint8_t opcode = code[offset];
+		size_t size = 0, operand = 0, target = 0;
+		uint8_t args[3] = {0};
+		int isJump = 0;
+		switch (krk_genericOpcode(opcode)) {
+#include "opcodes.h"
+		}
+		if (!size || offset + size > chunk->count) { okay = 0; break; }
+
+		while (nextLine < chunk->linesCount && chunk->lines[nextLine].startOffset <= offset) {
+			line = chunk->lines[nextLine++].line;
+		}
+
+		struct Instruction * inst = &opt->code[opt->count];
+		inst->offset = offset;
+		inst->size = size;
+		inst->line = line;
+		inst->operand = operand;
+		inst->target = 0;
+		inst->newOffset = 0;
+		inst->opcode = opcode;
+		inst->flags = isJump ? INST_JUMP : 0;
+		memcpy(inst->args, args, sizeof(args));
+		targetOffset[opt->count] = target;
+		indexOf[offset] = opt->count++;
+		offset += size;
+	}
+
+#undef SIMPLE
+#undef CONSTANT
+#undef OPERAND
+#undef JUMP
+#undef FUSED
+#undef QUICK
+#undef CLOSURE_MORE
+#undef NOOP
+#undef EXPAND_ARGS_MORE
+#undef FORMAT_VALUE_MORE
+#undef LOCAL_MORE
+
+	indexOf[chunk->count] = opt->count;
+
+	for (size_t i = 0; okay && i < opt->count; ++i) {
+		if (!(opt->code[i].flags & INST_JUMP)) continue;
+		if (targetOffset[i] > chunk->count || indexOf[targetOffset[i]] == (size_t)-1) {
+			okay = 0;
+			break;
+		}
+		opt->code[i].target = indexOf[targetOffset[i]];
+	}
+
+	free(indexOf);
+	free(targetOffset);
+	return okay;
+}
+
+/**
+ * Point jumps at removed instructions to whatever now follows them,
+ * and recompute which instructions are jump targets.
+ */
+static void resolveTargets(struct Optimizer * opt) {
+	for (size_t i = 0; i < opt->count; ++i) opt->code[i].flags &= ~INST_TARGET;
+	for (size_t i = 0; i < opt->count; ++i) {
+		struct Instruction * inst = &opt->code[i];
+		if ((inst->flags & INST_DEAD) || !(inst->flags & INST_JUMP)) continue;
+		inst->target = nextLive(opt, inst->target);
+		if (inst->target < opt->count) opt->code[inst->target].flags |= INST_TARGET;
+	}
+}
+
+static void removeInstruction(struct Optimizer * opt, size_t i) {
+	opt->code[i].flags |= INST_DEAD;
+}
+
+static void rewriteConstant(struct Optimizer * opt, size_t i, size_t index) {
+	struct Instruction * inst = &opt->code[i];
+	inst->opcode = index < 256 ? OP_CONSTANT : OP_CONSTANT_LONG;
+	inst->operand = index;
+	inst->size = index < 256 ? 2 : 4;
+	inst->flags |= INST_REWRITTEN;
+}
+
+static int isConstant(struct Optimizer * opt, size_t i, KrkValue * out) {
+	if (!isLive(opt, i)) return 0;
+	if (opt->code[i].opcode != OP_CONSTANT && opt->code[i].opcode != OP_CONSTANT_LONG) return 0;
+	*out = opt->func->chunk.constants.values[opt->code[i].operand];
+	return 1;
+}
+
+static int isIntegral(KrkValue value) {
+	return IS_INTEGER(value) || krk_getType(value) == vm.baseClasses->longClass;
+}
+
+static int isFoldable(KrkValue value) {
+	return isIntegral(value) || IS_FLOATING(value) || IS_STRING(value);
+}
+
+/**
+ * Decide, before running it, whether an operation on two constants is
+ * cheap and side-effect free enough to do at compile time.
+ */
+static int canFoldBinary(uint8_t opcode, KrkValue a, KrkValue b) {
+	if (!isFoldable(a) || !isFoldable(b)) return 0;
+
+	if (IS_STRING(a) || IS_STRING(b)) {
+		if (opcode == OP_ADD) return IS_STRING(a) && IS_STRING(b) && AS_STRING(a)->length + AS_STRING(b)->length <= FOLD_MAX_STRING;
+		if (opcode == OP_MULTIPLY) {
+			KrkValue str = IS_STRING(a) ? a : b;
+			KrkValue count = IS_STRING(a) ? b : a;
+			if (!IS_INTEGER(count)) return 0;
+			if (AS_INTEGER(count) <= 0) return 1;
+			return (size_t)AS_INTEGER(count) <= FOLD_MAX_STRING / (AS_STRING(str)->length ? AS_STRING(str)->length : 1);
+		}
+		return 0;
+	}
+
+	switch (opcode) {
+		case OP_POW:
+			/* Integer powers grow quickly; only fold small exponents. */
+			if (isIntegral(a) && isIntegral(b)) return IS_INTEGER(b) && AS_INTEGER(b) >= 0 && AS_INTEGER(b) <= 64;
+			return 1;
+		case OP_SHIFTLEFT:
+			return IS_INTEGER(b) && AS_INTEGER(b) >= 0 && AS_INTEGER(b) <= 64;
+		case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE:
+		case OP_FLOORDIV: case OP_MODULO: case OP_SHIFTRIGHT:
+		case OP_BITOR: case OP_BITXOR: case OP_BITAND:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static KrkValue foldBinary(uint8_t opcode, KrkValue a, KrkValue b) {
+	switch (opcode) {
+		case OP_ADD:        return krk_operator_add(a,b);
+		case OP_SUBTRACT:   return krk_operator_sub(a,b);
+		case OP_MULTIPLY:   return krk_operator_mul(a,b);
+		case OP_DIVIDE:     return krk_operator_truediv(a,b);
+		case OP_FLOORDIV:   return krk_operator_floordiv(a,b);
+		case OP_MODULO:     return krk_operator_mod(a,b);
+		case OP_POW:        return krk_operator_pow(a,b);
+		case OP_SHIFTLEFT:  return krk_operator_lshift(a,b);
+		case OP_SHIFTRIGHT: return krk_operator_rshift(a,b);
+		case OP_BITOR:      return krk_operator_or(a,b);
+		case OP_BITXOR:     return krk_operator_xor(a,b);
+		case OP_BITAND:     return krk_operator_and(a,b);
+	}
+	return NONE_VAL();
+}
+
+static KrkValue foldUnary(uint8_t opcode, KrkValue a) {
+	switch (opcode) {
+		case OP_NEGATE:    return krk_operator_neg(a);
+		case OP_BITNEGATE: return krk_operator_invert(a);
+		case OP_POS:       return krk_operator_pos(a);
+	}
+	return NONE_VAL();
+}
+
+/**
+ * Check the result of a folded operation. Anything that raised is left
+ * for runtime, where the exception will be raised with a proper traceback.
+ */
+static int acceptFolded(KrkValue result) {
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~(KRK_THREAD_HAS_EXCEPTION);
+		krk_currentThread.currentException = NONE_VAL();
+		return 0;
+	}
+	if (!isFoldable(result)) return 0;
+	if (IS_STRING(result) && AS_STRING(result)->length > FOLD_MAX_STRING) return 0;
+	return 1;
+}
+
+/**
+ * Find or add a constant for a folded value. Only identical values are
+ * shared, so 1, 1.0 and -0.0 each keep their own slot.
+ */
+static size_t foldedConstant(struct Optimizer * opt, KrkValue value) {
+	KrkValueArray * constants = &opt->func->chunk.constants;
+	for (size_t i = 0; i < constants->count; ++i) {
+		if (krk_valuesSame(constants->values[i], value)) return i;
+	}
+	return krk_addConstant(&opt->func->chunk, value);
+}
+
+static int foldConstants(struct Optimizer * opt) {
+	int changed = 0;
+	for (size_t i = nextLive(opt, 0); i < opt->count; i = nextLive(opt, i + 1)) {
+		KrkValue a, b;
+		if (!isConstant(opt, i, &a)) continue;
+		size_t j = nextLive(opt, i + 1);
+		if (j >= opt->count || (opt->code[j].flags & INST_TARGET)) continue;
+
+		uint8_t unary = opt->code[j].opcode;
+		if ((unary == OP_NEGATE || unary == OP_BITNEGATE || unary == OP_POS) && (isIntegral(a) || IS_FLOATING(a))) {
+			KrkValue result = foldUnary(unary, a);
+			if (!acceptFolded(result)) continue;
+			krk_push(result);
+			rewriteConstant(opt, i, foldedConstant(opt, result));
+			krk_pop();
+			removeInstruction(opt, j);
+			changed = 1;
+			continue;
+		}
+
+		if (!isConstant(opt, j, &b)) continue;
+		size_t k = nextLive(opt, j + 1);
+		if (k >= opt->count || (opt->code[k].flags & INST_TARGET)) continue;
+		if (!canFoldBinary(opt->code[k].opcode, a, b)) continue;
+
+		KrkValue result = foldBinary(opt->code[k].opcode, a, b);
+		if (!acceptFolded(result)) continue;
+		krk_push(result);
+		rewriteConstant(opt, i, foldedConstant(opt, result));
+		krk_pop();
+		removeInstruction(opt, j);
+		removeInstruction(opt, k);
+		changed = 1;
+	}
+	return changed;
+}
+
+static int pushesPlainValue(uint8_t opcode) {
+	switch (opcode) {
+		case OP_CONSTANT: case OP_CONSTANT_LONG:
+		case OP_GET_LOCAL: case OP_GET_LOCAL_LONG:
+		case OP_NONE: case OP_TRUE: case OP_FALSE:
+			return 1;
+	}
+	return 0;
+}
+
+static int peephole(struct Optimizer * opt) {
+	int changed = 0;
+	for (size_t i = nextLive(opt, 0); i < opt->count; i = nextLive(opt, i + 1)) {
+		struct Instruction * inst = &opt->code[i];
+		size_t j = nextLive(opt, i + 1);
+
+		/* A jump to the very next instruction does nothing. */
+		if ((inst->opcode == OP_JUMP || inst->opcode == OP_LOOP) && inst->target == j) {
+			removeInstruction(opt, i);
+			changed = 1;
+			continue;
+		}
+
+		if (j >= opt->count || (opt->code[j].flags & INST_TARGET)) continue;
+		struct Instruction * next = &opt->code[j];
+
+		if (next->opcode == OP_POP) {
+			if ((inst->opcode == OP_DUP && inst->operand == 0) || pushesPlainValue(inst->opcode)) {
+				removeInstruction(opt, i);
+				removeInstruction(opt, j);
+				changed = 1;
+			} else if (inst->opcode == OP_SET_LOCAL || inst->opcode == OP_SET_LOCAL_LONG) {
+				inst->opcode = inst->opcode == OP_SET_LOCAL ? OP_SET_LOCAL_POP : OP_SET_LOCAL_POP_LONG;
+				inst->flags |= INST_REWRITTEN;
+				removeInstruction(opt, j);
+				changed = 1;
+			}
+		} else if (inst->opcode == OP_SWAP && next->opcode == OP_SWAP) {
+			removeInstruction(opt, i);
+			removeInstruction(opt, j);
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+/**
+ * Relative jumps carry 16-bit distances. Nothing ever grows, so a jump
+ * that spans at most 0xFFFF bytes of the original chunk still fits.
+ */
+static int jumpFits(struct Optimizer * opt, size_t from, size_t to) {
+	size_t origin = opt->code[from].offset + 3;
+	size_t dest = to < opt->count ? opt->code[to].offset : opt->func->chunk.count;
+	return (dest > origin ? dest - origin : origin - dest) <= 0xFFFF;
+}
+
+static int threadJumps(struct Optimizer * opt) {
+	int changed = 0;
+	for (size_t i = nextLive(opt, 0); i < opt->count; i = nextLive(opt, i + 1)) {
+		struct Instruction * inst = &opt->code[i];
+		size_t target = inst->target;
+
+		switch (inst->opcode) {
+			case OP_JUMP:
+			case OP_LOOP:
+				for (int hops = 0; hops < THREAD_MAX_HOPS && target < opt->count; ++hops) {
+					struct Instruction * t = &opt->code[target];
+					if (t->opcode != OP_JUMP && t->opcode != OP_LOOP) break;
+					if (t->target == target || !jumpFits(opt, i, t->target)) break;
+					target = t->target;
+				}
+				if (target != inst->target) {
+					inst->target = target;
+					/* Backwards jumps are always LOOPs, so every cycle still checks for signals. */
+					inst->opcode = target > i ? OP_JUMP : OP_LOOP;
+					changed = 1;
+				}
+				break;
+
+			case OP_JUMP_IF_FALSE_OR_POP:
+			case OP_JUMP_IF_TRUE_OR_POP:
+			case OP_POP_JUMP_IF_FALSE:
+				for (int hops = 0; hops < THREAD_MAX_HOPS && target < opt->count; ++hops) {
+					struct Instruction * t = &opt->code[target];
+					size_t next = (size_t)-1;
+					uint8_t opcode = inst->opcode;
+					if (t->opcode == OP_JUMP) {
+						next = t->target;
+					} else if (t->opcode == inst->opcode && inst->opcode != OP_POP_JUMP_IF_FALSE) {
+						/* The value we kept is tested the same way again. */
+						next = t->target;
+					} else if (inst->opcode == OP_JUMP_IF_FALSE_OR_POP && t->opcode == OP_POP_JUMP_IF_FALSE) {
+						next = t->target;
+						opcode = OP_POP_JUMP_IF_FALSE;
+					} else if (inst->opcode == OP_JUMP_IF_FALSE_OR_POP && t->opcode == OP_POP) {
+						/* The value we kept is dropped right away; drop it before jumping instead. */
+						next = nextLive(opt, target + 1);
+						opcode = OP_POP_JUMP_IF_FALSE;
+					}
+					if (next == (size_t)-1 || next <= i || !jumpFits(opt, i, next)) break;
+					inst->opcode = opcode;
+					target = next;
+				}
+				if (target != inst->target) {
+					inst->target = target;
+					changed = 1;
+				}
+				break;
+		}
+	}
+	return changed;
+}
+
+static int isTerminator(uint8_t opcode) {
+	switch (opcode) {
+		case OP_RETURN: case OP_RAISE: case OP_RAISE_FROM:
+		case OP_JUMP: case OP_LOOP:
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Every handler the VM can resume at is either a jump target (try, with,
+ * yield from) or the instruction after the one that installed it (break
+ * and continue through a finally), so following jumps and fallthrough
+ * from the start of the chunk finds everything that can run.
+ */
+static int removeUnreachable(struct Optimizer * opt) {
+	size_t * pending = malloc(sizeof(size_t) * (opt->count + 1));
+	size_t pendingCount = 0;
+	int changed = 0;
+
+	for (size_t i = 0; i < opt->count; ++i) opt->code[i].flags &= ~INST_REACHED;
+
+#define REACH(index) do { size_t _i = (index); \
+	if (_i < opt->count && !(opt->code[_i].flags & INST_REACHED)) { \
+		opt->code[_i].flags |= INST_REACHED; pending[pendingCount++] = _i; } } while (0)
+
+	REACH(nextLive(opt, 0));
+	while (pendingCount) {
+		size_t i = pending[--pendingCount];
+		struct Instruction * inst = &opt->code[i];
+		if (inst->flags & INST_JUMP) REACH(inst->target);
+		if (!isTerminator(inst->opcode)) REACH(nextLive(opt, i + 1));
+	}
+
+#undef REACH
+
+	for (size_t i = 0; i < opt->count; ++i) {
+		if (!(opt->code[i].flags & (INST_DEAD | INST_REACHED))) {
+			removeInstruction(opt, i);
+			changed = 1;
+		}
+	}
+
+	free(pending);
+	return changed;
+}
+
+static int isFused(uint8_t opcode) {
+	switch (opcode) {
+#define FUSED(opc,kinds) case opc:
+#define QUICK(opc,generic)
+#define SIMPLE(opc)
+#define CONSTANT(opc,more)
+#define OPERAND(opc,more)
+#define JUMP(opc,sign)
+#include "opcodes.h"
+#undef FUSED
+#undef QUICK
+#undef SIMPLE
+#undef CONSTANT
+#undef OPERAND
+#undef JUMP
+			return 1;
+	}
+	return 0;
+}
+
+static int isComparison(uint8_t opcode) {
+	switch (opcode) {
+		case OP_LESS: case OP_GREATER: case OP_LESS_EQUAL: case OP_GREATER_EQUAL: case OP_EQUAL:
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Collect the next @p n live instructions starting at @p i into @p out,
+ * none of which but the first may be a jump target.
+ */
+static int sequence(struct Optimizer * opt, size_t i, size_t n, struct Instruction ** out) {
+	for (size_t j = 0; j < n; ++j) {
+		if (i >= opt->count || (j && (opt->code[i].flags & INST_TARGET))) return 0;
+		out[j] = &opt->code[i];
+		i = nextLive(opt, i + 1);
+	}
+	return 1;
+}
+
+static void fuse(struct Optimizer * opt, struct Instruction ** seq, size_t n, uint8_t opcode, const char * kinds, uint8_t a, uint8_t b) {
+	struct Instruction * inst = seq[0];
+	inst->opcode = opcode;
+	inst->size = krk_fusedSize(kinds);
+	inst->args[0] = a;
+	inst->args[1] = b;
+	inst->flags |= INST_REWRITTEN;
+	for (size_t j = 1; j < n; ++j) seq[j]->flags |= INST_DEAD;
+}
+
+/**
+ * Find where a branch that consumes its condition lands: POP_JUMP_IF_FALSE
+ * directly, or JUMP_IF_FALSE_OR_POP onto a POP, which `while` loops
+ * produce when the optimizer is not threading jumps for us.
+ */
+static int fusableBranch(struct Optimizer * opt, struct Instruction * inst, size_t * target) {
+	if (inst->opcode == OP_POP_JUMP_IF_FALSE) {
+		*target = inst->target;
+		return 1;
+	}
+	if (inst->opcode == OP_JUMP_IF_FALSE_OR_POP && isLive(opt, inst->target) && opt->code[inst->target].opcode == OP_POP) {
+		*target = nextLive(opt, inst->target + 1);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Replace common sequences with superinstructions, longest first.
+ * Only short local and constant operands are fused.
+ */
+static int fuseInstructions(struct Optimizer * opt) {
+	int changed = 0;
+	for (size_t i = nextLive(opt, 0); i < opt->count; i = nextLive(opt, i + 1)) {
+		struct Instruction * seq[5];
+		if (opt->code[i].opcode != OP_GET_LOCAL) continue;
+		if (!sequence(opt, i, 2, seq)) continue;
+		uint8_t a = seq[0]->operand;
+		uint8_t b = seq[1]->operand;
+
+		if (seq[1]->opcode == OP_CONSTANT) {
+			if (sequence(opt, i, 4, seq) && seq[2]->opcode == OP_INPLACE_ADD) {
+				if (seq[3]->opcode == OP_SET_LOCAL_POP && seq[3]->operand == a) {
+					fuse(opt, seq, 4, OP_INPLACE_ADD_LOCAL_CONST, "LC", a, b);
+					changed = 1;
+					continue;
+				}
+				if (seq[3]->opcode == OP_SET_LOCAL && seq[3]->operand == a && sequence(opt, i, 5, seq) && seq[4]->opcode == OP_POP) {
+					fuse(opt, seq, 5, OP_INPLACE_ADD_LOCAL_CONST, "LC", a, b);
+					changed = 1;
+					continue;
+				}
+			}
+		}
+
+		if (seq[1]->opcode == OP_CONSTANT || seq[1]->opcode == OP_GET_LOCAL) {
+			size_t target;
+			if (sequence(opt, i, 4, seq) && isComparison(seq[2]->opcode) && fusableBranch(opt, seq[3], &target)) {
+				seq[0]->args[2] = seq[2]->opcode;
+				seq[0]->target = target;
+				seq[0]->flags |= INST_JUMP;
+				if (seq[1]->opcode == OP_CONSTANT) {
+					fuse(opt, seq, 4, OP_COMPARE_LOCAL_CONST_JUMP, "LCKJ", a, b);
+				} else {
+					fuse(opt, seq, 4, OP_COMPARE_LOCAL_LOCAL_JUMP, "LLKJ", a, b);
+				}
+				changed = 1;
+				continue;
+			}
+		}
+
+		if (seq[1]->opcode == OP_CONSTANT && sequence(opt, i, 3, seq)) {
+			if (seq[2]->opcode == OP_ADD || seq[2]->opcode == OP_SUBTRACT) {
+				fuse(opt, seq, 3, seq[2]->opcode == OP_ADD ? OP_ADD_LOCAL_CONST : OP_SUB_LOCAL_CONST, "LC", a, b);
+				changed = 1;
+				continue;
+			}
+		}
+
+		if (seq[1]->opcode == OP_GET_LOCAL) {
+			fuse(opt, seq, 2, OP_GET_LOCAL_LOCAL, "LL", a, b);
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+/**
+ * Write the surviving instructions back into the chunk.
+ */
+static int layout(struct Optimizer * opt) {
+	KrkChunk * chunk = &opt->func->chunk;
+	size_t newCount = 0;
+
+	for (size_t i = 0; i < opt->count; ++i) {
+		if (opt->code[i].flags & INST_DEAD) continue;
+		opt->code[i].newOffset = newCount;
+		newCount += opt->code[i].size;
+	}
+
+	/* Everything must be resolvable before we touch the chunk. */
+	for (size_t i = 0; i < opt->count; ++i) {
+		struct Instruction * inst = &opt->code[i];
+		if ((inst->flags & INST_DEAD) || !(inst->flags & INST_JUMP)) continue;
+		size_t dest = inst->target < opt->count ? opt->code[inst->target].newOffset : newCount;
+		size_t origin = inst->newOffset + inst->size;
+		int backwards = inst->opcode == OP_LOOP || inst->opcode == OP_LOOP_ITER;
+		if (backwards ? (dest > origin || origin - dest > 0xFFFF) : (dest < origin || dest - origin > 0xFFFF)) return 0;
+	}
+
+	uint8_t * code = malloc(newCount ? newCount : 1);
+	KrkLineMap * lines = malloc(sizeof(KrkLineMap) * (opt->count ? opt->count : 1));
+	size_t linesCount = 0;
+
+	for (size_t i = 0; i < opt->count; ++i) {
+		struct Instruction * inst = &opt->code[i];
+		if (inst->flags & INST_DEAD) continue;
+		uint8_t * out = &code[inst->newOffset];
+
+		if (inst->flags & INST_JUMP) {
+			/* Plain jumps are three bytes; fused ones carry their other operands first. */
+			size_t dest = inst->target < opt->count ? opt->code[inst->target].newOffset : newCount;
+			size_t origin = inst->newOffset + inst->size;
+			size_t distance = dest > origin ? dest - origin : origin - dest;
+			out[0] = inst->opcode;
+			memcpy(&out[1], inst->args, inst->size - 3);
+			out[inst->size - 2] = (distance >> 8) & 0xFF;
+			out[inst->size - 1] = distance & 0xFF;
+		} else if (inst->flags & INST_REWRITTEN) {
+			out[0] = inst->opcode;
+			if (isFused(inst->opcode)) {
+				memcpy(&out[1], inst->args, inst->size - 1);
+			} else if (inst->size == 2) {
+				out[1] = inst->operand;
+			} else if (inst->size == 4) {
+				out[1] = (inst->operand >> 16) & 0xFF;
+				out[2] = (inst->operand >> 8) & 0xFF;
+				out[3] = inst->operand & 0xFF;
+			}
+		} else {
+			memcpy(out, &chunk->code[inst->offset], inst->size);
+		}
+
+		if (!linesCount || lines[linesCount-1].line != inst->line) {
+			lines[linesCount++] = (KrkLineMap){inst->newOffset, inst->line};
+		}
+	}
+
+	/*
+	 * Local names live from and die at instruction boundaries; move them with
+	 * their instructions, or to whatever survived after them if they were removed.
+	 */
+	size_t * offsetMap = malloc(sizeof(size_t) * (chunk->count + 1));
+	size_t mapped = newCount;
+	offsetMap[chunk->count] = newCount;
+	for (size_t i = opt->count; i > 0; --i) {
+		struct Instruction * inst = &opt->code[i-1];
+		for (size_t j = 1; j < inst->size; ++j) offsetMap[inst->offset + j] = mapped;
+		if (!(inst->flags & INST_DEAD)) mapped = inst->newOffset;
+		offsetMap[inst->offset] = mapped;
+	}
+	for (size_t i = 0; i < opt->func->localNameCount; ++i) {
+		KrkLocalEntry * entry = &opt->func->localNames[i];
+		entry->birthday = entry->birthday < chunk->count ? offsetMap[entry->birthday] : newCount;
+		entry->deathday = entry->deathday < chunk->count ? offsetMap[entry->deathday] : newCount;
+	}
+	free(offsetMap);
+
+	memcpy(chunk->code, code, newCount);
+	chunk->count = newCount;
+
+	if (linesCount > chunk->linesCapacity) {
+		size_t old = chunk->linesCapacity;
+		chunk->linesCapacity = linesCount;
+		chunk->lines = GROW_ARRAY(KrkLineMap, chunk->lines, old, chunk->linesCapacity);
+	}
+	memcpy(chunk->lines, lines, sizeof(KrkLineMap) * linesCount);
+	chunk->linesCount = linesCount;
+
+	free(code);
+	free(lines);
+	return 1;
+}
+
+void krk_optimizeCodeObject(KrkCodeObject * func, int optimize) {
+	struct Optimizer opt = {func, NULL, 0};
+
+	if (decode(&opt)) {
+		int changed, rewritten = 0;
+		while (optimize) {
+			changed = 0;
+			resolveTargets(&opt);
+			changed |= foldConstants(&opt);
+			resolveTargets(&opt);
+			changed |= peephole(&opt);
+			resolveTargets(&opt);
+			changed |= threadJumps(&opt);
+			resolveTargets(&opt);
+			changed |= removeUnreachable(&opt);
+			if (!changed) break;
+			rewritten = 1;
+		}
+		resolveTargets(&opt);
+		rewritten |= fuseInstructions(&opt);
+		if (rewritten) {
+			resolveTargets(&opt);
+			layout(&opt);
+		}
+	}
+
+	free(opt.code);
+}
@@ -19,6 +19,7 @@
 #include <kuroko/value.h>
 #include <kuroko/object.h>
 #include <kuroko/util.h>
+#include <kuroko/memory.h>
 
 /* Did you know this is actually specified to not exist in a header? */
 extern char ** environ;
@@ -187,7 +188,10 @@ static void _loadEnviron(KrkInstance * module) {
 KRK_Function(system) {
 	const char * cmd;
 	if (!krk_parseArgs("s",(const char*[]){"command"},&cmd)) return NONE_VAL();
-	return INTEGER_VAL(system(cmd));
+	krk_beginBlockingCall();
+	int result = system(cmd);
+	krk_endBlockingCall();
+	return INTEGER_VAL(result);
 }
 
 KRK_Function(getcwd) {
@@ -296,7 +300,9 @@ KRK_Function(open) {
 	int flags;
 	int mode = 0777;
 	if (!krk_parseArgs("si|i",(const char*[]){"path","flags","mode"}, &path, &flags, &mode)) return NONE_VAL();
+	krk_beginBlockingCall();
 	int result = open(path, flags, mode);
+	krk_endBlockingCall();
 	if (result == -1) {
 		return krk_runtimeError(KRK_EXC(OSError), "%s", strerror(errno));
 	}
@@ -332,7 +338,9 @@ KRK_Function(read) {
 	if (!krk_parseArgs("in",(const char*[]){"fd","count"}, &fd, &count)) return NONE_VAL();
 
 	uint8_t * tmp = malloc(count);
+	krk_beginBlockingCall();
 	ssize_t result = read(fd,tmp,count);
+	krk_endBlockingCall();
 	if (result == -1) {
 		free(tmp);
 		return krk_runtimeError(KRK_EXC(OSError), "%s", strerror(errno));
@@ -350,10 +358,14 @@ KRK_Function(read) {
 
 KRK_Function(write) {
 	int fd;
-	KrkBytes * buf;
-	if (!krk_parseArgs("iO!",(const char*[]){"fd","buf"}, &fd, KRK_BASE_CLASS(bytes), &buf)) return NONE_VAL();
-
-	ssize_t result = write(fd,buf->bytes,buf->length);
+	KrkValue data;
+	KrkBuffer buf;
+	if (!krk_parseArgs("iV",(const char*[]){"fd","buf"}, &fd, &data)) return NONE_VAL();
+	if (!krk_getBuffer(data, &buf, 0)) return NONE_VAL();
+
+	krk_beginBlockingCall();
+	ssize_t result = write(fd,buf.buf,buf.len);
+	krk_endBlockingCall();
 	if (result == -1) {
 		return krk_runtimeError(KRK_EXC(OSError), "%s", strerror(errno));
 	}
@@ -782,7 +794,7 @@ void krk_module_init_os(void) {
 	KRK_DOC(BIND_FUNC(module,write),
 		"@brief Write to an open file descriptor.\n"
 		"@arguments fd,data\n\n"
-		"Writes the @ref bytes object @p data to the open file descriptor @p fd.");
+		"Writes the @ref bytes object, or other bytes-like object, @p data to the open file descriptor @p fd.");
 	KRK_DOC(BIND_FUNC(module,mkdir),
 		"@brief Create a directory.\n"
 		"@arguments path,mode=0o777\n\n"
@@ -393,7 +393,7 @@ int krk_parseVArgs(
 		 * remaining key (or keys) should be a string, so we should find at least one
 		 * thing to complain about by name...
 		 */
-		for (size_t i = 0; i < AS_DICT(argv[argc])->capacity; ++i) {
+		for (size_t i = 0; i < AS_DICT(argv[argc])->used; ++i) {
 			KrkTableEntry * entry = &AS_DICT(argv[argc])->entries[i];
 			if (IS_STRING(entry->key)) {
 				krk_runtimeError(vm.exceptions->typeError, "%s() got an unexpected keyword argument '%S'",
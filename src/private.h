@@ -6,12 +6,14 @@
  * They are used internally by the interpreter library.
  */
 #include "kuroko/kuroko.h"
+#include "kuroko/object.h"
 
 extern void _createAndBind_numericClasses(void);
 extern void _createAndBind_strClass(void);
 extern void _createAndBind_listClass(void);
 extern void _createAndBind_tupleClass(void);
 extern void _createAndBind_bytesClass(void);
+extern void _createAndBind_memoryviewClass(void);
 extern void _createAndBind_dictClass(void);
 extern void _createAndBind_functionClass(void);
 extern void _createAndBind_rangeClass(void);
@@ -24,6 +26,43 @@ extern void _createAndBind_exceptions(void);
 extern void _createAndBind_longClass(void);
 extern void _createAndBind_compilerClass(void);
 
+extern KrkShape * krk_newShape(KrkShape * parent, KrkString * name);
+extern void krk_freeShape(KrkShape * shape);
+extern int krk_shapeFind(KrkShape * shape, KrkString * name);
+extern void krk_freeSlots(KrkInstance * instance);
+extern void krk_instanceDropShape(KrkInstance * instance);
+extern int krk_instanceGetField(KrkInstance * instance, KrkString * name, KrkValue * value);
+extern void krk_instanceSetField(KrkInstance * instance, KrkString * name, KrkValue value);
+extern int krk_instanceDeleteField(KrkInstance * instance, KrkString * name);
+
+extern void * krk_allocateObjectMemory(size_t size);
+extern void krk_releaseThreadSlots(void);
+extern void krk_walkObjects(void (*callback)(KrkObj * object, void * context), void * context);
+extern void krk_gcExpectThread(void);
+extern void krk_gcAttachThread(void);
+extern void krk_gcDetachThread(void);
+extern void krk_joinThreadPools(void);
+extern void krk_optimizeCodeObject(KrkCodeObject * func, int optimize);
+
+#ifdef KRK_OPCODE_STATS
+extern size_t krk_opcodeCounts[256];
+extern size_t krk_opcodePairCounts[256][256];
+#endif
+
+/* Operators without public declarations, for the constant folder */
+extern KrkValue krk_operator_mul(KrkValue,KrkValue);
+extern KrkValue krk_operator_truediv(KrkValue,KrkValue);
+extern KrkValue krk_operator_floordiv(KrkValue,KrkValue);
+extern KrkValue krk_operator_mod(KrkValue,KrkValue);
+extern KrkValue krk_operator_lshift(KrkValue,KrkValue);
+extern KrkValue krk_operator_rshift(KrkValue,KrkValue);
+extern KrkValue krk_operator_or(KrkValue,KrkValue);
+extern KrkValue krk_operator_xor(KrkValue,KrkValue);
+extern KrkValue krk_operator_and(KrkValue,KrkValue);
+extern KrkValue krk_operator_neg(KrkValue);
+extern KrkValue krk_operator_invert(KrkValue);
+extern KrkValue krk_operator_pos(KrkValue);
+
 /**
  * @brief Index numbers for always-available interned strings representing important method and member names.
  *
@@ -44,6 +83,33 @@ typedef enum {
 	METHOD__MAX,
 } KrkSpecialMethods;
 
+/**
+ * @brief Instance of @c rangeiterator; the VM steps these itself in @c for loops.
+ */
+struct RangeIterator {
+	KrkInstance inst;
+	krk_integer_type i;
+	krk_integer_type max;
+	krk_integer_type step;
+};
+
+/**
+ * @brief Instance of @c listiterator; the VM steps these itself in @c for loops.
+ */
+struct ListIterator {
+	KrkInstance inst;
+	KrkValue l;
+	size_t i;
+};
+
+/**
+ * @brief Instance of @c bytearray; the contents are stored in a separate @c bytes object.
+ */
+struct ByteArray {
+	KrkInstance inst;
+	KrkValue actual;
+};
+
 
 #define FORMAT_OP_EQ     (1 << 0)
 #define FORMAT_OP_REPR   (1 << 1)
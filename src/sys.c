@@ -3,6 +3,8 @@
 #include <kuroko/object.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 #define KRK_VERSION_MAJOR  1
 #define KRK_VERSION_MINOR  4
 #define KRK_VERSION_PATCH  0
@@ -107,6 +109,11 @@ KRK_Function(getsizeof) {
 		case KRK_OBJ_INSTANCE: {
 			KrkInstance * self = AS_INSTANCE(argv[0]);
 			mySize += sizeof(KrkTableEntry) * self->fields.capacity;
+			if (self->slots) {
+				size_t slots = 4;
+				while (slots < self->shape->count) slots <<= 1;
+				mySize += sizeof(KrkValue) * slots;
+			}
 			KrkClass * type = krk_getType(argv[0]);
 			mySize += type->allocSize; /* All instance types have an allocSize set */
 
@@ -157,7 +164,7 @@ KRK_Function(modules) {
 	FUNCTION_TAKES_NONE();
 	KrkValue moduleList = krk_list_of(0,NULL,0);
 	krk_push(moduleList);
-	for (size_t i = 0; i < vm.modules.capacity; ++i) {
+	for (size_t i = 0; i < vm.modules.used; ++i) {
 		KrkTableEntry * entry = &vm.modules.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
 		krk_writeValueArray(AS_LIST(moduleList), entry->key);
@@ -188,8 +195,11 @@ KRK_Function(members) {
 
 	KrkTable * src = NULL;
 
-	if (IS_INSTANCE(val) || IS_CLASS(val)) {
+	if (IS_INSTANCE(val)) {
+		krk_instanceDropShape(AS_INSTANCE(val));
 		src = &AS_INSTANCE(val)->fields;
+	} else if (IS_CLASS(val)) {
+		src = &AS_CLASS(val)->methods;
 	} else if (IS_CLOSURE(val)) {
 		src = &AS_CLOSURE(val)->fields;
 	}
@@ -253,6 +263,7 @@ void krk_module_init_kuroko(void) {
 	krk_attachNamedObject(&vm.system->fields, "module", (KrkObj*)vm.baseClasses->moduleClass);
 	krk_attachNamedObject(&vm.system->fields, "path_sep", (KrkObj*)S(PATH_SEP));
 	KrkValue module_paths = krk_list_of(0,NULL,0);
+	krk_push(module_paths);
 	krk_attachNamedValue(&vm.system->fields, "module_paths", module_paths);
 	krk_writeValueArray(AS_LIST(module_paths), OBJECT_VAL(S("./")));
 #ifndef KRK_NO_FILESYSTEM
@@ -277,4 +288,5 @@ void krk_module_init_kuroko(void) {
 		free(dir);
 	}
 #endif
+	krk_pop(); /* module_paths */
 }
@@ -9,16 +9,75 @@
 #include <kuroko/threads.h>
 #include <kuroko/util.h>
 
-#define TABLE_MAX_LOAD 3 / 4
+/**
+ * Tables are stored compactly: entries live in a dense array in the order
+ * they were inserted, and a separate, sparse array of small integers maps
+ * hash slots to positions in that array. The index array sits directly after
+ * the entries in the same allocation, and its elements are only as wide as
+ * they need to be to address every entry, so a small table spends a byte
+ * per slot on its index rather than a whole entry.
+ *
+ * Deleted entries are left in place with a tombstone key until the next
+ * resize squeezes them out, so iterating over the first @c used entries
+ * always visits the live keys in insertion order.
+ */
+#define TABLE_MIN_SIZE   8
+#define TABLE_USABLE(n)  (((n) << 1) / 3)
+#define INDEX_EMPTY      (-1)
+#define INDEX_DUMMY      (-2)
+#define TABLE_INDEXES(table) ((void*)&(table)->entries[(table)->capacity])
+
+#ifdef __TINYC__
+int __builtin_clz(unsigned int x) {
+	int i = 31;
+	while (!(x & (1 << i)) && i >= 0) i--;
+	return 31-i;
+}
+#endif
+
+/**
+ * Capacities are always TABLE_USABLE(n) for some power of two n,
+ * which we can recover without storing it: 3/2 of the capacity
+ * always lands between n/2 and n.
+ */
+static inline size_t indexSizeOf(size_t capacity) {
+	return (size_t)1 << (32 - __builtin_clz((unsigned int)(capacity * 3 / 2)));
+}
+
+static inline size_t indexWidth(size_t size) {
+	return size <= 128 ? 1 : size <= 32768 ? 2 : 4;
+}
+
+static inline size_t tableBytes(size_t capacity) {
+	size_t size = indexSizeOf(capacity);
+	return sizeof(KrkTableEntry) * capacity + indexWidth(size) * size;
+}
+
+static inline int32_t getIndex(void * indexes, size_t width, size_t slot) {
+	switch (width) {
+		case 1: return ((int8_t*)indexes)[slot];
+		case 2: return ((int16_t*)indexes)[slot];
+		default: return ((int32_t*)indexes)[slot];
+	}
+}
+
+static inline void setIndex(void * indexes, size_t width, size_t slot, int32_t ix) {
+	switch (width) {
+		case 1: ((int8_t*)indexes)[slot] = ix; break;
+		case 2: ((int16_t*)indexes)[slot] = ix; break;
+		default: ((int32_t*)indexes)[slot] = ix; break;
+	}
+}
 
 void krk_initTable(KrkTable * table) {
 	table->count = 0;
 	table->capacity = 0;
+	table->used = 0;
 	table->entries = NULL;
 }
 
 void krk_freeTable(KrkTable * table) {
-	FREE_ARRAY(KrkTableEntry, table->entries, table->capacity);
+	if (table->capacity) krk_reallocate(table->entries, tableBytes(table->capacity), 0);
 	krk_initTable(table);
 }
 
@@ -36,6 +95,10 @@ inline int krk_hashValue(KrkValue value, uint32_t *hashOut) {
 				*hashOut = AS_OBJECT(value)->hash;
 				return 0;
 			}
+			if (AS_OBJECT(value)->type == KRK_OBJ_STRING) {
+				*hashOut = krk_stringHash(AS_STRING(value));
+				return 0;
+			}
 			break;
 		default:
 #ifndef KRK_NO_FLOAT
@@ -63,111 +126,118 @@ _unhashable:
 	return 1;
 }
 
-KrkTableEntry * krk_findEntry(KrkTableEntry * entries, size_t capacity, KrkValue key) {
-	uint32_t index;
-	if (krk_hashValue(key, &index)) {
-		return NULL;
-	}
-	index &= (capacity-1);
-	KrkTableEntry * tombstone = NULL;
+/**
+ * Find the index slot for @p key, which is either the slot that refers to
+ * its entry, or the slot a new entry for it should be placed in.
+ * @p ixOut receives the position of the entry, or INDEX_EMPTY.
+ */
+static inline size_t findSlot(KrkTable * table, KrkValue key, uint32_t hash, int exact, int32_t * ixOut) {
+	void * indexes = TABLE_INDEXES(table);
+	size_t size = indexSizeOf(table->capacity);
+	size_t width = indexWidth(size);
+	size_t slot = hash & (size - 1);
+	size_t freeSlot = SIZE_MAX;
 	for (;;) {
-		KrkTableEntry * entry = &entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
-			return tombstone != NULL ? tombstone : entry;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return tombstone;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (krk_valuesSameOrEqual(entry->key, key)) {
-			return entry;
+		int32_t ix = getIndex(indexes, width, slot);
+		if (ix == INDEX_EMPTY) {
+			*ixOut = INDEX_EMPTY;
+			return freeSlot != SIZE_MAX ? freeSlot : slot;
+		} else if (ix == INDEX_DUMMY) {
+			if (freeSlot == SIZE_MAX) freeSlot = slot;
+		} else if (exact ? krk_valuesSame(table->entries[ix].key, key) : krk_valuesSameOrEqual(table->entries[ix].key, key)) {
+			*ixOut = ix;
+			return slot;
 		}
-		index = (index + 1) & (capacity-1);
+		slot = (slot + 1) & (size - 1);
 	}
 }
 
-KrkTableEntry * krk_findEntryExact(KrkTableEntry * entries, size_t capacity, KrkValue key) {
-	uint32_t index;
-	if (krk_hashValue(key, &index)) {
-		return NULL;
-	}
-	index &= (capacity-1);
-	KrkTableEntry * tombstone = NULL;
-	for (;;) {
-		KrkTableEntry * entry = &entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
-			return tombstone != NULL ? tombstone : entry;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return tombstone;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (krk_valuesSame(entry->key, key)) {
-			return entry;
-		}
-		index = (index + 1) & (capacity-1);
-	}
+KrkTableEntry * krk_findEntry(KrkTable * table, KrkValue key) {
+	uint32_t hash;
+	if (krk_hashValue(key, &hash)) return NULL;
+	if (!table->capacity) return NULL;
+	int32_t ix;
+	findSlot(table, key, hash, 0, &ix);
+	return ix == INDEX_EMPTY ? NULL : &table->entries[ix];
 }
 
-#ifdef __TINYC__
-int __builtin_clz(unsigned int x) {
-	int i = 31;
-	while (!(x & (1 << i)) && i >= 0) i--;
-	return 31-i;
-}
-#endif
-
 void krk_tableAdjustCapacity(KrkTable * table, size_t capacity) {
-	if (capacity) {
-		/* Fast power-of-two calculation */
-		size_t powerOfTwoCapacity = __builtin_clz(1) - __builtin_clz(capacity);
-		if ((1UL << powerOfTwoCapacity) != capacity) powerOfTwoCapacity++;
-		capacity = (1UL << powerOfTwoCapacity);
+	if (capacity < table->count) capacity = table->count;
+	if (!capacity) {
+		krk_freeTable(table);
+		return;
 	}
 
-	KrkTableEntry * entries = ALLOCATE(KrkTableEntry, capacity);
-	for (size_t i = 0; i < capacity; ++i) {
-		entries[i].key = KWARGS_VAL(0);
-		entries[i].value = KWARGS_VAL(0);
-	}
+	size_t size = TABLE_MIN_SIZE;
+	while (TABLE_USABLE(size) < capacity) size <<= 1;
+	capacity = TABLE_USABLE(size);
 
-	table->count = 0;
-	for (size_t i = 0; i < table->capacity; ++i) {
+	KrkTable out;
+	out.capacity = capacity;
+	out.entries = (KrkTableEntry*)krk_reallocate(NULL, 0, tableBytes(capacity));
+	memset(TABLE_INDEXES(&out), 0xFF, indexWidth(size) * size);
+
+	/* Copy the live entries over in order, dropping tombstones. */
+	size_t width = indexWidth(size);
+	void * indexes = TABLE_INDEXES(&out);
+	size_t count = 0;
+	for (size_t i = 0; i < table->used; ++i) {
 		KrkTableEntry * entry = &table->entries[i];
 		if (IS_KWARGS(entry->key)) continue;
-		KrkTableEntry * dest = krk_findEntry(entries, capacity, entry->key);
-		dest->key = entry->key;
-		dest->value = entry->value;
-		table->count++;
+		uint32_t hash = 0;
+		krk_hashValue(entry->key, &hash);
+		size_t slot = hash & (size - 1);
+		while (getIndex(indexes, width, slot) != INDEX_EMPTY) slot = (slot + 1) & (size - 1);
+		setIndex(indexes, width, slot, count);
+		out.entries[count++] = *entry;
+	}
+	for (size_t i = count; i < capacity; ++i) {
+		out.entries[i].key = KWARGS_VAL(0);
+		out.entries[i].value = KWARGS_VAL(0);
 	}
 
-	FREE_ARRAY(KrkTableEntry, table->entries, table->capacity);
-	table->entries = entries;
+	if (table->capacity) krk_reallocate(table->entries, tableBytes(table->capacity), 0);
+	table->entries = out.entries;
 	table->capacity = capacity;
+	table->count = count;
+	table->used = count;
 }
 
 int krk_tableSet(KrkTable * table, KrkValue key, KrkValue value) {
-	if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-		size_t capacity = GROW_CAPACITY(table->capacity);
+	uint32_t hash;
+	if (krk_hashValue(key, &hash)) return 0;
+	if (table->used + 1 > table->capacity) {
+		/* If at least half of the entries are tombstones, compacting is enough. */
+		size_t capacity = !table->capacity ? TABLE_USABLE(TABLE_MIN_SIZE) :
+			table->count < table->capacity / 2 ? table->capacity : table->capacity * 2;
 		krk_tableAdjustCapacity(table, capacity);
 	}
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
-	if (!entry) return 0;
-	int isNewKey = IS_KWARGS(entry->key);
-	if (isNewKey) table->count++;
-	entry->key = key;
-	entry->value = value;
-	return isNewKey;
+	int32_t ix;
+	size_t slot = findSlot(table, key, hash, 0, &ix);
+	if (ix != INDEX_EMPTY) {
+		table->entries[ix].key = key;
+		table->entries[ix].value = value;
+		return 0;
+	}
+	ix = table->used++;
+	setIndex(TABLE_INDEXES(table), indexWidth(indexSizeOf(table->capacity)), slot, ix);
+	table->entries[ix].key = key;
+	table->entries[ix].value = value;
+	table->count++;
+	return 1;
 }
 
 int krk_tableSetIfExists(KrkTable * table, KrkValue key, KrkValue value) {
 	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
-	if (!entry) return 0;
-	if (IS_KWARGS(entry->key)) return 0; /* Not found */
+	KrkTableEntry * entry = krk_findEntry(table, key);
+	if (!entry) return 0; /* Not found */
 	entry->key = key;
 	entry->value = value;
 	return 1;
 }
 
 void krk_tableAddAll(KrkTable * from, KrkTable * to) {
-	for (size_t i = 0; i < from->capacity; ++i) {
+	for (size_t i = 0; i < from->used; ++i) {
 		KrkTableEntry * entry = &from->entries[i];
 		if (!IS_KWARGS(entry->key)) {
 			krk_tableSet(to, entry->key, entry->value);
@@ -177,8 +247,8 @@ void krk_tableAddAll(KrkTable * from, KrkTable * to) {
 
 int krk_tableGet(KrkTable * table, KrkValue key, KrkValue * value) {
 	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
-	if (!entry || IS_KWARGS(entry->key)) {
+	KrkTableEntry * entry = krk_findEntry(table, key);
+	if (!entry) {
 		return 0;
 	} else {
 		*value = entry->value;
@@ -188,64 +258,69 @@ int krk_tableGet(KrkTable * table, KrkValue key, KrkValue * value) {
 
 int krk_tableGet_fast(KrkTable * table, KrkString * str, KrkValue * value) {
 	if (unlikely(table->count == 0)) return 0;
-	uint32_t index = str->obj.hash & (table->capacity-1);
-	KrkTableEntry * tombstone = NULL;
+	void * indexes = TABLE_INDEXES(table);
+	size_t size = indexSizeOf(table->capacity);
+	size_t width = indexWidth(size);
+	size_t slot = krk_stringHash(str) & (size - 1);
 	for (;;) {
-		KrkTableEntry * entry = &table->entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
+		int32_t ix = getIndex(indexes, width, slot);
+		if (ix == INDEX_EMPTY) {
 			return 0;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return 0;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (entry->key == OBJECT_VAL(str)) {
-			*value = entry->value;
-			return 1;
+		} else if (ix != INDEX_DUMMY) {
+			KrkValue key = table->entries[ix].key;
+			/* Interned names match by identity; anything else needs its contents checked. */
+			if (key == OBJECT_VAL(str) ||
+			    (unlikely(IS_STRING(key) && !(AS_OBJECT(key)->flags & str->obj.flags & KRK_OBJ_FLAGS_STRING_INTERNED)) &&
+			     krk_stringsEqual(AS_STRING(key), str))) {
+				*value = table->entries[ix].value;
+				return 1;
+			}
 		}
-		index = (index + 1) & (table->capacity-1);
+		slot = (slot + 1) & (size - 1);
 	}
 }
 
-int krk_tableDelete(KrkTable * table, KrkValue key) {
+static int tableDelete(KrkTable * table, KrkValue key, int exact) {
 	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
-	if (!entry || IS_KWARGS(entry->key)) {
-		return 0;
-	}
+	uint32_t hash;
+	if (krk_hashValue(key, &hash)) return 0;
+	int32_t ix;
+	size_t slot = findSlot(table, key, hash, exact, &ix);
+	if (ix == INDEX_EMPTY) return 0;
+	setIndex(TABLE_INDEXES(table), indexWidth(indexSizeOf(table->capacity)), slot, INDEX_DUMMY);
 	table->count--;
-	entry->key = KWARGS_VAL(1);
-	entry->value = KWARGS_VAL(0);
+	table->entries[ix].key = KWARGS_VAL(1);
+	table->entries[ix].value = KWARGS_VAL(0);
 	return 1;
 }
 
+int krk_tableDelete(KrkTable * table, KrkValue key) {
+	return tableDelete(table, key, 0);
+}
+
 int krk_tableDeleteExact(KrkTable * table, KrkValue key) {
-	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntryExact(table->entries, table->capacity, key);
-	if (!entry || IS_KWARGS(entry->key)) {
-		return 0;
-	}
-	table->count--;
-	entry->key = KWARGS_VAL(1);
-	entry->value = KWARGS_VAL(0);
-	return 1;
+	return tableDelete(table, key, 1);
 }
 
 KrkString * krk_tableFindString(KrkTable * table, const char * chars, size_t length, uint32_t hash) {
 	if (table->count == 0) return NULL;
 
-	uint32_t index = hash & (table->capacity-1);
-	KrkTableEntry * tombstone = NULL;
+	void * indexes = TABLE_INDEXES(table);
+	size_t size = indexSizeOf(table->capacity);
+	size_t width = indexWidth(size);
+	size_t slot = hash & (size - 1);
 	for (;;) {
-		KrkTableEntry * entry = &table->entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
+		int32_t ix = getIndex(indexes, width, slot);
+		if (ix == INDEX_EMPTY) {
 			return NULL;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return NULL;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (AS_STRING(entry->key)->length == length &&
-		           AS_OBJECT(entry->key)->hash == hash &&
-		           memcmp(AS_STRING(entry->key)->chars, chars, length) == 0) {
-			return AS_STRING(entry->key);
+		} else if (ix != INDEX_DUMMY) {
+			KrkValue key = table->entries[ix].key;
+			if (AS_STRING(key)->length == length &&
+			    AS_OBJECT(key)->hash == hash &&
+			    memcmp(AS_STRING(key)->chars, chars, length) == 0) {
+				return AS_STRING(key);
+			}
 		}
-		index = (index + 1) & (table->capacity-1);
+		slot = (slot + 1) & (size - 1);
 	}
 }
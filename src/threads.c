@@ -5,8 +5,12 @@
 #ifndef KRK_DISABLE_THREADS
 #include <kuroko/util.h>
 
+#include "private.h"
+
 #include <unistd.h>
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
 
 #if defined(__linux__)
 # include <sys/syscall.h>
@@ -51,7 +55,7 @@ struct Lock {
 
 KRK_Function(current_thread) {
 	if (&krk_currentThread == vm.threads) return NONE_VAL();
-	return krk_currentThread.stack[0];
+	return krk_currentThread.baseSegment.stack[0];
 }
 
 #define IS_Thread(o)  (krk_isInstanceOf(o, KRK_BASE_CLASS(Thread)))
@@ -59,26 +63,27 @@ KRK_Function(current_thread) {
 #define CURRENT_CTYPE struct Thread *
 #define CURRENT_NAME  self
 
-static volatile int _threadLock = 0;
 static void * _startthread(void * _threadObj) {
 #if defined(__APPLE__) && defined(__aarch64__)
 	krk_forceThreadData();
 #endif
 	memset(&krk_currentThread, 0, sizeof(KrkThreadState));
 	krk_currentThread.frames = calloc(vm.maximumCallDepth,sizeof(KrkCallFrame));
-	vm.globalFlags |= KRK_GLOBAL_THREADS;
-	_obtain_lock(_threadLock);
-	if (vm.threads->next) {
-		krk_currentThread.next = vm.threads->next;
-	}
-	vm.threads->next = &krk_currentThread;
-	_release_lock(_threadLock);
 
 	/* Get our run function */
 	struct Thread * self = _threadObj;
 	self->threadState = &krk_currentThread;
 	self->tid = gettid();
 
+	/*
+	 * Until this thread is on the thread list nothing can mark its stack, but no
+	 * collection can start either, as Thread.start counted us as running. Get the
+	 * thread object onto our own stack before letting collections see us.
+	 */
+	krk_currentThread.noSafepoint = 1;
+	krk_push(OBJECT_VAL(self));
+	krk_gcAttachThread();
+
 	KrkValue runMethod = NONE_VAL();
 	KrkClass * ourType = self->inst._class;
 	if (!krk_tableGet(&ourType->methods, OBJECT_VAL(S("run")), &runMethod)) {
@@ -91,20 +96,15 @@ static void * _startthread(void * _threadObj) {
 
 	self->alive = 0;
 
-	/* Remove this thread from the thread pool, its stack is garbage anyway */
-	_obtain_lock(_threadLock);
+	/* Our stack is garbage now; release it before leaving the thread list. */
 	krk_resetStack();
-	KrkThreadState * previous = vm.threads;
-	while (previous) {
-		if (previous->next == &krk_currentThread) {
-			previous->next = krk_currentThread.next;
-			break;
-		}
-		previous = previous->next;
-	}
-	_release_lock(_threadLock);
-
 	FREE_ARRAY(size_t, krk_currentThread.stack, krk_currentThread.stackSize);
+	krk_currentThread.stack = NULL;
+	krk_currentThread.stackTop = NULL;
+	krk_currentThread.stackSize = 0;
+	krk_releaseThreadSlots();
+	krk_gcDetachThread();
+
 	free(krk_currentThread.frames);
 
 	return NULL;
@@ -121,7 +121,9 @@ KRK_Method(Thread,join) {
 	if (!self->started)
 		return krk_runtimeError(KRK_EXC(ThreadError), "Thread has not been started.");
 
+	krk_beginBlockingCall();
 	pthread_join(self->nativeRef, NULL);
+	krk_endBlockingCall();
 	return NONE_VAL();
 }
 
@@ -133,6 +135,7 @@ KRK_Method(Thread,start) {
 
 	self->started = 1;
 	self->alive   = 1;
+	krk_gcExpectThread();
 	pthread_create(&self->nativeRef, NULL, _startthread, (void*)self);
 
 	return argv[0];
@@ -190,7 +193,11 @@ KRK_Method(Lock,__repr__) {
 
 KRK_Method(Lock,__enter__) {
 	METHOD_TAKES_NONE();
-	pthread_mutex_lock(&self->mutex);
+	if (pthread_mutex_trylock(&self->mutex)) {
+		krk_beginBlockingCall();
+		pthread_mutex_lock(&self->mutex);
+		krk_endBlockingCall();
+	}
 	return NONE_VAL();
 }
 
@@ -199,54 +206,1821 @@ KRK_Method(Lock,__exit__) {
 	return NONE_VAL();
 }
 
-void krk_module_init_threading(void) {
-	/**
-	 * threads = module()
-	 *
-	 * Methods for dealing with threads.
-	 */
-	KrkInstance * threadsModule = krk_newInstance(vm.baseClasses->moduleClass);
+static int _lock_acquire(struct Lock * self, int blocking) {
+	if (!pthread_mutex_trylock(&self->mutex)) return 1;
+	if (!blocking) return 0;
+	krk_beginBlockingCall();
+	pthread_mutex_lock(&self->mutex);
+	krk_endBlockingCall();
+	return 1;
+}
 
-	krk_attachNamedObject(&vm.modules, "threading", (KrkObj*)threadsModule);
-	krk_attachNamedObject(&threadsModule->fields, "__name__", (KrkObj*)S("threading"));
-	krk_attachNamedValue(&threadsModule->fields, "__file__", NONE_VAL());
-	KRK_DOC(threadsModule,
-		"@brief Methods and classes for creating platform threads.");
+KRK_Method(Lock,acquire) {
+	int blocking = 1;
+	if (!krk_parseArgs(".|p", (const char*[]){"blocking"}, &blocking)) return NONE_VAL();
+	return BOOLEAN_VAL(_lock_acquire(self, blocking));
+}
 
-	KRK_DOC(BIND_FUNC(threadsModule, current_thread),
-		"@brief Obtain a reference to the current thread.\n"
-		"@arguments \n\n"
-		"Returns the @ref Thread object associated with the calling thread, if one exists.");
+KRK_Method(Lock,release) {
+	METHOD_TAKES_NONE();
+	pthread_mutex_unlock(&self->mutex);
+	return NONE_VAL();
+}
 
-	KrkClass * ThreadError = krk_makeClass(threadsModule, &KRK_EXC(ThreadError), "ThreadError", vm.exceptions->OSError);
-	KRK_DOC(ThreadError,
-		"Raised in various situations when an action on a thread is invalid."
-	);
-	krk_finalizeClass(ThreadError);
+#undef CURRENT_CTYPE
 
-	KrkClass * Thread = krk_makeClass(threadsModule, &KRK_BASE_CLASS(Thread), "Thread", vm.baseClasses->objectClass);
-	KRK_DOC(Thread,
-		"Base class for building threaded execution contexts.\n\n"
-		"The @ref Thread class should be subclassed and the subclass should implement a @c run method."
-	);
-	Thread->allocSize = sizeof(struct Thread);
-	KRK_DOC(BIND_METHOD(Thread,start), "Start the thread. A thread may only be started once.");
-	KRK_DOC(BIND_METHOD(Thread,join), "Join the thread. Does not return until the thread finishes.");
-	KRK_DOC(BIND_METHOD(Thread,is_alive), "Query the status of the thread.");
-	KRK_DOC(BIND_PROP(Thread,tid), "The platform-specific thread identifier, if available. Usually an integer.");
-	krk_finalizeClass(Thread);
+/**
+ * @brief Condition variable bound to a @ref Lock.
+ * @extends KrkInstance
+ */
+struct Condition {
+	KrkInstance inst;
+	KrkValue lock;
+	pthread_cond_t cond;
+	int initialized;
+};
 
-	KrkClass * Lock = krk_makeClass(threadsModule, &KRK_BASE_CLASS(Lock), "Lock", vm.baseClasses->objectClass);
-	KRK_DOC(Lock,
-		"Represents an atomic mutex.\n\n"
-		"@ref Lock objects allow for exclusive access to a resource and can be used in a @c with block."
-	);
-	Lock->allocSize = sizeof(struct Lock);
-	KRK_DOC(BIND_METHOD(Lock,__init__), "Initialize a system mutex.");
-	KRK_DOC(BIND_METHOD(Lock,__enter__),"Acquire the lock.");
-	KRK_DOC(BIND_METHOD(Lock,__exit__), "Release the lock.");
-	BIND_METHOD(Lock,__repr__);
-	krk_finalizeClass(Lock);
+/**
+ * @brief Counting semaphore.
+ * @extends KrkInstance
+ *
+ * Acquiring and releasing an available count is a single atomic operation;
+ * the mutex and condition are only used when a thread has to sleep.
+ */
+struct Semaphore {
+	KrkInstance inst;
+	long value;
+	int waiters;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int initialized;
+};
+
+struct Event {
+	KrkInstance inst;
+	int flag;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int initialized;
+};
+
+struct QueueCell {
+	size_t sequence;
+	KrkValue value;
+};
+
+/**
+ * @brief Blocking FIFO queue.
+ * @extends KrkInstance
+ *
+ * Bounded queues are a lock-free multi-producer, multi-consumer ring,
+ * where each cell's sequence number says whether it is ready to be written
+ * or read at a given position. The ring has a power of two cells, at least
+ * two and at least @c maxsize, since a single cell can not tell full from
+ * empty; @c reserved counts items put and not yet taken, which is what
+ * keeps the queue within @c maxsize. Unbounded queues are a
+ * growable ring protected by @c mutex. Either way, threads only take the
+ * mutex to sleep, or to wake sleepers counted in @c getters and @c putters.
+ */
+struct Queue {
+	KrkInstance inst;
+	ssize_t maxsize;
+	struct QueueCell * cells;
+	size_t mask;
+	long reserved;
+	size_t enqueuePos;
+	size_t dequeuePos;
+	KrkValue * items;
+	size_t head;
+	size_t count;
+	size_t capacity;
+	long unfinished;
+	int getters;
+	int putters;
+	pthread_mutex_t mutex;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+	pthread_cond_t allDone;
+	int initialized;
+};
+
+struct AtomicInt {
+	KrkInstance inst;
+	int64_t value;
+};
+
+static KrkClass * Condition;
+static KrkClass * Semaphore;
+static KrkClass * Event;
+static KrkClass * Queue;
+static KrkClass * QueueEmpty;
+static KrkClass * QueueFull;
+static KrkClass * AtomicInt;
+
+#define IS_Condition(o) (krk_isInstanceOf(o, Condition))
+#define AS_Condition(o) ((struct Condition *)AS_OBJECT(o))
+#define IS_Semaphore(o) (krk_isInstanceOf(o, Semaphore))
+#define AS_Semaphore(o) ((struct Semaphore *)AS_OBJECT(o))
+#define IS_Event(o) (krk_isInstanceOf(o, Event))
+#define AS_Event(o) ((struct Event *)AS_OBJECT(o))
+#define IS_Queue(o) (krk_isInstanceOf(o, Queue))
+#define AS_Queue(o) ((struct Queue *)AS_OBJECT(o))
+#define IS_AtomicInt(o) (krk_isInstanceOf(o, AtomicInt))
+#define AS_AtomicInt(o) ((struct AtomicInt *)AS_OBJECT(o))
+
+/**
+ * Convert a @c timeout argument to an absolute deadline.
+ * Returns 0 for @c None (wait forever), 1 if @p out was set, -1 on error.
+ */
+static int _timeout_deadline(KrkValue timeout, struct timespec * out) {
+	if (IS_NONE(timeout)) return 0;
+	double seconds;
+	if (IS_INTEGER(timeout)) seconds = AS_INTEGER(timeout);
+#ifndef KRK_NO_FLOAT
+	else if (IS_FLOATING(timeout)) seconds = AS_FLOATING(timeout);
+#endif
+	else {
+		krk_runtimeError(vm.exceptions->typeError, "timeout must be a number, not '%T'", timeout);
+		return -1;
+	}
+	if (seconds < 0) {
+		krk_runtimeError(vm.exceptions->valueError, "timeout must be non-negative");
+		return -1;
+	}
+	clock_gettime(CLOCK_REALTIME, out);
+	time_t whole = (time_t)seconds;
+	out->tv_sec += whole;
+	out->tv_nsec += (long)((seconds - whole) * 1000000000.0);
+	if (out->tv_nsec >= 1000000000) {
+		out->tv_sec++;
+		out->tv_nsec -= 1000000000;
+	}
+	return 1;
+}
+
+/**
+ * Wait on @p cond, until @p deadline if there is one.
+ * Returns 0 once the deadline has passed.
+ */
+static inline int _cond_wait(pthread_cond_t * cond, pthread_mutex_t * mutex, struct timespec * deadline) {
+	if (!deadline) return pthread_cond_wait(cond, mutex), 1;
+	return pthread_cond_timedwait(cond, mutex, deadline) != ETIMEDOUT;
+}
+
+static void _condition_gcscan(KrkInstance * _self) {
+	krk_markValue(((struct Condition*)_self)->lock);
+}
+
+static void _condition_gcsweep(KrkInstance * _self) {
+	struct Condition * self = (struct Condition*)_self;
+	if (self->initialized) pthread_cond_destroy(&self->cond);
+}
+
+static void _semaphore_gcsweep(KrkInstance * _self) {
+	struct Semaphore * self = (struct Semaphore*)_self;
+	if (!self->initialized) return;
+	pthread_mutex_destroy(&self->mutex);
+	pthread_cond_destroy(&self->cond);
+}
+
+static void _event_gcsweep(KrkInstance * _self) {
+	struct Event * self = (struct Event*)_self;
+	if (!self->initialized) return;
+	pthread_mutex_destroy(&self->mutex);
+	pthread_cond_destroy(&self->cond);
+}
+
+#define CURRENT_CTYPE struct Condition *
+
+KRK_Method(Condition,__init__) {
+	KrkValue lock = NONE_VAL();
+	if (!krk_parseArgs(".|V", (const char*[]){"lock"}, &lock)) return NONE_VAL();
+	if (self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), "Condition is already initialized");
+	if (IS_NONE(lock)) {
+		struct Lock * fresh = (struct Lock*)krk_newInstance(KRK_BASE_CLASS(Lock));
+		pthread_mutex_init(&fresh->mutex, NULL);
+		lock = OBJECT_VAL(fresh);
+	} else if (!IS_Lock(lock)) {
+		return TYPE_ERROR(Lock,lock);
+	}
+	krk_writeBarrier((KrkObj*)self);
+	self->lock = lock;
+	pthread_cond_init(&self->cond, NULL);
+	self->initialized = 1;
+	return NONE_VAL();
+}
+
+#define CHECK_INIT(name) do { if (!self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), name " is not initialized"); } while (0)
+
+KRK_Method(Condition,acquire) {
+	int blocking = 1;
+	if (!krk_parseArgs(".|p", (const char*[]){"blocking"}, &blocking)) return NONE_VAL();
+	CHECK_INIT("Condition");
+	return BOOLEAN_VAL(_lock_acquire(AS_Lock(self->lock), blocking));
+}
+
+KRK_Method(Condition,release) {
+	METHOD_TAKES_NONE();
+	CHECK_INIT("Condition");
+	pthread_mutex_unlock(&AS_Lock(self->lock)->mutex);
+	return NONE_VAL();
+}
+
+KRK_Method(Condition,__enter__) {
+	METHOD_TAKES_NONE();
+	CHECK_INIT("Condition");
+	return BOOLEAN_VAL(_lock_acquire(AS_Lock(self->lock), 1));
+}
+
+KRK_Method(Condition,__exit__) {
+	CHECK_INIT("Condition");
+	pthread_mutex_unlock(&AS_Lock(self->lock)->mutex);
+	return NONE_VAL();
+}
+
+KRK_Method(Condition,wait) {
+	KrkValue timeout = NONE_VAL();
+	if (!krk_parseArgs(".|V", (const char*[]){"timeout"}, &timeout)) return NONE_VAL();
+	CHECK_INIT("Condition");
+	struct timespec deadline;
+	int timed = _timeout_deadline(timeout, &deadline);
+	if (timed < 0) return NONE_VAL();
+	krk_beginBlockingCall();
+	int notified = _cond_wait(&self->cond, &AS_Lock(self->lock)->mutex, timed ? &deadline : NULL);
+	krk_endBlockingCall();
+	return BOOLEAN_VAL(notified);
+}
+
+KRK_Method(Condition,wait_for) {
+	KrkValue predicate;
+	KrkValue timeout = NONE_VAL();
+	if (!krk_parseArgs(".V|V", (const char*[]){"predicate","timeout"}, &predicate, &timeout)) return NONE_VAL();
+	CHECK_INIT("Condition");
+	struct timespec deadline;
+	int timed = _timeout_deadline(timeout, &deadline);
+	if (timed < 0) return NONE_VAL();
+	for (;;) {
+		krk_push(predicate);
+		KrkValue result = krk_callStack(0);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+		if (!krk_isFalsey(result)) return result;
+		krk_beginBlockingCall();
+		int notified = _cond_wait(&self->cond, &AS_Lock(self->lock)->mutex, timed ? &deadline : NULL);
+		krk_endBlockingCall();
+		if (!notified) {
+			krk_push(predicate);
+			return krk_callStack(0);
+		}
+	}
+}
+
+KRK_Method(Condition,notify) {
+	ssize_t n = 1;
+	if (!krk_parseArgs(".|n", (const char*[]){"n"}, &n)) return NONE_VAL();
+	CHECK_INIT("Condition");
+	for (ssize_t i = 0; i < n; ++i) pthread_cond_signal(&self->cond);
+	return NONE_VAL();
+}
+
+KRK_Method(Condition,notify_all) {
+	METHOD_TAKES_NONE();
+	CHECK_INIT("Condition");
+	pthread_cond_broadcast(&self->cond);
+	return NONE_VAL();
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct Semaphore *
+
+KRK_Method(Semaphore,__init__) {
+	ssize_t value = 1;
+	if (!krk_parseArgs(".|n", (const char*[]){"value"}, &value)) return NONE_VAL();
+	if (self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), "Semaphore is already initialized");
+	if (value < 0) return krk_runtimeError(vm.exceptions->valueError, "semaphore initial value must be >= 0");
+	self->value = value;
+	pthread_mutex_init(&self->mutex, NULL);
+	pthread_cond_init(&self->cond, NULL);
+	self->initialized = 1;
+	return NONE_VAL();
+}
+
+static int _semaphore_try(struct Semaphore * self) {
+	long value = __atomic_load_n(&self->value, __ATOMIC_SEQ_CST);
+	while (value > 0) {
+		if (__atomic_compare_exchange_n(&self->value, &value, value - 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) return 1;
+	}
+	return 0;
+}
+
+KRK_Method(Semaphore,acquire) {
+	int blocking = 1;
+	KrkValue timeout = NONE_VAL();
+	if (!krk_parseArgs(".|pV", (const char*[]){"blocking","timeout"}, &blocking, &timeout)) return NONE_VAL();
+	CHECK_INIT("Semaphore");
+	if (_semaphore_try(self)) return BOOLEAN_VAL(1);
+	if (!blocking) return BOOLEAN_VAL(0);
+	struct timespec deadline;
+	int timed = _timeout_deadline(timeout, &deadline);
+	if (timed < 0) return NONE_VAL();
+
+	int acquired = 0;
+	krk_beginBlockingCall();
+	pthread_mutex_lock(&self->mutex);
+	__atomic_add_fetch(&self->waiters, 1, __ATOMIC_SEQ_CST);
+	while (!(acquired = _semaphore_try(self))) {
+		if (!_cond_wait(&self->cond, &self->mutex, timed ? &deadline : NULL)) {
+			acquired = _semaphore_try(self);
+			break;
+		}
+	}
+	__atomic_sub_fetch(&self->waiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&self->mutex);
+	krk_endBlockingCall();
+	return BOOLEAN_VAL(acquired);
+}
+
+KRK_Method(Semaphore,release) {
+	ssize_t n = 1;
+	if (!krk_parseArgs(".|n", (const char*[]){"n"}, &n)) return NONE_VAL();
+	CHECK_INIT("Semaphore");
+	if (n < 1) return krk_runtimeError(vm.exceptions->valueError, "n must be one or more");
+	__atomic_add_fetch(&self->value, n, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&self->waiters, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&self->mutex);
+		if (n == 1) pthread_cond_signal(&self->cond);
+		else pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mutex);
+	}
+	return NONE_VAL();
+}
+
+KRK_Method(Semaphore,__enter__) {
+	METHOD_TAKES_NONE();
+	return FUNC_NAME(Semaphore,acquire)(1, argv, 0);
+}
+
+KRK_Method(Semaphore,__exit__) {
+	return FUNC_NAME(Semaphore,release)(1, argv, 0);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct Event *
+
+KRK_Method(Event,__init__) {
+	METHOD_TAKES_NONE();
+	if (self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), "Event is already initialized");
+	pthread_mutex_init(&self->mutex, NULL);
+	pthread_cond_init(&self->cond, NULL);
+	self->initialized = 1;
+	return NONE_VAL();
+}
+
+KRK_Method(Event,is_set) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(__atomic_load_n(&self->flag, __ATOMIC_ACQUIRE));
+}
+
+KRK_Method(Event,set) {
+	METHOD_TAKES_NONE();
+	CHECK_INIT("Event");
+	pthread_mutex_lock(&self->mutex);
+	__atomic_store_n(&self->flag, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&self->cond);
+	pthread_mutex_unlock(&self->mutex);
+	return NONE_VAL();
+}
+
+KRK_Method(Event,clear) {
+	METHOD_TAKES_NONE();
+	CHECK_INIT("Event");
+	pthread_mutex_lock(&self->mutex);
+	__atomic_store_n(&self->flag, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&self->mutex);
+	return NONE_VAL();
+}
+
+KRK_Method(Event,wait) {
+	KrkValue timeout = NONE_VAL();
+	if (!krk_parseArgs(".|V", (const char*[]){"timeout"}, &timeout)) return NONE_VAL();
+	CHECK_INIT("Event");
+	if (__atomic_load_n(&self->flag, __ATOMIC_ACQUIRE)) return BOOLEAN_VAL(1);
+	struct timespec deadline;
+	int timed = _timeout_deadline(timeout, &deadline);
+	if (timed < 0) return NONE_VAL();
+	krk_beginBlockingCall();
+	pthread_mutex_lock(&self->mutex);
+	while (!self->flag && _cond_wait(&self->cond, &self->mutex, timed ? &deadline : NULL));
+	int flag = self->flag;
+	pthread_mutex_unlock(&self->mutex);
+	krk_endBlockingCall();
+	return BOOLEAN_VAL(flag);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct Queue *
+
+static void _queue_gcscan(KrkInstance * _self) {
+	struct Queue * self = (struct Queue*)_self;
+	if (self->cells) {
+		for (size_t pos = self->dequeuePos; pos != self->enqueuePos; ++pos) {
+			krk_markValue(self->cells[pos & self->mask].value);
+		}
+	} else {
+		for (size_t i = 0; i < self->count; ++i) {
+			krk_markValue(self->items[(self->head + i) & (self->capacity - 1)]);
+		}
+	}
+}
+
+static void _queue_gcsweep(KrkInstance * _self) {
+	struct Queue * self = (struct Queue*)_self;
+	if (!self->initialized) return;
+	free(self->cells);
+	free(self->items);
+	pthread_mutex_destroy(&self->mutex);
+	pthread_cond_destroy(&self->notEmpty);
+	pthread_cond_destroy(&self->notFull);
+	pthread_cond_destroy(&self->allDone);
+}
+
+KRK_Method(Queue,__init__) {
+	ssize_t maxsize = 0;
+	if (!krk_parseArgs(".|n", (const char*[]){"maxsize"}, &maxsize)) return NONE_VAL();
+	if (self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), "Queue is already initialized");
+	if (maxsize > 0) {
+		size_t cellCount = 2;
+		while (cellCount < (size_t)maxsize) cellCount <<= 1;
+		self->maxsize = maxsize;
+		self->mask = cellCount - 1;
+		self->cells = malloc(sizeof(struct QueueCell) * cellCount);
+		for (size_t i = 0; i < cellCount; ++i) {
+			self->cells[i].sequence = i;
+			self->cells[i].value = NONE_VAL();
+		}
+	}
+	pthread_mutex_init(&self->mutex, NULL);
+	pthread_cond_init(&self->notEmpty, NULL);
+	pthread_cond_init(&self->notFull, NULL);
+	pthread_cond_init(&self->allDone, NULL);
+	self->initialized = 1;
+	return NONE_VAL();
+}
+
+static size_t _queue_size(struct Queue * self) {
+	if (self->cells) {
+		size_t dequeuePos = __atomic_load_n(&self->dequeuePos, __ATOMIC_SEQ_CST);
+		size_t enqueuePos = __atomic_load_n(&self->enqueuePos, __ATOMIC_SEQ_CST);
+		return enqueuePos - dequeuePos;
+	}
+	return __atomic_load_n(&self->count, __ATOMIC_SEQ_CST);
+}
+
+static int _queue_full(struct Queue * self) {
+	return self->cells && __atomic_load_n(&self->reserved, __ATOMIC_SEQ_CST) >= self->maxsize;
+}
+
+/* Returns 0 if a bounded queue is full. Never holds the mutex across an allocation. */
+static int _queue_try_put(struct Queue * self, KrkValue value) {
+	krk_writeBarrier((KrkObj*)self);
+	if (self->cells) {
+		/* Claim room first; the ring itself always has space for every claim. */
+		if (__atomic_add_fetch(&self->reserved, 1, __ATOMIC_SEQ_CST) > self->maxsize) {
+			__atomic_sub_fetch(&self->reserved, 1, __ATOMIC_SEQ_CST);
+			return 0;
+		}
+		size_t pos = __atomic_load_n(&self->enqueuePos, __ATOMIC_RELAXED);
+		struct QueueCell * cell;
+		for (;;) {
+			cell = &self->cells[pos & self->mask];
+			size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+			intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+			if (diff == 0) {
+				if (__atomic_compare_exchange_n(&self->enqueuePos, &pos, pos + 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) break;
+			} else if (diff < 0) {
+				/* A getter has taken this cell's item but not yet released the cell. */
+				pos = __atomic_load_n(&self->enqueuePos, __ATOMIC_RELAXED);
+			} else {
+				pos = __atomic_load_n(&self->enqueuePos, __ATOMIC_RELAXED);
+			}
+		}
+		cell->value = value;
+		__atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+		return 1;
+	}
+
+	pthread_mutex_lock(&self->mutex);
+	if (self->count == self->capacity) {
+		size_t capacity = self->capacity ? self->capacity * 2 : 16;
+		KrkValue * items = malloc(sizeof(KrkValue) * capacity);
+		for (size_t i = 0; i < self->count; ++i) {
+			items[i] = self->items[(self->head + i) & (self->capacity - 1)];
+		}
+		free(self->items);
+		self->items = items;
+		self->head = 0;
+		self->capacity = capacity;
+	}
+	self->items[(self->head + self->count) & (self->capacity - 1)] = value;
+	__atomic_add_fetch(&self->count, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&self->mutex);
+	return 1;
+}
+
+/* Returns 0 if the queue is empty. The result is stored directly into @p out. */
+static int _queue_try_get(struct Queue * self, KrkValue * out) {
+	if (self->cells) {
+		size_t pos = __atomic_load_n(&self->dequeuePos, __ATOMIC_RELAXED);
+		struct QueueCell * cell;
+		for (;;) {
+			cell = &self->cells[pos & self->mask];
+			size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+			intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (__atomic_compare_exchange_n(&self->dequeuePos, &pos, pos + 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) break;
+			} else if (diff < 0) {
+				return 0;
+			} else {
+				pos = __atomic_load_n(&self->dequeuePos, __ATOMIC_RELAXED);
+			}
+		}
+		*out = cell->value;
+		__atomic_store_n(&cell->sequence, pos + self->mask + 1, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&self->reserved, 1, __ATOMIC_SEQ_CST);
+		return 1;
+	}
+
+	if (!__atomic_load_n(&self->count, __ATOMIC_SEQ_CST)) return 0;
+	int found = 0;
+	pthread_mutex_lock(&self->mutex);
+	if (self->count) {
+		*out = self->items[self->head];
+		self->head = (self->head + 1) & (self->capacity - 1);
+		__atomic_sub_fetch(&self->count, 1, __ATOMIC_SEQ_CST);
+		found = 1;
+	}
+	pthread_mutex_unlock(&self->mutex);
+	return found;
+}
+
+static void _queue_wake(struct Queue * self, int * waiters, pthread_cond_t * cond) {
+	if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&self->mutex);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(&self->mutex);
+	}
+}
+
+KRK_Method(Queue,put) {
+	KrkValue item;
+	int block = 1;
+	KrkValue timeout = NONE_VAL();
+	if (!krk_parseArgs(".V|pV", (const char*[]){"item","block","timeout"}, &item, &block, &timeout)) return NONE_VAL();
+	CHECK_INIT("Queue");
+	struct timespec deadline;
+	int timed = 0;
+	if (block && (timed = _timeout_deadline(timeout, &deadline)) < 0) return NONE_VAL();
+
+	__atomic_add_fetch(&self->unfinished, 1, __ATOMIC_SEQ_CST);
+	while (!_queue_try_put(self, item)) {
+		int expired = !block;
+		if (block) {
+			krk_beginBlockingCall();
+			pthread_mutex_lock(&self->mutex);
+			__atomic_add_fetch(&self->putters, 1, __ATOMIC_SEQ_CST);
+			while (_queue_full(self) && !expired) {
+				expired = !_cond_wait(&self->notFull, &self->mutex, timed ? &deadline : NULL);
+			}
+			__atomic_sub_fetch(&self->putters, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&self->mutex);
+			krk_endBlockingCall();
+			if (expired && !_queue_full(self)) expired = 0;
+		}
+		if (expired) {
+			__atomic_sub_fetch(&self->unfinished, 1, __ATOMIC_SEQ_CST);
+			return krk_runtimeError(QueueFull, "queue is full");
+		}
+	}
+	_queue_wake(self, &self->getters, &self->notEmpty);
+	return NONE_VAL();
+}
+
+KRK_Method(Queue,get) {
+	int block = 1;
+	KrkValue timeout = NONE_VAL();
+	if (!krk_parseArgs(".|pV", (const char*[]){"block","timeout"}, &block, &timeout)) return NONE_VAL();
+	CHECK_INIT("Queue");
+	struct timespec deadline;
+	int timed = 0;
+	if (block && (timed = _timeout_deadline(timeout, &deadline)) < 0) return NONE_VAL();
+
+	KrkValue out;
+	while (!_queue_try_get(self, &out)) {
+		int expired = !block;
+		if (block) {
+			krk_beginBlockingCall();
+			pthread_mutex_lock(&self->mutex);
+			__atomic_add_fetch(&self->getters, 1, __ATOMIC_SEQ_CST);
+			while (!_queue_size(self) && !expired) {
+				expired = !_cond_wait(&self->notEmpty, &self->mutex, timed ? &deadline : NULL);
+			}
+			__atomic_sub_fetch(&self->getters, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&self->mutex);
+			krk_endBlockingCall();
+			if (expired && _queue_size(self)) expired = 0;
+		}
+		if (expired) return krk_runtimeError(QueueEmpty, "queue is empty");
+	}
+	_queue_wake(self, &self->putters, &self->notFull);
+	return out;
+}
+
+KRK_Method(Queue,put_nowait) {
+	KrkValue item;
+	if (!krk_parseArgs(".V", (const char*[]){"item"}, &item)) return NONE_VAL();
+	return FUNC_NAME(Queue,put)(4, (KrkValue[]){argv[0], item, BOOLEAN_VAL(0), NONE_VAL()}, 0);
+}
+
+KRK_Method(Queue,get_nowait) {
+	METHOD_TAKES_NONE();
+	return FUNC_NAME(Queue,get)(2, (KrkValue[]){argv[0], BOOLEAN_VAL(0)}, 0);
+}
+
+KRK_Method(Queue,qsize) {
+	METHOD_TAKES_NONE();
+	return INTEGER_VAL(_queue_size(self));
+}
+
+KRK_Method(Queue,empty) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(_queue_size(self) == 0);
+}
+
+KRK_Method(Queue,full) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(_queue_full(self));
+}
+
+KRK_Method(Queue,maxsize) {
+	METHOD_TAKES_NONE();
+	return INTEGER_VAL(self->maxsize);
+}
+
+KRK_Method(Queue,task_done) {
+	METHOD_TAKES_NONE();
+	CHECK_INIT("Queue");
+	long unfinished = __atomic_load_n(&self->unfinished, __ATOMIC_SEQ_CST);
+	do {
+		if (unfinished <= 0) return krk_runtimeError(vm.exceptions->valueError, "task_done() called too many times");
+	} while (!__atomic_compare_exchange_n(&self->unfinished, &unfinished, unfinished - 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+	if (unfinished == 1) {
+		pthread_mutex_lock(&self->mutex);
+		pthread_cond_broadcast(&self->allDone);
+		pthread_mutex_unlock(&self->mutex);
+	}
+	return NONE_VAL();
+}
+
+KRK_Method(Queue,join) {
+	METHOD_TAKES_NONE();
+	CHECK_INIT("Queue");
+	if (!__atomic_load_n(&self->unfinished, __ATOMIC_SEQ_CST)) return NONE_VAL();
+	krk_beginBlockingCall();
+	pthread_mutex_lock(&self->mutex);
+	while (__atomic_load_n(&self->unfinished, __ATOMIC_SEQ_CST)) pthread_cond_wait(&self->allDone, &self->mutex);
+	pthread_mutex_unlock(&self->mutex);
+	krk_endBlockingCall();
+	return NONE_VAL();
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct AtomicInt *
+
+extern KrkValue krk_int_op_add(krk_integer_type a, krk_integer_type b);
+#define ATOMIC_RESULT(v) krk_int_op_add((v), 0)
+
+KRK_Method(AtomicInt,__init__) {
+	long long value = 0;
+	if (!krk_parseArgs(".|L", (const char*[]){"value"}, &value)) return NONE_VAL();
+	__atomic_store_n(&self->value, value, __ATOMIC_SEQ_CST);
+	return NONE_VAL();
+}
+
+KRK_Method(AtomicInt,load) {
+	METHOD_TAKES_NONE();
+	return ATOMIC_RESULT(__atomic_load_n(&self->value, __ATOMIC_SEQ_CST));
+}
+
+KRK_Method(AtomicInt,store) {
+	long long value;
+	if (!krk_parseArgs(".L", (const char*[]){"value"}, &value)) return NONE_VAL();
+	__atomic_store_n(&self->value, value, __ATOMIC_SEQ_CST);
+	return NONE_VAL();
+}
+
+KRK_Method(AtomicInt,exchange) {
+	long long value;
+	if (!krk_parseArgs(".L", (const char*[]){"value"}, &value)) return NONE_VAL();
+	return ATOMIC_RESULT(__atomic_exchange_n(&self->value, value, __ATOMIC_SEQ_CST));
+}
+
+KRK_Method(AtomicInt,fetch_add) {
+	long long n = 1;
+	if (!krk_parseArgs(".|L", (const char*[]){"n"}, &n)) return NONE_VAL();
+	return ATOMIC_RESULT(__atomic_fetch_add(&self->value, n, __ATOMIC_SEQ_CST));
+}
+
+KRK_Method(AtomicInt,fetch_sub) {
+	long long n = 1;
+	if (!krk_parseArgs(".|L", (const char*[]){"n"}, &n)) return NONE_VAL();
+	return ATOMIC_RESULT(__atomic_fetch_sub(&self->value, n, __ATOMIC_SEQ_CST));
+}
+
+KRK_Method(AtomicInt,compare_exchange) {
+	long long expected, desired;
+	if (!krk_parseArgs(".LL", (const char*[]){"expected","desired"}, &expected, &desired)) return NONE_VAL();
+	int64_t actual = expected;
+	int swapped = __atomic_compare_exchange_n(&self->value, &actual, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return BOOLEAN_VAL(swapped);
+}
+
+KRK_Method(AtomicInt,__repr__) {
+	METHOD_TAKES_NONE();
+	return krk_stringFromFormat("AtomicInt(%Ld)", (long long)__atomic_load_n(&self->value, __ATOMIC_SEQ_CST));
+}
+
+#undef CURRENT_CTYPE
+
+/**
+ * @brief A unit of work submitted to a @ref ThreadPoolExecutor.
+ * @extends KrkInstance
+ *
+ * Holds the callable and its arguments until a worker runs it, and
+ * then the return value or the exception it raised. For @c map chunks,
+ * @c args is a tuple of argument tuples and the result is a list.
+ */
+struct PoolFuture {
+	KrkInstance inst;
+	KrkValue pool;
+	KrkValue fn;
+	KrkValue args;
+	KrkValue kwargs;
+	KrkValue value;
+	KrkValue callbacks; /* (callback, next) chain, newest first */
+	int state;
+	int chunk;
+};
+
+enum {
+	POOL_PENDING,
+	POOL_RUNNING,
+	POOL_CANCELLED,
+	POOL_FINISHED,
+	POOL_FAILED,
+};
+
+/**
+ * @brief Double-ended work queue.
+ *
+ * Each worker pushes and pops at the bottom of its own deque; other workers
+ * steal from the top, so a worker keeps running the work it spawned itself
+ * while idle workers drain the oldest entries. Each deque has its own spin
+ * lock, which is only ever held for a handful of instructions.
+ */
+struct WorkQueue {
+	int lock;
+	KrkValue * items;
+	size_t head;
+	size_t count;
+	size_t capacity;
+};
+
+struct Worker {
+	struct Pool * pool;
+	pthread_t nativeRef;
+	struct WorkQueue queue;
+	unsigned int seed;
+};
+
+/**
+ * @brief Native thread pool.
+ * @extends KrkInstance
+ *
+ * Workers are started on the first submission and keep their thread state
+ * until the pool is shut down. Work submitted from outside the pool goes to
+ * the shared @c inject queue and is taken in order; work submitted by a
+ * worker goes to its own deque. @c pending counts queued work items and is
+ * what sleeping workers wait on; @c sleeping and @c waiting let submitters
+ * and finishing workers skip the pool mutex when nobody needs waking.
+ */
+struct Pool {
+	KrkInstance inst;
+	struct Worker * workers;
+	size_t workerCount;
+	struct WorkQueue inject;
+	pthread_mutex_t mutex;
+	pthread_cond_t workCond;
+	pthread_cond_t doneCond;
+	long pending;
+	int sleeping;
+	int waiting;
+	int alive;
+	unsigned int initialized:1;
+	unsigned int started:1;
+	unsigned int shutdown:1;
+	unsigned int joined:1;
+	struct Pool * nextStarted;
+};
+
+struct PoolMapIterator {
+	KrkInstance inst;
+	KrkValue futures;
+	KrkValue chunk;
+	size_t index;
+	size_t offset;
+};
+
+static KrkClass * ThreadPoolExecutor;
+static KrkClass * PoolFuture;
+static KrkClass * PoolMapIterator;
+
+/* The worker running on this thread, if it belongs to a pool. */
+static threadLocal struct Worker * _currentWorker = NULL;
+
+/*
+ * Pools whose workers have been started, so their threads can be joined
+ * before the VM is torn down. Entries leave the list when the pool is swept.
+ */
+static struct Pool * _startedPools = NULL;
+static pthread_mutex_t _startedPoolsLock = PTHREAD_MUTEX_INITIALIZER;
+
+#define IS_ThreadPoolExecutor(o) (krk_isInstanceOf(o, ThreadPoolExecutor))
+#define AS_ThreadPoolExecutor(o) ((struct Pool *)AS_OBJECT(o))
+#define IS_PoolFuture(o) (krk_isInstanceOf(o, PoolFuture))
+#define AS_PoolFuture(o) ((struct PoolFuture *)AS_OBJECT(o))
+#define IS_PoolMapIterator(o) (krk_isInstanceOf(o, PoolMapIterator))
+#define AS_PoolMapIterator(o) ((struct PoolMapIterator *)AS_OBJECT(o))
+
+static void _queue_push(struct WorkQueue * queue, KrkValue item) {
+	_obtain_lock(queue->lock);
+	if (queue->count == queue->capacity) {
+		size_t capacity = queue->capacity ? queue->capacity * 2 : 16;
+		KrkValue * items = malloc(sizeof(KrkValue) * capacity);
+		for (size_t i = 0; i < queue->count; ++i) {
+			items[i] = queue->items[(queue->head + i) & (queue->capacity - 1)];
+		}
+		free(queue->items);
+		queue->items = items;
+		queue->head = 0;
+		queue->capacity = capacity;
+	}
+	queue->items[(queue->head + queue->count) & (queue->capacity - 1)] = item;
+	queue->count++;
+	_release_lock(queue->lock);
+}
+
+static int _queue_pop(struct WorkQueue * queue, KrkValue * out) {
+	if (!__atomic_load_n(&queue->count, __ATOMIC_RELAXED)) return 0;
+	_obtain_lock(queue->lock);
+	int found = 0;
+	if (queue->count) {
+		queue->count--;
+		*out = queue->items[(queue->head + queue->count) & (queue->capacity - 1)];
+		found = 1;
+	}
+	_release_lock(queue->lock);
+	return found;
+}
+
+static int _queue_steal(struct WorkQueue * queue, KrkValue * out) {
+	if (!__atomic_load_n(&queue->count, __ATOMIC_RELAXED)) return 0;
+	_obtain_lock(queue->lock);
+	int found = 0;
+	if (queue->count) {
+		*out = queue->items[queue->head];
+		queue->head = (queue->head + 1) & (queue->capacity - 1);
+		queue->count--;
+		found = 1;
+	}
+	_release_lock(queue->lock);
+	return found;
+}
+
+static void _queue_mark(struct WorkQueue * queue) {
+	for (size_t i = 0; i < queue->count; ++i) {
+		krk_markValue(queue->items[(queue->head + i) & (queue->capacity - 1)]);
+	}
+}
+
+static void _pool_gcscan(KrkInstance * _self) {
+	struct Pool * self = (struct Pool*)_self;
+	_queue_mark(&self->inject);
+	for (size_t i = 0; i < self->workerCount; ++i) _queue_mark(&self->workers[i].queue);
+}
+
+static void _pool_gcsweep(KrkInstance * _self) {
+	struct Pool * self = (struct Pool*)_self;
+	if (!self->initialized) return;
+	if (self->started) {
+		pthread_mutex_lock(&_startedPoolsLock);
+		for (struct Pool ** p = &_startedPools; *p; p = &(*p)->nextStarted) {
+			if (*p == self) {
+				*p = self->nextStarted;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&_startedPoolsLock);
+	}
+	if (__atomic_load_n(&self->alive, __ATOMIC_ACQUIRE)) {
+		/*
+		 * Live workers keep their pool on their stacks, and krk_joinThreadPools
+		 * waits for them before the VM is torn down, so this should not happen.
+		 * Drop queued work and wait for the workers to leave anyway.
+		 */
+		pthread_mutex_lock(&self->mutex);
+		self->shutdown = 1;
+		for (size_t i = 0; i <= self->workerCount; ++i) {
+			struct WorkQueue * queue = i < self->workerCount ? &self->workers[i].queue : &self->inject;
+			_obtain_lock(queue->lock);
+			queue->count = 0;
+			_release_lock(queue->lock);
+		}
+		__atomic_store_n(&self->pending, 0, __ATOMIC_SEQ_CST);
+		pthread_cond_broadcast(&self->workCond);
+		pthread_mutex_unlock(&self->mutex);
+	}
+	if (self->started && !self->joined) {
+		/* Workers that already left still have to be reaped. */
+		for (size_t i = 0; i < self->workerCount; ++i) pthread_join(self->workers[i].nativeRef, NULL);
+		self->joined = 1;
+	}
+	for (size_t i = 0; i < self->workerCount; ++i) free(self->workers[i].queue.items);
+	free(self->inject.items);
+	free(self->workers);
+	self->workers = NULL;
+	self->workerCount = 0;
+	pthread_mutex_destroy(&self->mutex);
+	pthread_cond_destroy(&self->workCond);
+	pthread_cond_destroy(&self->doneCond);
+}
+
+static void _pool_future_gcscan(KrkInstance * _self) {
+	struct PoolFuture * self = (struct PoolFuture*)_self;
+	krk_markValue(self->pool);
+	krk_markValue(self->fn);
+	krk_markValue(self->args);
+	krk_markValue(self->kwargs);
+	krk_markValue(self->value);
+	krk_markValue(self->callbacks);
+}
+
+static void _pool_map_gcscan(KrkInstance * _self) {
+	struct PoolMapIterator * self = (struct PoolMapIterator*)_self;
+	krk_markValue(self->futures);
+	krk_markValue(self->chunk);
+}
+
+static inline int _future_done(struct PoolFuture * self) {
+	return __atomic_load_n(&self->state, __ATOMIC_ACQUIRE) >= POOL_CANCELLED;
+}
+
+/**
+ * Try to take one work item: from our own deque first, then from outside
+ * submissions, then from the other workers. The item is written straight
+ * into a stack slot so it is never held only in a C local.
+ */
+static int _pool_take(struct Pool * pool, struct Worker * worker, KrkValue * slot) {
+	if (worker && _queue_pop(&worker->queue, slot)) goto _found;
+	if (_queue_steal(&pool->inject, slot)) goto _found;
+	size_t start = worker ? (size_t)rand_r(&worker->seed) : 0;
+	for (size_t i = 0; i < pool->workerCount; ++i) {
+		struct Worker * victim = &pool->workers[(start + i) % pool->workerCount];
+		if (victim == worker) continue;
+		if (_queue_steal(&victim->queue, slot)) goto _found;
+	}
+	return 0;
+_found:
+	__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+static void _pool_finish(struct PoolFuture * self, KrkValue value, int state) {
+	struct Pool * pool = AS_ThreadPoolExecutor(self->pool);
+	krk_writeBarrier((KrkObj*)self);
+	self->value = value;
+	self->fn = NONE_VAL();
+	self->args = NONE_VAL();
+	self->kwargs = NONE_VAL();
+
+	pthread_mutex_lock(&pool->mutex);
+	__atomic_store_n(&self->state, state, __ATOMIC_SEQ_CST);
+	KrkValue callbacks = self->callbacks;
+	self->callbacks = NONE_VAL();
+	if (pool->waiting) pthread_cond_broadcast(&pool->doneCond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (IS_NONE(callbacks)) return;
+
+	/* Callbacks were chained newest first; reverse the chain in place. */
+	krk_push(callbacks);
+	KrkValue prev = NONE_VAL();
+	while (!IS_NONE(callbacks)) {
+		KrkTuple * link = AS_TUPLE(callbacks);
+		KrkValue next = link->values.values[1];
+		link->values.values[1] = prev;
+		prev = callbacks;
+		callbacks = next;
+	}
+	krk_currentThread.stackTop[-1] = prev;
+
+	size_t base = krk_currentThread.stackTop - krk_currentThread.stack;
+	while (!IS_NONE(prev)) {
+		KrkTuple * link = AS_TUPLE(prev);
+		krk_push(link->values.values[0]);
+		krk_push(OBJECT_VAL(self));
+		krk_callStack(1);
+		krk_currentThread.stackTop = krk_currentThread.stack + base;
+		/* Like an exception in a thread's run(), a failing callback only affects itself. */
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		prev = link->values.values[1];
+	}
+	krk_pop();
+}
+
+static KrkValue _pool_call(KrkValue fn, KrkValue args, KrkValue kwargs) {
+	/*
+	 * A worker has no call frames of its own, and returning from the outermost
+	 * frame does not restore the stack, so put it back ourselves.
+	 */
+	size_t base = krk_currentThread.stackTop - krk_currentThread.stack;
+	KrkTuple * tuple = AS_TUPLE(args);
+	krk_push(fn);
+	for (size_t i = 0; i < tuple->values.count; ++i) krk_push(tuple->values.values[i]);
+	int argCount = tuple->values.count;
+	if (!IS_NONE(kwargs)) {
+		krk_push(KWARGS_VAL(KWARGS_DICT));
+		krk_push(kwargs);
+		krk_push(KWARGS_VAL(1));
+		argCount += 3;
+	}
+	KrkValue result = krk_callStack(argCount);
+	krk_currentThread.stackTop = krk_currentThread.stack + base;
+	return result;
+}
+
+/**
+ * Run the work item in the top stack slot, unless it was cancelled while queued.
+ */
+static void _pool_run(void) {
+	struct PoolFuture * self = AS_PoolFuture(krk_peek(0));
+	int expected = POOL_PENDING;
+	if (!__atomic_compare_exchange_n(&self->state, &expected, POOL_RUNNING, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) return;
+
+	KrkValue result;
+	if (self->chunk) {
+		KrkTuple * chunk = AS_TUPLE(self->args);
+		KrkValue list = krk_list_of(0,NULL,0);
+		krk_push(list);
+		for (size_t i = 0; i < chunk->values.count; ++i) {
+			KrkValue value = _pool_call(self->fn, chunk->values.values[i], NONE_VAL());
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) break;
+			krk_push(value);
+			krk_writeValueArray(AS_LIST(list), value);
+			krk_pop();
+		}
+		result = krk_pop();
+	} else {
+		result = _pool_call(self->fn, self->args, self->kwargs);
+	}
+
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		_pool_finish(self, krk_currentThread.currentException, POOL_FAILED);
+	} else {
+		_pool_finish(self, result, POOL_FINISHED);
+	}
+}
+
+static void * _poolworker(void * _worker) {
+#if defined(__APPLE__) && defined(__aarch64__)
+	krk_forceThreadData();
+#endif
+	memset(&krk_currentThread, 0, sizeof(KrkThreadState));
+	krk_currentThread.frames = calloc(vm.maximumCallDepth,sizeof(KrkCallFrame));
+
+	struct Worker * worker = _worker;
+	struct Pool * pool = worker->pool;
+	_currentWorker = worker;
+
+	/* As in _startthread; there is no Thread object, so current_thread() sees None. */
+	krk_currentThread.noSafepoint = 1;
+	krk_push(NONE_VAL());
+	krk_push(OBJECT_VAL(pool));
+	krk_gcAttachThread();
+
+	krk_push(NONE_VAL());
+	for (;;) {
+		if (_pool_take(pool, worker, &krk_currentThread.stackTop[-1])) {
+			_pool_run();
+			krk_currentThread.stackTop = krk_currentThread.stack + 3;
+			krk_currentThread.stackTop[-1] = NONE_VAL();
+			continue;
+		}
+
+		krk_beginBlockingCall();
+		pthread_mutex_lock(&pool->mutex);
+		__atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) <= 0 && !pool->shutdown) {
+			pthread_cond_wait(&pool->workCond, &pool->mutex);
+		}
+		__atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+		int exiting = pool->shutdown && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) <= 0;
+		pthread_mutex_unlock(&pool->mutex);
+		krk_endBlockingCall();
+		if (exiting) break;
+	}
+
+	_currentWorker = NULL;
+	krk_resetStack();
+	FREE_ARRAY(size_t, krk_currentThread.stack, krk_currentThread.stackSize);
+	krk_currentThread.stack = NULL;
+	krk_currentThread.stackTop = NULL;
+	krk_currentThread.stackSize = 0;
+	krk_releaseThreadSlots();
+	/* Last touch of the pool; after this it may be collected. */
+	__atomic_sub_fetch(&pool->alive, 1, __ATOMIC_RELEASE);
+	krk_gcDetachThread();
+
+	free(krk_currentThread.frames);
+
+	return NULL;
+}
+
+static void _pool_start(struct Pool * self) {
+	self->started = 1;
+	self->alive = self->workerCount;
+	pthread_mutex_lock(&_startedPoolsLock);
+	self->nextStarted = _startedPools;
+	_startedPools = self;
+	pthread_mutex_unlock(&_startedPoolsLock);
+	for (size_t i = 0; i < self->workerCount; ++i) {
+		krk_gcExpectThread();
+		pthread_create(&self->workers[i].nativeRef, NULL, _poolworker, (void*)&self->workers[i]);
+	}
+}
+
+/**
+ * Called before the VM is torn down. Pools that were not shut down with
+ * @c wait=True still have workers that run managed code, so stop accepting
+ * work, let them finish what was already submitted, and join them.
+ */
+void krk_joinThreadPools(void) {
+	for (;;) {
+		pthread_mutex_lock(&_startedPoolsLock);
+		struct Pool * pool = _startedPools;
+		while (pool && pool->joined) pool = pool->nextStarted;
+		pthread_mutex_unlock(&_startedPoolsLock);
+		if (!pool) break;
+
+		/* Keep the pool from being collected while we wait; other pools may be, so look again afterwards. */
+		krk_push(OBJECT_VAL(pool));
+		pthread_mutex_lock(&pool->mutex);
+		pool->shutdown = 1;
+		pthread_cond_broadcast(&pool->workCond);
+		pthread_mutex_unlock(&pool->mutex);
+		krk_beginBlockingCall();
+		for (size_t i = 0; i < pool->workerCount; ++i) pthread_join(pool->workers[i].nativeRef, NULL);
+		krk_endBlockingCall();
+		pool->joined = 1;
+		krk_pop();
+	}
+}
+
+/**
+ * Queue a work item. Workers submitting to their own pool use their own deque;
+ * everyone else uses the shared queue.
+ */
+static void _pool_submit(struct Pool * self, KrkValue future) {
+	if (!self->started) _pool_start(self);
+	struct WorkQueue * target = (_currentWorker && _currentWorker->pool == self)
+		? &_currentWorker->queue : &self->inject;
+	krk_writeBarrier((KrkObj*)self);
+	_queue_push(target, future);
+	__atomic_add_fetch(&self->pending, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&self->sleeping, __ATOMIC_SEQ_CST) || __atomic_load_n(&self->waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&self->mutex);
+		pthread_cond_signal(&self->workCond);
+		if (self->waiting) pthread_cond_broadcast(&self->doneCond);
+		pthread_mutex_unlock(&self->mutex);
+	}
+}
+
+static struct PoolFuture * _pool_future(struct Pool * self, KrkValue fn, KrkValue args, KrkValue kwargs, int chunk) {
+	struct PoolFuture * out = (struct PoolFuture*)krk_newInstance(PoolFuture);
+	out->pool = OBJECT_VAL(self);
+	out->fn = fn;
+	out->args = args;
+	out->kwargs = kwargs;
+	out->value = NONE_VAL();
+	out->callbacks = NONE_VAL();
+	out->chunk = chunk;
+	return out;
+}
+
+/**
+ * Wait for @p self to finish. A worker of the same pool runs other queued
+ * work while it waits, so tasks may wait on tasks they submitted without
+ * exhausting the pool. Returns 0 if interrupted.
+ */
+static int _future_wait(struct PoolFuture * self) {
+	if (!IS_ThreadPoolExecutor(self->pool)) return 1;
+	struct Pool * pool = AS_ThreadPoolExecutor(self->pool);
+	struct Worker * worker = (_currentWorker && _currentWorker->pool == pool) ? _currentWorker : NULL;
+
+	while (!_future_done(self)) {
+		if (worker) {
+			krk_push(NONE_VAL());
+			if (_pool_take(pool, worker, &krk_currentThread.stackTop[-1])) {
+				size_t top = krk_currentThread.stackTop - krk_currentThread.stack;
+				_pool_run();
+				krk_currentThread.stackTop = krk_currentThread.stack + top;
+				krk_pop();
+				continue;
+			}
+			krk_pop();
+		}
+
+		krk_beginBlockingCall();
+		pthread_mutex_lock(&pool->mutex);
+		__atomic_add_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+		while (!_future_done(self) && !(worker && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) > 0)) {
+			if (worker) {
+				pthread_cond_wait(&pool->doneCond, &pool->mutex);
+			} else {
+				/* Wake up now and then so the main thread can see a keyboard interrupt. */
+				struct timespec until;
+				clock_gettime(CLOCK_REALTIME, &until);
+				until.tv_nsec += 100000000;
+				if (until.tv_nsec >= 1000000000) { until.tv_sec++; until.tv_nsec -= 1000000000; }
+				pthread_cond_timedwait(&pool->doneCond, &pool->mutex, &until);
+				if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
+			}
+		}
+		__atomic_sub_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&pool->mutex);
+		krk_endBlockingCall();
+		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) return 0;
+	}
+	return 1;
+}
+
+static int _future_cancel(struct PoolFuture * self) {
+	int expected = POOL_PENDING;
+	if (!__atomic_compare_exchange_n(&self->state, &expected, POOL_RUNNING, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		return expected == POOL_CANCELLED;
+	}
+	_pool_finish(self, NONE_VAL(), POOL_CANCELLED);
+	return 1;
+}
+
+#define CURRENT_CTYPE struct Pool *
+
+KRK_Method(ThreadPoolExecutor,__init__) {
+	ssize_t max_workers = 0;
+	if (!krk_parseArgs(".|n", (const char*[]){"max_workers"}, &max_workers)) return NONE_VAL();
+	if (self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), "pool is already initialized");
+	if (max_workers < 0) return krk_runtimeError(vm.exceptions->valueError, "max_workers must be greater than 0");
+	if (max_workers == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		max_workers = (cpus > 0 ? cpus : 1) + 4;
+		if (max_workers > 32) max_workers = 32;
+	}
+	self->workers = calloc(max_workers, sizeof(struct Worker));
+	self->workerCount = max_workers;
+	for (size_t i = 0; i < self->workerCount; ++i) {
+		self->workers[i].pool = self;
+		self->workers[i].seed = i + 1;
+	}
+	pthread_mutex_init(&self->mutex, NULL);
+	pthread_cond_init(&self->workCond, NULL);
+	pthread_cond_init(&self->doneCond, NULL);
+	self->initialized = 1;
+	return NONE_VAL();
+}
+
+#define CHECK_POOL() do { \
+	if (!self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), "pool is not initialized"); \
+	if (self->shutdown) return krk_runtimeError(KRK_EXC(ThreadError), "cannot schedule new work after shutdown"); \
+} while (0)
+
+KRK_Method(ThreadPoolExecutor,submit) {
+	KrkValue fn;
+	int extra = 0;
+	const KrkValue * extras = NULL;
+	if (!krk_parseArgs(".V*~", (const char*[]){"fn"}, &fn, &extra, &extras)) return NONE_VAL();
+	CHECK_POOL();
+
+	KrkValue args = krk_tuple_of(extra, (KrkValue*)extras, 0);
+	krk_push(args);
+	KrkValue kwargs = NONE_VAL();
+	if (hasKw && AS_DICT(argv[argc])->count) {
+		kwargs = krk_dict_of(0,NULL,0);
+		krk_push(kwargs);
+		krk_tableAddAll(AS_DICT(argv[argc]), AS_DICT(kwargs));
+	}
+	KrkValue future = OBJECT_VAL(_pool_future(self, fn, args, kwargs, 0));
+	krk_push(future);
+	_pool_submit(self, future);
+	return future;
+}
+
+struct MapBuilder {
+	struct Pool * pool;
+	KrkValue fn;
+	KrkValue futures;
+	ssize_t chunksize;
+	size_t chunkSlot;
+	int zipped;
+};
+
+static void _map_submit(struct MapBuilder * builder, KrkValue args, int chunk) {
+	KrkValue future = OBJECT_VAL(_pool_future(builder->pool, builder->fn, args, NONE_VAL(), chunk));
+	krk_push(future);
+	krk_writeValueArray(AS_LIST(builder->futures), future);
+	_pool_submit(builder->pool, future);
+	krk_pop();
+}
+
+static void _map_flush(struct MapBuilder * builder) {
+	KrkValue chunk = krk_currentThread.stack[builder->chunkSlot];
+	if (!AS_LIST(chunk)->count) return;
+	KrkValue args = krk_tuple_of(AS_LIST(chunk)->count, AS_LIST(chunk)->values, 0);
+	krk_push(args);
+	_map_submit(builder, args, 1);
+	krk_pop();
+	krk_currentThread.stack[builder->chunkSlot] = krk_list_of(0,NULL,0);
+}
+
+static int _map_callback(void * context, const KrkValue * values, size_t count) {
+	struct MapBuilder * builder = context;
+	for (size_t i = 0; i < count; ++i) {
+		KrkValue args = builder->zipped ? values[i] : krk_tuple_of(1, (KrkValue*)&values[i], 0);
+		if (builder->chunksize == 1) {
+			krk_push(args);
+			_map_submit(builder, args, 0);
+			krk_pop();
+		} else {
+			/* The chunk under construction lives in a stack slot. */
+			KrkValue chunk = krk_currentThread.stack[builder->chunkSlot];
+			krk_push(args);
+			krk_writeValueArray(AS_LIST(chunk), args);
+			krk_pop();
+			if ((ssize_t)AS_LIST(chunk)->count == builder->chunksize) _map_flush(builder);
+		}
+	}
+	return 0;
+}
+
+KRK_Method(ThreadPoolExecutor,map) {
+	KrkValue fn;
+	int iterableCount = 0;
+	const KrkValue * iterables = NULL;
+	ssize_t chunksize = 1;
+	if (!krk_parseArgs(".V*$n", (const char*[]){"fn","chunksize"}, &fn, &iterableCount, &iterables, &chunksize)) return NONE_VAL();
+	CHECK_POOL();
+	if (!iterableCount) return krk_runtimeError(vm.exceptions->typeError, "map() must have at least one iterable");
+	if (chunksize < 1) return krk_runtimeError(vm.exceptions->valueError, "chunksize must be >= 1");
+
+	struct MapBuilder builder = {self, fn, krk_list_of(0,NULL,0), chunksize, 0, iterableCount > 1};
+	krk_push(builder.futures);
+
+	KrkValue iterable = iterables[0];
+	if (builder.zipped) {
+		/* Several iterables are consumed in parallel, same as zip() */
+		KrkValue zip;
+		if (!krk_tableGet_fast(&vm.builtins->fields, S("zip"), &zip)) return NONE_VAL();
+		krk_push(zip);
+		for (int i = 0; i < iterableCount; ++i) krk_push(iterables[i]);
+		iterable = krk_callStack(iterableCount);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+		krk_push(iterable);
+	}
+
+	builder.chunkSlot = krk_currentThread.stackTop - krk_currentThread.stack;
+	krk_push(krk_list_of(0,NULL,0));
+	if (krk_unpackIterable(iterable, &builder, _map_callback)) return NONE_VAL();
+	if (chunksize > 1) _map_flush(&builder);
+
+	struct PoolMapIterator * out = (struct PoolMapIterator*)krk_newInstance(PoolMapIterator);
+	out->futures = builder.futures;
+	out->chunk = NONE_VAL();
+	return OBJECT_VAL(out);
+}
+
+KRK_Method(ThreadPoolExecutor,shutdown) {
+	int wait = 1;
+	int cancel_futures = 0;
+	if (!krk_parseArgs(".|p$p", (const char*[]){"wait","cancel_futures"}, &wait, &cancel_futures)) return NONE_VAL();
+	if (!self->initialized) return krk_runtimeError(KRK_EXC(ThreadError), "pool is not initialized");
+
+	if (cancel_futures) {
+		krk_push(NONE_VAL());
+		while (_pool_take(self, NULL, &krk_currentThread.stackTop[-1])) {
+			_future_cancel(AS_PoolFuture(krk_peek(0)));
+		}
+		krk_pop();
+	}
+
+	pthread_mutex_lock(&self->mutex);
+	self->shutdown = 1;
+	pthread_cond_broadcast(&self->workCond);
+	pthread_mutex_unlock(&self->mutex);
+
+	if (!self->started || self->joined) return NONE_VAL();
+	if (_currentWorker && _currentWorker->pool == self) return NONE_VAL();
+
+	/* Without waiting, the workers are joined when the pool is collected or the VM exits. */
+	if (!wait) return NONE_VAL();
+
+	self->joined = 1;
+	krk_beginBlockingCall();
+	for (size_t i = 0; i < self->workerCount; ++i) pthread_join(self->workers[i].nativeRef, NULL);
+	krk_endBlockingCall();
+	return NONE_VAL();
+}
+
+KRK_Method(ThreadPoolExecutor,__enter__) {
+	METHOD_TAKES_NONE();
+	return argv[0];
+}
+
+KRK_Method(ThreadPoolExecutor,__exit__) {
+	krk_push(argv[0]);
+	return FUNC_NAME(ThreadPoolExecutor,shutdown)(1, (KrkValue*)krk_currentThread.stackTop - 1, 0);
+}
+
+KRK_Method(ThreadPoolExecutor,__repr__) {
+	METHOD_TAKES_NONE();
+	return krk_stringFromFormat("<ThreadPoolExecutor max_workers=%zu%s>", self->workerCount,
+		self->shutdown ? " shutdown" : "");
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct PoolFuture *
+
+KRK_Method(PoolFuture,__init__) {
+	METHOD_TAKES_NONE();
+	krk_writeBarrier((KrkObj*)self);
+	self->pool = self->fn = self->args = self->kwargs = self->value = self->callbacks = NONE_VAL();
+	return NONE_VAL();
+}
+
+KRK_Method(PoolFuture,done) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(_future_done(self));
+}
+
+KRK_Method(PoolFuture,running) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(__atomic_load_n(&self->state, __ATOMIC_ACQUIRE) == POOL_RUNNING);
+}
+
+KRK_Method(PoolFuture,cancelled) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(__atomic_load_n(&self->state, __ATOMIC_ACQUIRE) == POOL_CANCELLED);
+}
+
+KRK_Method(PoolFuture,cancel) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(_future_cancel(self));
+}
+
+KRK_Method(PoolFuture,result) {
+	METHOD_TAKES_NONE();
+	if (!_future_wait(self)) return NONE_VAL();
+	switch (self->state) {
+		case POOL_CANCELLED: return krk_runtimeError(KRK_EXC(ThreadError), "future was cancelled");
+		case POOL_FAILED: krk_raiseException(self->value, NONE_VAL()); return NONE_VAL();
+		default: return self->value;
+	}
+}
+
+KRK_Method(PoolFuture,exception) {
+	METHOD_TAKES_NONE();
+	if (!_future_wait(self)) return NONE_VAL();
+	switch (self->state) {
+		case POOL_CANCELLED: return krk_runtimeError(KRK_EXC(ThreadError), "future was cancelled");
+		case POOL_FAILED: return self->value;
+		default: return NONE_VAL();
+	}
+}
+
+KRK_Method(PoolFuture,add_done_callback) {
+	KrkValue fn;
+	if (!krk_parseArgs(".V", (const char*[]){"fn"}, &fn)) return NONE_VAL();
+
+	KrkValue link = krk_tuple_of(2, (KrkValue[]){fn, NONE_VAL()}, 0);
+	krk_push(link);
+	krk_writeBarrier((KrkObj*)self);
+
+	int done = 1;
+	if (IS_ThreadPoolExecutor(self->pool)) {
+		struct Pool * pool = AS_ThreadPoolExecutor(self->pool);
+		pthread_mutex_lock(&pool->mutex);
+		if (!_future_done(self)) {
+			AS_TUPLE(link)->values.values[1] = self->callbacks;
+			self->callbacks = link;
+			done = 0;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	if (done) {
+		krk_push(fn);
+		krk_push(argv[0]);
+		krk_callStack(1);
+	}
+	return NONE_VAL();
+}
+
+KRK_Method(PoolFuture,__repr__) {
+	METHOD_TAKES_NONE();
+	switch (__atomic_load_n(&self->state, __ATOMIC_ACQUIRE)) {
+		case POOL_PENDING: return OBJECT_VAL(S("<Future pending>"));
+		case POOL_RUNNING: return OBJECT_VAL(S("<Future running>"));
+		case POOL_CANCELLED: return OBJECT_VAL(S("<Future cancelled>"));
+		case POOL_FAILED: return krk_stringFromFormat("<Future finished exception=%R>", self->value);
+		default: return krk_stringFromFormat("<Future finished result=%R>", self->value);
+	}
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct PoolMapIterator *
+
+KRK_Method(PoolMapIterator,__iter__) {
+	METHOD_TAKES_NONE();
+	return argv[0];
+}
+
+KRK_Method(PoolMapIterator,__call__) {
+	METHOD_TAKES_NONE();
+	for (;;) {
+		if (IS_list(self->chunk) && self->offset < AS_LIST(self->chunk)->count) {
+			return AS_LIST(self->chunk)->values[self->offset++];
+		}
+		if (!IS_list(self->futures) || self->index >= AS_LIST(self->futures)->count) return argv[0];
+
+		struct PoolFuture * future = AS_PoolFuture(AS_LIST(self->futures)->values[self->index++]);
+		if (!_future_wait(future)) return NONE_VAL();
+		if (future->state != POOL_FINISHED) {
+			/* Give up on the rest, as a generator would. */
+			for (size_t i = self->index; i < AS_LIST(self->futures)->count; ++i) {
+				_future_cancel(AS_PoolFuture(AS_LIST(self->futures)->values[i]));
+			}
+			self->index = AS_LIST(self->futures)->count;
+			if (future->state == POOL_CANCELLED) return krk_runtimeError(KRK_EXC(ThreadError), "future was cancelled");
+			krk_raiseException(future->value, NONE_VAL());
+			return NONE_VAL();
+		}
+		if (!future->chunk) return future->value;
+		krk_writeBarrier((KrkObj*)self);
+		self->chunk = future->value;
+		self->offset = 0;
+	}
+}
+
+#undef CURRENT_CTYPE
+
+void krk_module_init_threading(void) {
+	/**
+	 * threads = module()
+	 *
+	 * Methods for dealing with threads.
+	 */
+	KrkInstance * threadsModule = krk_newInstance(vm.baseClasses->moduleClass);
+
+	krk_attachNamedObject(&vm.modules, "threading", (KrkObj*)threadsModule);
+	krk_attachNamedObject(&threadsModule->fields, "__name__", (KrkObj*)S("threading"));
+	krk_attachNamedValue(&threadsModule->fields, "__file__", NONE_VAL());
+	KRK_DOC(threadsModule,
+		"@brief Methods and classes for creating platform threads.");
+
+	KRK_DOC(BIND_FUNC(threadsModule, current_thread),
+		"@brief Obtain a reference to the current thread.\n"
+		"@arguments \n\n"
+		"Returns the @ref Thread object associated with the calling thread, if one exists.");
+
+	KrkClass * ThreadError = krk_makeClass(threadsModule, &KRK_EXC(ThreadError), "ThreadError", vm.exceptions->OSError);
+	KRK_DOC(ThreadError,
+		"Raised in various situations when an action on a thread is invalid."
+	);
+	krk_finalizeClass(ThreadError);
+
+	KrkClass * Thread = krk_makeClass(threadsModule, &KRK_BASE_CLASS(Thread), "Thread", vm.baseClasses->objectClass);
+	KRK_DOC(Thread,
+		"Base class for building threaded execution contexts.\n\n"
+		"The @ref Thread class should be subclassed and the subclass should implement a @c run method."
+	);
+	Thread->allocSize = sizeof(struct Thread);
+	KRK_DOC(BIND_METHOD(Thread,start), "Start the thread. A thread may only be started once.");
+	KRK_DOC(BIND_METHOD(Thread,join), "Join the thread. Does not return until the thread finishes.");
+	KRK_DOC(BIND_METHOD(Thread,is_alive), "Query the status of the thread.");
+	KRK_DOC(BIND_PROP(Thread,tid), "The platform-specific thread identifier, if available. Usually an integer.");
+	krk_finalizeClass(Thread);
+
+	KrkClass * Lock = krk_makeClass(threadsModule, &KRK_BASE_CLASS(Lock), "Lock", vm.baseClasses->objectClass);
+	KRK_DOC(Lock,
+		"Represents an atomic mutex.\n\n"
+		"@ref Lock objects allow for exclusive access to a resource and can be used in a @c with block."
+	);
+	Lock->allocSize = sizeof(struct Lock);
+	KRK_DOC(BIND_METHOD(Lock,__init__), "Initialize a system mutex.");
+	KRK_DOC(BIND_METHOD(Lock,__enter__),"Acquire the lock.");
+	KRK_DOC(BIND_METHOD(Lock,__exit__), "Release the lock.");
+	KRK_DOC(BIND_METHOD(Lock,acquire),
+		"@brief Acquire the lock.\n"
+		"@arguments blocking=True\n\n"
+		"Returns @c False if @p blocking is not set and the lock is held elsewhere.");
+	KRK_DOC(BIND_METHOD(Lock,release), "Release the lock.");
+	BIND_METHOD(Lock,__repr__);
+	krk_finalizeClass(Lock);
+
+	Condition = krk_makeClass(threadsModule, &Condition, "Condition", vm.baseClasses->objectClass);
+	KRK_DOC(Condition,
+		"@brief Condition variable for waiting on a @ref Lock.\n"
+		"@arguments lock=None\n\n"
+		"If @p lock is not given, a new @ref Lock is created.");
+	Condition->allocSize = sizeof(struct Condition);
+	Condition->_ongcscan = _condition_gcscan;
+	Condition->_ongcsweep = _condition_gcsweep;
+	BIND_METHOD(Condition,__init__);
+	KRK_DOC(BIND_METHOD(Condition,acquire), "@brief Acquire the underlying lock.\n@arguments blocking=True");
+	KRK_DOC(BIND_METHOD(Condition,release), "@brief Release the underlying lock.");
+	BIND_METHOD(Condition,__enter__);
+	BIND_METHOD(Condition,__exit__);
+	KRK_DOC(BIND_METHOD(Condition,wait),
+		"@brief Release the lock and wait to be notified, then reacquire it.\n"
+		"@arguments timeout=None\n\n"
+		"Returns @c False if @p timeout seconds passed without a notification.");
+	KRK_DOC(BIND_METHOD(Condition,wait_for),
+		"@brief Wait until @p predicate returns a true value.\n"
+		"@arguments predicate,timeout=None\n\n"
+		"Returns the last value returned by @p predicate.");
+	KRK_DOC(BIND_METHOD(Condition,notify), "@brief Wake up to @p n waiting threads.\n@arguments n=1");
+	KRK_DOC(BIND_METHOD(Condition,notify_all), "@brief Wake up all waiting threads.");
+	krk_finalizeClass(Condition);
+
+	Semaphore = krk_makeClass(threadsModule, &Semaphore, "Semaphore", vm.baseClasses->objectClass);
+	KRK_DOC(Semaphore,
+		"@brief Counting semaphore.\n"
+		"@arguments value=1");
+	Semaphore->allocSize = sizeof(struct Semaphore);
+	Semaphore->_ongcsweep = _semaphore_gcsweep;
+	BIND_METHOD(Semaphore,__init__);
+	KRK_DOC(BIND_METHOD(Semaphore,acquire),
+		"@brief Decrement the counter, waiting while it is zero.\n"
+		"@arguments blocking=True,timeout=None\n\n"
+		"Returns @c False if the counter could not be decremented in time.");
+	KRK_DOC(BIND_METHOD(Semaphore,release), "@brief Increment the counter by @p n, waking waiting threads.\n@arguments n=1");
+	BIND_METHOD(Semaphore,__enter__);
+	BIND_METHOD(Semaphore,__exit__);
+	krk_finalizeClass(Semaphore);
+
+	Event = krk_makeClass(threadsModule, &Event, "Event", vm.baseClasses->objectClass);
+	KRK_DOC(Event, "@brief A flag threads can wait to be set.");
+	Event->allocSize = sizeof(struct Event);
+	Event->_ongcsweep = _event_gcsweep;
+	BIND_METHOD(Event,__init__);
+	KRK_DOC(BIND_METHOD(Event,is_set), "@brief Whether the flag is set.");
+	KRK_DOC(BIND_METHOD(Event,set), "@brief Set the flag, waking all waiting threads.");
+	KRK_DOC(BIND_METHOD(Event,clear), "@brief Clear the flag.");
+	KRK_DOC(BIND_METHOD(Event,wait),
+		"@brief Wait until the flag is set.\n"
+		"@arguments timeout=None\n\n"
+		"Returns the flag, which is @c False only if @p timeout expired.");
+	krk_finalizeClass(Event);
+
+	QueueEmpty = krk_makeClass(threadsModule, &QueueEmpty, "Empty", vm.exceptions->Exception);
+	KRK_DOC(QueueEmpty, "Raised by @ref Queue.get when no item is available.");
+	krk_finalizeClass(QueueEmpty);
+	QueueFull = krk_makeClass(threadsModule, &QueueFull, "Full", vm.exceptions->Exception);
+	KRK_DOC(QueueFull, "Raised by @ref Queue.put when a bounded queue has no room.");
+	krk_finalizeClass(QueueFull);
+
+	Queue = krk_makeClass(threadsModule, &Queue, "Queue", vm.baseClasses->objectClass);
+	KRK_DOC(Queue,
+		"@brief First-in, first-out queue for passing items between threads.\n"
+		"@arguments maxsize=0\n\n"
+		"If @p maxsize is greater than zero, @ref Queue.put blocks while the queue holds that many items.");
+	Queue->allocSize = sizeof(struct Queue);
+	Queue->_ongcscan = _queue_gcscan;
+	Queue->_ongcsweep = _queue_gcsweep;
+	BIND_METHOD(Queue,__init__);
+	KRK_DOC(BIND_METHOD(Queue,put),
+		"@brief Add @p item to the queue.\n"
+		"@arguments item,block=True,timeout=None\n\n"
+		"Raises @ref Full if the queue is full and @p block is not set or @p timeout expires.");
+	KRK_DOC(BIND_METHOD(Queue,get),
+		"@brief Remove and return the oldest item in the queue.\n"
+		"@arguments block=True,timeout=None\n\n"
+		"Raises @ref Empty if the queue is empty and @p block is not set or @p timeout expires.");
+	KRK_DOC(BIND_METHOD(Queue,put_nowait), "@brief Same as @c put(item,False).\n@arguments item");
+	KRK_DOC(BIND_METHOD(Queue,get_nowait), "@brief Same as @c get(False).");
+	KRK_DOC(BIND_METHOD(Queue,qsize), "@brief Number of items in the queue.");
+	KRK_DOC(BIND_METHOD(Queue,empty), "@brief Whether the queue is empty.");
+	KRK_DOC(BIND_METHOD(Queue,full), "@brief Whether a bounded queue is full.");
+	BIND_PROP(Queue,maxsize);
+	KRK_DOC(BIND_METHOD(Queue,task_done),
+		"@brief Mark an item taken with @ref Queue.get as processed.");
+	KRK_DOC(BIND_METHOD(Queue,join),
+		"@brief Wait until every item put in the queue has been marked with @ref Queue.task_done.");
+	krk_finalizeClass(Queue);
+
+	AtomicInt = krk_makeClass(threadsModule, &AtomicInt, "AtomicInt", vm.baseClasses->objectClass);
+	KRK_DOC(AtomicInt,
+		"@brief A 64-bit integer updated with atomic operations.\n"
+		"@arguments value=0\n\n"
+		"Arithmetic wraps around on overflow.");
+	AtomicInt->allocSize = sizeof(struct AtomicInt);
+	BIND_METHOD(AtomicInt,__init__);
+	KRK_DOC(BIND_METHOD(AtomicInt,load), "@brief Read the value.");
+	KRK_DOC(BIND_METHOD(AtomicInt,store), "@brief Replace the value.\n@arguments value");
+	KRK_DOC(BIND_METHOD(AtomicInt,exchange), "@brief Replace the value, returning the old one.\n@arguments value");
+	KRK_DOC(BIND_METHOD(AtomicInt,fetch_add), "@brief Add @p n, returning the old value.\n@arguments n=1");
+	KRK_DOC(BIND_METHOD(AtomicInt,fetch_sub), "@brief Subtract @p n, returning the old value.\n@arguments n=1");
+	KRK_DOC(BIND_METHOD(AtomicInt,compare_exchange),
+		"@brief Replace the value with @p desired if it equals @p expected.\n"
+		"@arguments expected,desired\n\n"
+		"Returns whether the value was replaced.");
+	BIND_METHOD(AtomicInt,__repr__);
+	krk_finalizeClass(AtomicInt);
+
+	PoolFuture = krk_makeClass(threadsModule, &PoolFuture, "Future", vm.baseClasses->objectClass);
+	KRK_DOC(PoolFuture,
+		"Result of a call submitted to a @ref ThreadPoolExecutor.\n\n"
+		"A @ref Future is pending until a worker picks it up, running while the call executes, "
+		"and finished once it has returned a value, raised an exception, or been cancelled."
+	);
+	PoolFuture->allocSize = sizeof(struct PoolFuture);
+	PoolFuture->_ongcscan = _pool_future_gcscan;
+	PoolFuture->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	BIND_METHOD(PoolFuture,__init__);
+	KRK_DOC(BIND_METHOD(PoolFuture,done), "@brief Whether the call has finished or was cancelled.");
+	KRK_DOC(BIND_METHOD(PoolFuture,running), "@brief Whether a worker is currently running the call.");
+	KRK_DOC(BIND_METHOD(PoolFuture,cancelled), "@brief Whether the call was cancelled before it started.");
+	KRK_DOC(BIND_METHOD(PoolFuture,cancel),
+		"@brief Cancel the call if it has not started yet.\n\n"
+		"Returns @c True if the future is now cancelled.");
+	KRK_DOC(BIND_METHOD(PoolFuture,result),
+		"@brief Wait for the call to finish and return its result.\n\n"
+		"Raises the exception from the call if it failed, or @ref ThreadError if it was cancelled.");
+	KRK_DOC(BIND_METHOD(PoolFuture,exception),
+		"@brief Wait for the call to finish and return the exception it raised, or @c None.");
+	KRK_DOC(BIND_METHOD(PoolFuture,add_done_callback),
+		"@brief Call @p fn with this future once it is done.\n"
+		"@arguments fn\n\n"
+		"Callbacks run on the worker that finished the call, or immediately if the future is already done.");
+	BIND_METHOD(PoolFuture,__repr__);
+	krk_finalizeClass(PoolFuture);
+
+	PoolMapIterator = krk_makeClass(threadsModule, &PoolMapIterator, "_PoolMapIterator", vm.baseClasses->objectClass);
+	PoolMapIterator->allocSize = sizeof(struct PoolMapIterator);
+	PoolMapIterator->_ongcscan = _pool_map_gcscan;
+	PoolMapIterator->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	BIND_METHOD(PoolMapIterator,__iter__);
+	BIND_METHOD(PoolMapIterator,__call__);
+	krk_finalizeClass(PoolMapIterator);
+
+	ThreadPoolExecutor = krk_makeClass(threadsModule, &ThreadPoolExecutor, "ThreadPoolExecutor", vm.baseClasses->objectClass);
+	KRK_DOC(ThreadPoolExecutor,
+		"@brief Runs calls on a pool of persistent worker threads.\n"
+		"@arguments max_workers=None\n\n"
+		"Workers are started on the first submission and live until @ref ThreadPoolExecutor.shutdown is called. "
+		"Each worker has its own queue of work; idle workers steal from busy ones. "
+		"By default, the pool has four more workers than there are processors, up to 32."
+	);
+	ThreadPoolExecutor->allocSize = sizeof(struct Pool);
+	ThreadPoolExecutor->_ongcscan = _pool_gcscan;
+	ThreadPoolExecutor->_ongcsweep = _pool_gcsweep;
+	BIND_METHOD(ThreadPoolExecutor,__init__);
+	KRK_DOC(BIND_METHOD(ThreadPoolExecutor,submit),
+		"@brief Schedule @c fn(*args,**kwargs) to run on a worker.\n"
+		"@arguments fn,*args,**kwargs\n\n"
+		"Returns a @ref Future for the call.");
+	KRK_DOC(BIND_METHOD(ThreadPoolExecutor,map),
+		"@brief Run @p fn over the items of @p iterables on the pool.\n"
+		"@arguments fn,*iterables,chunksize=1\n\n"
+		"All calls are submitted up front, @p chunksize at a time per work item. "
+		"Returns an iterator over the results, in order.");
+	KRK_DOC(BIND_METHOD(ThreadPoolExecutor,shutdown),
+		"@brief Stop accepting work and let the workers exit once the queues are empty.\n"
+		"@arguments wait=True,cancel_futures=False\n\n"
+		"If @p wait is set, blocks until all workers have exited; otherwise they are joined "
+		"when the pool is collected or the interpreter exits. "
+		"If @p cancel_futures is set, work that has not started yet is cancelled.");
+	BIND_METHOD(ThreadPoolExecutor,__enter__);
+	BIND_METHOD(ThreadPoolExecutor,__exit__);
+	BIND_METHOD(ThreadPoolExecutor,__repr__);
+	krk_finalizeClass(ThreadPoolExecutor);
 }
 
 
@@ -10,6 +10,7 @@
 #include <kuroko/value.h>
 #include <kuroko/object.h>
 #include <kuroko/util.h>
+#include <kuroko/memory.h>
 
 KRK_Function(sleep) {
 	FUNCTION_TAKES_EXACTLY(1);
@@ -22,7 +23,9 @@ KRK_Function(sleep) {
 	                      (IS_FLOATING(argv[0]) ? AS_FLOATING(argv[0]) : 0)) *
 	                      1000000;
 
+	krk_beginBlockingCall();
 	usleep(usecs);
+	krk_endBlockingCall();
 
 	return BOOLEAN_VAL(1);
 }
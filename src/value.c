@@ -185,6 +185,8 @@ static inline int _krk_same_type_equivalence(uint16_t valtype, KrkValue a, KrkVa
 		case KRK_VAL_HANDLER:
 			return a == b;
 		case KRK_VAL_OBJECT:
+			if (IS_STRING(a) && IS_STRING(b)) return krk_stringsEqual(AS_STRING(a), AS_STRING(b));
+			/* fallthrough */
 		default:
 			return _krk_method_equivalence(a,b);
 	}
@@ -200,6 +202,8 @@ static inline int _krk_same_type_equivalence_b(uint16_t valtype, KrkValue a, Krk
 		case KRK_VAL_HANDLER:
 			return 0;
 		case KRK_VAL_OBJECT:
+			if (IS_STRING(a) && IS_STRING(b)) return krk_stringsEqual(AS_STRING(a), AS_STRING(b));
+			/* fallthrough */
 		default:
 			return _krk_method_equivalence(a,b);
 	}
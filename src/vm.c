@@ -122,6 +122,9 @@ KrkThreadState * krk_getCurrentThread(void) {
  * happens on startup (twice) and after an exception.
  */
 void krk_resetStack(void) {
+	krk_currentThread.segment = &krk_currentThread.baseSegment;
+	krk_currentThread.baseSegment.stack = krk_currentThread.stack;
+	krk_currentThread.baseSegment.stackSize = krk_currentThread.stackSize;
 	krk_currentThread.stackTop = krk_currentThread.stack;
 	krk_currentThread.stackMax = krk_currentThread.stack + krk_currentThread.stackSize;
 	krk_currentThread.frameCount = 0;
@@ -145,6 +148,11 @@ void krk_growStack(void) {
 	krk_currentThread.stackSize = newsize;
 	krk_currentThread.stackTop = krk_currentThread.stack + old_offset;
 	krk_currentThread.stackMax = krk_currentThread.stack + krk_currentThread.stackSize;
+
+	/* Upvalues find their stack through the segment, so keep it in sync. */
+	if (!krk_currentThread.segment) krk_currentThread.segment = &krk_currentThread.baseSegment;
+	krk_currentThread.segment->stack = krk_currentThread.stack;
+	krk_currentThread.segment->stackSize = krk_currentThread.stackSize;
 }
 
 /**
@@ -261,7 +269,7 @@ void krk_finalizeClass(KrkClass * _class) {
 		}
 	}
 
-	for (size_t i = 0; i < _class->subclasses.capacity; ++i) {
+	for (size_t i = 0; i < _class->subclasses.used; ++i) {
 		KrkTableEntry * entry = &_class->subclasses.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
 		krk_finalizeClass(AS_CLASS(entry->key));
@@ -347,6 +355,19 @@ static void multipleDefs(const KrkClosure * closure, int destination) {
 				S("<unnamed>"))));
 }
 
+static void missingArgument(const KrkClosure * closure, size_t index) {
+	if (index < closure->function->localNameCount) {
+		krk_runtimeError(vm.exceptions->typeError, "%s() %s: '%S'",
+			closure->function->name ? closure->function->name->chars : "<unnamed>",
+			"missing required positional argument",
+			closure->function->localNames[index].name);
+	} else {
+		krk_runtimeError(vm.exceptions->typeError, "%s() %s",
+			closure->function->name ? closure->function->name->chars : "<unnamed>",
+			"missing required positional argument");
+	}
+}
+
 static int _unpack_op(void * context, const KrkValue * values, size_t count) {
 	KrkTuple * output = context;
 	if (unlikely(output->values.count + count > output->values.capacity)) {
@@ -399,17 +420,20 @@ int krk_processComplexArguments(int argCount, KrkValueArray * positionals, KrkTa
 					krk_runtimeError(vm.exceptions->typeError, "%s(): **expression value is not a dict.", name);
 					return 0;
 				}
-				for (size_t i = 0; i < AS_DICT(value)->capacity; ++i) {
+				for (size_t i = 0; i < AS_DICT(value)->used; ++i) {
 					KrkTableEntry * entry = &AS_DICT(value)->entries[i];
 					if (!IS_KWARGS(entry->key)) {
 						if (!IS_STRING(entry->key)) {
 							krk_runtimeError(vm.exceptions->typeError, "%s(): **expression contains non-string key", name);
 							return 0;
 						}
-						if (!krk_tableSet(keywords, entry->key, entry->value)) {
+						/* Keyword names are matched against argument names by identity. */
+						krk_push(OBJECT_VAL(krk_internString(AS_STRING(entry->key))));
+						if (!krk_tableSet(keywords, krk_peek(0), entry->value)) {
 							krk_runtimeError(vm.exceptions->typeError, "%s() got multiple values for argument '%S'", name, AS_STRING(entry->key));
 							return 0;
 						}
+						krk_pop();
 					}
 				}
 			} else if (AS_INTEGER(key) == KWARGS_SINGLE) { /* single value */
@@ -425,6 +449,128 @@ int krk_processComplexArguments(int argCount, KrkValueArray * positionals, KrkTa
 	return 1;
 }
 
+/**
+ * Push a call frame for a managed function whose arguments are already
+ * in place at the top of the stack.
+ */
+static inline void enterFrame(KrkClosure * closure, int argCount, int returnDepth) {
+	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount++];
+	frame->closure = closure;
+	frame->ip = closure->function->chunk.code;
+	frame->slots = (krk_currentThread.stackTop - argCount) - krk_currentThread.stack;
+	frame->outSlots = frame->slots - returnDepth;
+	frame->globalsOwner = closure->globalsOwner;
+	frame->globals = closure->globalsTable;
+	FRAME_IN(frame);
+}
+
+/**
+ * Keyword argument bindings for a code object, built on first use: each
+ * named parameter, hashed by its interned name, with the stack slot it
+ * occupies once arguments are in place.
+ */
+static KrkArgumentBinding * getArgumentPlan(KrkCodeObject * function) {
+	if (unlikely(!function->argumentPlan)) {
+		size_t size = 1;
+		while (size < (size_t)(function->potentialPositionals + function->keywordArgs) * 2) size <<= 1;
+		KrkArgumentBinding * plan = ALLOCATE(KrkArgumentBinding, size);
+		memset(plan, 0, sizeof(KrkArgumentBinding) * size);
+
+		size_t keywordSlots = function->potentialPositionals + !!(function->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS);
+		for (size_t i = 0; i < (size_t)(function->potentialPositionals + function->keywordArgs); ++i) {
+			KrkValue name = i < function->potentialPositionals ? function->positionalArgNames.values[i] :
+				function->keywordArgNames.values[i - function->potentialPositionals];
+			if (!IS_STRING(name)) continue; /* Positional-only */
+			size_t j = AS_STRING(name)->obj.hash & (size - 1);
+			while (plan[j].name) j = (j + 1) & (size - 1);
+			plan[j].name = AS_STRING(name);
+			plan[j].slot = i < function->potentialPositionals ? i : keywordSlots + (i - function->potentialPositionals);
+			plan[j].index = i;
+		}
+
+		function->argumentPlanSize = size;
+		if (!__sync_bool_compare_and_swap(&function->argumentPlan, NULL, plan)) {
+			FREE_ARRAY(KrkArgumentBinding, plan, size);
+		}
+	}
+	return function->argumentPlan;
+}
+
+static inline KrkArgumentBinding * findBinding(KrkCodeObject * function, KrkString * name) {
+	KrkArgumentBinding * plan = function->argumentPlan;
+	size_t mask = function->argumentPlanSize - 1;
+	for (size_t j = name->obj.hash & mask; plan[j].name; j = (j + 1) & mask) {
+		if (plan[j].name == name) return &plan[j];
+	}
+	return NULL;
+}
+
+/**
+ * Bind a call's keyword arguments directly into their parameter slots.
+ *
+ * Handles calls where every keyword is a plain name=value, the positional
+ * arguments fit in the function's positional parameters, and the function
+ * takes no **kwargs. Anything else is left for krk_processComplexArguments,
+ * and 0 is returned without touching the stack. Otherwise the arguments
+ * are in place for the call and the new argument count is returned, or
+ * -1 if an exception was raised.
+ */
+static int bindKeywordArguments(KrkClosure * closure, int argCount) {
+	KrkCodeObject * function = closure->function;
+	if (function->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS) return 0;
+
+	size_t kwargsCount = AS_INTEGER(krk_currentThread.stackTop[-1]);
+	size_t positionals = argCount - 1 - kwargsCount * 2;
+	if (!kwargsCount || positionals > function->potentialPositionals) return 0;
+	for (size_t i = 0; i < kwargsCount; ++i) {
+		if (!IS_STRING(krk_currentThread.stackTop[-1 - kwargsCount * 2 + i * 2])) return 0;
+	}
+
+	getArgumentPlan(function);
+
+	/* Move the name/value pairs out of the way, above where the arguments will end. */
+	size_t total = function->totalArguments;
+	size_t base = (krk_currentThread.stackTop - argCount) - krk_currentThread.stack;
+	size_t pairs = base + (total > (size_t)argCount ? total : (size_t)argCount);
+	while (pairs + kwargsCount * 2 > krk_currentThread.stackSize) krk_growStack();
+	KrkValue * stack = krk_currentThread.stack;
+	memcpy(&stack[pairs], &stack[base + positionals], sizeof(KrkValue) * kwargsCount * 2);
+	for (size_t i = positionals; i < total; ++i) stack[base + i] = KWARGS_VAL(0);
+
+	/* Nothing may allocate while the pairs are above the top of the stack. */
+	krk_currentThread.stackTop = &stack[base + total];
+	for (size_t i = 0; i < kwargsCount; ++i) {
+		KrkArgumentBinding * binding = findBinding(function, AS_STRING(stack[pairs + i * 2]));
+		if (unlikely(!binding)) {
+			krk_currentThread.stackTop = &stack[pairs + kwargsCount * 2];
+			krk_runtimeError(vm.exceptions->typeError, "%s() got an unexpected keyword argument '%S'",
+				function->name ? function->name->chars : "<unnamed>",
+				AS_STRING(stack[pairs + i * 2]));
+			return -1;
+		}
+		if (unlikely(!IS_KWARGS(stack[base + binding->slot]))) {
+			krk_currentThread.stackTop = &stack[pairs + kwargsCount * 2];
+			multipleDefs(closure, binding->index);
+			return -1;
+		}
+		stack[base + binding->slot] = stack[pairs + i * 2 + 1];
+	}
+
+	for (size_t i = 0; i < function->requiredArgs; ++i) {
+		if (unlikely(IS_KWARGS(stack[base + i]))) {
+			missingArgument(closure, i);
+			return -1;
+		}
+	}
+
+	if (function->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS) {
+		KrkValue list = krk_list_of(0, NULL, 0);
+		krk_currentThread.stack[base + function->potentialPositionals] = list;
+	}
+
+	return total;
+}
+
 /**
  * Call a managed method.
  * Takes care of argument count checking, default argument filling,
@@ -442,6 +588,12 @@ static inline int _callManaged(KrkClosure * closure, int argCount, int returnDep
 	size_t argCountX = argCount;
 
 	if (argCount && unlikely(IS_KWARGS(krk_currentThread.stackTop[-1]))) {
+		int bound = bindKeywordArguments(closure, argCount);
+		if (unlikely(bound < 0)) return 0;
+		if (likely(bound)) {
+			argCount = bound;
+			goto _argumentsPlaced;
+		}
 
 		KrkValue myList = krk_list_of(0,NULL,0);
 		krk_push(myList);
@@ -513,7 +665,7 @@ static inline int _callManaged(KrkClosure * closure, int argCount, int returnDep
 		krk_currentThread.scratchSpace[0] = NONE_VAL();
 
 		/* Now place keyword arguments */
-		for (size_t i = 0; i < keywords->capacity; ++i) {
+		for (size_t i = 0; i < keywords->used; ++i) {
 			KrkTableEntry * entry = &keywords->entries[i];
 			if (!IS_KWARGS(entry->key)) {
 				KrkValue name = entry->key;
@@ -566,16 +718,7 @@ _finishKwarg:
 
 		for (size_t i = 0; i < (size_t)closure->function->requiredArgs; ++i) {
 			if (IS_KWARGS(krk_currentThread.stackTop[-argCount + i])) {
-				if (i < closure->function->localNameCount) {
-					krk_runtimeError(vm.exceptions->typeError, "%s() %s: '%S'",
-						closure->function->name ? closure->function->name->chars : "<unnamed>",
-						"missing required positional argument",
-						closure->function->localNames[i].name);
-				} else {
-					krk_runtimeError(vm.exceptions->typeError, "%s() %s",
-						closure->function->name ? closure->function->name->chars : "<unnamed>",
-						"missing required positional argument");
-				}
+				missingArgument(closure, i);
 				goto _errorAfterKeywords;
 			}
 		}
@@ -594,6 +737,7 @@ _finishKwarg:
 
 	if (unlikely(!checkArgumentCount(closure, argCountX))) goto _errorAfterKeywords;
 
+_argumentsPlaced:
 	while (argCount < (int)totalArguments) {
 		krk_push(KWARGS_VAL(0));
 		argCount++;
@@ -611,14 +755,7 @@ _finishKwarg:
 		goto _errorAfterKeywords;
 	}
 
-	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount++];
-	frame->closure = closure;
-	frame->ip = closure->function->chunk.code;
-	frame->slots = (krk_currentThread.stackTop - argCount) - krk_currentThread.stack;
-	frame->outSlots = frame->slots - returnDepth;
-	frame->globalsOwner = closure->globalsOwner;
-	frame->globals = closure->globalsTable;
-	FRAME_IN(frame);
+	enterFrame(closure, argCount, returnDepth);
 	return 1;
 
 _errorDuringPositionals:
@@ -815,6 +952,7 @@ static void closeUpvalues(int last) {
 		KrkUpvalue * upvalue = krk_currentThread.openUpvalues;
 		upvalue->closed = krk_currentThread.stack[upvalue->location];
 		upvalue->location = -1;
+		krk_writeBarrier((KrkObj*)upvalue);
 		krk_currentThread.openUpvalues = upvalue->next;
 	}
 }
@@ -906,7 +1044,7 @@ void krk_initVM(int flags) {
 	krk_forceThreadData();
 #endif
 
-	vm.globalFlags = flags & 0xFF00;
+	vm.globalFlags = flags & ~0x00FF;
 	vm.maximumCallDepth = KRK_CALL_FRAMES_MAX;
 
 	/* Reset current thread */
@@ -920,10 +1058,15 @@ void krk_initVM(int flags) {
 	/* GC state */
 	vm.objects = NULL;
 	vm.bytesAllocated = 0;
-	vm.nextGC = 1024 * 1024;
+	vm.nextGC = KRK_GC_NURSERY_SIZE;
 	vm.grayCount = 0;
 	vm.grayCapacity = 0;
 	vm.grayStack = NULL;
+	vm.youngObjects = NULL;
+	vm.nextMajorGC = 1024 * 1024;
+	vm.rememberedCount = 0;
+	vm.rememberedCapacity = 0;
+	vm.remembered = NULL;
 
 	/* Global objects */
 	vm.exceptions = calloc(1,sizeof(struct Exceptions));
@@ -955,6 +1098,7 @@ void krk_initVM(int flags) {
 	_createAndBind_listClass();
 	_createAndBind_tupleClass();
 	_createAndBind_bytesClass();
+	_createAndBind_memoryviewClass();
 	_createAndBind_dictClass();
 	_createAndBind_functionClass();
 	_createAndBind_rangeClass();
@@ -990,6 +1134,10 @@ void krk_initVM(int flags) {
  * Reclaim resources used by the VM.
  */
 void krk_freeVM(void) {
+#ifndef KRK_DISABLE_THREADS
+	/* Pool workers may still be running managed code. */
+	krk_joinThreadPools();
+#endif
 	krk_freeTable(&vm.strings);
 	krk_freeTable(&vm.modules);
 	if (vm.specialMethodNames) free(vm.specialMethodNames);
@@ -1134,7 +1282,7 @@ static int handleException(void) {
 		!IS_HANDLER_TYPE(krk_currentThread.stack[stackOffset], OP_FILTER_EXCEPT)
 		; stackOffset--);
 	if (stackOffset < exitSlot) {
-		if (exitSlot == 0) {
+		if (exitSlot == 0 && !krk_currentThread.segment->outer) {
 			/*
 			 * No exception was found and we have reached the top of the call stack.
 			 * Call dumpTraceback to present the exception to the user and reset the
@@ -1171,6 +1319,147 @@ static int handleException(void) {
 	return 0;
 }
 
+static KrkValue runModuleCode(KrkCodeObject * function) {
+	if (!function) {
+		if (!krk_currentThread.frameCount) handleException();
+		return NONE_VAL();
+	}
+
+	krk_push(OBJECT_VAL(function));
+	krk_attachNamedObject(&krk_currentThread.module->fields, "__file__", (KrkObj*)function->chunk.filename);
+	KrkClosure * closure = krk_newClosure(function, OBJECT_VAL(krk_currentThread.module));
+	krk_pop();
+
+	krk_push(OBJECT_VAL(closure));
+	return krk_callStack(0);
+}
+
+#ifndef KRK_NO_FILESYSTEM
+static char * readFile(const char * fileName, size_t * sizeOut) {
+	FILE * f = fopen(fileName,"r");
+	if (!f) return NULL;
+
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	char * buf = malloc(size+1);
+	if (fread(buf, 1, size, f) != size) {
+		fclose(f);
+		free(buf);
+		return NULL;
+	}
+	fclose(f);
+	buf[size] = '\0';
+	*sizeOut = size;
+	return buf;
+}
+
+/**
+ * Source files are cached next to themselves, in the style of __pycache__:
+ * dir/name.krk is cached as dir/__krkcache__/name.kbc, or as name.opt.kbc
+ * when the optimizer is enabled, so the two kinds of output never mix.
+ */
+static char * bytecodeCachePath(const char * fileName) {
+	const char * base = strrchr(fileName, PATH_SEP[0]);
+	base = base ? base + 1 : fileName;
+	const char * ext = strrchr(base, '.');
+	const char * suffix = (vm.globalFlags & KRK_GLOBAL_OPTIMIZE) ? ".opt.kbc" : ".kbc";
+	size_t dirLen = base - fileName;
+	size_t baseLen = ext ? (size_t)(ext - base) : strlen(base);
+
+	size_t len = dirLen + sizeof("__krkcache__" PATH_SEP) - 1 + baseLen + strlen(suffix) + 1;
+	char * out = malloc(len);
+	snprintf(out, len, "%.*s__krkcache__" PATH_SEP "%.*s%s", (int)dirLen, fileName, (int)baseLen, base, suffix);
+	return out;
+}
+
+static KrkCodeObject * loadBytecode(const char * path, KrkString * fileName, const KrkSourceStamp * source) {
+	size_t size;
+	char * data = readFile(path, &size);
+	if (!data) return NULL;
+	KrkCodeObject * function = krk_unmarshalCode(data, size, fileName, source);
+	free(data);
+	return function;
+}
+
+/**
+ * Failing to write the cache is never an error: the directory may be
+ * read-only, or another process may be writing the same file. Write to
+ * a temporary name and rename it into place so readers never see a
+ * partial file.
+ */
+static void writeBytecode(const char * path, KrkCodeObject * function, const KrkSourceStamp * source) {
+	const char * base = strrchr(path, PATH_SEP[0]);
+	char * dir = strdup(path);
+	dir[base - path] = '\0';
+#ifdef _WIN32
+	mkdir(dir);
+#else
+	mkdir(dir, 0777);
+#endif
+	free(dir);
+
+	size_t len = strlen(path) + 32;
+	char * tmp = malloc(len);
+	snprintf(tmp, len, "%s.%ld.tmp", path, (long)getpid());
+
+	FILE * out = fopen(tmp, "wb");
+	if (out) {
+		int failed = krk_marshalCode(function, out, source);
+		if (fclose(out) || failed || rename(tmp, path)) remove(tmp);
+	}
+	free(tmp);
+}
+
+/**
+ * Compile and run a module source file, or bytecode if the file
+ * was compiled ahead of time. The bytecode cache for a source file is
+ * only used if it matches the source's modification time and size.
+ */
+static KrkValue runModuleFile(char * fileName, struct stat * statbuf, int isBytecode) {
+	KrkString * fileNameStr = krk_copyString(fileName, strlen(fileName));
+	krk_push(OBJECT_VAL(fileNameStr));
+
+	KrkCodeObject * function = NULL;
+
+	if (isBytecode) {
+		function = loadBytecode(fileName, fileNameStr, NULL);
+		if (!function) krk_runtimeError(vm.exceptions->importError, "Bad bytecode in '%s'", fileName);
+	} else {
+		KrkSourceStamp stamp = { statbuf->st_mtime, statbuf->st_size };
+		char * cachePath = NULL;
+
+		/* Disassembly is printed by the compiler, so skip the cache when it was requested. */
+		if (!(krk_currentThread.flags & KRK_THREAD_ENABLE_DISASSEMBLY)) {
+			cachePath = bytecodeCachePath(fileName);
+			function = loadBytecode(cachePath, fileNameStr, &stamp);
+		}
+
+		if (!function) {
+			size_t size;
+			char * buf = readFile(fileName, &size);
+			if (!buf) {
+				krk_runtimeError(vm.exceptions->importError, "Could not read '%s': %s", fileName, strerror(errno));
+			} else {
+				function = krk_compile(buf, fileName);
+				free(buf);
+				if (function && cachePath && !(vm.globalFlags & KRK_GLOBAL_NO_WRITE_BYTECODE)) {
+					krk_push(OBJECT_VAL(function));
+					writeBytecode(cachePath, function, &stamp);
+					krk_pop();
+				}
+			}
+		}
+
+		free(cachePath);
+	}
+
+	krk_pop(); /* fileNameStr */
+	return runModuleCode(function);
+}
+#endif
+
 /**
  * Load a module.
  *
@@ -1179,6 +1468,9 @@ static int handleException(void) {
  * to resolve module names. krk source files will always take priority, so if
  * a later search path has a krk source and an earlier search path has a shared
  * object module, the later search path will still win.
+ *
+ * Compiled source modules are cached as bytecode in a __krkcache__ directory
+ * beside the source. A .kbc file with no source may also be imported directly.
  */
 int krk_loadModule(KrkString * path, KrkValue * moduleOut, KrkString * runAs, KrkValue parent) {
 	/* See if the module is already loaded */
@@ -1217,6 +1509,7 @@ int krk_loadModule(KrkString * path, KrkValue * moduleOut, KrkString * runAs, Kr
 	/* First search for {path}.krk in the module search paths */
 	for (int i = 0; i < moduleCount; ++i, krk_pop()) {
 		int isPackage = 0;
+		int isBytecode = 0;
 		char * fileName;
 
 		krk_push(AS_LIST(modulePaths)->values[i]);
@@ -1293,6 +1586,19 @@ int krk_loadModule(KrkString * path, KrkValue * moduleOut, KrkString * runAs, Kr
 			goto _normalFile;
 		}
 
+		/* Try .../path.kbc, compiled ahead of time with no source alongside it */
+		krk_pop();
+		krk_push(AS_LIST(modulePaths)->values[i]);
+		krk_push(OBJECT_VAL(path));
+		krk_addObjects(); /* Concatenate path... */
+		krk_push(OBJECT_VAL(S(".kbc")));
+		krk_addObjects(); /* and file extension */
+		fileName = AS_CSTRING(krk_peek(0));
+		if (stat(fileName,&statbuf) == 0) {
+			isBytecode = 1;
+			goto _normalFile;
+		}
+
 		/* Try next search path */
 		continue;
 
@@ -1315,7 +1621,7 @@ int krk_loadModule(KrkString * path, KrkValue * moduleOut, KrkString * runAs, Kr
 				krk_attachNamedValue(&krk_currentThread.module->fields, "__package__", NONE_VAL());
 			}
 		}
-		krk_runfile(fileName,fileName);
+		runModuleFile(fileName,&statbuf,isBytecode);
 		*moduleOut = OBJECT_VAL(krk_currentThread.module);
 		krk_currentThread.module = enclosing;
 		if (!IS_OBJECT(*moduleOut)) {
@@ -1644,10 +1950,202 @@ static KrkClass * checkCache(KrkClass * type, KrkString * name, KrkValue * metho
 	return _class;
 }
 
+/**
+ * Per-instruction attribute cache for OP_GET_PROPERTY and OP_GET_METHOD.
+ *
+ * Entries remember the receiver class's cacheIndex, which clearCache()
+ * resets whenever the class or one of its bases changes, so a match is
+ * always current. Sites that see too many classes stop filling entries
+ * and use the shared cache above.
+ */
+static KrkClass * checkInlineCache(KrkInlineCache * ic, KrkClass * type, KrkString * name, KrkValue * method) {
+	/* Entries below count are complete; the acquire pairs with the release that published them. */
+	unsigned int count = __atomic_load_n(&ic->count, __ATOMIC_ACQUIRE);
+	if (likely(type->cacheIndex)) {
+		for (unsigned int i = 0; i < count; ++i) {
+			if (ic->entries[i].index == type->cacheIndex) {
+				*method = ic->entries[i].value;
+				return ic->entries[i].owner;
+			}
+		}
+	}
+
+	KrkClass * _class = checkCache(type, name, method);
+
+	/* One thread fills entries at a time; any other just skips caching this lookup. */
+	if (ic->state != KRK_INLINE_CACHE_MEGAMORPHIC && !__atomic_exchange_n(&ic->filling, 1, __ATOMIC_ACQUIRE)) {
+		count = ic->count;
+		if (count == KRK_INLINE_CACHE_WAYS) {
+			ic->state = KRK_INLINE_CACHE_MEGAMORPHIC;
+			__atomic_store_n(&ic->count, 0, __ATOMIC_RELEASE);
+		} else {
+			/* Fill the entry before publishing it. */
+			KrkInlineCacheEntry * entry = &ic->entries[count];
+			entry->index = type->cacheIndex;
+			entry->owner = _class;
+			entry->value = _class ? *method : NONE_VAL();
+			__atomic_store_n(&ic->count, count + 1, __ATOMIC_RELEASE);
+			ic->state = count == 0 ? KRK_INLINE_CACHE_MONOMORPHIC : KRK_INLINE_CACHE_POLYMORPHIC;
+		}
+		__atomic_store_n(&ic->filling, 0, __ATOMIC_RELEASE);
+	}
+
+	return _class;
+}
+
+static KrkInlineCache * getInlineCache(KrkCodeObject * function, size_t index) {
+	if (unlikely(!function->inlineCaches)) {
+		size_t count = function->chunk.constants.count;
+		KrkInlineCache * caches = ALLOCATE(KrkInlineCache, count);
+		memset(caches, 0, sizeof(KrkInlineCache) * count);
+		if (!__sync_bool_compare_and_swap(&function->inlineCaches, NULL, caches)) {
+			FREE_ARRAY(KrkInlineCache, caches, count);
+		}
+	}
+	return &function->inlineCaches[index];
+}
+
+/*
+ * Adaptive quickening.
+ *
+ * Generic instructions that have to work out what they are operating on
+ * every time they run count their executions, and after a short warmup
+ * rewrite themselves in place into a form specialized for the values they
+ * see (the QUICK entries in opcodes.h). A specialized instruction checks
+ * its guess before doing anything and, if it no longer holds, puts the
+ * generic opcode back and runs that instead. Each attempt doubles the
+ * warmup for that site, so sites that never settle stop trying.
+ *
+ * Every form of an instruction is the same size and is correct for any
+ * input, so code shared between threads only needs the rewrite itself
+ * to be atomic: it only replaces the opcode that was just executed, and
+ * leaves alone anything another thread or the debugger put there since.
+ */
+#define QUICKEN_WARMUP      8
+#define QUICKEN_MAX_BACKOFF 8
+
+static uint16_t * getWarmupCounters(KrkCodeObject * function) {
+	if (unlikely(!function->warmupCounters)) {
+		size_t count = function->chunk.count;
+		uint16_t * counters = ALLOCATE(uint16_t, count);
+		memset(counters, 0, sizeof(uint16_t) * count);
+		if (!__sync_bool_compare_and_swap(&function->warmupCounters, NULL, counters)) {
+			FREE_ARRAY(uint16_t, counters, count);
+		}
+	}
+	return function->warmupCounters;
+}
+
+/**
+ * Count an execution of the generic instruction at @p instr and report
+ * whether it is time to try to specialize it. Counters keep the number of
+ * executions in the low twelve bits and how many times the site has tried
+ * in the high four.
+ */
+static inline int quickenReady(KrkCodeObject * function, uint8_t * instr) {
+	uint16_t * counter = &getWarmupCounters(function)[instr - function->chunk.code];
+	unsigned int backoff = *counter >> 12;
+	unsigned int count = (*counter & 0xFFF) + 1;
+	if (likely(count < ((unsigned int)QUICKEN_WARMUP << backoff))) {
+		*counter = (backoff << 12) | count;
+		return 0;
+	}
+	*counter = (backoff < QUICKEN_MAX_BACKOFF ? backoff + 1 : backoff) << 12;
+	return 1;
+}
+
+static inline void rewriteOpcode(uint8_t * instr, uint8_t from, uint8_t to) {
+	__atomic_compare_exchange_n(instr, &from, to, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static inline int isNumeric(KrkValue value) {
+	return IS_INTEGER(value) || IS_FLOATING(value);
+}
+
+static inline double asDouble(KrkValue value) {
+	return IS_INTEGER(value) ? (double)AS_INTEGER(value) : AS_FLOATING(value);
+}
+
+/* A float and an int or another float: float methods convert the int with a cast. */
+static inline int isFloatPair(KrkValue a, KrkValue b) {
+#ifndef KRK_NO_FLOAT
+	return (IS_FLOATING(a) && isNumeric(b)) || (IS_INTEGER(a) && IS_FLOATING(b));
+#else
+	return 0;
+#endif
+}
+
+static void quickenBinary(uint8_t * instr, uint8_t generic, KrkValue a, KrkValue b) {
+	int ints = IS_INTEGER(a) && IS_INTEGER(b);
+	int floats = isFloatPair(a, b);
+	uint8_t specialized = generic;
+
+#define PICK(intForm,floatForm) specialized = ints ? intForm : floats ? floatForm : generic; break
+	switch (generic) {
+		case OP_ADD:
+			specialized = ints ? OP_ADD_INT : floats ? OP_ADD_FLOAT : (IS_STRING(a) && IS_STRING(b)) ? OP_ADD_STR : generic;
+			break;
+		case OP_SUBTRACT:      PICK(OP_SUB_INT, OP_SUB_FLOAT);
+		case OP_MULTIPLY:      PICK(OP_MUL_INT, OP_MUL_FLOAT);
+		case OP_DIVIDE:        PICK(OP_DIV_FLOAT, OP_DIV_FLOAT);
+		case OP_LESS:          PICK(OP_LESS_INT, OP_LESS_FLOAT);
+		case OP_GREATER:       PICK(OP_GREATER_INT, OP_GREATER_FLOAT);
+		case OP_LESS_EQUAL:    PICK(OP_LESS_EQUAL_INT, OP_LESS_EQUAL_FLOAT);
+		case OP_GREATER_EQUAL: PICK(OP_GREATER_EQUAL_INT, OP_GREATER_EQUAL_FLOAT);
+		case OP_EQUAL:         PICK(OP_EQUAL_INT, generic);
+	}
+#undef PICK
+
+	if (specialized != generic) rewriteOpcode(instr, generic, specialized);
+}
+
+/**
+ * Attribute loads from instances that keep the attribute in a shape slot,
+ * where the class has nothing by that name that could take precedence.
+ * Both facts are remembered in the inline cache as single words: a shape
+ * never changes which slot holds a name, and a class gets a new cacheIndex
+ * whenever it, or one of its bases, changes.
+ */
+static void quickenProperty(uint8_t * instr, KrkInlineCache * ic, KrkString * name, KrkValue receiver) {
+	if (!IS_INSTANCE(receiver)) return;
+	KrkInstance * instance = AS_INSTANCE(receiver);
+	if (!instance->shape) return;
+	int slot = krk_shapeFind(instance->shape, name);
+	if (slot < 0) return;
+	KrkValue method;
+	if (checkCache(instance->_class, name, &method)) return;
+	ic->quickShape = instance->shape->id * KRK_SHAPE_MAX_SLOTS + slot;
+	ic->quickClass = instance->_class->cacheIndex;
+	rewriteOpcode(instr, OP_GET_PROPERTY, OP_GET_PROPERTY_INSTANCE_SLOT);
+}
+
+/**
+ * Managed calls that need none of the argument processing: exactly as many
+ * positional arguments as the function takes, no keyword arguments, and no
+ * generator or coroutine to build.
+ */
+static inline int isExactManagedCall(KrkValue callee, int argCount) {
+	if (!IS_CLOSURE(callee)) return 0;
+	KrkCodeObject * function = AS_CLOSURE(callee)->function;
+	return function->requiredArgs == argCount && function->totalArguments == argCount &&
+		!(function->obj.flags & (KRK_OBJ_FLAGS_CODEOBJECT_IS_GENERATOR | KRK_OBJ_FLAGS_CODEOBJECT_IS_COROUTINE)) &&
+		!(argCount && IS_KWARGS(krk_currentThread.stackTop[-1]));
+}
+
+static void quickenCall(uint8_t * instr, uint8_t generic, KrkValue callee, int argCount) {
+	int method = generic == OP_CALL_METHOD;
+	if (method && IS_NONE(callee)) return;
+	if (isExactManagedCall(callee, argCount)) {
+		rewriteOpcode(instr, generic, method ? OP_CALL_METHOD_MANAGED_EXACT : OP_CALL_MANAGED_EXACT);
+	} else if (IS_NATIVE(callee)) {
+		rewriteOpcode(instr, generic, method ? OP_CALL_METHOD_NATIVE : OP_CALL_NATIVE);
+	}
+}
+
 static void clearCache(KrkClass * type) {
 	if (type->cacheIndex) {
 		type->cacheIndex = 0;
-		for (size_t i = 0; i < type->subclasses.capacity; ++i) {
+		for (size_t i = 0; i < type->subclasses.used; ++i) {
 			KrkTableEntry * entry = &type->subclasses.entries[i];
 			if (entry->key == KWARGS_VAL(0)) continue;
 			clearCache(AS_CLASS(entry->key));
@@ -1692,11 +2190,11 @@ int krk_bindMethod(KrkClass * originalClass, KrkString * name) {
 	return krk_bindMethodSuper(originalClass,name,originalClass);
 }
 
-static int valueGetMethod(KrkString * name) {
+static int valueGetMethod(KrkString * name, KrkInlineCache * ic) {
 	KrkValue this = krk_peek(0);
 	KrkClass * myClass = krk_getType(this);
 	KrkValue value, method;
-	KrkClass * _class = checkCache(myClass, name, &method);
+	KrkClass * _class = ic ? checkInlineCache(ic, myClass, name, &method) : checkCache(myClass, name, &method);
 
 	/* Class descriptors */
 	if (_class) {
@@ -1712,7 +2210,23 @@ static int valueGetMethod(KrkString * name) {
 
 	/* Fields */
 	if (IS_INSTANCE(this)) {
-		if (krk_tableGet_fast(&AS_INSTANCE(this)->fields, name, &value)) goto found;
+		KrkInstance * instance = AS_INSTANCE(this);
+		if (instance->shape) {
+			/* Shape and slot share one word so other threads never see half an update. */
+			int slot;
+			size_t key = ic ? ic->shapeKey : 0;
+			if (key / (KRK_SHAPE_MAX_SLOTS + 1) == instance->shape->id) {
+				slot = (int)(key % (KRK_SHAPE_MAX_SLOTS + 1)) - 1;
+			} else {
+				slot = krk_shapeFind(instance->shape, name);
+				if (ic) ic->shapeKey = instance->shape->id * (KRK_SHAPE_MAX_SLOTS + 1) + (slot + 1);
+			}
+			if (slot >= 0) {
+				value = instance->slots[slot];
+				goto found;
+			}
+		}
+		if (krk_tableGet_fast(&instance->fields, name, &value)) goto found;
 	} else if (IS_CLASS(this)) {
 		KrkClass * type = AS_CLASS(this);
 		do {
@@ -1781,8 +2295,8 @@ found_method:
 	return 1;
 }
 
-static int valueGetProperty(KrkString * name) {
-	switch (valueGetMethod(name)) {
+static int valueGetProperty(KrkString * name, KrkInlineCache * ic) {
+	switch (valueGetMethod(name, ic)) {
 		case 2:
 			krk_currentThread.stackTop[-2] = krk_currentThread.stackTop[-1];
 			krk_currentThread.stackTop--;
@@ -1797,13 +2311,13 @@ static int valueGetProperty(KrkString * name) {
 }
 
 int krk_getAttribute(KrkString * name) {
-	return valueGetProperty(name);
+	return valueGetProperty(name, NULL);
 }
 
 KrkValue krk_valueGetAttribute(KrkValue value, char * name) {
 	krk_push(OBJECT_VAL(krk_copyString(name,strlen(name))));
 	krk_push(value);
-	if (!valueGetProperty(AS_STRING(krk_peek(1)))) {
+	if (!valueGetProperty(AS_STRING(krk_peek(1)), NULL)) {
 		return krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%s'", krk_peek(0), name);
 	}
 	krk_swap(1);
@@ -1814,7 +2328,7 @@ KrkValue krk_valueGetAttribute(KrkValue value, char * name) {
 KrkValue krk_valueGetAttribute_default(KrkValue value, char * name, KrkValue defaultVal) {
 	krk_push(OBJECT_VAL(krk_copyString(name,strlen(name))));
 	krk_push(value);
-	if (!valueGetProperty(AS_STRING(krk_peek(1)))) {
+	if (!valueGetProperty(AS_STRING(krk_peek(1)), NULL)) {
 		krk_pop();
 		krk_pop();
 		return defaultVal;
@@ -1827,7 +2341,7 @@ KrkValue krk_valueGetAttribute_default(KrkValue value, char * name, KrkValue def
 static int valueDelProperty(KrkString * name) {
 	if (IS_INSTANCE(krk_peek(0))) {
 		KrkInstance* instance = AS_INSTANCE(krk_peek(0));
-		if (!krk_tableDelete(&instance->fields, OBJECT_VAL(name))) {
+		if (!krk_instanceDeleteField(instance, name)) {
 			return 0;
 		}
 		krk_pop(); /* the original value */
@@ -1892,9 +2406,15 @@ static KrkValue setAttr_wrapper(KrkValue owner, KrkClass * _class, KrkTable * fi
 	return to;
 }
 
+static KrkValue setInstanceAttr_wrapper(KrkValue owner, KrkClass * _class, KrkString * name, KrkValue to) {
+	if (_setDescriptor(owner,_class,name,to)) return krk_pop();
+	krk_instanceSetField(AS_INSTANCE(owner), name, to);
+	return to;
+}
+
 _noexport
 KrkValue krk_instanceSetAttribute_wrapper(KrkValue owner, KrkString * name, KrkValue to) {
-	return setAttr_wrapper(owner, AS_INSTANCE(owner)->_class, &AS_INSTANCE(owner)->fields, name, to);
+	return setInstanceAttr_wrapper(owner, AS_INSTANCE(owner)->_class, name, to);
 }
 
 static int valueSetProperty(KrkString * name) {
@@ -1908,7 +2428,7 @@ static int valueSetProperty(KrkString * name) {
 		return 1;
 	}
 	if (IS_INSTANCE(owner)) {
-		krk_currentThread.stackTop[-1] = setAttr_wrapper(owner,type,&AS_INSTANCE(owner)->fields, name, value);
+		krk_currentThread.stackTop[-1] = setInstanceAttr_wrapper(owner,type,name,value);
 	} else if (IS_CLASS(owner)) {
 		krk_currentThread.stackTop[-1] = setAttr_wrapper(owner,type,&AS_CLASS(owner)->methods, name, value);
 		if (name->length > 1 && name->chars[0] == '_' && name->chars[1] == '_') {
@@ -1956,6 +2476,7 @@ KrkValue krk_valueSetAttribute(KrkValue owner, char * name, KrkValue to) {
 
 extern KrkValue krk_int_op_add(krk_integer_type a, krk_integer_type b);
 extern KrkValue krk_int_op_sub(krk_integer_type a, krk_integer_type b);
+extern KrkValue krk_int_op_mul(krk_integer_type a, krk_integer_type b);
 
 /* These operations are most likely to occur on integers, so we special case them */
 #define LIKELY_INT_BINARY_OP(op) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
@@ -1974,6 +2495,90 @@ extern KrkValue krk_int_op_sub(krk_integer_type a, krk_integer_type b);
 	else a = krk_operator_ ## op (a); \
 	krk_currentThread.stackTop[-1] = a; break; }
 
+/* The fused local/constant arithmetic instructions share the integer fast path. */
+#define LIKELY_INT_LOCAL_CONST_OP(op) { \
+	KrkValue a = krk_currentThread.stack[frame->slots + frame->ip[0]]; \
+	KrkValue b = frame->closure->function->chunk.constants.values[frame->ip[1]]; \
+	frame->ip += 2; \
+	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) krk_push(krk_int_op_ ## op (AS_INTEGER(a), AS_INTEGER(b))); \
+	else krk_push(krk_operator_ ## op (a,b)); \
+	break; }
+
+/* Generic arithmetic and comparisons count toward being quickened. */
+#define QUICKEN_BINARY(generic) \
+	if (unlikely(quickenReady(frame->closure->function, frame->ip - 1))) \
+		quickenBinary(frame->ip - 1, generic, krk_peek(1), krk_peek(0));
+
+/* Quickened arithmetic and comparisons fall back when their operands change. */
+#define SPECIALIZED_BINARY_OP(opc,generic,guard,result) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
+	if (unlikely(!(guard))) DEOPTIMIZE(opc,generic); \
+	krk_currentThread.stackTop[-2] = result; krk_currentThread.stackTop--; break; }
+#define INT_OP(opc,generic,result) SPECIALIZED_BINARY_OP(opc,generic,IS_INTEGER(a) && IS_INTEGER(b),result)
+#define FLOAT_OP(opc,generic,operator) SPECIALIZED_BINARY_OP(opc,generic,isFloatPair(a,b),FLOATING_VAL(asDouble(a) operator asDouble(b)))
+#define INT_COMPARE_OP(opc,generic,operator) INT_OP(opc,generic,BOOLEAN_VAL(AS_INTEGER(a) operator AS_INTEGER(b)))
+#define FLOAT_COMPARE_OP(opc,generic,operator) SPECIALIZED_BINARY_OP(opc,generic,isFloatPair(a,b),BOOLEAN_VAL(asDouble(a) operator asDouble(b)))
+
+/**
+ * Comparison for the fused compare-and-jump instructions. The result is
+ * tested as POP_JUMP_IF_FALSE would test it, without putting it on the
+ * stack unless it needs a call to @c __bool__.
+ */
+static inline int fusedCompare(uint8_t kind, KrkValue a, KrkValue b) {
+	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) {
+		switch (kind) {
+			case OP_LESS:          return AS_INTEGER(a) <  AS_INTEGER(b);
+			case OP_GREATER:       return AS_INTEGER(a) >  AS_INTEGER(b);
+			case OP_LESS_EQUAL:    return AS_INTEGER(a) <= AS_INTEGER(b);
+			case OP_GREATER_EQUAL: return AS_INTEGER(a) >= AS_INTEGER(b);
+			default:               return AS_INTEGER(a) == AS_INTEGER(b);
+		}
+	}
+	KrkValue result;
+	switch (kind) {
+		case OP_LESS:          result = krk_operator_lt(a,b); break;
+		case OP_GREATER:       result = krk_operator_gt(a,b); break;
+		case OP_LESS_EQUAL:    result = krk_operator_le(a,b); break;
+		case OP_GREATER_EQUAL: result = krk_operator_ge(a,b); break;
+		default:               result = krk_operator_eq(a,b); break;
+	}
+	if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return 1;
+	if (IS_BOOLEAN(result)) return AS_BOOLEAN(result);
+	krk_push(result);
+	int truth = !krk_isFalsey(result);
+	krk_pop();
+	return truth;
+}
+
+/**
+ * Step range and list iterators in place for CALL_ITER and LOOP_ITER,
+ * pushing the next value, or the iterator itself when it is exhausted,
+ * exactly as calling it would. Returns 0 for any other iterator.
+ */
+static inline int nextFromNativeIterator(KrkValue iter) {
+	if (!IS_INSTANCE(iter)) return 0;
+	KrkClass * type = AS_INSTANCE(iter)->_class;
+	if (type == vm.baseClasses->rangeiteratorClass) {
+		struct RangeIterator * self = (struct RangeIterator*)AS_OBJECT(iter);
+		krk_integer_type i = self->i;
+		if (self->step > 0 ? (i >= self->max) : (i <= self->max)) {
+			krk_push(iter);
+		} else {
+			self->i = i + self->step;
+			krk_push(INTEGER_VAL(i));
+		}
+		return 1;
+	} else if (type == vm.baseClasses->listiteratorClass) {
+		struct ListIterator * self = (struct ListIterator*)AS_OBJECT(iter);
+		if (self->i >= AS_LIST(self->l)->count) {
+			krk_push(iter);
+		} else {
+			krk_push(AS_LIST(self->l)->values[self->i++]);
+		}
+		return 1;
+	}
+	return 0;
+}
+
 #define READ_BYTE() (*frame->ip++)
 #define READ_CONSTANT(s) (frame->closure->function->chunk.constants.values[OPERAND])
 #define READ_STRING(s) AS_STRING(READ_CONSTANT(s))
@@ -2105,41 +2710,143 @@ int krk_isSubClass(const KrkClass * cls, const KrkClass * base) {
 	return 0;
 }
 
+/*
+ * Threaded dispatch uses the labels-as-values extension to jump straight
+ * from the end of one instruction to the handler for the next one, which
+ * gives the branch predictor one indirect jump per opcode to work with
+ * instead of the single jump at the top of the switch.
+ */
+#if !defined(KRK_DISABLE_THREADED_DISPATCH) && !defined(KRK_OPCODE_STATS) && defined(__GNUC__)
+# define KRK_THREADED_DISPATCH 1
+#endif
+
+/*
+ * Instruction-frequency profiling, for finding sequences worth fusing into
+ * superinstructions. Every instruction passes through the top of the loop
+ * when this is enabled; the counters are read through dis.opcode_stats().
+ */
+#ifdef KRK_OPCODE_STATS
+size_t krk_opcodeCounts[256];
+size_t krk_opcodePairCounts[256][256];
+# define COUNT_OPCODE(opc) do { \
+	__atomic_fetch_add(&krk_opcodeCounts[opc], 1, __ATOMIC_RELAXED); \
+	if (lastOpcode >= 0) __atomic_fetch_add(&krk_opcodePairCounts[lastOpcode][opc], 1, __ATOMIC_RELAXED); \
+	lastOpcode = opc; } while (0)
+#else
+# define COUNT_OPCODE(opc) (void)0
+#endif
+
+#ifdef KRK_THREADED_DISPATCH
+# define TARGET(opc) case opc: lbl_ ## opc:
+# define NEXT_INSTRUCTION() { OPERAND = 0; goto *dispatchTable[READ_BYTE()]; }
+# define DISPATCH_GENERIC(opc) goto *dispatchTable[opc]
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wpedantic"
+#else
+# define TARGET(opc) case opc:
+# define NEXT_INSTRUCTION() continue
+# define DISPATCH_GENERIC(opc) { opcode = opc; goto _dispatch; }
+#endif
+
+/**
+ * Put a quickened instruction back to its generic form and run that
+ * instead. Specialized handlers check their guards before reading any
+ * operands, so the generic handler starts from the same place.
+ */
+#define DEOPTIMIZE(opc,generic) { rewriteOpcode(frame->ip - 1, opc, generic); DISPATCH_GENERIC(generic); }
+
+/**
+ * Finish an instruction that may take a while to come back to:
+ * backward jumps and calls. The thread flags are checked for
+ * tracing, single-stepping, and signals before the next instruction.
+ */
+#define BREAK_AND_CHECK_FLAGS() goto _finishAndCheck
+
+/**
+ * Thread flags that must be examined after every instruction.
+ * While tracing or stepping, every instruction needs to come back
+ * to the flag checks; otherwise only exceptions do.
+ */
+static inline unsigned int instructionCheckMask(void) {
+	if (unlikely(krk_currentThread.flags & (KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP))) {
+		return KRK_THREAD_HAS_EXCEPTION | KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP | KRK_THREAD_SIGNALLED;
+	}
+	return KRK_THREAD_HAS_EXCEPTION;
+}
+
 /**
  * VM main loop.
  */
 static KrkValue run(void) {
 	KrkCallFrame* frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+	KrkOpCode opcode;
+	unsigned int OPERAND;
+
+	/* Thread flags that must be examined after every instruction. */
+	unsigned int checkMask;
+
+#ifdef KRK_OPCODE_STATS
+	int lastOpcode = -1;
+#endif
+
+#ifdef KRK_THREADED_DISPATCH
+	static void * const dispatchTable[256] = {
+#define OPCODE(opc)         [opc] = &&lbl_ ## opc,
+#define SIMPLE(opc)         OPCODE(opc)
+#define CONSTANT(opc,more)  OPCODE(opc) OPCODE(opc ## _LONG)
+#define OPERAND(opc,more)   OPCODE(opc) OPCODE(opc ## _LONG)
+#define JUMP(opc,sign)      OPCODE(opc)
+#define FUSED(opc,kinds)    OPCODE(opc)
+#define QUICK(opc,generic)  OPCODE(opc)
+#include "opcodes.h"
+#undef SIMPLE
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+#undef FUSED
+#undef QUICK
+#undef OPCODE
+	};
+#endif
+
+_checkFlags:
+	if (unlikely(krk_currentThread.flags & (KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP | KRK_THREAD_SIGNALLED | KRK_THREAD_SAFEPOINT))) {
+		if (krk_currentThread.flags & KRK_THREAD_SAFEPOINT) {
+			krk_gcSafepoint();
+		}
 
-	while (1) {
-		if (unlikely(krk_currentThread.flags & (KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP | KRK_THREAD_SIGNALLED))) {
 #ifndef KRK_NO_TRACING
-			if (krk_currentThread.flags & KRK_THREAD_ENABLE_TRACING) {
-				krk_debug_dumpStack(stderr, frame);
-				krk_disassembleInstruction(stderr, frame->closure->function,
-					(size_t)(frame->ip - frame->closure->function->chunk.code));
-			}
+		if (krk_currentThread.flags & KRK_THREAD_ENABLE_TRACING) {
+			krk_debug_dumpStack(stderr, frame);
+			krk_disassembleInstruction(stderr, frame->closure->function,
+				(size_t)(frame->ip - frame->closure->function->chunk.code));
+		}
 #endif
 
 #ifndef KRK_DISABLE_DEBUG
-			if (krk_currentThread.flags & KRK_THREAD_SINGLE_STEP) {
-				krk_debuggerHook(frame);
-			}
+		if (krk_currentThread.flags & KRK_THREAD_SINGLE_STEP) {
+			krk_debuggerHook(frame);
+		}
 #endif
 
-			if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) {
-				krk_currentThread.flags &= ~(KRK_THREAD_SIGNALLED); /* Clear signal flag */
-				krk_runtimeError(vm.exceptions->keyboardInterrupt, "Keyboard interrupt.");
-				goto _finishException;
-			}
+		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) {
+			krk_currentThread.flags &= ~(KRK_THREAD_SIGNALLED); /* Clear signal flag */
+			krk_runtimeError(vm.exceptions->keyboardInterrupt, "Keyboard interrupt.");
+			goto _finishException;
 		}
+	}
+
+	checkMask = instructionCheckMask();
+
+	while (1) {
 #ifndef KRK_DISABLE_DEBUG
 _resumeHook: (void)0;
 #endif
 
 		/* Each instruction begins with one opcode byte */
-		KrkOpCode opcode = READ_BYTE();
-		unsigned int OPERAND = 0;
+		opcode = READ_BYTE();
+		OPERAND = 0;
+		COUNT_OPCODE(opcode);
 
 /* Only GCC lets us put these on empty statements; just hope clang doesn't start complaining */
 #ifndef __clang__
@@ -2152,8 +2859,11 @@ _resumeHook: (void)0;
 #define THREE_BYTE_OPERAND { OPERAND = (frame->ip[0] << 16) | (frame->ip[1] << 8); frame->ip += 2; } FALLTHROUGH
 #define ONE_BYTE_OPERAND { OPERAND = (OPERAND & ~0xFF) | READ_BYTE(); }
 
+#ifndef KRK_THREADED_DISPATCH
+_dispatch:
+#endif
 		switch (opcode) {
-			case OP_CLEANUP_WITH: {
+			TARGET(OP_CLEANUP_WITH) {
 				/* Top of stack is a HANDLER that should have had something loaded into it if it was still valid */
 				KrkValue handler = krk_peek(0);
 				KrkValue exceptionObject = krk_peek(1);
@@ -2189,8 +2899,8 @@ _resumeHook: (void)0;
 				}
 				if (AS_HANDLER_TYPE(handler) != OP_RETURN) break;
 				krk_pop(); /* handler */
-			} /* fallthrough */
-			case OP_RETURN: {
+			} FALLTHROUGH
+			TARGET(OP_RETURN) {
 _finishReturn: (void)0;
 				KrkValue result = krk_pop();
 				closeUpvalues(frame->slots);
@@ -2227,91 +2937,115 @@ _finishReturn: (void)0;
 				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
 				break;
 			}
-			case OP_LESS:          LIKELY_INT_COMPARE_OP(lt,<)
-			case OP_GREATER:       LIKELY_INT_COMPARE_OP(gt,>)
-			case OP_LESS_EQUAL:    LIKELY_INT_COMPARE_OP(le,<=)
-			case OP_GREATER_EQUAL: LIKELY_INT_COMPARE_OP(ge,>=)
-			case OP_ADD:           LIKELY_INT_BINARY_OP(add)
-			case OP_SUBTRACT:      LIKELY_INT_BINARY_OP(sub)
-			case OP_MULTIPLY:      BINARY_OP(mul)
-			case OP_DIVIDE:        BINARY_OP(truediv)
-			case OP_FLOORDIV:      BINARY_OP(floordiv)
-			case OP_MODULO:        BINARY_OP(mod)
-			case OP_BITOR:         BINARY_OP(or)
-			case OP_BITXOR:        BINARY_OP(xor)
-			case OP_BITAND:        BINARY_OP(and)
-			case OP_SHIFTLEFT:     BINARY_OP(lshift)
-			case OP_SHIFTRIGHT:    BINARY_OP(rshift)
-			case OP_POW:           BINARY_OP(pow)
-			case OP_MATMUL:        BINARY_OP(matmul)
-			case OP_EQUAL:         BINARY_OP(eq);
-			case OP_IS:            BINARY_OP(is);
-			case OP_BITNEGATE:     LIKELY_INT_UNARY_OP(invert,~)
-			case OP_NEGATE:        LIKELY_INT_UNARY_OP(neg,-)
-			case OP_POS:           LIKELY_INT_UNARY_OP(pos,+)
-			case OP_NONE:  krk_push(NONE_VAL()); break;
-			case OP_TRUE:  krk_push(BOOLEAN_VAL(1)); break;
-			case OP_FALSE: krk_push(BOOLEAN_VAL(0)); break;
-			case OP_UNSET: krk_push(KWARGS_VAL(0)); break;
-			case OP_NOT:   krk_currentThread.stackTop[-1] = BOOLEAN_VAL(krk_isFalsey(krk_peek(0))); break;
-			case OP_POP:   krk_pop(); break;
-
-			case OP_INPLACE_ADD:        INPLACE_BINARY_OP(add)
-			case OP_INPLACE_SUBTRACT:   INPLACE_BINARY_OP(sub)
-			case OP_INPLACE_MULTIPLY:   INPLACE_BINARY_OP(mul)
-			case OP_INPLACE_DIVIDE:     INPLACE_BINARY_OP(truediv)
-			case OP_INPLACE_FLOORDIV:   INPLACE_BINARY_OP(floordiv)
-			case OP_INPLACE_MODULO:     INPLACE_BINARY_OP(mod)
-			case OP_INPLACE_BITOR:      INPLACE_BINARY_OP(or)
-			case OP_INPLACE_BITXOR:     INPLACE_BINARY_OP(xor)
-			case OP_INPLACE_BITAND:     INPLACE_BINARY_OP(and)
-			case OP_INPLACE_SHIFTLEFT:  INPLACE_BINARY_OP(lshift)
-			case OP_INPLACE_SHIFTRIGHT: INPLACE_BINARY_OP(rshift)
-			case OP_INPLACE_POW:        INPLACE_BINARY_OP(pow)
-			case OP_INPLACE_MATMUL:     INPLACE_BINARY_OP(matmul)
-
-			case OP_RAISE: {
+			TARGET(OP_LESS)          QUICKEN_BINARY(OP_LESS)          LIKELY_INT_COMPARE_OP(lt,<)
+			TARGET(OP_GREATER)       QUICKEN_BINARY(OP_GREATER)       LIKELY_INT_COMPARE_OP(gt,>)
+			TARGET(OP_LESS_EQUAL)    QUICKEN_BINARY(OP_LESS_EQUAL)    LIKELY_INT_COMPARE_OP(le,<=)
+			TARGET(OP_GREATER_EQUAL) QUICKEN_BINARY(OP_GREATER_EQUAL) LIKELY_INT_COMPARE_OP(ge,>=)
+			TARGET(OP_ADD)           QUICKEN_BINARY(OP_ADD)           LIKELY_INT_BINARY_OP(add)
+			TARGET(OP_SUBTRACT)      QUICKEN_BINARY(OP_SUBTRACT)      LIKELY_INT_BINARY_OP(sub)
+			TARGET(OP_MULTIPLY)      QUICKEN_BINARY(OP_MULTIPLY)      BINARY_OP(mul)
+			TARGET(OP_DIVIDE)        QUICKEN_BINARY(OP_DIVIDE)        BINARY_OP(truediv)
+			TARGET(OP_FLOORDIV)      BINARY_OP(floordiv)
+			TARGET(OP_MODULO)        BINARY_OP(mod)
+			TARGET(OP_BITOR)         BINARY_OP(or)
+			TARGET(OP_BITXOR)        BINARY_OP(xor)
+			TARGET(OP_BITAND)        BINARY_OP(and)
+			TARGET(OP_SHIFTLEFT)     BINARY_OP(lshift)
+			TARGET(OP_SHIFTRIGHT)    BINARY_OP(rshift)
+			TARGET(OP_POW)           BINARY_OP(pow)
+			TARGET(OP_MATMUL)        BINARY_OP(matmul)
+			TARGET(OP_EQUAL)         QUICKEN_BINARY(OP_EQUAL)         BINARY_OP(eq);
+			TARGET(OP_IS)            BINARY_OP(is);
+			TARGET(OP_BITNEGATE)     LIKELY_INT_UNARY_OP(invert,~)
+			TARGET(OP_NEGATE)        LIKELY_INT_UNARY_OP(neg,-)
+			TARGET(OP_POS)           LIKELY_INT_UNARY_OP(pos,+)
+
+			TARGET(OP_ADD_INT)               INT_OP(OP_ADD_INT, OP_ADD, krk_int_op_add(AS_INTEGER(a), AS_INTEGER(b)))
+			TARGET(OP_SUB_INT)               INT_OP(OP_SUB_INT, OP_SUBTRACT, krk_int_op_sub(AS_INTEGER(a), AS_INTEGER(b)))
+			TARGET(OP_MUL_INT)               INT_OP(OP_MUL_INT, OP_MULTIPLY, krk_int_op_mul(AS_INTEGER(a), AS_INTEGER(b)))
+			TARGET(OP_ADD_FLOAT)             FLOAT_OP(OP_ADD_FLOAT, OP_ADD, +)
+			TARGET(OP_SUB_FLOAT)             FLOAT_OP(OP_SUB_FLOAT, OP_SUBTRACT, -)
+			TARGET(OP_MUL_FLOAT)             FLOAT_OP(OP_MUL_FLOAT, OP_MULTIPLY, *)
+			TARGET(OP_DIV_FLOAT)             SPECIALIZED_BINARY_OP(OP_DIV_FLOAT, OP_DIVIDE,
+				isNumeric(a) && isNumeric(b) && asDouble(b) != 0.0, FLOATING_VAL(asDouble(a) / asDouble(b)))
+			TARGET(OP_LESS_INT)              INT_COMPARE_OP(OP_LESS_INT, OP_LESS, <)
+			TARGET(OP_GREATER_INT)           INT_COMPARE_OP(OP_GREATER_INT, OP_GREATER, >)
+			TARGET(OP_LESS_EQUAL_INT)        INT_COMPARE_OP(OP_LESS_EQUAL_INT, OP_LESS_EQUAL, <=)
+			TARGET(OP_GREATER_EQUAL_INT)     INT_COMPARE_OP(OP_GREATER_EQUAL_INT, OP_GREATER_EQUAL, >=)
+			TARGET(OP_EQUAL_INT)             INT_COMPARE_OP(OP_EQUAL_INT, OP_EQUAL, ==)
+			TARGET(OP_LESS_FLOAT)            FLOAT_COMPARE_OP(OP_LESS_FLOAT, OP_LESS, <)
+			TARGET(OP_GREATER_FLOAT)         FLOAT_COMPARE_OP(OP_GREATER_FLOAT, OP_GREATER, >)
+			TARGET(OP_LESS_EQUAL_FLOAT)      FLOAT_COMPARE_OP(OP_LESS_EQUAL_FLOAT, OP_LESS_EQUAL, <=)
+			TARGET(OP_GREATER_EQUAL_FLOAT)   FLOAT_COMPARE_OP(OP_GREATER_EQUAL_FLOAT, OP_GREATER_EQUAL, >=)
+			TARGET(OP_ADD_STR) {
+				if (unlikely(!IS_STRING(krk_peek(0)) || !IS_STRING(krk_peek(1)))) DEOPTIMIZE(OP_ADD_STR, OP_ADD);
+				krk_addObjects();
+				break;
+			}
+
+			TARGET(OP_NONE)  krk_push(NONE_VAL()); break;
+			TARGET(OP_TRUE)  krk_push(BOOLEAN_VAL(1)); break;
+			TARGET(OP_FALSE) krk_push(BOOLEAN_VAL(0)); break;
+			TARGET(OP_UNSET) krk_push(KWARGS_VAL(0)); break;
+			TARGET(OP_NOT)   krk_currentThread.stackTop[-1] = BOOLEAN_VAL(krk_isFalsey(krk_peek(0))); break;
+			TARGET(OP_POP)   krk_pop(); break;
+
+			TARGET(OP_INPLACE_ADD)        INPLACE_BINARY_OP(add)
+			TARGET(OP_INPLACE_SUBTRACT)   INPLACE_BINARY_OP(sub)
+			TARGET(OP_INPLACE_MULTIPLY)   INPLACE_BINARY_OP(mul)
+			TARGET(OP_INPLACE_DIVIDE)     INPLACE_BINARY_OP(truediv)
+			TARGET(OP_INPLACE_FLOORDIV)   INPLACE_BINARY_OP(floordiv)
+			TARGET(OP_INPLACE_MODULO)     INPLACE_BINARY_OP(mod)
+			TARGET(OP_INPLACE_BITOR)      INPLACE_BINARY_OP(or)
+			TARGET(OP_INPLACE_BITXOR)     INPLACE_BINARY_OP(xor)
+			TARGET(OP_INPLACE_BITAND)     INPLACE_BINARY_OP(and)
+			TARGET(OP_INPLACE_SHIFTLEFT)  INPLACE_BINARY_OP(lshift)
+			TARGET(OP_INPLACE_SHIFTRIGHT) INPLACE_BINARY_OP(rshift)
+			TARGET(OP_INPLACE_POW)        INPLACE_BINARY_OP(pow)
+			TARGET(OP_INPLACE_MATMUL)     INPLACE_BINARY_OP(matmul)
+
+			TARGET(OP_RAISE) {
 				krk_raiseException(krk_peek(0), NONE_VAL());
 				goto _finishException;
 			}
-			case OP_RAISE_FROM: {
+			TARGET(OP_RAISE_FROM) {
 				krk_raiseException(krk_peek(1), krk_peek(0));
 				goto _finishException;
 			}
-			case OP_CLOSE_UPVALUE:
+			TARGET(OP_CLOSE_UPVALUE)
 				closeUpvalues((krk_currentThread.stackTop - krk_currentThread.stack)-1);
 				krk_pop();
 				break;
-			case OP_INVOKE_GETTER: {
+			TARGET(OP_INVOKE_GETTER) {
 				commonMethodInvoke(offsetof(KrkClass,_getter), 2, "'%T' object is not subscriptable");
 				break;
 			}
-			case OP_INVOKE_SETTER: {
+			TARGET(OP_INVOKE_SETTER) {
 				commonMethodInvoke(offsetof(KrkClass,_setter), 3, "'%T' object doesn't support item assignment");
 				break;
 			}
-			case OP_INVOKE_DELETE: {
+			TARGET(OP_INVOKE_DELETE) {
 				commonMethodInvoke(offsetof(KrkClass,_delitem), 2, "'%T' object doesn't support item deletion");
 				krk_pop(); /* unused result */
 				break;
 			}
-			case OP_INVOKE_ITER: {
+			TARGET(OP_INVOKE_ITER) {
 				commonMethodInvoke(offsetof(KrkClass,_iter), 1, "'%T' object is not iterable");
 				break;
 			}
-			case OP_INVOKE_CONTAINS: {
+			TARGET(OP_INVOKE_CONTAINS) {
 				krk_swap(1); /* operands are backwards */
 				commonMethodInvoke(offsetof(KrkClass,_contains), 2, "'%T' object can not be tested for membership");
 				break;
 			}
-			case OP_INVOKE_AWAIT: {
+			TARGET(OP_INVOKE_AWAIT) {
 				if (!krk_getAwaitable()) goto _finishException;
 				break;
 			}
-			case OP_SWAP:
+			TARGET(OP_SWAP)
 				krk_swap(1);
 				break;
-			case OP_FILTER_EXCEPT: {
+			TARGET(OP_FILTER_EXCEPT) {
 				int isMatch = 0;
 				if (AS_HANDLER_TYPE(krk_peek(1)) == OP_RETURN) {
 					isMatch = 0;
@@ -2338,13 +3072,13 @@ _finishReturn: (void)0;
 				krk_push(BOOLEAN_VAL(isMatch));
 				break;
 			}
-			case OP_TRY_ELSE: {
+			TARGET(OP_TRY_ELSE) {
 				if (IS_HANDLER(krk_peek(0))) {
 					krk_currentThread.stackTop[-1] = HANDLER_VAL(OP_FILTER_EXCEPT,AS_HANDLER_TARGET(krk_peek(0)));
 				}
 				break;
 			}
-			case OP_BEGIN_FINALLY: {
+			TARGET(OP_BEGIN_FINALLY) {
 				if (IS_HANDLER(krk_peek(0))) {
 					if (AS_HANDLER_TYPE(krk_peek(0)) == OP_PUSH_TRY) {
 						krk_currentThread.stackTop[-1] = HANDLER_VAL(OP_BEGIN_FINALLY,AS_HANDLER_TARGET(krk_peek(0)));
@@ -2354,7 +3088,7 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_END_FINALLY: {
+			TARGET(OP_END_FINALLY) {
 				KrkValue handler = krk_peek(0);
 				if (IS_HANDLER(handler)) {
 					if (AS_HANDLER_TYPE(handler) == OP_RAISE || AS_HANDLER_TYPE(handler) == OP_END_FINALLY) {
@@ -2373,25 +3107,27 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_BREAKPOINT: {
+			TARGET(OP_BREAKPOINT) {
 #ifndef KRK_DISABLE_DEBUG
 				/* First off, halt execution. */
 				krk_debugBreakpointHandler();
 				if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) goto _finishException;
+				/* The debugger may have started single-stepping or tracing. */
+				checkMask = instructionCheckMask();
 				goto _resumeHook;
 #else
 				krk_runtimeError(vm.exceptions->baseException, "Breakpoint.");
 				goto _finishException;
 #endif
 			}
-			case OP_YIELD: {
+			TARGET(OP_YIELD) {
 				KrkValue result = krk_peek(0);
 				krk_currentThread.frameCount--;
 				assert(krk_currentThread.frameCount == (size_t)krk_currentThread.exitOnFrame);
 				/* Do NOT restore the stack */
 				return result;
 			}
-			case OP_ANNOTATE: {
+			TARGET(OP_ANNOTATE) {
 				if (IS_CLOSURE(krk_peek(0))) {
 					krk_swap(1);
 					AS_CLOSURE(krk_peek(1))->annotations = krk_peek(0);
@@ -2406,46 +3142,46 @@ _finishReturn: (void)0;
 				break;
 			}
 
-			case OP_LIST_APPEND_TOP: {
+			TARGET(OP_LIST_APPEND_TOP) {
 				KrkValue list = krk_peek(1);
 				FUNC_NAME(list,append)(2,(KrkValue[]){list,krk_peek(0)},0);
 				krk_pop();
 				break;
 			}
-			case OP_DICT_SET_TOP: {
+			TARGET(OP_DICT_SET_TOP) {
 				KrkValue dict = krk_peek(2);
 				FUNC_NAME(dict,__setitem__)(3,(KrkValue[]){dict,krk_peek(1),krk_peek(0)},0);
 				krk_pop();
 				krk_pop();
 				break;
 			}
-			case OP_SET_ADD_TOP: {
+			TARGET(OP_SET_ADD_TOP) {
 				KrkValue set = krk_peek(1);
 				FUNC_NAME(set,add)(2,(KrkValue[]){set,krk_peek(0)},0);
 				krk_pop();
 				break;
 			}
 
-			case OP_LIST_EXTEND_TOP: {
+			TARGET(OP_LIST_EXTEND_TOP) {
 				KrkValue list = krk_peek(1);
 				FUNC_NAME(list,extend)(2,(KrkValue[]){list,krk_peek(0)},0);
 				krk_pop();
 				break;
 			}
-			case OP_DICT_UPDATE_TOP: {
+			TARGET(OP_DICT_UPDATE_TOP) {
 				KrkValue dict = krk_peek(1);
 				FUNC_NAME(dict,update)(2,(KrkValue[]){dict,krk_peek(0)},0);
 				krk_pop();
 				break;
 			}
-			case OP_SET_UPDATE_TOP: {
+			TARGET(OP_SET_UPDATE_TOP) {
 				KrkValue set = krk_peek(1);
 				FUNC_NAME(set,update)(2,(KrkValue[]){set,krk_peek(0)},0);
 				krk_pop();
 				break;
 			}
 
-			case OP_TUPLE_FROM_LIST: {
+			TARGET(OP_TUPLE_FROM_LIST) {
 				KrkValue list = krk_peek(0);
 				size_t count = AS_LIST(list)->count;
 				KrkValue tuple = OBJECT_VAL(krk_newTuple(count));
@@ -2461,35 +3197,35 @@ _finishReturn: (void)0;
 			/*
 			 * Two-byte operands
 			 */
-			case OP_JUMP_IF_FALSE_OR_POP: {
+			TARGET(OP_JUMP_IF_FALSE_OR_POP) {
 				TWO_BYTE_OPERAND;
 				if (krk_peek(0) == BOOLEAN_VAL(0) || krk_isFalsey(krk_peek(0))) frame->ip += OPERAND;
 				else krk_pop();
 				break;
 			}
-			case OP_POP_JUMP_IF_FALSE: {
+			TARGET(OP_POP_JUMP_IF_FALSE) {
 				TWO_BYTE_OPERAND;
 				if (krk_peek(0) == BOOLEAN_VAL(0) || krk_isFalsey(krk_peek(0))) frame->ip += OPERAND;
 				krk_pop();
 				break;
 			}
-			case OP_JUMP_IF_TRUE_OR_POP: {
+			TARGET(OP_JUMP_IF_TRUE_OR_POP) {
 				TWO_BYTE_OPERAND;
 				if (!krk_isFalsey(krk_peek(0))) frame->ip += OPERAND;
 				else krk_pop();
 				break;
 			}
-			case OP_JUMP: {
+			TARGET(OP_JUMP) {
 				TWO_BYTE_OPERAND;
 				frame->ip += OPERAND;
 				break;
 			}
-			case OP_LOOP: {
+			TARGET(OP_LOOP) {
 				TWO_BYTE_OPERAND;
 				frame->ip -= OPERAND;
-				break;
+				BREAK_AND_CHECK_FLAGS();
 			}
-			case OP_PUSH_TRY: {
+			TARGET(OP_PUSH_TRY) {
 				TWO_BYTE_OPERAND;
 				uint16_t tryTarget = OPERAND + (frame->ip - frame->closure->function->chunk.code);
 				krk_push(NONE_VAL());
@@ -2497,7 +3233,7 @@ _finishReturn: (void)0;
 				krk_push(handler);
 				break;
 			}
-			case OP_PUSH_WITH: {
+			TARGET(OP_PUSH_WITH) {
 				TWO_BYTE_OPERAND;
 				uint16_t cleanupTarget = OPERAND + (frame->ip - frame->closure->function->chunk.code);
 				KrkValue contextManager = krk_peek(0);
@@ -2515,7 +3251,7 @@ _finishReturn: (void)0;
 				krk_push(handler);
 				break;
 			}
-			case OP_YIELD_FROM: {
+			TARGET(OP_YIELD_FROM) {
 				TWO_BYTE_OPERAND;
 				uint8_t * exitIp = frame->ip + OPERAND;
 				/* Stack has [iterator] [sent value] */
@@ -2551,49 +3287,53 @@ _finishReturn: (void)0;
 				frame->ip = exitIp;
 				break;
 			}
-			case OP_CALL_ITER: {
+			TARGET(OP_CALL_ITER) {
 				TWO_BYTE_OPERAND;
 				KrkValue iter = krk_peek(0);
-				krk_push(iter);
-				krk_push(krk_callStack(0));
+				if (!nextFromNativeIterator(iter)) {
+					krk_push(iter);
+					krk_push(krk_callStack(0));
+				}
 				/* krk_valuesSame() */
 				if (iter == krk_peek(0)) frame->ip += OPERAND;
 				break;
 			}
-			case OP_LOOP_ITER: {
+			TARGET(OP_LOOP_ITER) {
 				TWO_BYTE_OPERAND;
 				KrkValue iter = krk_peek(0);
-				krk_push(iter);
-				krk_push(krk_callStack(0));
+				if (!nextFromNativeIterator(iter)) {
+					krk_push(iter);
+					krk_push(krk_callStack(0));
+				}
 				if (iter != krk_peek(0)) frame->ip -= OPERAND;
-				break;
+				BREAK_AND_CHECK_FLAGS();
 			}
-			case OP_TEST_ARG: {
+			TARGET(OP_TEST_ARG) {
 				TWO_BYTE_OPERAND;
 				if (krk_pop() != KWARGS_VAL(0)) frame->ip += OPERAND;
 				break;
 			}
 
-			case OP_CONSTANT_LONG:
+			TARGET(OP_CONSTANT_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CONSTANT: {
+			TARGET(OP_CONSTANT) {
 				ONE_BYTE_OPERAND;
 				KrkValue constant = frame->closure->function->chunk.constants.values[OPERAND];
 				krk_push(constant);
 				break;
 			}
-			case OP_DEFINE_GLOBAL_LONG:
+			TARGET(OP_DEFINE_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DEFINE_GLOBAL: {
+			TARGET(OP_DEFINE_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				krk_tableSet(frame->globals, OBJECT_VAL(name), krk_peek(0));
 				krk_pop();
 				break;
 			}
-			case OP_GET_GLOBAL_LONG:
+			TARGET(OP_GET_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_GLOBAL: {
+			TARGET(OP_GET_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				KrkValue value;
@@ -2606,9 +3346,9 @@ _finishReturn: (void)0;
 				krk_push(value);
 				break;
 			}
-			case OP_SET_GLOBAL_LONG:
+			TARGET(OP_SET_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_GLOBAL: {
+			TARGET(OP_SET_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (!krk_tableSetIfExists(frame->globals, OBJECT_VAL(name), krk_peek(0))) {
@@ -2617,9 +3357,9 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_DEL_GLOBAL_LONG:
+			TARGET(OP_DEL_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DEL_GLOBAL: {
+			TARGET(OP_DEL_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (!krk_tableDelete(frame->globals, OBJECT_VAL(name))) {
@@ -2628,9 +3368,9 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_IMPORT_LONG:
+			TARGET(OP_IMPORT_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_IMPORT: {
+			TARGET(OP_IMPORT) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (!krk_doRecursiveModuleLoad(name)) {
@@ -2638,57 +3378,147 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_GET_LOCAL_LONG:
+			TARGET(OP_GET_LOCAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_LOCAL: {
+			TARGET(OP_GET_LOCAL) {
 				ONE_BYTE_OPERAND;
 				krk_push(krk_currentThread.stack[frame->slots + OPERAND]);
 				break;
 			}
-			case OP_SET_LOCAL_LONG:
+			TARGET(OP_SET_LOCAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_LOCAL: {
+			TARGET(OP_SET_LOCAL) {
 				ONE_BYTE_OPERAND;
 				krk_currentThread.stack[frame->slots + OPERAND] = krk_peek(0);
 				break;
 			}
-			case OP_SET_LOCAL_POP_LONG:
+			TARGET(OP_SET_LOCAL_POP_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_LOCAL_POP: {
+			TARGET(OP_SET_LOCAL_POP) {
 				ONE_BYTE_OPERAND;
 				krk_currentThread.stack[frame->slots + OPERAND] = krk_pop();
 				break;
 			}
-			case OP_CALL_LONG:
+
+			/*
+			 * Superinstructions, substituted by the compiler for common
+			 * sequences. Operands are single bytes read straight from ip;
+			 * see opcode_enum.h for the encoding.
+			 */
+			TARGET(OP_GET_LOCAL_LOCAL) {
+				krk_push(krk_currentThread.stack[frame->slots + frame->ip[0]]);
+				krk_push(krk_currentThread.stack[frame->slots + frame->ip[1]]);
+				frame->ip += 2;
+				break;
+			}
+			TARGET(OP_ADD_LOCAL_CONST) LIKELY_INT_LOCAL_CONST_OP(add)
+			TARGET(OP_SUB_LOCAL_CONST) LIKELY_INT_LOCAL_CONST_OP(sub)
+			TARGET(OP_INPLACE_ADD_LOCAL_CONST) {
+				size_t slot = frame->slots + frame->ip[0];
+				KrkValue a = krk_currentThread.stack[slot];
+				KrkValue b = frame->closure->function->chunk.constants.values[frame->ip[1]];
+				frame->ip += 2;
+				if (likely(IS_INTEGER(a) && IS_INTEGER(b))) {
+					a = krk_int_op_add(AS_INTEGER(a), AS_INTEGER(b));
+				} else {
+					a = krk_operator_iadd(a,b);
+					if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) goto _finishException;
+				}
+				krk_currentThread.stack[slot] = a;
+				break;
+			}
+			TARGET(OP_COMPARE_LOCAL_CONST_JUMP) {
+				KrkValue a = krk_currentThread.stack[frame->slots + frame->ip[0]];
+				KrkValue b = frame->closure->function->chunk.constants.values[frame->ip[1]];
+				uint8_t kind = frame->ip[2];
+				OPERAND = (frame->ip[3] << 8) | frame->ip[4];
+				frame->ip += 5;
+				if (!fusedCompare(kind, a, b)) frame->ip += OPERAND;
+				break;
+			}
+			TARGET(OP_COMPARE_LOCAL_LOCAL_JUMP) {
+				KrkValue a = krk_currentThread.stack[frame->slots + frame->ip[0]];
+				KrkValue b = krk_currentThread.stack[frame->slots + frame->ip[1]];
+				uint8_t kind = frame->ip[2];
+				OPERAND = (frame->ip[3] << 8) | frame->ip[4];
+				frame->ip += 5;
+				if (!fusedCompare(kind, a, b)) frame->ip += OPERAND;
+				break;
+			}
+			TARGET(OP_CALL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CALL: {
+			TARGET(OP_CALL) {
 				ONE_BYTE_OPERAND;
+				if (unlikely(OPERAND < 256 && frame->ip[-2] == OP_CALL && quickenReady(frame->closure->function, frame->ip - 2)))
+					quickenCall(frame->ip - 2, OP_CALL, krk_peek(OPERAND), OPERAND);
 				if (unlikely(!krk_callValue(krk_peek(OPERAND), OPERAND, 1))) goto _finishException;
 				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
-				break;
+				BREAK_AND_CHECK_FLAGS();
 			}
-			case OP_CALL_METHOD_LONG:
+			TARGET(OP_CALL_METHOD_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CALL_METHOD: {
+			TARGET(OP_CALL_METHOD) {
 				ONE_BYTE_OPERAND;
+				if (unlikely(OPERAND < 256 && frame->ip[-2] == OP_CALL_METHOD && quickenReady(frame->closure->function, frame->ip - 2)))
+					quickenCall(frame->ip - 2, OP_CALL_METHOD, krk_peek(OPERAND+1), OPERAND+1);
 				if (IS_NONE(krk_peek(OPERAND+1))) {
 					if (unlikely(!krk_callValue(krk_peek(OPERAND), OPERAND, 2))) goto _finishException;
 				} else {
 					if (unlikely(!krk_callValue(krk_peek(OPERAND+1), OPERAND+1, 1))) goto _finishException;
 				}
 				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
-				break;
+				BREAK_AND_CHECK_FLAGS();
+			}
+
+			/* Quickened calls; a full call stack is left for the generic form to report. */
+			TARGET(OP_CALL_MANAGED_EXACT) {
+				unsigned int argCount = frame->ip[0];
+				KrkValue callee = krk_peek(argCount);
+				if (unlikely(!isExactManagedCall(callee, argCount))) DEOPTIMIZE(OP_CALL_MANAGED_EXACT, OP_CALL);
+				if (unlikely(krk_currentThread.frameCount == vm.maximumCallDepth)) DISPATCH_GENERIC(OP_CALL);
+				frame->ip++;
+				enterFrame(AS_CLOSURE(callee), argCount, 1);
+				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+				BREAK_AND_CHECK_FLAGS();
+			}
+			TARGET(OP_CALL_METHOD_MANAGED_EXACT) {
+				unsigned int argCount = frame->ip[0] + 1;
+				KrkValue callee = krk_peek(argCount);
+				if (unlikely(!isExactManagedCall(callee, argCount))) DEOPTIMIZE(OP_CALL_METHOD_MANAGED_EXACT, OP_CALL_METHOD);
+				if (unlikely(krk_currentThread.frameCount == vm.maximumCallDepth)) DISPATCH_GENERIC(OP_CALL_METHOD);
+				frame->ip++;
+				enterFrame(AS_CLOSURE(callee), argCount, 1);
+				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+				BREAK_AND_CHECK_FLAGS();
+			}
+			TARGET(OP_CALL_NATIVE) {
+				unsigned int argCount = frame->ip[0];
+				KrkValue callee = krk_peek(argCount);
+				if (unlikely(!IS_NATIVE(callee))) DEOPTIMIZE(OP_CALL_NATIVE, OP_CALL);
+				frame->ip++;
+				if (unlikely(!_callNative(AS_NATIVE(callee), argCount, 1))) goto _finishException;
+				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+				BREAK_AND_CHECK_FLAGS();
+			}
+			TARGET(OP_CALL_METHOD_NATIVE) {
+				unsigned int argCount = frame->ip[0] + 1;
+				KrkValue callee = krk_peek(argCount);
+				if (unlikely(!IS_NATIVE(callee))) DEOPTIMIZE(OP_CALL_METHOD_NATIVE, OP_CALL_METHOD);
+				frame->ip++;
+				if (unlikely(!_callNative(AS_NATIVE(callee), argCount, 1))) goto _finishException;
+				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+				BREAK_AND_CHECK_FLAGS();
 			}
-			case OP_EXPAND_ARGS_LONG:
+			TARGET(OP_EXPAND_ARGS_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_EXPAND_ARGS: {
+			TARGET(OP_EXPAND_ARGS) {
 				ONE_BYTE_OPERAND;
 				krk_push(KWARGS_VAL(KWARGS_SINGLE-OPERAND));
 				break;
 			}
-			case OP_CLOSURE_LONG:
+			TARGET(OP_CLOSURE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CLOSURE: {
+			TARGET(OP_CLOSURE) {
 				ONE_BYTE_OPERAND;
 				KrkCodeObject * function = AS_codeobject(READ_CONSTANT(OPERAND));
 				KrkClosure * closure = krk_newClosure(function, frame->globalsOwner);
@@ -2712,26 +3542,27 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_GET_UPVALUE_LONG:
+			TARGET(OP_GET_UPVALUE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_UPVALUE: {
+			TARGET(OP_GET_UPVALUE) {
 				ONE_BYTE_OPERAND;
 				krk_push(*UPVALUE_LOCATION(frame->closure->upvalues[OPERAND]));
 				break;
 			}
-			case OP_SET_UPVALUE_LONG:
+			TARGET(OP_SET_UPVALUE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_UPVALUE: {
+			TARGET(OP_SET_UPVALUE) {
 				ONE_BYTE_OPERAND;
 				*UPVALUE_LOCATION(frame->closure->upvalues[OPERAND]) = krk_peek(0);
+				krk_writeBarrier((KrkObj*)frame->closure->upvalues[OPERAND]);
 				break;
 			}
-			case OP_IMPORT_FROM_LONG:
+			TARGET(OP_IMPORT_FROM_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_IMPORT_FROM: {
+			TARGET(OP_IMPORT_FROM) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
-				if (unlikely(!valueGetProperty(name))) {
+				if (unlikely(!valueGetProperty(name, NULL))) {
 					/* Try to import... */
 					KrkValue moduleName;
 					if (!krk_tableGet(&AS_INSTANCE(krk_peek(0))->fields, vm.specialMethodNames[METHOD_NAME], &moduleName)) {
@@ -2752,20 +3583,35 @@ _finishReturn: (void)0;
 					krk_currentThread.stackTop -= 2;
 				}
 			} break;
-			case OP_GET_PROPERTY_LONG:
+			TARGET(OP_GET_PROPERTY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_PROPERTY: {
+			TARGET(OP_GET_PROPERTY) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
-				if (unlikely(!valueGetProperty(name))) {
+				KrkInlineCache * ic = getInlineCache(frame->closure->function, OPERAND);
+				if (unlikely(OPERAND < 256 && frame->ip[-2] == OP_GET_PROPERTY && quickenReady(frame->closure->function, frame->ip - 2)))
+					quickenProperty(frame->ip - 2, ic, name, krk_peek(0));
+				if (unlikely(!valueGetProperty(name, ic))) {
 					krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%S'", krk_peek(0), name);
 					goto _finishException;
 				}
 				break;
 			}
-			case OP_DEL_PROPERTY_LONG:
+			TARGET(OP_GET_PROPERTY_INSTANCE_SLOT) {
+				KrkValue receiver = krk_peek(0);
+				KrkInlineCache * ic = &frame->closure->function->inlineCaches[frame->ip[0]];
+				size_t key = ic->quickShape;
+				if (unlikely(!IS_INSTANCE(receiver) || !AS_INSTANCE(receiver)->shape ||
+					AS_INSTANCE(receiver)->shape->id != key / KRK_SHAPE_MAX_SLOTS ||
+					!AS_INSTANCE(receiver)->_class->cacheIndex ||
+					AS_INSTANCE(receiver)->_class->cacheIndex != ic->quickClass)) DEOPTIMIZE(OP_GET_PROPERTY_INSTANCE_SLOT, OP_GET_PROPERTY);
+				frame->ip++;
+				krk_currentThread.stackTop[-1] = AS_INSTANCE(receiver)->slots[key % KRK_SHAPE_MAX_SLOTS];
+				break;
+			}
+			TARGET(OP_DEL_PROPERTY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DEL_PROPERTY: {
+			TARGET(OP_DEL_PROPERTY) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (unlikely(!valueDelProperty(name))) {
@@ -2774,9 +3620,9 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_SET_PROPERTY_LONG:
+			TARGET(OP_SET_PROPERTY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_PROPERTY: {
+			TARGET(OP_SET_PROPERTY) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (unlikely(!valueSetProperty(name))) {
@@ -2785,9 +3631,9 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_SET_NAME_LONG:
+			TARGET(OP_SET_NAME_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_NAME: {
+			TARGET(OP_SET_NAME) {
 				ONE_BYTE_OPERAND;
 				krk_push(krk_currentThread.stack[frame->slots]);
 				krk_swap(1);
@@ -2796,18 +3642,18 @@ _finishReturn: (void)0;
 				commonMethodInvoke(offsetof(KrkClass,_setter), 3, "'%T' object doesn't support item assignment");
 				break;
 			}
-			case OP_GET_NAME_LONG:
+			TARGET(OP_GET_NAME_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_NAME: {
+			TARGET(OP_GET_NAME) {
 				ONE_BYTE_OPERAND;
 				krk_push(krk_currentThread.stack[frame->slots]);
 				krk_push(OBJECT_VAL(READ_STRING(OPERAND)));
 				commonMethodInvoke(offsetof(KrkClass,_getter), 2, "'%T' object doesn't support item assignment");
 				break;
 			}
-			case OP_GET_SUPER_LONG:
+			TARGET(OP_GET_SUPER_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_SUPER: {
+			TARGET(OP_GET_SUPER) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				KrkValue baseClass = krk_peek(1);
@@ -2851,12 +3697,12 @@ _finishReturn: (void)0;
 				krk_pop();
 				break;
 			}
-			case OP_GET_METHOD_LONG:
+			TARGET(OP_GET_METHOD_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_METHOD: {
+			TARGET(OP_GET_METHOD) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
-				int result = valueGetMethod(name);
+				int result = valueGetMethod(name, getInlineCache(frame->closure->function, OPERAND));
 				if (result == 2) {
 					krk_push(NONE_VAL());
 					krk_swap(2);
@@ -2869,22 +3715,22 @@ _finishReturn: (void)0;
 				}
 				break;
 			}
-			case OP_DUP_LONG:
+			TARGET(OP_DUP_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DUP:
+			TARGET(OP_DUP)
 				ONE_BYTE_OPERAND;
 				krk_push(krk_peek(OPERAND));
 				break;
-			case OP_KWARGS_LONG:
+			TARGET(OP_KWARGS_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_KWARGS: {
+			TARGET(OP_KWARGS) {
 				ONE_BYTE_OPERAND;
 				krk_push(KWARGS_VAL(OPERAND));
 				break;
 			}
-			case OP_CLOSE_MANY_LONG:
+			TARGET(OP_CLOSE_MANY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CLOSE_MANY: {
+			TARGET(OP_CLOSE_MANY) {
 				ONE_BYTE_OPERAND;
 				closeUpvalues((krk_currentThread.stackTop - krk_currentThread.stack) - OPERAND);
 				for (unsigned int i = 0; i < OPERAND; ++i) {
@@ -2893,9 +3739,9 @@ _finishReturn: (void)0;
 				break;
 			}
 
-			case OP_EXIT_LOOP_LONG:
+			TARGET(OP_EXIT_LOOP_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_EXIT_LOOP: {
+			TARGET(OP_EXIT_LOOP) {
 				ONE_BYTE_OPERAND;
 _finishPopBlock:
 				closeUpvalues(frame->slots + OPERAND);
@@ -2920,62 +3766,62 @@ _finishPopBlock:
 				break;
 			}
 
-			case OP_POP_MANY_LONG:
+			TARGET(OP_POP_MANY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_POP_MANY: {
+			TARGET(OP_POP_MANY) {
 				ONE_BYTE_OPERAND;
 				for (unsigned int i = 0; i < OPERAND; ++i) {
 					krk_pop();
 				}
 				break;
 			}
-			case OP_TUPLE_LONG:
+			TARGET(OP_TUPLE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_TUPLE: {
+			TARGET(OP_TUPLE) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_tuple_of, OPERAND);
 				break;
 			}
-			case OP_MAKE_LIST_LONG:
+			TARGET(OP_MAKE_LIST_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_LIST: {
+			TARGET(OP_MAKE_LIST) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_list_of, OPERAND);
 				break;
 			}
-			case OP_MAKE_DICT_LONG:
+			TARGET(OP_MAKE_DICT_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_DICT: {
+			TARGET(OP_MAKE_DICT) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_dict_of, OPERAND);
 				break;
 			}
-			case OP_MAKE_SET_LONG:
+			TARGET(OP_MAKE_SET_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_SET: {
+			TARGET(OP_MAKE_SET) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_set_of, OPERAND);
 				break;
 			}
-			case OP_SLICE_LONG:
+			TARGET(OP_SLICE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SLICE: {
+			TARGET(OP_SLICE) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_slice_of, OPERAND);
 				break;
 			}
-			case OP_LIST_APPEND_LONG:
+			TARGET(OP_LIST_APPEND_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_LIST_APPEND: {
+			TARGET(OP_LIST_APPEND) {
 				ONE_BYTE_OPERAND;
 				KrkValue list = krk_currentThread.stack[frame->slots + OPERAND];
 				FUNC_NAME(list,append)(2,(KrkValue[]){list,krk_peek(0)},0);
 				krk_pop();
 				break;
 			}
-			case OP_DICT_SET_LONG:
+			TARGET(OP_DICT_SET_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DICT_SET: {
+			TARGET(OP_DICT_SET) {
 				ONE_BYTE_OPERAND;
 				KrkValue dict = krk_currentThread.stack[frame->slots + OPERAND];
 				FUNC_NAME(dict,__setitem__)(3,(KrkValue[]){dict,krk_peek(1),krk_peek(0)},0);
@@ -2983,18 +3829,18 @@ _finishPopBlock:
 				krk_pop();
 				break;
 			}
-			case OP_SET_ADD_LONG:
+			TARGET(OP_SET_ADD_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_ADD: {
+			TARGET(OP_SET_ADD) {
 				ONE_BYTE_OPERAND;
 				KrkValue set = krk_currentThread.stack[frame->slots + OPERAND];
 				FUNC_NAME(set,add)(2,(KrkValue[]){set,krk_peek(0)},0);
 				krk_pop();
 				break;
 			}
-			case OP_REVERSE_LONG:
+			TARGET(OP_REVERSE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_REVERSE: {
+			TARGET(OP_REVERSE) {
 				ONE_BYTE_OPERAND;
 				krk_push(NONE_VAL()); /* Storage space */
 				for (ssize_t i = 0; i < (ssize_t)OPERAND / 2; ++i) {
@@ -3005,9 +3851,9 @@ _finishPopBlock:
 				krk_pop();
 				break;
 			}
-			case OP_UNPACK_LONG:
+			TARGET(OP_UNPACK_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_UNPACK: {
+			TARGET(OP_UNPACK) {
 				ONE_BYTE_OPERAND;
 				KrkValue sequence = krk_peek(0);
 				KrkTuple * values = krk_newTuple(OPERAND);
@@ -3034,17 +3880,17 @@ _finishPopBlock:
 				break;
 			}
 
-			case OP_FORMAT_VALUE_LONG:
+			TARGET(OP_FORMAT_VALUE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_FORMAT_VALUE: {
+			TARGET(OP_FORMAT_VALUE) {
 				ONE_BYTE_OPERAND;
 				if (doFormatString(OPERAND)) goto _finishException;
 				break;
 			}
 
-			case OP_MAKE_STRING_LONG:
+			TARGET(OP_MAKE_STRING_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_STRING: {
+			TARGET(OP_MAKE_STRING) {
 				ONE_BYTE_OPERAND;
 
 				struct StringBuilder sb = {0};
@@ -3067,9 +3913,9 @@ _finishPopBlock:
 				break;
 			}
 
-			case OP_MISSING_KW_LONG:
+			TARGET(OP_MISSING_KW_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MISSING_KW: {
+			TARGET(OP_MISSING_KW) {
 				ONE_BYTE_OPERAND;
 				krk_runtimeError(vm.exceptions->typeError, "%s() missing required keyword-only argument: %R",
 					frame->closure->function->name ? frame->closure->function->name->chars : "<unnamed>",
@@ -3077,9 +3923,9 @@ _finishPopBlock:
 				break;
 			}
 
-			case OP_UNPACK_EX_LONG:
+			TARGET(OP_UNPACK_EX_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_UNPACK_EX: {
+			TARGET(OP_UNPACK_EX) {
 				ONE_BYTE_OPERAND;
 				unsigned char before = OPERAND >> 8;
 				unsigned char after = OPERAND;
@@ -3136,7 +3982,9 @@ _finishPopBlock:
 			default:
 				__builtin_unreachable();
 		}
-		if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) {
+		if (likely(!(krk_currentThread.flags & checkMask))) NEXT_INSTRUCTION();
+_finishAndCheck:
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
 _finishException:
 			if (!handleException()) {
 				if (!IS_NONE(krk_currentThread.stackTop[-2])) {
@@ -3156,11 +4004,19 @@ _finishException:
 				return NONE_VAL();
 			}
 		}
+		goto _checkFlags;
 	}
 #undef BINARY_OP
 #undef READ_BYTE
 }
 
+#ifdef KRK_THREADED_DISPATCH
+# pragma GCC diagnostic pop
+#endif
+#undef TARGET
+#undef NEXT_INSTRUCTION
+#undef BREAK_AND_CHECK_FLAGS
+
 /**
  * Run the VM until it returns from the current call frame;
  * used by native methods to call into managed methods.
@@ -3188,19 +4044,7 @@ KrkInstance * krk_startModule(const char * name) {
 }
 
 KrkValue krk_interpret(const char * src, char * fromFile) {
-	KrkCodeObject * function = krk_compile(src, fromFile);
-	if (!function) {
-		if (!krk_currentThread.frameCount) handleException();
-		return NONE_VAL();
-	}
-
-	krk_push(OBJECT_VAL(function));
-	krk_attachNamedObject(&krk_currentThread.module->fields, "__file__", (KrkObj*)function->chunk.filename);
-	KrkClosure * closure = krk_newClosure(function, OBJECT_VAL(krk_currentThread.module));
-	krk_pop();
-
-	krk_push(OBJECT_VAL(closure));
-	return krk_callStack(0);
+	return runModuleCode(krk_compile(src, fromFile));
 }
 
 #ifndef KRK_NO_FILESYSTEM